@@ -0,0 +1,232 @@
+/*-----------------------------------------------------------------------------
+ * file:  cksum_bench.c
+ *
+ * Description:
+ *
+ * Checks every checksum kernel in sr_cksum.c against the two word at a
+ * time routines the router used to have in includes.c, then times them
+ * all over packet sizes from a bare IP header up to a 9K jumbo frame.
+ * The last column is sr_cksum() itself, with the kernel it selected and
+ * its short buffer cut-over.
+ *
+ *   make cksum_bench && ./cksum_bench
+ *
+ * Exits non-zero if any kernel disagrees with the old routines.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "sr_cksum.h"
+
+#define MAX_LEN     9216
+#define MAX_ALIGN   32
+#define BENCH_BYTES (64 * 1024 * 1024)  /* per size and routine */
+
+static const uint32_t bench_sizes[] =
+{ 20, 28, 64, 128, 256, 576, 1024, 1500, 2048, 4096, 8192, 9000, MAX_LEN };
+
+/*---------------------------------------------------------------------
+ * The original routines from includes.c, unchanged.
+ *---------------------------------------------------------------------*/
+
+static uint16_t
+calculateChecksum(void *header, uint32_t len) {
+  uint32_t answer = 0;
+  uint16_t *stream = (uint16_t*) header;
+  uint32_t i, stop = len / 2;
+  for (i = 0; i < stop; ++i) {
+    answer += *stream;
+    if (answer & 0xFFFF0000) {
+      answer &= 0xFFFF;
+      ++answer;
+    }
+    ++stream;
+  }
+
+  /* odd number of bytes. goody */
+  if (len % 2) {
+    uint8_t byte;
+    memcpy(&byte, stream, 1);
+    answer += byte;
+   
+    if (answer & 0xFFFF0000) {
+      answer &= 0xFFFF;
+      ++answer;
+    }
+  }
+  
+  return ~(answer & 0xFFFF); /* and flip the bits */
+}
+
+static uint16_t
+checksum2(void *buf, uint32_t len) {
+
+  len /= 2;
+  uint16_t *data = (uint16_t*) buf;
+  uint32_t answer = 0;
+
+  while (len--) {
+    answer += *data;
+    ++data;
+  }
+  
+  while (answer >> 16)
+	answer = (answer & 0xffff) + (answer >> 16);
+
+  return ~answer;
+}
+
+/*---------------------------------------------------------------------*/
+
+static uint8_t buf[MAX_LEN + MAX_ALIGN];
+
+static double now_ns(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, 0);
+    return tv.tv_sec * 1e9 + tv.tv_usec * 1e3;
+} /* -- now_ns -- */
+
+static void fill(int pattern)
+{
+    uint32_t i;
+
+    for(i = 0; i < sizeof(buf); ++i)
+    {
+        switch(pattern)
+        {
+            case 0:  buf[i] = 0x00; break;
+            case 1:  buf[i] = 0xff; break;
+            default: buf[i] = (uint8_t)rand(); break;
+        }
+    }
+} /* -- fill -- */
+
+/*---------------------------------------------------------------------
+ * Method: verify(..)
+ *
+ * Every length up to MAX_LEN at every alignment up to MAX_ALIGN, for
+ * zeros, ones and random bytes.
+ *
+ *---------------------------------------------------------------------*/
+
+static int verify(const struct sr_cksum_kernel* k)
+{
+    uint32_t len, off;
+    int pattern, bad = 0;
+
+    sr_cksum_kernel = k;
+
+    for(pattern = 0; pattern < 4; ++pattern)
+    {
+        fill(pattern);
+        for(off = 0; off < MAX_ALIGN; off += (pattern < 2) ? 8 : 1)
+        {
+            for(len = 0; len <= MAX_LEN; ++len)
+            {
+                uint16_t want1 = calculateChecksum(buf + off, len);
+                uint16_t want2 = checksum2(buf + off, len);
+                uint16_t got1  = sr_cksum(buf + off, len);
+                uint16_t got2  = sr_cksum(buf + off, len & ~1U);
+
+                if(want1 != got1 || want2 != got2)
+                {
+                    if(bad++ < 10)
+                    {
+                        fprintf(stderr, "%s: len %u off %u: "
+                                "calculateChecksum %04x/%04x "
+                                "checksum2 %04x/%04x\n",
+                                k->name, len, off, want1, got1, want2, got2);
+                    }
+                }
+            }
+        }
+    }
+
+    return bad;
+} /* -- verify -- */
+
+static double time_fn(uint16_t (*fn)(void*, uint32_t), uint32_t len,
+                      volatile uint16_t* sink)
+{
+    uint32_t iters = BENCH_BYTES / len, i;
+    double t0, t1;
+
+    for(i = 0; i < iters / 16; ++i)
+    { *sink ^= fn(buf, len); }
+
+    t0 = now_ns();
+    for(i = 0; i < iters; ++i)
+    { *sink ^= fn(buf, len); }
+    t1 = now_ns();
+
+    return (t1 - t0) / iters;
+} /* -- time_fn -- */
+
+static uint16_t run_sr_cksum(void* p, uint32_t len)
+{ return sr_cksum(p, len); }
+
+static uint16_t run_kernel(void* p, uint32_t len)
+{ return sr_cksum_fold(sr_cksum_kernel->sum(p, len)); }
+
+int main(int argc, char** argv)
+{
+    const struct sr_cksum_kernel* k = 0;
+    const struct sr_cksum_kernel* best = 0;
+    volatile uint16_t sink = 0;
+    uint32_t s;
+    int bad = 0;
+
+    sr_cksum_init();
+    best = sr_cksum_kernel;
+
+    for(k = sr_cksum_kernels; k->name; ++k)
+    {
+        int n;
+
+        if(k->supported && !k->supported())
+        {
+            printf("%-8s not supported on this CPU, skipped\n", k->name);
+            continue;
+        }
+        n = verify(k);
+        printf("%-8s %s\n", k->name, n ? "MISMATCH" : "bit-exact");
+        bad += n;
+    }
+
+    printf("\nselected kernel: %s\n\n", best->name);
+    printf("%6s %18s %18s", "bytes", "calculateChecksum", "checksum2");
+    for(k = sr_cksum_kernels; k->name; ++k)
+    {
+        if(k->supported == 0 || k->supported())
+        { printf(" %8s", k->name); }
+    }
+    printf(" %8s   (ns/call)\n", "sr_cksum");
+
+    fill(2);
+    for(s = 0; s < sizeof(bench_sizes) / sizeof(bench_sizes[0]); ++s)
+    {
+        uint32_t len = bench_sizes[s];
+
+        printf("%6u %18.1f %18.1f", len,
+               time_fn(calculateChecksum, len, &sink),
+               time_fn(checksum2, len, &sink));
+
+        for(k = sr_cksum_kernels; k->name; ++k)
+        {
+            if(k->supported && !k->supported())
+            { continue; }
+            sr_cksum_kernel = k;
+            printf(" %8.1f", time_fn(run_kernel, len, &sink));
+        }
+
+        sr_cksum_kernel = best;
+        printf(" %8.1f\n", time_fn(run_sr_cksum, len, &sink));
+    }
+
+    return bad ? 1 : 0;
+} /* -- main -- */
@@ -1,59 +1,32 @@
 #include "includes.h"
+#include "sr_counters.h"
+#include "sr_evlog.h"
+#include "sr_hist.h"
+#include "sr_icmp.h"
 
-/*   our ARP queue  */
-Arpqueue *arpqueue = NULL;
+/* the ARP cache, see sr_router.c */
+extern struct sr_arpcache arpcache;
+
+/* see includes.h */
+uint8_t checking;
 
 uint16_t
 calculateChecksum(void *header, uint32_t len) {
-  uint32_t answer = 0;
-  uint16_t *stream = (uint16_t*) header;
-  uint32_t i, stop = len / 2;
-  for (i = 0; i < stop; ++i) {
-    answer += *stream;
-    if (answer & 0xFFFF0000) {
-      answer &= 0xFFFF;
-      ++answer;
-    }
-    ++stream;
-  }
 
-  /* odd number of bytes. goody */
-  if (len % 2) {
-    uint8_t byte;
-    memcpy(&byte, stream, 1);
-    answer += byte;
-   
-    if (answer & 0xFFFF0000) {
-      answer &= 0xFFFF;
-      ++answer;
-    }
-  }
-  
-  return ~(answer & 0xFFFF); /* and flip the bits */
+  /* same result as summing word by word, just faster (see sr_cksum.c) */
+  return sr_cksum(header, len);
 }
 
 
 /**************************************************
  * Checksum function two
- *  Len is in bytes 
+ *  Len is in bytes, a trailing odd byte is ignored
  *  From: page 95 of Peterson and Davie 
  **************************************************/
 uint16_t
 checksum2(void *buf, uint32_t len) {
 
-  len /= 2;
-  uint16_t *data = (uint16_t*) buf;
-  uint32_t answer = 0;
-
-  while (len--) {
-    answer += *data;
-    ++data;
-  }
-  
-  while (answer >> 16)
-	answer = (answer & 0xffff) + (answer >> 16);
-
-  return ~answer;
+  return sr_cksum(buf, len & ~1U);
 }
 
 
@@ -76,286 +49,157 @@ void setChecking(int v){
  ***************************************************************************/
 void
 add2queue(uint8_t *packet, uint32_t len, 
-	  uint32_t ip, char *interface, struct sr_instance *sr) {
+	  uint32_t ip, unsigned int ifindex, struct sr_instance *sr) {
 
-  int queueLen = 0;
-  int gotMatch   = 0;
-  Arpqueue *tmp = arpqueue;
+  const struct sr_fib_route *best = sr_fib_lookup(sr->fib, ip);
+  struct sr_arpq_req *req;
 
-  if (arpqueue == NULL) {
-    arpqueue = (Arpqueue*) malloc(sizeof(Arpqueue));
-    if (arpqueue == NULL) {
-      fprintf(stderr, "Malloc error\n");
-      exit(1);
-    }
-    tmp = arpqueue;
-  } 
-  else{
-    
-    while (tmp->next != NULL) {
-      if (tmp->ip == ip || tmp->next->ip == ip) {
-	gotMatch = 1;
-      }
-      tmp = tmp->next;
-      queueLen++;
-    }
+  /* packets wait on the neighbor they will be sent to */
+  if (best != NULL && best->gw.s_addr != 0)
+    ip = best->gw.s_addr;
 
-    tmp->next = (Arpqueue*) malloc(sizeof(Arpqueue));
-    if (tmp->next == NULL) {
-      fprintf(stderr, "Malloc error\n");
-      exit(1);
-    }
-    tmp = tmp->next;
-  }
-  tmp->ip = ip;
-  tmp->len = len;
-  tmp->packet = (uint8_t*) malloc(len);
-  strcpy(tmp->interface, interface);
-  tmp->remainingTries = INTIAL_TRIES-1;
-  tmp->timeInSeconds = time(NULL); 
-  if (tmp->packet == NULL) {
-    fprintf(stderr, "Malloc error\n");
-    exit(1);  
-  }
-  memcpy( tmp->packet, packet, len);
-  tmp->next = NULL;
+  req = sr_arpq_find(sr->arpq, ip);
 
   /* ensure that the initial ARP request for this IP happens now... */
-  if(! gotMatch) {
+  if (req == NULL) {
+    req = sr_arpq_new(sr->arpq, ip, INTIAL_TRIES-1);
+    sr_timer_init(&req->timer, arpRetry, req);
+    sr_timer_arm(sr->timers, &req->timer, ARP_RETRY_MS);
     sendArpRequest(sr, ip);
   }
 
-
-  /*fprintf(stderr, "Queue length: %d\n", queueLen);*/
+  /* only the last few packets wait, older ones make room */
+  if (sr_arpq_push(req, packet, len, ifindex))
+    sr_count_drop(SR_DROP_ARP_QUEUE_FULL);
+  sr_count(SR_EV_ARP_QUEUED);
 }
 
 
 
 /***************************************************************************
- *
+ * Learn (or refresh) the MAC of a neighbor heard on interface ifindex
  ***************************************************************************/
 void
-addToArpcache(uint32_t ip, uint8_t *mac, Arpcache *arpcache, struct sr_instance *sr, char *interface) {
-
-  unsigned long min = -1, i, j=0, seconds = time (NULL);
-  uint8_t found = FALSE;
-  /*
-  struct sr_rt *best = longestPrefixMatch(ip, sr->routing_table);
-
-  if (best->gw.s_addr != 0)
-    ip = best->gw.s_addr;
-  else 
-    ip = best->dest.s_addr;
-  */
+addToArpcache(uint32_t ip, uint8_t *mac, struct sr_arpcache *arpcache, struct sr_instance *sr, unsigned int ifindex) {
 
+  struct sr_if *iface = sr_get_interface_by_index(sr, ifindex);
   uint8_t qaid =  (uint8_t) ( ( ntohl(ip) & 0xFF000000) >> 24);
   uint8_t oaid = (uint8_t) ( (ntohl(sr->if_list->ip)) >> 24);
 
-  for (i = 0; i < REALLYBIG; ++i) {
-    if(memcmp(mac, arpcache[i].mac, ETHER_ADDR_LEN) == 0){
-
-      
-      if (qaid != oaid) {
-	arpcache[i].timeInSeconds = time (NULL);
-
-      }
-      found = TRUE;
-      break;
-    }
-    else if (seconds - arpcache[i].timeInSeconds > TIMEOUT && 
-	     arpcache[i].timeInSeconds != -1) {
-      j = i;
-      break; /* a HACK. get rid of the stalest entry if all else fails */
-    } else if ( min > arpcache[i].timeInSeconds ) {
-      j = i;
-      min = arpcache[i].timeInSeconds;
-    }
-  }
-
-
-  /* 0th entry CANNOT time out (that's the firewall */
-  if(!found){
+  if (iface == NULL)
+    return;
 
-    strcpy(arpcache[j].interface, interface);
-    arpcache[j].ip = ip;
-    memcpy( arpcache[j].mac, mac, ETHER_ADDR_LEN);
+  /* neighbors outside our area (that's the firewall) never time out */
+  uint8_t flags = (qaid != oaid) ? SR_ARP_PERMANENT : 0;
+  time_t now = time(NULL);
 
-    /* different area ids */
-    if (qaid != oaid)
-      arpcache[j].timeInSeconds = -1;
-    else
-      arpcache[j].timeInSeconds = time (NULL);
+  sr_arpcache_insert(arpcache, ip, mac, iface->ifindex, flags, now);
 
-    /*    fprintf(stderr, "ARPCACHE: Adding to index: %lu interface: %s time is: %lu\n"
-	  , j, interface, arpcache[j].timeInSeconds);    
-    printIp(ip);
-    printMac(mac);*/
+  /* routes through this neighbor see the new MAC right away; a
+     neighbor no route has led to yet gets its adjacency from the cache
+     once one does (see findAdjacency) */
+  sr_adj_update(sr->adj, ip, mac, iface, flags, now);
 
-  }
+  /* and anything waiting on it goes out on the next checkQueue */
+  sr_arpq_resolved(sr->arpq, ip);
 }
 
 
 
 /**************************************************
- *
+ * Finds the cache entry for the next hop towards quip,
+ * NULL on a miss.  The FIB (connected, static and
+ * PWOSPF routes together) picks the next hop.
  **************************************************/
-uint32_t
-checkArpcache(uint32_t quip, Arpcache *arpcache, struct sr_instance *sr) {
-  uint32_t i, isApp = 0;
-
-  dynrt *bestDynamic = dynamicLongestPrefixMatch(quip, sr->ospf_subsys->drt);
-  struct sr_rt *bestStatic;
-  
-  struct sr_if *nextHop = sr->if_list;
-
-  unsigned long seconds = time(NULL);
-
-  /* attempt a naive search first */
-  for (i= 0; i < REALLYBIG; ++i) {
-    if (arpcache[i].timeInSeconds == 0) {
-      break;
-    } else if (seconds - arpcache[i].timeInSeconds <= TIMEOUT) {
-      /* if the quip is attached to us, there's no other route, so just return it */
-      if (arpcache[i].ip == quip) {
-	/*fprintf(stderr, "NAIVE SEARCH WORKED \n");*/
-	return i;
-      }
-    } 
-  }
-
-  if(bestDynamic == NULL){
-    bestStatic = longestPrefixMatch(quip, sr->routing_table);
-    if (bestStatic == NULL) /* TODO: May need to drop the packet! this won't do that */
-      return -1;
-
-    /*printf("STATIC MAPPING! Gateway, dest, orig\t\n ");
-    printIp(bestStatic->gw.s_addr);
-    printIp(bestStatic->dest.s_addr);
-    printIp(quip);*/
-
-    
-    nextHop = sr_get_interface(sr, bestStatic->interface);
-  } else {
-
-    uint32_t mask = ntohl(bestDynamic->mask.s_addr);
-    uint32_t max = -1;
-    
-    /* if the longest prefix match is the default route (mask is 0), check the static interface list */
-    if (max - mask > 2) {
-      while (nextHop != NULL) {
-	if  ((nextHop->ip & nextHop->mask) == (quip & nextHop->mask)) {
-	  isApp = 1;
-	  /*fprintf(stderr, "GOT AN APP SERVER! WAITING ON AN ARP\t\t");*/
-	  /*printIp(quip);
-	    printIp(nextHop->ip);*/
-	  return -1;
-	}
-	nextHop = nextHop->next;
-      }
-    }
-
-    /*printf("Trying to find ip:\t\t\t");
-    printIp(quip);
-    printf("dynamic mask is: \t\t\t");
-    printIp(bestDynamic->mask.s_addr);
-    printf("dynamic nextHop is: \t\t\t");
-    printIp(bestDynamic->gw.s_addr);*/
-
-    /* definitely not an APP server */
-    if (nextHop == NULL) {
-      /*printf("\t\t Got a dynamic routing table match out of Iface: %s  \t",
-	bestDynamic->interface);
-	printIp(quip);*/
-      nextHop = sr_get_interface(sr, bestDynamic->interface);
+struct sr_arpentry *
+checkArpcache(uint32_t quip, struct sr_arpcache *arpcache, struct sr_instance *sr) {
+  uint32_t nextHopIp;
+  const struct sr_fib_route *best;
+  struct sr_arpentry *entry;
+  time_t seconds = time(NULL);
+  uint64_t start = sr_hist_clock();
+
+  /* if the quip is attached to us, there's no other route, so just return it */
+  entry = sr_arpcache_lookup(arpcache, quip, seconds);
+
+  /* a route without a gateway means quip itself is the next hop, and
+     we already know that one is not cached */
+  if (entry == NULL) {
+    best = sr_fib_lookup(sr->fib, quip);
+    if (best != NULL && best->gw.s_addr != 0) {
+      nextHopIp = best->gw.s_addr;
+      entry = sr_arpcache_lookup(arpcache, nextHopIp, seconds);
     }
   }
 
-  if (nextHop == NULL) {
-    /*    if (bestDynamic == NULL)
-      fprintf(stderr, "This should NEVER happen: No next hop for iface: %s\n", bestStatic->interface);
-    else
-    fprintf(stderr, "This should NEVER happen: No next hop for iface: %s\n", bestDynamic->interface);*/
-    return -1;
-  }
+  sr_count(entry != NULL ? SR_EV_ARP_HIT : SR_EV_ARP_MISS);
+  sr_hist_since(SR_HIST_CHECK_ARPCACHE, start);
+  return entry;
+}
 
-  /* if you're here, then one of the two bests is not NULL */
 
-  
 
-  for (i = 0; i < REALLYBIG; ++i) {
-
-    /* outer */
-    if (arpcache[i].timeInSeconds == 0) {
-      /*fprintf(stderr, "THE ARPCACHE ENTRY HAS TIMED OUT at index %d\n", i);*/
-      return -1;
-    } 
-    /* outer*/
-    else if ( seconds - arpcache[i].timeInSeconds <= TIMEOUT ) { /* entry hasn't timed out */
-      /* inner */
-      if (isApp) {
-	/*fprintf(stderr, "IS AN APP SERVER! WOOT!\n");*/
-	if (arpcache[i].ip == quip) {
-	  return i;
-	}
-      }
-      /* inner */
-      else if (bestDynamic == NULL) {
-	
-	if (bestStatic->gw.s_addr == 0) { /* gateway is the next hop */ 
-	  if ( (bestStatic->dest.s_addr & nextHop->mask) == (arpcache[i].ip & nextHop->mask) ) {
-	    /*fprintf(stderr, "HERE I AM! HIT IS THE NEXT HOP IN THE STATIC MOFO\n");*/
-	    return i;
-	  }
-	} 
-	else if ( (arpcache[i].ip & nextHop->mask) == (bestStatic->gw.s_addr & nextHop->mask)) { /* MAY NEED TO BE &MASK ...? */
-	  /*fprintf(stderr, "Got a CACHE HIT in the static routing table\n");*/
-	  return i;
-	}
-      } 
-      /* inner */
-      else {
-	if (arpcache[i].ip == bestDynamic->gw.s_addr) {
-	  /*fprintf(stderr, "Got a CACHE HIT in the dynamic routing table\n");*/
-	  return i;
-	}
-      }
-    }
-  }
+/**************************************************
+ * Adjacency for nextHopIp, made from its ARP cache
+ * entry.  NULL if ARP hasn't resolved it (yet).
+ **************************************************/
+static struct sr_adj *
+newAdjacency(uint32_t nextHopIp, struct sr_instance *sr, time_t now) {
+  struct sr_arpentry *entry = sr_arpcache_lookup(&arpcache, nextHopIp, now);
+  struct sr_if *iface;
 
+  if (entry == NULL)
+    return NULL;
 
-  return -1;
+  iface = sr_get_interface_by_index(sr, entry->ifindex);
+  if (iface == NULL)
+    return NULL;
+
+  return sr_adj_get(sr->adj, nextHopIp, entry->mac, iface, entry->flags,
+		    entry->stamp);
 }
 
 
 
 /**************************************************
- * removes the ith entry from the arpqueue
+ * Routes with a gateway keep a pointer to its
+ * adjacency, so the common case is a single FIB
+ * lookup.  On a connected route quip is its own next
+ * hop.  Only next hops a route leads to get an
+ * adjacency; anything else is sent straight to quip
+ * if it has one.
  **************************************************/
-void
-removeFromQueue(uint32_t i) {
-
-  /*fprintf(stderr, "Removing index: %d from queue\n", i);*/
- 
-  Arpqueue *tmp, *prev;
-  if (i == 0) {
-    tmp = arpqueue->next;
-    free(arpqueue->packet);
-    free(arpqueue);
-    arpqueue = tmp;
-  } else {
-   tmp = arpqueue;
-   while (i) {
-     prev = tmp;
-     tmp = tmp->next;
-     --i;
-   }
-   free(tmp->packet);
-   prev->next = tmp->next;
-   free(tmp);
+struct sr_adj *
+findAdjacency(uint32_t quip, struct sr_instance *sr) {
+  uint64_t start = sr_hist_clock();
+  struct sr_fib_route *best = sr_fib_lookup(sr->fib, quip);
+  struct sr_adj *adj = NULL;
+  time_t now = time(NULL);
+
+  if (best != NULL && best->gw.s_addr != 0) {
+    /* workers read the binding without a lock (see sr_worker.c) */
+    if (best->adj == NULL)
+      __atomic_store_n(&best->adj, newAdjacency(best->gw.s_addr, sr, now),
+		       __ATOMIC_RELEASE);
+    if (sr_adj_usable(best->adj, now))
+      adj = best->adj;
   }
+
+  if (adj == NULL) {
+    adj = sr_adj_find(sr->adj, quip);
+    if (adj == NULL && best != NULL && best->gw.s_addr == 0)
+      adj = newAdjacency(quip, sr, now);
+    if (!sr_adj_usable(adj, now))
+      adj = NULL;
+  }
+
+  sr_count(adj != NULL ? SR_EV_ARP_HIT : SR_EV_ARP_MISS);
+  sr_hist_since(SR_HIST_FIND_ADJACENCY, start);
+  return adj;
 }
 
 
+
 /**************************************************
  *
  **************************************************/
@@ -402,45 +246,16 @@ sendArpRequest(struct sr_instance *sr, uint32_t ipAddress) {
     printIp(ipAddress);*/
 
   uint8_t junk[ sizeof(struct sr_arphdr) + sizeof(struct sr_ethernet_hdr)];
-  dynrt *dynamicRt = dynamicLongestPrefixMatch(ipAddress, sr->ospf_subsys->drt);
-  if (dynamicRt == NULL) {
-    struct sr_rt *best = longestPrefixMatch(ipAddress, sr->routing_table);
-    if (best == NULL)
-      return;
-
-    if (best->gw.s_addr != 0)
-      ipAddress = best->gw.s_addr;
-  
-  } else {
-
-
-    uint32_t mask = ntohl(dynamicRt->mask.s_addr);
-    uint32_t max = -1;
-    struct sr_if *nextHop = sr->if_list;
-  /* if the longest prefix match is the default route (mask is 0), check the static interface list */
-    if (max - mask > 2) {
-
-      while (nextHop != NULL) {
-	if  ((nextHop->ip & nextHop->mask) == (ipAddress & nextHop->mask)) {
-	  /*fprintf(stderr, "SENDING ARP TO APP SERVER (not remapping IP)\t\t");
-	  printIp(ipAddress);
-	  printIp(nextHop->ip);*/
-	  
-	  break;
-	}
-	nextHop = nextHop->next;
-      }
-      
-    }
-    if(nextHop == NULL) {
-      ipAddress = dynamicRt->gw.s_addr;
-      if (ipAddress == 0)
-	return;
-    }
-  }
+  const struct sr_fib_route *best = sr_fib_lookup(sr->fib, ipAddress);
+
+  if (best == NULL)
+    return;
+
+  /* ARP for the gateway, or the host itself if it is on one of our links */
+  if (best->gw.s_addr != 0)
+    ipAddress = best->gw.s_addr;
 
-  /*printf("Arp!!!!! remapped IP: ");*/
-  printIp(ipAddress);
+  sr_log(SR_LOG_ARP_REQUEST, ipAddress, 0, 0, 0);
 
   /* zero out the packet */
   memset(junk, 0, sizeof(struct sr_arphdr) + sizeof(struct sr_ethernet_hdr) );
@@ -476,7 +291,8 @@ sendArpRequest(struct sr_instance *sr, uint32_t ipAddress) {
     memcpy( etherpacket->ether_shost, walker->addr, ETHER_ADDR_LEN);
 
     sr_send_packet(sr, junk,
-		   sizeof(struct sr_arphdr) + sizeof(struct sr_ethernet_hdr), walker->name);
+		   sizeof(struct sr_arphdr) + sizeof(struct sr_ethernet_hdr), walker->ifindex);
+    sr_count(SR_EV_ARP_REQUEST);
     walker = walker->next;
   }
 
@@ -486,214 +302,163 @@ sendArpRequest(struct sr_instance *sr, uint32_t ipAddress) {
 
 
 /**************************************************
- *
+ * Send an ICMP error about original (its IP header
+ * and 8 bytes) out of ifindex, unless that is over
+ * the limits (see sr_icmp.h).  Built from the
+ * interface's template, so only the addresses, type,
+ * code and quoted bytes are written and the
+ * checksums patched.
  **************************************************/
 void generateICMP(struct sr_instance *sr, uint32_t destIp,
                   uint8_t pType, uint8_t pCode, uint8_t *packet,
-		  Arpcache *arpcache, uint8_t *original, char *interface, uint32_t sourceIp) {
+		  struct sr_arpcache *arpcache, uint8_t *original, unsigned int ifindex, uint32_t sourceIp) {
 
-  /*printf("IN generate ICMP");*/
- 
-  uint8_t data[  sizeof(struct ip) + sizeof(struct sr_ethernet_hdr) +
-                 sizeof(struct icmpPayload) ];
+  uint64_t start = sr_hist_clock();
+  uint8_t data[SR_ICMP_FRAME];
 
-  /* zero out the packet */
-  memset(data, 0, sizeof(struct ip) + sizeof(struct sr_ethernet_hdr) +
-         sizeof(struct icmpPayload));
+  struct sr_if *ifMatch = sr_get_interface_by_index(sr, ifindex);
+
+  if (ifMatch == NULL)
+    return;
+
+  /* over the limit: counted, and not even built */
+  if (!sr_icmp_allow(sr->icmp, ifMatch->ifindex, sr->timers->now))
+    return;
 
-  /* parse ethernet headers from original packet and our new one */
+  memcpy(data, sr_icmp_template(sr->icmp, ifMatch), SR_ICMP_FRAME);
+
+  /* back to where the original came from */
   struct sr_ethernet_hdr *origEthHeader = (struct sr_ethernet_hdr*)packet;
   struct sr_ethernet_hdr *ethHeader = (struct sr_ethernet_hdr*)data;
-
-  /* Swap ethernet targets */
-  memcpy(ethHeader->ether_shost, origEthHeader->ether_dhost, ETHER_ADDR_LEN);
   memcpy(ethHeader->ether_dhost, origEthHeader->ether_shost, ETHER_ADDR_LEN);
-  ethHeader->ether_type = htons(ETHERTYPE_IP);
 
+  /* the template is from the interface's own address */
   struct ip *ipHeader = (struct ip*)(data + sizeof(struct sr_ethernet_hdr));
-  ipHeader->ip_tos = 0;
-  struct sr_if *ifMatch = sr_get_interface(sr, interface);
-  
-  /*unsigned char tempLen = htons(sizeof( struct ip) + sizeof(struct icmpPayload)); MAY NEED TO CHANGE */
-  ipHeader->ip_len = htons(sizeof(struct icmpPayload) + sizeof(struct ip));/*(tempLen * 4) */
-  ipHeader->ip_id = 0; /* MAY NEED TO CHANGE */
-  ipHeader->ip_off = htons(IP_DF);
-  ipHeader->ip_ttl = DEFAULT_TTL;
-  ipHeader->ip_p = IPPROTO_ICMP;
-
-
-  if (sourceIp)
+  if (sourceIp && sourceIp != ipHeader->ip_src.s_addr) {
+    ipHeader->ip_sum = sr_cksum_adjust32(ipHeader->ip_sum, ipHeader->ip_src.s_addr, sourceIp);
     ipHeader->ip_src.s_addr = sourceIp;
-  else
-    ipHeader->ip_src.s_addr = ifMatch->ip;
- 
+  }
+  ipHeader->ip_sum = sr_cksum_adjust32(ipHeader->ip_sum, 0, destIp);
   ipHeader->ip_dst.s_addr = destIp;
 
-  /*printf("Source interface: %s\tSource ip:\n", interface);
-  printIp(ifMatch->ip);
-  printMac(ethHeader->ether_shost);*/
-  
-  uint8_t test = (0x4 << 4) | ( (sizeof(struct ip) >> 2)); 
-  memcpy(ipHeader, &test, 1);
-  /* test should be 0x45 ? that's what comes in. */
-  
-
-  /*
-  if (pCode == PORT_UNREACHABLE) {
-    struct ip *origIphdr = (struct ip*) (packet + sizeof(struct sr_ethernet_hdr));
-    ipHeader->ip_src.s_addr = origIphdr->ip_dst.s_addr;
-    }*/
-
-  ipHeader->ip_sum = 0;
-  uint16_t myChecksum = calculateChecksum(ipHeader, sizeof(struct ip));
-  /* DO CHECKSUM AFTER POPULATING ALL DATA */
-  ipHeader->ip_sum = myChecksum;
-  
-  struct icmpPayload *icmpHeader = (struct icmpPayload*)(data +
-                                                         sizeof(struct sr_ethernet_hdr)
-                                                         + sizeof(struct ip));
-  icmpHeader->type = pType;
-  icmpHeader->code = pCode;
-  icmpHeader->quench = 0;
-
-  /* QUENCH IS INTERNET HEADER PLUS FIRST 64 BITS OF ORIGINAL DATAGRAM'S DATA */
-  memcpy(icmpHeader->data, original,
-         (sizeof(struct ip) + 8));
-
-  icmpHeader->checksum = 0;
-  uint16_t icmpChecksum = calculateChecksum(icmpHeader, sizeof(struct icmpPayload));
-  icmpHeader->checksum = icmpChecksum;
-
-  /*printf("%X is the header length\n", (uint8_t) icmpHeader->data[0]);*/
+  struct icmpPayload *icmpHeader = (struct icmpPayload*)(ipHeader + 1);
+  icmpHeader->checksum = sr_cksum_set8(icmpHeader->checksum, icmpHeader,
+                                       &icmpHeader->type, pType);
+  icmpHeader->checksum = sr_cksum_set8(icmpHeader->checksum, icmpHeader,
+                                       &icmpHeader->code, pCode);
+
+  /* QUENCH IS INTERNET HEADER PLUS FIRST 64 BITS OF ORIGINAL DATAGRAM'S DATA;
+     the template's are zero, so their sum just adds on */
+  memcpy(icmpHeader->data, original, sizeof(icmpHeader->data));
+  icmpHeader->checksum =
+    sr_cksum_fold((uint16_t)~icmpHeader->checksum +
+                  (uint16_t)~sr_cksum(icmpHeader->data, sizeof(icmpHeader->data)));
+
+  if (pType == TIMEOUT_TYPE)
+    sr_count(SR_EV_ICMP_TIME_EXCEEDED);
+  else if (pType != DEST_UNREACHABLE_TYPE)
+    sr_count(SR_EV_ICMP_ERROR_OTHER);
+  else if (pCode == HOST_UNREACHABLE)
+    sr_count(SR_EV_ICMP_HOST_UNREACH);
+  else if (pCode == PROTOCOL_UNREACHABLE)
+    sr_count(SR_EV_ICMP_PROTO_UNREACH);
+  else if (pCode == PORT_UNREACHABLE)
+    sr_count(SR_EV_ICMP_PORT_UNREACH);
+  else
+    sr_count(SR_EV_ICMP_ERROR_OTHER);
+  sr_log(SR_LOG_ICMP_ERROR, pType, pCode, destIp, ifMatch->ifindex);
 
-  sr_send_packet(sr, data,
-                 sizeof(struct ip) + sizeof(struct sr_ethernet_hdr) + sizeof(struct icmpPayload), ifMatch->name); /*"eth0"*/
+  sr_send_packet(sr, data, SR_ICMP_FRAME, ifMatch->ifindex);
+  sr_hist_since(SR_HIST_GENERATE_ICMP, start);
 }
 
-/***************************************************************************
- *
- ***************************************************************************/
-struct sr_if *checkInterfaces(char *myIF, struct sr_instance *sr){
-
-  int found = FALSE;
-
-  struct sr_if *ifTemp = sr->if_list;
-
-  do{
-    if(strcmp(ifTemp->name, myIF) == 0){
-      found = TRUE;
-      break;
-    }      
-  }while( ((!found) && (ifTemp = ifTemp->next)) );
+/****************************************************************
+ *Sends the packets whose next hop has answered
+ ****************************************************************/
+void
+checkQueue(struct sr_instance *sr, struct sr_rt *routingTable, 
+	   struct sr_arpcache *arpcache, struct sr_if *US) {
   
-  if(found){
-    return ifTemp;
-  }
-  else{
-    return NULL;
+  checking = CHECKING;
+  struct sr_arpq_req *req;
+  struct sr_arpq_pkt *waiter;
+  struct sr_pkt vec[SR_VECTOR_SIZE];
+  unsigned int n;
+
+  /* release everything waiting on neighbors that have answered; the
+     packets go through the router again now that the MAC is known */
+  while ((req = sr_arpq_pop_ready(sr->arpq)) != NULL) {
+    waiter = req->head;
+    while (waiter != NULL) {
+      for (n = 0; waiter != NULL && n < SR_VECTOR_SIZE; ++n, waiter = waiter->next) {
+	vec[n].buf = waiter->packet;
+	vec[n].len = waiter->len;
+	vec[n].ifindex = waiter->ifindex;
+	sr_count(SR_EV_ARP_RELEASED);
+      }
+      sr_handlepackets(sr, vec, n);
+    }
+    sr_arpq_free(req);
   }
+
+  checking = CLEAR;
 }
 
 
 
 /****************************************************************
- *Walks down the queue. If the counter is 0, it frees the memory
- *and sends 
+ *Timer for a next hop nobody has answered for yet: ARP again
+ *every ARP_RETRY_MS, and once INTIAL_TRIES requests have gone
+ *unanswered tell the senders their host is unreachable
  ****************************************************************/
 void
-checkQueue(struct sr_instance *sr, struct sr_rt *routingTable, 
-	   Arpcache *arpcache, struct sr_if *US) {
-  
-  checking = CHECKING;
-  uint32_t i, cacheIndex, queueIndex = 0, lazyArp[REALLYBIG], currQueueSize = 0;
-  Arpqueue *tmp = arpqueue;
-  unsigned long seconds = time(NULL);
+arpRetry(void *ctx, void *arg) {
 
+  struct sr_instance *sr = (struct sr_instance*) ctx;
+  struct sr_arpq_req *req = (struct sr_arpq_req*) arg;
+  struct sr_arpq_pkt *waiter;
+  unsigned int n = 0;
 
-  if (tmp == NULL){
-    checking = CLEAR;
+  if (req->tries) {
+    --(req->tries);
+    sendArpRequest(sr, req->ip);
+    sr_timer_arm(sr->timers, &req->timer, ARP_RETRY_MS);
     return;
   }
 
-  while (tmp != NULL) {
-
+  for (waiter = req->head; waiter != NULL; waiter = waiter->next) {
+    struct sr_ethernet_hdr *eth = (struct sr_ethernet_hdr*) waiter->packet;
 
-    if (tmp->remainingTries) {
+    sr_count_drop(SR_DROP_ARP_UNRESOLVED);
+    ++n;
 
-      cacheIndex = checkArpcache(tmp->ip, arpcache, sr);
-      /*printf("Remaining tries: %d ; index: %d\n", tmp->remainingTries, cacheIndex);
-	printIp(tmp->ip);*/
-      /* GOT A CACHE HIT */
-      if (cacheIndex != -1) { /* TODO: send arp REPLY (ICMP ECHO?) */
-	sr_handlepacket(sr, tmp->packet, tmp->len, tmp->interface);
-        tmp = tmp->next;
-        removeFromQueue(queueIndex); /* frees the memory */
-	continue;
-      }
-      /* GOT A CACHE MISS */
-      else{
-	/* send out an ARP request for this ip */
-        if (seconds - tmp->timeInSeconds > 0) {
-	  --(tmp->remainingTries);
-
-	  for (i = 0; i < currQueueSize; ++i)
-	    if (lazyArp[i] == tmp->ip)
-	      break;
-	  
-  /* send out an ARP request ONLY if we have not sent one out on this round of checking */
-	  if (i == currQueueSize) {
-	  
-	    sendArpRequest(sr, tmp->ip);
-	    /*printf("New ip ?!\n");
-	      printIp(tmp->ip);*/
-
-	    lazyArp[i] = tmp->ip;
-	    currQueueSize++;
-	  } 
-
-
-	  
-	  tmp->timeInSeconds = seconds;
-        }
-      }
-    } else { /* TODO: Send host ICMP host unreachable */
-      
-      /* interpolate what the original IP packet was */
-      uint8_t clone[ sizeof(struct ip) + 8];
-      memset(clone, 0, sizeof(struct ip) + 8);
-      
-      struct ip *data;
-      memcpy(clone, &(tmp->packet[sizeof(struct sr_ethernet_hdr)]),
-			sizeof(struct ip) + 8);
-      data = (struct ip*) clone;
-      data->ip_ttl += 1;
-      data->ip_sum = 0;
-      /* TODO: htons the sum? */
-      data->ip_sum = calculateChecksum(data, sizeof(struct ip));
-      
-      struct sr_ethernet_hdr *eth = (struct sr_ethernet_hdr*) tmp->packet;
-      if (eth->ether_type == htons(ETHERTYPE_IP)) {
-	struct ip *ipHeader = (struct ip*)(tmp->packet + sizeof(struct sr_ethernet_hdr));
-	struct sr_rt *rtMatch = longestPrefixMatch(ipHeader->ip_src.s_addr, sr->routing_table);
-
-	generateICMP(sr, tmp->ip, DEST_UNREACHABLE_TYPE,
-		     HOST_UNREACHABLE, tmp->packet, arpcache, clone, rtMatch->interface, 0);
-      }
-      else if (eth->ether_type == htons(ETHERTYPE_ARP)) {
-	struct sr_arphdr *arp = (struct sr_arphdr*) (tmp->packet + sizeof(struct sr_ethernet_hdr));
-	struct sr_rt *rtMatch = longestPrefixMatch(arp->ar_sip, sr->routing_table);
-	generateICMP(sr, tmp->ip, DEST_UNREACHABLE_TYPE,
-		     HOST_UNREACHABLE, tmp->packet, arpcache, clone, rtMatch->interface, 0);
-      }
-      tmp = tmp->next;
-      removeFromQueue(queueIndex);
+    /* ARP requests we were passing on are dropped quietly */
+    if (eth->ether_type != htons(ETHERTYPE_IP) ||
+	waiter->len < sizeof(struct sr_ethernet_hdr) + sizeof(struct ip))
       continue;
-    }
-    tmp = tmp->next;
-    ++queueIndex;
+
+    /* interpolate what the original IP packet was */
+    uint8_t clone[ sizeof(struct ip) + 8];
+    unsigned int quote = waiter->len - sizeof(struct sr_ethernet_hdr);
+    struct ip *data;
+
+    if (quote > sizeof(struct ip) + 8)
+      quote = sizeof(struct ip) + 8;
+    memset(clone, 0, sizeof(struct ip) + 8);
+    memcpy(clone, &(waiter->packet[sizeof(struct sr_ethernet_hdr)]), quote);
+    data = (struct ip*) clone;
+    sr_ip_set_ttl(data, data->ip_ttl + 1);
+
+    const struct sr_fib_route *rtMatch = sr_fib_lookup(sr->fib, data->ip_src.s_addr);
+
+    if (rtMatch != NULL)
+      generateICMP(sr, data->ip_src.s_addr, DEST_UNREACHABLE_TYPE,
+		   HOST_UNREACHABLE, waiter->packet, &arpcache, clone, rtMatch->ifindex, 0);
   }
 
-  checking = CLEAR;
+  sr_log(SR_LOG_ARP_GIVE_UP, req->ip, n, 0, 0);
+  sr_arpq_remove(sr->arpq, req);
+  sr_arpq_free(req);
 }
 
 
@@ -703,43 +468,26 @@ checkQueue(struct sr_instance *sr, struct sr_rt *routingTable,
  ***************************************************************************/
 void forwardPacket(struct sr_instance *_sr, uint8_t *_packet, 
 		   int _len, uint32_t _dstIp, struct sr_if *US,
-		   Arpcache *arpcache, uint32_t index){
+		   struct sr_adj *nextHop){
 
+  uint64_t start = sr_hist_clock();
   struct sr_ethernet_hdr *ethHdr = (struct sr_ethernet_hdr*) _packet;
   struct ip *ipHdr = (struct ip*) (_packet + sizeof(struct sr_ethernet_hdr));
-  struct icmpPayload *icmp = (struct icmpPayload*)
-    (_packet + sizeof(struct sr_ethernet_hdr) + sizeof(struct ip));
-  
-  /*
-    struct sr_rt *rtTemp = longestPrefixMatch(_dstIp, RT);
-    struct sr_if *ifMatch = checkInterfaces(rtTemp->interface, _sr);
-  */
-  struct sr_if *ifMatch = sr_get_interface(_sr, arpcache[index].interface);
-
-  /*fprintf(stderr, "FORWARDING PACKET OUT OF ARPCACHE INDEX: %d\n",
-    index);*/
+  unsigned int ifindex;
 
-  memcpy(ethHdr->ether_shost, ifMatch->addr, ETHER_ADDR_LEN);
-  memcpy(ethHdr->ether_dhost, arpcache[index].mac, ETHER_ADDR_LEN);
+  /* the reader may be rewriting the adjacency while a worker is here */
+  ifindex = sr_adj_rewrite(nextHop, ethHdr);
 
+  /* the TTL (and its checksum) was already taken care of by
+     sr_handlepacket, and the ICMP checksum doesn't cover the IP header */
   if(ipHdr->ip_src.s_addr == ipHdr->ip_dst.s_addr){
-    ipHdr->ip_dst.s_addr = arpcache[index].ip;
+    ipHdr->ip_sum = sr_cksum_adjust32(ipHdr->ip_sum, ipHdr->ip_dst.s_addr,
+				      nextHop->nexthop);
+    ipHdr->ip_dst.s_addr = nextHop->nexthop;
   }
 
-  /*set IP checksum */
-  ipHdr->ip_sum = 0;
-  ipHdr->ip_sum = calculateChecksum( (void*) ipHdr, sizeof(struct ip));
-
-  
-  /* DON'T CHANGE CHECKSUM FOR TCP/UDP PACKETS */
-  if(ipHdr->ip_p != TCP_PROTOCOL && ipHdr->ip_p != UDP_PROTOCOL){
-    /* set ICMP checksum */
-    icmp->checksum = 0;
-    icmp->checksum = calculateChecksum( (void*) icmp, 
-					_len - (sizeof(struct sr_ethernet_hdr) + sizeof(struct ip)));
-  }
-  
-  sr_send_packet(_sr, _packet, _len,  arpcache[index].interface);/*ifMatch->name);*/
+  sr_send_packet(_sr, _packet, _len, ifindex);
+  sr_hist_since(SR_HIST_FORWARD_PACKET, start);
 }
 
 
@@ -747,19 +495,9 @@ void forwardPacket(struct sr_instance *_sr, uint8_t *_packet,
 /***************************************************************************
  * Return interface matching dIp, NULL if none found
  ***************************************************************************/
-struct sr_if *oneOfUs(struct sr_if *US, uint32_t dIp){
-
-  struct sr_if *retVal = US;
+struct sr_if *oneOfUs(struct sr_instance *sr, uint32_t dIp){
 
-  while(retVal != NULL){
-    if(retVal->ip == dIp){
-      /*fprintf(stderr, "FOUND A MATCHING INTERFACE!!!\n");*/
-      return retVal;
-    }
-    retVal = retVal->next;
-  }
-
-  return NULL;
+  return sr_get_interface_by_ip(sr, dIp);
 }
 
 
@@ -769,7 +507,7 @@ struct sr_if *oneOfUs(struct sr_if *US, uint32_t dIp){
  **************************************************/
 void checkRT(struct sr_instance *sr){
   
-  struct sr_rt *prev, *RT = sr->routing_table;
+  struct sr_rt *prev = NULL, *RT = sr->routing_table;
 
   while(RT != NULL && RT->dest.s_addr != 0){
     prev = RT;
@@ -788,44 +526,6 @@ void checkRT(struct sr_instance *sr){
 
 
 
-/****************************************************************************
- * Assumes that the queried IP address is in network byte order
- ***************************************************************************/
-struct sr_rt *longestPrefixMatch(uint32_t query, struct sr_rt *sr){
-  
-  uint32_t i, j, mask, dest, longestMatch = 0, skip;
-  struct sr_rt *bestMatch = NULL;
-  query = htonl(query);
-  while (sr != NULL ) {
-    skip = 0;
- 
-    dest = htonl(sr->dest.s_addr);
-    mask = htonl(sr->mask.s_addr);
-
-    for (j = 0; j < 32; ++j) {
-      i = 1 << (31-j);
-      /*       if the mask is set to 1 for the jth bit  */
-      if ((i & mask) != 0) {
-	if ( (i & dest) != (i & query)) {
-	  skip = 1; /* bits don't agree */
-	  break; 
-        }
-      } else 
-	break;
-    }
-    
-    if (skip==0 && j >= longestMatch) {
-      longestMatch = j;
-      bestMatch = sr;
-    }
-    sr = sr->next;
-  }
-
-  return bestMatch;
-}
-
-
-
 /****************************************************************************
  * Assumes that the queried IP address is in network byte order
  ***************************************************************************/
@@ -846,18 +546,11 @@ void printHello(struct ospfv2_hello_hdr *head){
 /**************************************************
  *
  **************************************************/
-uint8_t *getMacForInterface(struct sr_instance *sr, char *interface){
+uint8_t *getMacForInterface(struct sr_instance *sr, unsigned int ifindex){
   
-  struct sr_if *walker = sr->if_list;
-  
-  while(walker != NULL){
-    if(strcmp(walker->name, interface) == 0){
-      return walker->addr;
-    }
-    walker = walker->next;
-  }
+  struct sr_if *iface = sr_get_interface_by_index(sr, ifindex);
 
-  return NULL;
+  return (iface != NULL) ? iface->addr : NULL;
 }
 
 
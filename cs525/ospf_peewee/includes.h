@@ -15,8 +15,9 @@
 #define TIMEOUT_TYPE 11
 
 #define REALLYBIG 1000
-#define TIMEOUT 15
+#define TIMEOUT SR_ARPCACHE_TIMEOUT
 #define INTIAL_TRIES 5
+#define ARP_RETRY_MS 1000
 
 #define CHECKING 0
 #define CLEAR 1
@@ -41,6 +42,13 @@
 
 /* includes */
 #include "sr_rt.h"
+#include "sr_fib.h"
+#include "sr_arpcache.h"
+#include "sr_arpq.h"
+#include "sr_timer.h"
+#include "sr_adj.h"
+#include "sr_cksum.h"
+#include "sr_graph.h"
 #include "sr_router.h"
 #include "pwospf_protocol.h"
 #include "sr_pwospf.h"
@@ -48,8 +56,8 @@
 #include <stdlib.h>
 #include <stdio.h>
 
- /* variable to break recursive queue checkin */
-uint8_t checking;
+ /* variable to break recursive queue checkin, defined in includes.c */
+extern uint8_t checking;
 
 /**************************************************
  *
@@ -64,44 +72,12 @@ struct icmpPayload {
 
 
 
-/**************************************************
- *
- **************************************************/
-typedef struct {
-  char interface[sr_IFACE_NAMELEN];
-  uint32_t ip;
-  uint8_t  mac[ETHER_ADDR_LEN];
-  unsigned long timeInSeconds;
-} Arpcache;
-
-
-
-/**************************************************
- *
- **************************************************/
-typedef struct arpqueue {
-  uint16_t type;
-  uint32_t ip, len;
-  uint8_t *packet;
-  uint32_t remainingTries;
-  char interface[sr_IFACE_NAMELEN];
-  unsigned long timeInSeconds;
-  struct arpqueue *next;
-} Arpqueue;
-
-
-
 /**************************************************
  * PROTOTYPES
  **************************************************/
-void removeFromQueue(uint32_t i);
 void generateICMP(struct sr_instance *sr, uint32_t destIp, 
                   uint8_t pType, uint8_t pCode, uint8_t *packet,
-		  Arpcache *arpcache, uint8_t *original, char *interface, uint32_t srcIp);
-
-/* uses the static routing table */
-struct sr_rt *
-longestPrefixMatch(uint32_t query, struct sr_rt *sr);
+		  struct sr_arpcache *arpcache, uint8_t *original, unsigned int ifindex, uint32_t srcIp);
 
 
 /**************************************************
@@ -115,7 +91,7 @@ calculateChecksum(void *header, uint32_t len);
 
 /**************************************************
  * Checksum function two
- *  Len is in bytes 
+ *  Len is in bytes, a trailing odd byte is ignored
  *  From: page 95 of Peterson and Davie 
  **************************************************/
 uint16_t
@@ -133,25 +109,27 @@ void setChecking(int v);
  ***************************************************************************/
 void
 add2queue(uint8_t *packet, uint32_t len, 
-	  uint32_t ip, char *interface, struct sr_instance *sr);
+	  uint32_t ip, unsigned int ifindex, struct sr_instance *sr);
 
 /***************************************************************************
  *
  ***************************************************************************/
 void
-addToArpcache(uint32_t ip, uint8_t *mac, Arpcache *arpcache, struct sr_instance *sr, char *);
+addToArpcache(uint32_t ip, uint8_t *mac, struct sr_arpcache *arpcache, struct sr_instance *sr, unsigned int ifindex);
 
 /**************************************************
- *
+ * Cache entry of the next hop towards quip, NULL if
+ * it has not been resolved
  **************************************************/
-uint32_t
-checkArpcache(uint32_t quip, Arpcache *arpcache, struct sr_instance *sr);
+struct sr_arpentry *
+checkArpcache(uint32_t quip, struct sr_arpcache *arpcache, struct sr_instance *sr);
 
 /**************************************************
- * removes the ith entry from the arpqueue
+ * Adjacency to forward a packet for quip through,
+ * NULL if its next hop has not been resolved
  **************************************************/
-void
-removeFromQueue(uint32_t i);
+struct sr_adj *
+findAdjacency(uint32_t quip, struct sr_instance *sr);
 
 /**************************************************
  *
@@ -175,30 +153,30 @@ sendArpRequest(struct sr_instance *sr, uint32_t ipAddress);
  *
  **************************************************/
 
-/***************************************************************************
- *
- ***************************************************************************/
-struct sr_if *checkInterfaces(char *myIF, struct sr_instance *sr);
-
 /****************************************************************
- *Walks down the queue. If the counter is 0, it frees the memory
- *and sends 
+ *Sends the packets whose next hop has answered
  ****************************************************************/
 void
 checkQueue(struct sr_instance *sr, struct sr_rt *routingTable, 
-	   Arpcache *arpcache, struct sr_if *US);
+	   struct sr_arpcache *arpcache, struct sr_if *US);
+
+/****************************************************************
+ *Retry timer of a next hop in the ARP queue, see sr_timer.h
+ ****************************************************************/
+void
+arpRetry(void *ctx, void *arg);
 
 /***************************************************************************
  *
  ***************************************************************************/
 void forwardPacket(struct sr_instance *_sr, uint8_t *_packet, 
 		   int _len, uint32_t _dstIp, struct sr_if *US,
-		   Arpcache *arpcache, uint32_t index);
+		   struct sr_adj *nextHop);
 
 /***************************************************************************
  * Return interface matching dIp, NULL if none found
  ***************************************************************************/
-struct sr_if *oneOfUs(struct sr_if *US, uint32_t dIp);
+struct sr_if *oneOfUs(struct sr_instance *sr, uint32_t dIp);
 
 /**************************************************
  *
@@ -215,7 +193,7 @@ void printHello(struct ospfv2_hello_hdr *head);
 /**************************************************
  *
  **************************************************/
-uint8_t *getMacForInterface(struct sr_instance *sr, char *interface);
+uint8_t *getMacForInterface(struct sr_instance *sr, unsigned int ifindex);
 
 
 
@@ -0,0 +1,330 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_adj.c
+ *
+ * Description:
+ *
+ * Adjacency table, see sr_adj.h.  The index is an open addressing hash of
+ * pointers keyed by next hop address; adjacencies themselves are
+ * allocated one at a time so growing the index never moves them.
+ *
+ * A published index only ever has entries added to it; when it grows, or
+ * sr_adj_expire takes entries out, a new one is built and replaces it as
+ * a whole.  So lookups need no lock: a reader sees either the old index or
+ * the new one, and a slot either empty or holding a complete adjacency.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+
+#include <netinet/in.h>
+
+#include "sr_adj.h"
+#include "sr_hash.h"
+#include "sr_if.h"
+#include "sr_fib.h"
+#include "sr_epoch.h"
+
+static __inline__ struct sr_adj**
+sr_adj_find_slot(struct sr_adj_index* index, uint32_t nexthop)
+{
+    uint32_t i = sr_hash32(nexthop) & index->mask;
+    struct sr_adj* adj;
+
+    while((adj = index->slots[i]) != 0 && adj->nexthop != nexthop)
+    { i = (i + 1) & index->mask; }
+
+    return &index->slots[i];
+} /* -- sr_adj_find_slot -- */
+
+static struct sr_adj_index* sr_adj_alloc(uint32_t size)
+{
+    struct sr_adj_index* index = 0;
+
+    index = (struct sr_adj_index*)calloc(1, sizeof(struct sr_adj_index) +
+                                         (size - 1) * sizeof(struct sr_adj*));
+    assert(index);
+    index->mask = size - 1;
+
+    return index;
+} /* -- sr_adj_alloc -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_adj_rebuild(..)
+ * Scope:  Local
+ *
+ * Move every adjacency of the index except those in 'gone' (sorted, see
+ * sr_adj_cmp) to a new index of size slots.  Readers may still be
+ * probing the old one, so it is retired to the epoch rather than freed.
+ *
+ *---------------------------------------------------------------------*/
+
+static int sr_adj_cmp(const void* a, const void* b)
+{
+    const struct sr_adj* x = *(const struct sr_adj* const*)a;
+    const struct sr_adj* y = *(const struct sr_adj* const*)b;
+
+    return (x < y) ? -1 : (x > y);
+} /* -- sr_adj_cmp -- */
+
+static void sr_adj_rebuild(struct sr_adjtab* tab, uint32_t size,
+                           struct sr_adj** gone, uint32_t ngone)
+{
+    struct sr_adj_index* old   = tab->index;
+    struct sr_adj_index* index = sr_adj_alloc(size);
+    uint32_t i;
+
+    tab->used = 0;
+    for(i = 0; i <= old->mask; ++i)
+    {
+        if(old->slots[i] == 0 ||
+           (ngone && bsearch(&old->slots[i], gone, ngone,
+                             sizeof(struct sr_adj*), sr_adj_cmp)))
+        { continue; }
+
+        *sr_adj_find_slot(index, old->slots[i]->nexthop) = old->slots[i];
+        ++tab->used;
+    }
+
+    __atomic_store_n(&tab->index, index, __ATOMIC_RELEASE);
+    sr_epoch_retire(tab->epoch, old, free);
+} /* -- sr_adj_rebuild -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_adj_set_iface(..)
+ * Scope:  Local
+ *
+ * Point the adjacency out of iface and fill in the source half of the
+ * rewrite.
+ *
+ *---------------------------------------------------------------------*/
+
+static void sr_adj_set_iface(struct sr_adj* adj, const struct sr_if* iface)
+{
+    adj->ifindex = iface->ifindex;
+    memcpy(adj->rewrite.ether_shost, iface->addr, ETHER_ADDR_LEN);
+} /* -- sr_adj_set_iface -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_adj_init(..)
+ * Scope:  Global
+ *
+ * Outgrown indices are retired to 'epoch'.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_adj_init(struct sr_adjtab* tab, struct sr_epoch* epoch)
+{
+    /* -- REQUIRES -- */
+    assert(tab);
+
+    tab->index = sr_adj_alloc(SR_ADJ_MIN_SIZE);
+    tab->epoch = epoch;
+    tab->used  = 0;
+} /* -- sr_adj_init -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_adj_find(..)
+ * Scope:  Global
+ *
+ * Adjacency for nexthop (network byte order), or 0 if there is none.
+ * The adjacency may not be resolved yet, see sr_adj_usable.  Safe to call
+ * from any thread.
+ *
+ *---------------------------------------------------------------------*/
+
+struct sr_adj* sr_adj_find(struct sr_adjtab* tab, uint32_t nexthop)
+{
+    if(nexthop == 0)
+    { return 0; }
+
+    return *sr_adj_find_slot(__atomic_load_n(&tab->index, __ATOMIC_ACQUIRE),
+                             nexthop);
+} /* -- sr_adj_find -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_adj_set(..)
+ * Scope:  Local
+ *
+ * ARP has nexthop at mac on iface, last confirmed at stamp.  Workers
+ * may be copying the rewrite meanwhile, so it is changed between two
+ * bumps of seq (see sr_adj_rewrite).
+ *
+ *---------------------------------------------------------------------*/
+
+static void sr_adj_set(struct sr_adj* adj, const uint8_t* mac,
+                       const struct sr_if* iface, uint8_t arp_flags,
+                       time_t stamp)
+{
+    if(adj->ifindex != iface->ifindex ||
+       memcmp(adj->rewrite.ether_dhost, mac, ETHER_ADDR_LEN) != 0)
+    {
+        __atomic_store_n(&adj->seq, adj->seq + 1, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+
+        if(adj->ifindex != iface->ifindex)
+        { sr_adj_set_iface(adj, iface); }
+        memcpy(adj->rewrite.ether_dhost, mac, ETHER_ADDR_LEN);
+
+        __atomic_store_n(&adj->seq, adj->seq + 1, __ATOMIC_RELEASE);
+    }
+
+    __atomic_store_n(&adj->arp_flags, arp_flags, __ATOMIC_RELAXED);
+    __atomic_store_n(&adj->stamp, (uint32_t)stamp, __ATOMIC_RELAXED);
+    __atomic_store_n(&adj->flags, adj->flags | SR_ADJ_RESOLVED,
+                     __ATOMIC_RELEASE);
+} /* -- sr_adj_set -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_adj_get(..)
+ * Scope:  Global
+ *
+ * Adjacency for nexthop, creating it from what ARP knows about it
+ * (mac on iface, see sr_adj_set) if it doesn't exist yet.  Only next hops
+ * a route leads to should get one.
+ *
+ *---------------------------------------------------------------------*/
+
+struct sr_adj* sr_adj_get(struct sr_adjtab* tab, uint32_t nexthop,
+                          const uint8_t* mac, const struct sr_if* iface,
+                          uint8_t arp_flags, time_t stamp)
+{
+    struct sr_adj** slot = 0;
+    struct sr_adj*  adj  = 0;
+
+    /* -- REQUIRES -- */
+    assert(tab);
+    assert(mac);
+    assert(iface);
+
+    if(nexthop == 0)
+    { return 0; }
+
+    slot = sr_adj_find_slot(tab->index, nexthop);
+    if(*slot)
+    { return *slot; }
+
+    /* -- keep the load factor under 1/2 -- */
+    if(tab->used + 1 > (tab->index->mask + 1) / 2)
+    {
+        sr_adj_rebuild(tab, (tab->index->mask + 1) * 2, 0, 0);
+        slot = sr_adj_find_slot(tab->index, nexthop);
+    }
+
+    adj = (struct sr_adj*)calloc(1, sizeof(struct sr_adj));
+    assert(adj);
+    adj->nexthop = nexthop;
+    adj->rewrite.ether_type = htons(ETHERTYPE_IP);
+    sr_adj_set_iface(adj, iface);
+    sr_adj_set(adj, mac, iface, arp_flags, stamp);
+
+    /* -- fully set up before readers can see it -- */
+    __atomic_store_n(slot, adj, __ATOMIC_RELEASE);
+    ++tab->used;
+
+    return adj;
+} /* -- sr_adj_get -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_adj_update(..)
+ * Scope:  Global
+ *
+ * ARP has resolved nexthop to mac on iface; rewrite its adjacency in
+ * place if it has one.  Returns the adjacency, or 0 if there is none.
+ *
+ *---------------------------------------------------------------------*/
+
+struct sr_adj* sr_adj_update(struct sr_adjtab* tab, uint32_t nexthop,
+                             const uint8_t* mac, const struct sr_if* iface,
+                             uint8_t arp_flags, time_t now)
+{
+    struct sr_adj* adj = 0;
+
+    /* -- REQUIRES -- */
+    assert(tab);
+    assert(mac);
+    assert(iface);
+
+    if((adj = sr_adj_find(tab, nexthop)) != 0)
+    { sr_adj_set(adj, mac, iface, arp_flags, now); }
+
+    return adj;
+} /* -- sr_adj_update -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_adj_expire(..)
+ * Scope:  Global
+ *
+ * Take out every adjacency that has aged out and that no route of fib
+ * points at, and retire it to the epoch.  Shrinks the index if that
+ * leaves it mostly empty.  Run off a timer, like sr_arpcache_expire.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_adj_expire(struct sr_adjtab* tab, const struct sr_fib* fib,
+                   time_t now)
+{
+    struct sr_adj_index* index = 0;
+    struct sr_adj** gone = 0;
+    struct sr_adj** hit  = 0;
+    uint8_t*        keep = 0;
+    uint32_t ngone = 0, size, i, j;
+
+    /* -- REQUIRES -- */
+    assert(tab);
+
+    index = tab->index;
+    for(i = 0; i <= index->mask; ++i)
+    {
+        if(index->slots[i] && !sr_adj_usable(index->slots[i], now))
+        { ++ngone; }
+    }
+    if(ngone == 0)
+    { return; }
+
+    gone = (struct sr_adj**)malloc(ngone * sizeof(struct sr_adj*));
+    assert(gone);
+    ngone = 0;
+    for(i = 0; i <= index->mask; ++i)
+    {
+        if(index->slots[i] && !sr_adj_usable(index->slots[i], now))
+        { gone[ngone++] = index->slots[i]; }
+    }
+    qsort(gone, ngone, sizeof(struct sr_adj*), sr_adj_cmp);
+    keep = (uint8_t*)calloc(ngone, 1);
+    assert(keep);
+
+    /* -- a route's gateway stays, it will be needed once ARP answers -- */
+    for(i = 1; fib && i < fib->nroutes; ++i)
+    {
+        if(fib->routes[i].adj == 0 || sr_adj_usable(fib->routes[i].adj, now))
+        { continue; }
+
+        hit = (struct sr_adj**)bsearch(&fib->routes[i].adj, gone, ngone,
+                                       sizeof(struct sr_adj*), sr_adj_cmp);
+        if(hit)
+        { keep[hit - gone] = 1; }
+    }
+
+    /* -- what is left stays sorted -- */
+    for(i = 0, j = 0; i < ngone; ++i)
+    {
+        if(!keep[i])
+        { gone[j++] = gone[i]; }
+    }
+    ngone = j;
+    free(keep);
+
+    if(ngone)
+    {
+        size = index->mask + 1;
+        while(size > SR_ADJ_MIN_SIZE && (tab->used - ngone) * 8 < size)
+        { size /= 2; }
+        sr_adj_rebuild(tab, size, gone, ngone);
+
+        for(i = 0; i < ngone; ++i)
+        { sr_epoch_retire(tab->epoch, gone[i], free); }
+    }
+    free(gone);
+} /* -- sr_adj_expire -- */
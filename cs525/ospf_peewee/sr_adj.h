@@ -0,0 +1,143 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_adj.h
+ *
+ * Description:
+ *
+ * Adjacency (next hop rewrite) table.  An adjacency holds everything the
+ * forwarding path needs to send a packet to one neighbor: the egress
+ * interface and a ready made Ethernet header.  FIB routes with a gateway
+ * point straight at the gateway's adjacency, so forwarding is one trie
+ * lookup and one header copy.
+ *
+ * An adjacency is created the first time a route leads to a neighbor
+ * ARP has resolved, so hosts that only ARP for us (or pretend to) cost
+ * nothing here.  When ARP refreshes a neighbor its adjacency is rewritten
+ * in place and every route through it picks the change up; the rewrite
+ * and interface are guarded by a sequence count, so a worker copying
+ * them meanwhile (sr_adj_rewrite) retries rather than sending with half
+ * of an old header.  Adjacencies
+ * that have aged out and no route points at any more are swept out by
+ * sr_adj_expire and retired to the epoch, so pointers to them stay valid
+ * for as long as a reader can hold one.
+ *
+ * Only the thread handling packets changes this table; forwarding workers
+ * (see sr_worker.h) look adjacencies up with sr_adj_find and use them,
+ * inside an epoch read section (see sr_epoch.h).
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_ADJ_H
+#define SR_ADJ_H
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif /* _DARWIN_ */
+
+#include <time.h>
+#include <string.h>
+
+#include "sr_protocol.h"
+#include "sr_arpcache.h"
+
+#define SR_ADJ_MIN_SIZE  64   /* initial slots, power of two */
+
+/* -- adjacency flags -- */
+#define SR_ADJ_RESOLVED  0x01 /* rewrite holds the neighbor's MAC */
+
+struct sr_if;
+struct sr_epoch;
+struct sr_fib;
+
+/* ----------------------------------------------------------------------------
+ * struct sr_adj
+ *
+ * 'rewrite' is copied over the Ethernet header of a forwarded packet as is.
+ * ARP flags (SR_ARP_PERMANENT) are kept in arp_flags.  'seq' is odd while
+ * the adjacency is being rewritten.
+ *
+ * -------------------------------------------------------------------------- */
+
+struct sr_adj
+{
+    struct sr_ethernet_hdr rewrite;
+    uint8_t      flags;
+    uint8_t      arp_flags;
+    unsigned int ifindex;
+    uint32_t     nexthop;    /* network byte order */
+    uint32_t     stamp;      /* time() the neighbor was last confirmed */
+    uint32_t     seq;
+};
+
+struct sr_adj_index
+{
+    uint32_t       mask;      /* number of slots - 1 */
+    struct sr_adj* slots[1];  /* mask + 1 of them */
+};
+
+struct sr_adjtab
+{
+    struct sr_adj_index* index;
+    struct sr_epoch*     epoch;   /* outgrown indices are retired to */
+    uint32_t             used;
+};
+
+void sr_adj_init(struct sr_adjtab* tab, struct sr_epoch* epoch);
+struct sr_adj* sr_adj_find(struct sr_adjtab* tab, uint32_t nexthop);
+struct sr_adj* sr_adj_get(struct sr_adjtab* tab, uint32_t nexthop,
+                          const uint8_t* mac, const struct sr_if* iface,
+                          uint8_t arp_flags, time_t stamp);
+struct sr_adj* sr_adj_update(struct sr_adjtab* tab, uint32_t nexthop,
+                             const uint8_t* mac, const struct sr_if* iface,
+                             uint8_t arp_flags, time_t now);
+void sr_adj_expire(struct sr_adjtab* tab, const struct sr_fib* fib,
+                   time_t now);
+
+/*---------------------------------------------------------------------
+ * Method: sr_adj_usable(..)
+ *
+ * True if packets can be sent with the adjacency's rewrite, i.e. its
+ * neighbor is resolved and has not aged out of the ARP cache.
+ *
+ *---------------------------------------------------------------------*/
+
+static __inline__ int sr_adj_usable(const struct sr_adj* adj, time_t now)
+{
+    return adj &&
+           (__atomic_load_n(&adj->flags, __ATOMIC_ACQUIRE) & SR_ADJ_RESOLVED) &&
+           ((__atomic_load_n(&adj->arp_flags, __ATOMIC_RELAXED) &
+             SR_ARP_PERMANENT) ||
+            (uint32_t)now - __atomic_load_n(&adj->stamp, __ATOMIC_RELAXED) <=
+            SR_ARPCACHE_TIMEOUT);
+} /* -- sr_adj_usable -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_adj_rewrite(..)
+ *
+ * Copy the adjacency's Ethernet header to eth and return the interface
+ * to send out of, both from the same version of it.
+ *
+ *---------------------------------------------------------------------*/
+
+static __inline__ unsigned int sr_adj_rewrite(const struct sr_adj* adj,
+                                              struct sr_ethernet_hdr* eth)
+{
+    unsigned int ifindex;
+    uint32_t seq;
+
+    do
+    {
+        while((seq = __atomic_load_n(&adj->seq, __ATOMIC_ACQUIRE)) & 1)
+        { }
+        memcpy(eth, &adj->rewrite, sizeof(struct sr_ethernet_hdr));
+        ifindex = adj->ifindex;
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    } while(__atomic_load_n(&adj->seq, __ATOMIC_RELAXED) != seq);
+
+    return ifindex;
+} /* -- sr_adj_rewrite -- */
+
+#endif /* -- SR_ADJ_H -- */
@@ -0,0 +1,244 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_arpcache.c
+ *
+ * Description:
+ *
+ * Open addressing ARP cache, see sr_arpcache.h.  Slots are probed
+ * linearly from the hash of the address, and removal shifts later
+ * members of the probe run back so no tombstones are needed.  Entries
+ * that have aged out stay in place until they are refreshed, removed or
+ * swept by sr_arpcache_expire.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+
+#include "sr_arpcache.h"
+#include "sr_hash.h"
+
+static __inline__ int sr_arpcache_valid(const struct sr_arpentry* e,
+                                        time_t now)
+{
+    return (e->flags & SR_ARP_PERMANENT) ||
+           ((uint32_t)now - e->stamp <= SR_ARPCACHE_TIMEOUT);
+} /* -- sr_arpcache_valid -- */
+
+static void sr_arpcache_alloc(struct sr_arpcache* cache, uint32_t size)
+{
+    cache->slots = (struct sr_arpentry*)calloc(size,
+                                               sizeof(struct sr_arpentry));
+    assert(cache->slots);
+    cache->mask = size - 1;
+    cache->used = 0;
+} /* -- sr_arpcache_alloc -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_arpcache_find_slot(..)
+ * Scope:  Local
+ *
+ * Slot holding ip, or the free slot where it would go.
+ *
+ *---------------------------------------------------------------------*/
+
+static __inline__ struct sr_arpentry*
+sr_arpcache_find_slot(const struct sr_arpcache* cache, uint32_t ip)
+{
+    uint32_t i = sr_hash32(ip) & cache->mask;
+
+    while(cache->slots[i].ip != 0 && cache->slots[i].ip != ip)
+    { i = (i + 1) & cache->mask; }
+
+    return &cache->slots[i];
+} /* -- sr_arpcache_find_slot -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_arpcache_rehash(..)
+ * Scope:  Local
+ *
+ * Move the live entries into a fresh table, doubling it only if they
+ * would still fill more than a quarter of the current one.  Aged out
+ * entries are dropped on the way.
+ *
+ *---------------------------------------------------------------------*/
+
+static void sr_arpcache_rehash(struct sr_arpcache* cache, time_t now)
+{
+    struct sr_arpentry* old = cache->slots;
+    uint32_t old_size = cache->mask + 1;
+    uint32_t live = 0, size = old_size, i;
+
+    for(i = 0; i < old_size; ++i)
+    {
+        if(old[i].ip != 0 && sr_arpcache_valid(&old[i], now))
+        { ++live; }
+    }
+
+    if(live > old_size / 4)
+    { size = old_size * 2; }
+
+    sr_arpcache_alloc(cache, size);
+
+    for(i = 0; i < old_size; ++i)
+    {
+        if(old[i].ip != 0 && sr_arpcache_valid(&old[i], now))
+        {
+            *sr_arpcache_find_slot(cache, old[i].ip) = old[i];
+            ++cache->used;
+        }
+    }
+
+    free(old);
+} /* -- sr_arpcache_rehash -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_arpcache_init(..)
+ * Scope:  Global
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_arpcache_init(struct sr_arpcache* cache)
+{
+    /* -- REQUIRES -- */
+    assert(cache);
+
+    sr_arpcache_alloc(cache, SR_ARPCACHE_MIN_SIZE);
+} /* -- sr_arpcache_init -- */
+
+void sr_arpcache_destroy(struct sr_arpcache* cache)
+{
+    free(cache->slots);
+    cache->slots = 0;
+    cache->mask = cache->used = 0;
+} /* -- sr_arpcache_destroy -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_arpcache_lookup(..)
+ * Scope:  Global
+ *
+ * Return the entry for ip (network byte order) if it is present and has
+ * not aged out, otherwise 0.
+ *
+ *---------------------------------------------------------------------*/
+
+struct sr_arpentry* sr_arpcache_lookup(struct sr_arpcache* cache,
+                                       uint32_t ip, time_t now)
+{
+    struct sr_arpentry* e = 0;
+
+    if(ip == 0)
+    { return 0; }
+
+    e = sr_arpcache_find_slot(cache, ip);
+    if(e->ip == 0 || !sr_arpcache_valid(e, now))
+    { return 0; }
+
+    return e;
+} /* -- sr_arpcache_lookup -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_arpcache_insert(..)
+ * Scope:  Global
+ *
+ * Add or refresh the mapping for ip.  Returns the entry, which is only
+ * valid until the next insert or remove.
+ *
+ *---------------------------------------------------------------------*/
+
+struct sr_arpentry* sr_arpcache_insert(struct sr_arpcache* cache,
+                                       uint32_t ip, const uint8_t* mac,
+                                       unsigned int ifindex, uint8_t flags,
+                                       time_t now)
+{
+    struct sr_arpentry* e = 0;
+
+    /* -- REQUIRES -- */
+    assert(cache);
+    assert(mac);
+    assert(ifindex <= UINT8_MAX);
+
+    if(ip == 0)
+    { return 0; }
+
+    e = sr_arpcache_find_slot(cache, ip);
+    if(e->ip == 0)
+    {
+        /* -- keep the load factor under 1/2 -- */
+        if(cache->used + 1 > (cache->mask + 1) / 2)
+        {
+            sr_arpcache_rehash(cache, now);
+            e = sr_arpcache_find_slot(cache, ip);
+        }
+        e->ip = ip;
+        ++cache->used;
+    }
+
+    memcpy(e->mac, mac, ETHER_ADDR_LEN);
+    e->ifindex = ifindex;
+    e->flags   = flags;
+    e->stamp   = (uint32_t)now;
+
+    return e;
+} /* -- sr_arpcache_insert -- */
+
+static int sr_arpcache_key(const void* slot, uint32_t* k)
+{
+    *k = ((const struct sr_arpentry*)slot)->ip;
+    return *k != 0;
+} /* -- sr_arpcache_key -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_arpcache_remove(..)
+ * Scope:  Global
+ *
+ * Backward shift deletion, see sr_hash_remove.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_arpcache_remove(struct sr_arpcache* cache, uint32_t ip)
+{
+    struct sr_arpentry* e = 0;
+    uint32_t hole;
+
+    if(ip == 0)
+    { return; }
+
+    e = sr_arpcache_find_slot(cache, ip);
+    if(e->ip == 0)
+    { return; }
+
+    hole = sr_hash_remove(cache->slots, sizeof(struct sr_arpentry),
+                          cache->mask, e - cache->slots,
+                          sr_arpcache_key);
+
+    memset(&cache->slots[hole], 0, sizeof(struct sr_arpentry));
+    --cache->used;
+} /* -- sr_arpcache_remove -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_arpcache_expire(..)
+ * Scope:  Global
+ *
+ * Drop every entry that has aged out.  Lookups never return those
+ * anyway, this only gives their slots back; it is run off a timer rather
+ * than from the forwarding path.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_arpcache_expire(struct sr_arpcache* cache, time_t now)
+{
+    uint32_t i;
+
+    /* -- REQUIRES -- */
+    assert(cache);
+
+    for(i = 0; i <= cache->mask; ++i)
+    {
+        if(cache->slots[i].ip != 0 && !sr_arpcache_valid(&cache->slots[i], now))
+        {
+            sr_arpcache_rehash(cache, now);
+            return;
+        }
+    }
+} /* -- sr_arpcache_expire -- */
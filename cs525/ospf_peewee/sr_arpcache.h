@@ -0,0 +1,70 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_arpcache.h
+ *
+ * Description:
+ *
+ * ARP (neighbor) cache.  An open addressing hash table keyed by the
+ * neighbor's IPv4 address with linear probing.  Entries are 16 bytes so
+ * four share a cache line, and the table doubles whenever it gets half
+ * full so there is no fixed limit on the number of neighbors.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_ARPCACHE_H
+#define SR_ARPCACHE_H
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif /* _DARWIN_ */
+
+#include <time.h>
+
+#include "sr_protocol.h"
+
+#define SR_ARPCACHE_MIN_SIZE  256  /* initial slots, power of two */
+#define SR_ARPCACHE_TIMEOUT   15   /* seconds an entry stays valid */
+#define SR_ARPCACHE_SWEEP     1000 /* ms between sweeps for aged out entries */
+
+/* -- entry flags -- */
+#define SR_ARP_PERMANENT 0x01      /* never ages out */
+
+/* ----------------------------------------------------------------------------
+ * struct sr_arpentry
+ *
+ * A slot with ip == 0 is free.
+ *
+ * -------------------------------------------------------------------------- */
+
+struct sr_arpentry
+{
+    uint32_t ip;                    /* network byte order */
+    uint8_t  mac[ETHER_ADDR_LEN];
+    uint8_t  ifindex;               /* interface the neighbor is on, see
+                                       SR_IF_MAX */
+    uint8_t  flags;
+    uint32_t stamp;                 /* time() the entry was last confirmed */
+};
+
+struct sr_arpcache
+{
+    struct sr_arpentry* slots;
+    uint32_t            mask;       /* number of slots - 1 */
+    uint32_t            used;
+};
+
+void sr_arpcache_init(struct sr_arpcache* cache);
+void sr_arpcache_destroy(struct sr_arpcache* cache);
+struct sr_arpentry* sr_arpcache_lookup(struct sr_arpcache* cache,
+                                       uint32_t ip, time_t now);
+struct sr_arpentry* sr_arpcache_insert(struct sr_arpcache* cache,
+                                       uint32_t ip, const uint8_t* mac,
+                                       unsigned int ifindex, uint8_t flags,
+                                       time_t now);
+void sr_arpcache_remove(struct sr_arpcache* cache, uint32_t ip);
+void sr_arpcache_expire(struct sr_arpcache* cache, time_t now);
+
+#endif /* -- SR_ARPCACHE_H -- */
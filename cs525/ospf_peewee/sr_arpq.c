@@ -0,0 +1,312 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_arpq.c
+ *
+ * Description:
+ *
+ * Pending resolution queue, see sr_arpq.h.  The index probes linearly and
+ * deletes by backward shift (see sr_hash.h); requests and packets are
+ * allocated individually so the index can grow under them.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+
+#include "sr_arpq.h"
+#include "sr_hash.h"
+
+static __inline__ struct sr_arpq_req**
+sr_arpq_find_slot(const struct sr_arpq* q, uint32_t ip)
+{
+    uint32_t i = sr_hash32(ip) & q->mask;
+
+    while(q->slots[i] && q->slots[i]->ip != ip)
+    { i = (i + 1) & q->mask; }
+
+    return &q->slots[i];
+} /* -- sr_arpq_find_slot -- */
+
+static void sr_arpq_alloc(struct sr_arpq* q, uint32_t size)
+{
+    q->slots = (struct sr_arpq_req**)calloc(size, sizeof(struct sr_arpq_req*));
+    assert(q->slots);
+    q->mask = size - 1;
+} /* -- sr_arpq_alloc -- */
+
+static void sr_arpq_grow(struct sr_arpq* q)
+{
+    struct sr_arpq_req** old = q->slots;
+    uint32_t old_size = q->mask + 1, i;
+
+    sr_arpq_alloc(q, old_size * 2);
+
+    for(i = 0; i < old_size; ++i)
+    {
+        if(old[i])
+        { *sr_arpq_find_slot(q, old[i]->ip) = old[i]; }
+    }
+
+    free(old);
+} /* -- sr_arpq_grow -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_arpq_init(..)
+ * Scope:  Global
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_arpq_init(struct sr_arpq* q, struct sr_timer_wheel* timers)
+{
+    /* -- REQUIRES -- */
+    assert(q);
+    assert(timers);
+
+    sr_arpq_alloc(q, SR_ARPQ_MIN_SIZE);
+    q->used   = 0;
+    q->all    = 0;
+    q->ready  = 0;
+    q->timers = timers;
+} /* -- sr_arpq_init -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_arpq_find(..)
+ * Scope:  Global
+ *
+ * The request for next hop ip, or 0 if it isn't being resolved.
+ *
+ *---------------------------------------------------------------------*/
+
+struct sr_arpq_req* sr_arpq_find(struct sr_arpq* q, uint32_t ip)
+{
+    /* -- REQUIRES -- */
+    assert(q);
+
+    return *sr_arpq_find_slot(q, ip);
+} /* -- sr_arpq_find -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_arpq_new(..)
+ * Scope:  Global
+ *
+ * Start resolving ip, which must not have a request yet.  The caller
+ * sends the first ARP request and arms the retry timer.
+ *
+ *---------------------------------------------------------------------*/
+
+struct sr_arpq_req* sr_arpq_new(struct sr_arpq* q, uint32_t ip,
+                                uint32_t tries)
+{
+    struct sr_arpq_req** slot = 0;
+    struct sr_arpq_req*  req  = 0;
+
+    /* -- REQUIRES -- */
+    assert(q);
+
+    /* -- keep the load factor under 1/2 -- */
+    if(q->used + 1 > (q->mask + 1) / 2)
+    { sr_arpq_grow(q); }
+
+    slot = sr_arpq_find_slot(q, ip);
+    assert(*slot == 0);
+
+    req = (struct sr_arpq_req*)calloc(1, sizeof(struct sr_arpq_req));
+    assert(req);
+    req->ip    = ip;
+    req->tries = tries;
+    req->tail  = &req->head;
+
+    req->next = q->all;
+    if(q->all)
+    { q->all->prev = req; }
+    q->all = req;
+
+    *slot = req;
+    ++q->used;
+
+    return req;
+} /* -- sr_arpq_new -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_arpq_push(..)
+ * Scope:  Global
+ *
+ * Queue a copy of packet behind req.  Returns 1 if the oldest packet
+ * waiting had to be dropped to make room, see SR_ARPQ_MAX_PKTS.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_arpq_push(struct sr_arpq_req* req, const uint8_t* packet,
+                 unsigned int len, unsigned int ifindex)
+{
+    struct sr_arpq_pkt* pkt = 0;
+    int dropped = 0;
+
+    /* -- REQUIRES -- */
+    assert(req);
+    assert(packet);
+
+    if(req->npkts >= SR_ARPQ_MAX_PKTS)
+    {
+        pkt = req->head;
+        req->head = pkt->next;
+        if(req->head == 0)
+        { req->tail = &req->head; }
+        --req->npkts;
+        dropped = 1;
+
+        /* -- its copy is reused if the new packet fits -- */
+        if(pkt->len < len)
+        {
+            free(pkt);
+            pkt = 0;
+        }
+    }
+
+    if(pkt == 0)
+    {
+        pkt = (struct sr_arpq_pkt*)malloc(sizeof(struct sr_arpq_pkt) + len);
+        assert(pkt);
+    }
+    pkt->next    = 0;
+    pkt->packet  = (uint8_t*)(pkt + 1);
+    pkt->len     = len;
+    pkt->ifindex = ifindex;
+    memcpy(pkt->packet, packet, len);
+
+    *req->tail = pkt;
+    req->tail  = &pkt->next;
+    ++req->npkts;
+
+    return dropped;
+} /* -- sr_arpq_push -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_arpq_resolved(..)
+ * Scope:  Global
+ *
+ * ARP has heard from ip; if anything waits on it, mark its request to
+ * be released by the next sr_arpq_pop_ready.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_arpq_resolved(struct sr_arpq* q, uint32_t ip)
+{
+    struct sr_arpq_req* req = 0;
+
+    /* -- REQUIRES -- */
+    assert(q);
+
+    req = *sr_arpq_find_slot(q, ip);
+    if(req == 0 || req->resolved)
+    { return; }
+
+    sr_timer_cancel(q->timers, &req->timer);
+
+    req->resolved   = 1;
+    req->ready_next = q->ready;
+    q->ready        = req;
+} /* -- sr_arpq_resolved -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_arpq_pop_ready(..)
+ * Scope:  Global
+ *
+ * Take a resolved request off the queue, or return 0 if there are none.
+ * The caller owns the request and its packets; see sr_arpq_free.
+ *
+ *---------------------------------------------------------------------*/
+
+struct sr_arpq_req* sr_arpq_pop_ready(struct sr_arpq* q)
+{
+    struct sr_arpq_req* req = 0;
+
+    /* -- REQUIRES -- */
+    assert(q);
+
+    req = q->ready;
+    if(req == 0)
+    { return 0; }
+
+    q->ready = req->ready_next;
+    req->resolved = 0;
+    sr_arpq_remove(q, req);
+
+    return req;
+} /* -- sr_arpq_pop_ready -- */
+
+static int sr_arpq_key(const void* slot, uint32_t* k)
+{
+    const struct sr_arpq_req* req = *(struct sr_arpq_req* const*)slot;
+
+    if(req == 0)
+    { return 0; }
+
+    *k = req->ip;
+    return 1;
+} /* -- sr_arpq_key -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_arpq_remove(..)
+ * Scope:  Global
+ *
+ * Unlink req from the queue and stop its timer, without freeing it.
+ * Must not be called on a request that is waiting to be popped as ready.
+ *
+ * The index slot is emptied by backward shift, see sr_hash_remove.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_arpq_remove(struct sr_arpq* q, struct sr_arpq_req* req)
+{
+    struct sr_arpq_req** slot = 0;
+    uint32_t hole;
+
+    /* -- REQUIRES -- */
+    assert(q);
+    assert(req);
+    assert(!req->resolved);
+
+    sr_timer_cancel(q->timers, &req->timer);
+
+    if(req->prev)
+    { req->prev->next = req->next; }
+    else
+    { q->all = req->next; }
+    if(req->next)
+    { req->next->prev = req->prev; }
+    req->prev = req->next = 0;
+
+    slot = sr_arpq_find_slot(q, req->ip);
+    assert(*slot == req);
+
+    hole = sr_hash_remove(q->slots, sizeof(struct sr_arpq_req*), q->mask,
+                          slot - q->slots, sr_arpq_key);
+    q->slots[hole] = 0;
+    --q->used;
+} /* -- sr_arpq_remove -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_arpq_free(..)
+ * Scope:  Global
+ *
+ * Free a removed request and any packets still on it.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_arpq_free(struct sr_arpq_req* req)
+{
+    struct sr_arpq_pkt* pkt = 0;
+
+    if(req == 0)
+    { return; }
+
+    while(req->head)
+    {
+        pkt = req->head;
+        req->head = pkt->next;
+        free(pkt);
+    }
+
+    free(req);
+} /* -- sr_arpq_free -- */
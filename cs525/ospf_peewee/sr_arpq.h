@@ -0,0 +1,99 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_arpq.h
+ *
+ * Description:
+ *
+ * Packets waiting for ARP.  Every next hop being resolved has one request,
+ * found through an open addressing hash keyed by its address, holding the
+ * packets waiting on it in arrival order.  Queueing a packet, finding the
+ * packets to release when the neighbor answers and dropping a request are
+ * all constant time.  Each request carries the timer that drives its
+ * retries, see sr_timer.h.
+ *
+ * A request holds at most SR_ARPQ_MAX_PKTS packets (Linux's unres_qlen);
+ * past that the oldest is dropped for the newest, so a flood towards a
+ * neighbor that doesn't answer costs a few frames rather than memory
+ * without bound.
+ *
+ * Only the thread handling packets touches the queue.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_ARPQ_H
+#define SR_ARPQ_H
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif /* _DARWIN_ */
+
+#include "sr_timer.h"
+
+#define SR_ARPQ_MIN_SIZE  64   /* initial slots, power of two */
+#define SR_ARPQ_MAX_PKTS  3    /* packets waiting on one next hop */
+
+/* ----------------------------------------------------------------------------
+ * struct sr_arpq_pkt
+ *
+ * A queued copy of a packet; the frame follows the struct in the same
+ * allocation.
+ *
+ * -------------------------------------------------------------------------- */
+
+struct sr_arpq_pkt
+{
+    struct sr_arpq_pkt* next;
+    uint8_t*            packet;
+    unsigned int        len;
+    unsigned int        ifindex;  /* interface it was received on */
+};
+
+/* ----------------------------------------------------------------------------
+ * struct sr_arpq_req
+ *
+ * An outstanding resolution.  'all' links every request; 'ready_next'
+ * links the ones resolved since the queue was last drained.  The owner
+ * sets up and arms 'timer'; it is cancelled when the request is removed
+ * or resolved.
+ *
+ * -------------------------------------------------------------------------- */
+
+struct sr_arpq_req
+{
+    uint32_t             ip;       /* next hop, network byte order */
+    uint32_t             tries;    /* ARP requests left before giving up */
+    struct sr_timer      timer;
+    uint8_t              resolved;
+    struct sr_arpq_pkt*  head;
+    struct sr_arpq_pkt** tail;
+    unsigned int         npkts;
+    struct sr_arpq_req*  prev;
+    struct sr_arpq_req*  next;
+    struct sr_arpq_req*  ready_next;
+};
+
+struct sr_arpq
+{
+    struct sr_arpq_req**   slots;
+    uint32_t               mask;    /* number of slots - 1 */
+    uint32_t               used;
+    struct sr_arpq_req*    all;
+    struct sr_arpq_req*    ready;
+    struct sr_timer_wheel* timers;  /* runs the requests' timers */
+};
+
+void sr_arpq_init(struct sr_arpq* q, struct sr_timer_wheel* timers);
+struct sr_arpq_req* sr_arpq_find(struct sr_arpq* q, uint32_t ip);
+struct sr_arpq_req* sr_arpq_new(struct sr_arpq* q, uint32_t ip,
+                                uint32_t tries);
+int  sr_arpq_push(struct sr_arpq_req* req, const uint8_t* packet,
+                  unsigned int len, unsigned int ifindex);
+void sr_arpq_resolved(struct sr_arpq* q, uint32_t ip);
+struct sr_arpq_req* sr_arpq_pop_ready(struct sr_arpq* q);
+void sr_arpq_remove(struct sr_arpq* q, struct sr_arpq_req* req);
+void sr_arpq_free(struct sr_arpq_req* req);
+
+#endif /* -- SR_ARPQ_H -- */
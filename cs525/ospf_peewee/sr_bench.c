@@ -0,0 +1,652 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_bench.c
+ *
+ * Description:
+ *
+ * Per packet cost of the router's main paths.  The router core is linked
+ * against a stub sr_send_packet that only counts, a three interface router
+ * is set up in memory and synthetic frames are pushed through
+ * sr_handlepackets a vector at a time:
+ *
+ *   icmp-echo       echo request to one of our addresses
+ *   udp-transit     UDP through us, next hop in the ARP cache
+ *   tcp-transit     the same for TCP
+ *   transit-miss    UDP through us to a next hop that never answers ARP;
+ *                   the queue is emptied every SR_BENCH_MISS_ROUND packets
+ *   ttl-expiry      transit with TTL 1, answered with time exceeded
+ *   ttl-limited     the same, with the default ICMP error limits (see
+ *                   sr_icmp.h), so almost all are suppressed; the other
+ *                   paths run without limits
+ *   arp-request     who-has for one of our addresses
+ *   arp-reply       is-at from a neighbor we already know
+ *   pwospf-hello    hello from an established neighbor
+ *   pwospf-lsu      LSU with a new sequence number, so a flood to the
+ *                   other neighbor every time; the route it carries only
+ *                   changes (and rebuilds the FIB) the first time
+ *
+ * Frames are rebuilt from a template before each vector, outside the
+ * timed part.  For each path it reports ns/packet, packets/s, heap
+ * allocations/packet (Linux, through ld --wrap) and frames sent/packet;
+ * the last is checked, so a path that stopped doing what it is meant to
+ * fails the run.  -c appends the results to a CSV file, one row per path,
+ * labelled with -l (make bench uses the commit), so runs of different
+ * commits can be put side by side:
+ *
+ *   make bench BENCH_ARGS="-c bench.csv"
+ *
+ * -H runs with the latency histograms on (see sr_hist.h), to see what
+ * they cost, and prints them after the table.
+ *
+ * PWOSPF runs from the timer wheel (as with sr -e) and the wheel is never
+ * advanced, so no ARP retries or hellos of our own happen while timing.
+ * What the router prints on stdout goes to /dev/null, its cost included.
+ *
+ *---------------------------------------------------------------------------*/
+
+#define _DEFAULT_SOURCE  /* clock_gettime under -ansi */
+#define _BSD_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#ifdef _LINUX_
+#include <getopt.h>
+#endif /* _LINUX_ */
+
+#include "sr_router.h"
+#include "sr_if.h"
+#include "sr_rt.h"
+#include "sr_cksum.h"
+#include "sr_graph.h"
+#include "sr_arpq.h"
+#include "sr_epoch.h"
+#include "sr_hist.h"
+#include "sr_icmp.h"
+#include "pwospf_protocol.h"
+
+extern char* optarg;
+extern struct sr_arpcache arpcache;  /* sr_router.c */
+
+#define SR_BENCH_PACKETS    1000000
+#define SR_BENCH_LSU_MAX    59000   /* LSU sequence numbers are 16 bits */
+#define SR_BENCH_MISS_ROUND 1024
+#define SR_BENCH_FRAME_MAX  128
+#define SR_BENCH_NS         1000000000ULL
+
+/* -- the router: eth0 10.0.1.1/24, eth1 10.0.2.1/24, eth2 10.0.3.1/24 -- */
+#define BENCH_HOST     "10.0.1.100"  /* sender, on eth0 */
+#define BENCH_NBR1     "10.0.2.2"    /* PWOSPF neighbor on eth1, resolved */
+#define BENCH_NBR2     "10.0.3.2"    /* PWOSPF neighbor on eth2 */
+#define BENCH_DEAD     "10.0.3.3"    /* next hop that never answers */
+#define BENCH_FAR      "192.168.1.1" /* routed via NBR1 */
+#define BENCH_NOWHERE  "172.16.1.1"  /* routed via DEAD */
+
+static const uint8_t bench_bcast[6] = { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff };
+
+/* ----------------------------------------------------------------------------
+ * struct sr_bench_path
+ *
+ * 'build' writes packet i of the path into frame and returns its length;
+ * 'sends' is the number of frames the router should send per packet, or
+ * a negative number if it isn't fixed.  'limited' runs it with the
+ * default ICMP error limits.
+ *
+ * -------------------------------------------------------------------------- */
+
+struct sr_bench_path
+{
+    const char*  name;
+    unsigned int (*build)(uint8_t* frame, unsigned int i);
+    unsigned int ifindex;   /* received on */
+    double       sends;
+    unsigned int max;       /* packets at most, 0 for no limit */
+    int          limited;
+};
+
+static uint64_t bench_sent   = 0;
+static uint64_t bench_allocs = 0;
+
+/*---------------------------------------------------------------------
+ * Heap allocations made by the router, counted through
+ * -Wl,--wrap=malloc and friends (see the Makefile).
+ *---------------------------------------------------------------------*/
+
+#ifdef SR_BENCH_ALLOCS
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t n, size_t size);
+void* __real_realloc(void* ptr, size_t size);
+
+void* __wrap_malloc(size_t size)
+{ ++bench_allocs; return __real_malloc(size); }
+
+void* __wrap_calloc(size_t n, size_t size)
+{ ++bench_allocs; return __real_calloc(n, size); }
+
+void* __wrap_realloc(void* ptr, size_t size)
+{ ++bench_allocs; return __real_realloc(ptr, size); }
+#endif /* SR_BENCH_ALLOCS */
+
+/*---------------------------------------------------------------------
+ * Method: sr_send_packet(..)
+ * Scope:  Global
+ *
+ * Stands in for the one in sr_vns_comm.c: the same checks, then count.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_send_packet(struct sr_instance* sr, uint8_t* buf, unsigned int len,
+                   unsigned int ifindex)
+{
+    /* REQUIRES */
+    assert(sr);
+    assert(buf);
+
+    if(sr_get_interface_by_index(sr, ifindex) == 0 ||
+       len < sizeof(struct sr_ethernet_hdr))
+    { return -1; }
+
+    ++bench_sent;
+    return 0;
+} /* -- sr_send_packet -- */
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * SR_BENCH_NS + ts.tv_nsec;
+} /* -- now_ns -- */
+
+static uint32_t ip_of(const char* s)
+{
+    struct in_addr in;
+
+    inet_aton(s, &in);
+    return in.s_addr;
+} /* -- ip_of -- */
+
+static void mac_of(uint8_t* mac, uint8_t host, uint8_t n)
+{
+    static const uint8_t base[6] = { 0x02, 0, 0, 0, 0, 0 };
+
+    memcpy(mac, base, 6);
+    mac[4] = host;   /* 0 for the router, 1 for everybody else */
+    mac[5] = n;
+} /* -- mac_of -- */
+
+/*---------------------------------------------------------------------
+ * Frame building.
+ *---------------------------------------------------------------------*/
+
+#define ETH_LEN  sizeof(struct sr_ethernet_hdr)
+#define IP_LEN   sizeof(struct ip)
+#define OSPF_LEN sizeof(struct ospfv2_hdr)
+
+static void build_eth(uint8_t* frame, const uint8_t* dst, const uint8_t* src,
+                      uint16_t type)
+{
+    struct sr_ethernet_hdr* eth = (struct sr_ethernet_hdr*)frame;
+
+    memcpy(eth->ether_dhost, dst, 6);
+    memcpy(eth->ether_shost, src, 6);
+    eth->ether_type = htons(type);
+} /* -- build_eth -- */
+
+/* -- an IP packet from a host on ifindex n, len bytes in all -- */
+static struct ip* build_ip(uint8_t* frame, unsigned int n, unsigned int len,
+                           uint8_t proto, const char* src, const char* dst,
+                           uint8_t ttl)
+{
+    struct ip* iphdr = (struct ip*)(frame + ETH_LEN);
+    uint8_t router[6], host[6];
+
+    mac_of(router, 0, n);
+    mac_of(host, 1, n);
+    build_eth(frame, router, host, ETHERTYPE_IP);
+
+    memset(iphdr, 0, IP_LEN);
+    iphdr->ip_v   = 4;
+    iphdr->ip_hl  = IP_LEN / 4;
+    iphdr->ip_len = htons(len - ETH_LEN);
+    iphdr->ip_ttl = ttl;
+    iphdr->ip_p   = proto;
+    iphdr->ip_src.s_addr = ip_of(src);
+    iphdr->ip_dst.s_addr = ip_of(dst);
+    iphdr->ip_sum = sr_cksum(iphdr, IP_LEN);
+
+    return iphdr;
+} /* -- build_ip -- */
+
+static unsigned int build_echo(uint8_t* frame, unsigned int i)
+{
+    unsigned int len = 98;  /* ping's default */
+    uint8_t* icmp = frame + ETH_LEN + IP_LEN;
+
+    build_ip(frame, 0, len, IPPROTO_ICMP, BENCH_HOST, "10.0.1.1", 64);
+    memset(icmp, 0, len - ETH_LEN - IP_LEN);
+    icmp[0] = ECHO_REQUEST;
+    icmp[6] = (uint8_t)(i >> 8);
+    icmp[7] = (uint8_t)i;
+    *(uint16_t*)(icmp + 2) = sr_cksum(icmp, len - ETH_LEN - IP_LEN);
+
+    return len;
+} /* -- build_echo -- */
+
+static unsigned int build_l4(uint8_t* frame, uint8_t proto, const char* dst,
+                             uint8_t ttl)
+{
+    unsigned int len = 64;
+    uint8_t* l4 = frame + ETH_LEN + IP_LEN;
+
+    build_ip(frame, 0, len, proto, BENCH_HOST, dst, ttl);
+    memset(l4, 0, len - ETH_LEN - IP_LEN);
+    *(uint16_t*)l4       = htons(40000);
+    *(uint16_t*)(l4 + 2) = htons(5001);
+
+    return len;
+} /* -- build_l4 -- */
+
+static unsigned int build_udp(uint8_t* frame, unsigned int i)
+{ return build_l4(frame, UDP_PROTOCOL, BENCH_FAR, 64); }
+
+static unsigned int build_tcp(uint8_t* frame, unsigned int i)
+{ return build_l4(frame, TCP_PROTOCOL, BENCH_FAR, 64); }
+
+static unsigned int build_miss(uint8_t* frame, unsigned int i)
+{ return build_l4(frame, UDP_PROTOCOL, BENCH_NOWHERE, 64); }
+
+static unsigned int build_expiry(uint8_t* frame, unsigned int i)
+{ return build_l4(frame, UDP_PROTOCOL, BENCH_FAR, 1); }
+
+static unsigned int build_arp(uint8_t* frame, unsigned int n, uint16_t op,
+                              const char* sip, const char* tip)
+{
+    struct sr_arphdr* arp = (struct sr_arphdr*)(frame + ETH_LEN);
+    uint8_t router[6], host[6];
+
+    mac_of(router, 0, n);
+    mac_of(host, 1, n);
+    build_eth(frame, op == ARP_REQUEST ? bench_bcast : router, host,
+              ETHERTYPE_ARP);
+
+    arp->ar_hrd = htons(ARPHDR_ETHER);
+    arp->ar_pro = htons(ETHERTYPE_IP);
+    arp->ar_hln = 6;
+    arp->ar_pln = 4;
+    arp->ar_op  = htons(op);
+    memcpy(arp->ar_sha, host, 6);
+    arp->ar_sip = ip_of(sip);
+    memcpy(arp->ar_tha, op == ARP_REQUEST ? bench_bcast : router, 6);
+    arp->ar_tip = ip_of(tip);
+
+    return ETH_LEN + sizeof(struct sr_arphdr);
+} /* -- build_arp -- */
+
+static unsigned int build_arp_request(uint8_t* frame, unsigned int i)
+{ return build_arp(frame, 0, ARP_REQUEST, BENCH_HOST, "10.0.1.1"); }
+
+static unsigned int build_arp_reply(uint8_t* frame, unsigned int i)
+{ return build_arp(frame, 1, ARP_REPLY, BENCH_NBR1, "10.0.2.1"); }
+
+/* -- PWOSPF from the neighbor 'nbr' on ifindex n, body already in place -- */
+static void build_ospf(uint8_t* frame, unsigned int n, unsigned int len,
+                       uint8_t type, const char* nbr)
+{
+    struct ospfv2_hdr* ospf = (struct ospfv2_hdr*)(frame + ETH_LEN + IP_LEN);
+
+    build_ip(frame, n, len, OSPF_TYPE, nbr, "224.0.0.5", DEFAULT_TTL);
+
+    ospf->version = OSPF_V2;
+    ospf->type    = type;
+    ospf->len     = htons(len - ETH_LEN - IP_LEN);
+    ospf->rid     = ip_of(nbr);
+    ospf->aid     = htonl(10);  /* the first octet of our addresses */
+    ospf->csum    = 0;
+    ospf->autype  = 0;
+    ospf->audata  = 0;
+    ospf->csum    = sr_cksum(ospf, len - ETH_LEN - IP_LEN);
+} /* -- build_ospf -- */
+
+static unsigned int build_hello_from(uint8_t* frame, unsigned int n,
+                                     const char* nbr)
+{
+    struct ospfv2_hello_hdr* hello =
+        (struct ospfv2_hello_hdr*)(frame + ETH_LEN + IP_LEN + OSPF_LEN);
+    unsigned int len = ETH_LEN + IP_LEN + OSPF_LEN + sizeof(*hello);
+
+    hello->nmask    = ip_of("255.255.255.0");
+    hello->helloint = htons(OSPF_DEFAULT_HELLOINT);
+    hello->padding  = 0;
+    build_ospf(frame, n, len, OSPF_TYPE_HELLO, nbr);
+
+    return len;
+} /* -- build_hello_from -- */
+
+static unsigned int build_hello(uint8_t* frame, unsigned int i)
+{ return build_hello_from(frame, 1, BENCH_NBR1); }
+
+static unsigned int build_lsu(uint8_t* frame, unsigned int i)
+{
+    struct ospfv2_lsu_hdr* hdr =
+        (struct ospfv2_lsu_hdr*)(frame + ETH_LEN + IP_LEN + OSPF_LEN);
+    struct ospfv2_lsu* adv = (struct ospfv2_lsu*)(hdr + 1);
+    unsigned int len = ETH_LEN + IP_LEN + OSPF_LEN + sizeof(*hdr) +
+                       sizeof(*adv);
+
+    hdr->seq     = htons((uint16_t)(i + 1));  /* always news */
+    hdr->unused  = 0;
+    hdr->ttl     = 64;
+    hdr->num_adv = htonl(1);
+    adv->subnet  = ip_of("192.168.0.0");
+    adv->mask    = ip_of("255.255.0.0");
+    adv->rid     = ip_of(BENCH_NBR1);
+    build_ospf(frame, 1, len, OSPF_TYPE_LSU, BENCH_NBR1);
+
+    return len;
+} /* -- build_lsu -- */
+
+static const struct sr_bench_path bench_paths[] =
+{
+    { "icmp-echo",    build_echo,        0,  1, 0, 0 },
+    { "udp-transit",  build_udp,         0,  1, 0, 0 },
+    { "tcp-transit",  build_tcp,         0,  1, 0, 0 },
+    { "transit-miss", build_miss,        0, -1, 0, 0 },
+    { "ttl-expiry",   build_expiry,      0,  1, 0, 0 },
+    { "ttl-limited",  build_expiry,      0, -1, 0, 1 },
+    { "arp-request",  build_arp_request, 0,  1, 0, 0 },
+    { "arp-reply",    build_arp_reply,   1,  0, 0, 0 },
+    { "pwospf-hello", build_hello,       1,  0, 0, 0 },
+    { "pwospf-lsu",   build_lsu,         1,  1, SR_BENCH_LSU_MAX, 0 },
+    { 0, 0, 0, 0, 0, 0 }
+};
+
+/*---------------------------------------------------------------------
+ * Method: bench_router(..)
+ * Scope:  Local
+ *
+ * The router under test, with its neighbors known the way they would
+ * be after a while of running.
+ *
+ *---------------------------------------------------------------------*/
+
+static void bench_router(struct sr_instance* sr)
+{
+    static const char* names[3] = { "eth0", "eth1", "eth2" };
+    static const char* ips[3]   = { "10.0.1.1", "10.0.2.1", "10.0.3.1" };
+    uint8_t frame[SR_BENCH_FRAME_MAX], mac[6];
+    struct in_addr dest, gw, mask;
+    struct sr_pkt pkt;
+    unsigned int i;
+
+    memset(sr, 0, sizeof(struct sr_instance));
+    sr->sockfd     = -1;
+    sr->event_loop = 1;
+    sr_init(sr);
+
+    for(i = 0; i < 3; ++i)
+    {
+        mac_of(mac, 0, i);
+        sr_add_interface(sr, names[i]);
+        sr_set_ether_addr(sr, mac);
+        sr_set_ether_ip(sr, ip_of(ips[i]));
+        sr_set_ether_mask(sr, ip_of("255.255.255.0"));
+    }
+
+    dest.s_addr = 0;
+    gw.s_addr   = ip_of("10.0.1.2");
+    mask.s_addr = 0;
+    sr_add_rt_entry(sr, dest, gw, mask, "eth0");
+    dest.s_addr = ip_of("192.168.0.0");
+    gw.s_addr   = ip_of(BENCH_NBR1);
+    mask.s_addr = ip_of("255.255.0.0");
+    sr_add_rt_entry(sr, dest, gw, mask, "eth1");
+    dest.s_addr = ip_of("172.16.0.0");
+    gw.s_addr   = ip_of(BENCH_DEAD);
+    mask.s_addr = ip_of("255.240.0.0");
+    sr_add_rt_entry(sr, dest, gw, mask, "eth2");
+    sr->hw_init = 1;
+
+    /* -- hellos from both neighbors, so LSUs from one flood to the other -- */
+    pkt.ifindex = 1;
+    pkt.buf     = frame;
+    pkt.len     = build_hello_from(frame, 1, BENCH_NBR1);
+    sr_handlepackets(sr, &pkt, 1);
+    pkt.ifindex = 2;
+    pkt.len     = build_hello_from(frame, 2, BENCH_NBR2);
+    sr_handlepackets(sr, &pkt, 1);
+
+    /* -- and the host on eth0 -- */
+    mac_of(mac, 1, 0);
+    addToArpcache(ip_of(BENCH_HOST), mac, &arpcache, sr, 0);
+} /* -- bench_router -- */
+
+/*---------------------------------------------------------------------
+ * Method: bench_fresh(..)
+ * Scope:  Local
+ *
+ * Before each path and between rounds: neighbors heard from just now,
+ * nothing waiting for ARP.
+ *
+ *---------------------------------------------------------------------*/
+
+static void bench_fresh(struct sr_instance* sr)
+{
+    struct sr_arpq_req* req = 0;
+    uint8_t mac[6];
+
+    mac_of(mac, 1, 1);
+    addToArpcache(ip_of(BENCH_NBR1), mac, &arpcache, sr, 1);
+
+    if((req = sr_arpq_find(sr->arpq, ip_of(BENCH_DEAD))) != 0)
+    {
+        sr_arpq_remove(sr->arpq, req);
+        sr_arpq_free(req);
+    }
+} /* -- bench_fresh -- */
+
+/*---------------------------------------------------------------------
+ * Method: bench_run(..)
+ * Scope:  Local
+ *
+ * Push packets first to first + npkts - 1 of the path through in
+ * vectors of batch.  Returns the ns spent in the router; *allocs and
+ * *sent get what it did.
+ *
+ *---------------------------------------------------------------------*/
+
+static uint64_t bench_run(struct sr_instance* sr,
+                          const struct sr_bench_path* path,
+                          unsigned int first, unsigned int npkts,
+                          unsigned int batch, uint64_t* allocs,
+                          uint64_t* sent)
+{
+    static uint8_t frames[SR_VECTOR_SIZE][SR_BENCH_FRAME_MAX];
+    struct sr_pkt pkts[SR_VECTOR_SIZE];
+    uint64_t ns = 0, a0, s0, t0;
+    unsigned int done, n, i, since = 0;
+
+    *allocs = 0;
+    *sent   = 0;
+    bench_fresh(sr);
+
+    for(done = 0; done < npkts; done += n)
+    {
+        n = npkts - done < batch ? npkts - done : batch;
+        for(i = 0; i < n; ++i)
+        {
+            pkts[i].buf     = frames[i];
+            pkts[i].len     = path->build(frames[i], first + done + i);
+            pkts[i].ifindex = path->ifindex;
+        }
+
+        a0 = bench_allocs;
+        s0 = bench_sent;
+        t0 = now_ns();
+
+        sr_handlepackets(sr, pkts, n);
+        /* -- a quiescent point for sr_epoch.h, as in the receive loop -- */
+        sr_epoch_exit(sr->reader);
+        sr_epoch_enter(sr->epoch, sr->reader);
+
+        ns      += now_ns() - t0;
+        *allocs += bench_allocs - a0;
+        *sent   += bench_sent - s0;
+
+        if((since += n) >= SR_BENCH_MISS_ROUND)
+        {
+            bench_fresh(sr);
+            since = 0;
+        }
+    }
+
+    return ns;
+} /* -- bench_run -- */
+
+/*-----------------------------------------------------------------------------
+ *---------------------------------------------------------------------------*/
+
+int main(int argc, char **argv)
+{
+    int c;
+    unsigned int npkts = SR_BENCH_PACKETS;
+    unsigned int batch = SR_VECTOR_SIZE;
+    char *only = 0;
+    char *csv = 0;
+    char *label = "-";
+    struct sr_instance sr;
+    const struct sr_bench_path* path = 0;
+    uint64_t ns, allocs, sent;
+    unsigned int n;
+    FILE* out = 0;
+    FILE* report = 0;
+    int bad = 0;
+    int hist = 0;
+    struct sr_icmp_limits unlimited = { 0, 0, 0, 0 };
+
+    while ((c = getopt(argc, argv, "hn:b:p:c:l:H")) != EOF)
+    {
+        switch (c)
+        {
+            case 'n':
+                npkts = atoi((char *) optarg);
+                break;
+            case 'b':
+                batch = atoi((char *) optarg);
+                break;
+            case 'p':
+                only = optarg;
+                break;
+            case 'c':
+                csv = optarg;
+                break;
+            case 'l':
+                label = optarg;
+                break;
+            case 'H':
+                hist = 1;
+                break;
+            default:
+                printf("Format: %s [-n packets per path] [-b vector size] "
+                       "[-p path] [-c csv file] [-l label] [-H]\n", argv[0]);
+                exit(c == 'h' ? 0 : 1);
+        } /* switch */
+    } /* -- while -- */
+
+    if(npkts == 0 || batch == 0 || batch > SR_VECTOR_SIZE)
+    {
+        fprintf(stderr, "sr_bench: need packets > 0 and 0 < vector size "
+                "<= %d\n", SR_VECTOR_SIZE);
+        exit(1);
+    }
+
+    if(csv)
+    {
+        if((out = fopen(csv, "a")) == 0)
+        {
+            perror(csv);
+            exit(1);
+        }
+        if(ftell(out) == 0)
+        {
+            fprintf(out, "label,path,packets,vector,ns_per_packet,"
+                    "packets_per_sec,allocs_per_packet,sends_per_packet\n");
+        }
+    }
+
+    /* -- the results keep stdout, the router's chatter doesn't -- */
+    report = fdopen(dup(STDOUT_FILENO), "w");
+    if(report == 0 || freopen("/dev/null", "w", stdout) == 0)
+    {
+        perror("sr_bench: stdout");
+        exit(1);
+    }
+
+    sr_cksum_init();
+    bench_router(&sr);
+
+    if(hist)
+    { sr_hist_enable(1); }
+
+    fprintf(report, "%-14s %10s %10s %12s %12s %12s\n", "path", "packets",
+            "ns/pkt", "pkts/s", "allocs/pkt", "sends/pkt");
+
+    for(path = bench_paths; path->name; ++path)
+    {
+        if(only && strcmp(only, path->name) != 0)
+        { continue; }
+
+        n = path->max && npkts > path->max ? path->max : npkts;
+
+        sr_icmp_destroy(sr.icmp);
+        sr.icmp = sr_icmp_create(path->limited ? 0 : &unlimited);
+
+        /* -- warm the caches and the allocator first -- */
+        bench_run(&sr, path, 0, n / 10 + 1, batch, &allocs, &sent);
+        ns = bench_run(&sr, path, n / 10 + 1, n, batch, &allocs, &sent);
+
+        fprintf(report, "%-14s %10u %10.1f %12.0f ", path->name, n,
+                (double)ns / n, ns ? n * (double)SR_BENCH_NS / ns : 0.0);
+#ifdef SR_BENCH_ALLOCS
+        fprintf(report, "%12.3f ", (double)allocs / n);
+#else
+        fprintf(report, "%12s ", "n/a");
+#endif /* SR_BENCH_ALLOCS */
+        fprintf(report, "%12.3f", (double)sent / n);
+
+        if(path->sends >= 0 && sent != (uint64_t)(path->sends * n))
+        {
+            fprintf(report, "   UNEXPECTED, should be %.3f", path->sends);
+            bad = 1;
+        }
+        fprintf(report, "\n");
+        fflush(report);
+
+        if(out)
+        {
+            fprintf(out, "%s,%s,%u,%u,%.1f,%.0f,", label, path->name, n, batch,
+                    (double)ns / n, ns ? n * (double)SR_BENCH_NS / ns : 0.0);
+#ifdef SR_BENCH_ALLOCS
+            fprintf(out, "%.3f,", (double)allocs / n);
+#else
+            fprintf(out, ",");
+#endif /* SR_BENCH_ALLOCS */
+            fprintf(out, "%.3f\n", (double)sent / n);
+        }
+    }
+
+    if(out)
+    { fclose(out); }
+
+    if(hist)
+    { sr_hist_print_stats(report); }
+
+    return bad;
+} /* -- main -- */
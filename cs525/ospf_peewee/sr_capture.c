@@ -0,0 +1,612 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_capture.c
+ *
+ * Description:
+ *
+ * Asynchronous packet capture, see sr_capture.h.
+ *
+ * The ring is the bounded queue of D. Vyukov.  Slot i starts with seq i.
+ * A producer at enqueue position pos may fill slot pos & mask once its
+ * seq equals pos, and marks it full by setting seq to pos + 1; the
+ * writer empties it and sets seq to pos + SR_CAPTURE_SLOTS, which is
+ * where the producer one lap later expects it.  A seq behind pos means
+ * the ring is full.
+ *
+ * Only the writer thread touches the file.  Files are opened, given
+ * their header and rotated there, between packets.
+ *
+ *---------------------------------------------------------------------------*/
+
+#define _DEFAULT_SOURCE  /* usleep and clock_gettime under -ansi */
+#define _BSD_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sched.h>
+
+#include "sr_capture.h"
+
+#define SR_CAPTURE_NS 1000000000ULL
+
+/*---------------------------------------------------------------------
+ * Method: sr_capture_write(..)
+ * Scope:  Local
+ *
+ * Write out the buffer.  A failed write, or no file to write to, loses
+ * what was in it.
+ *
+ *---------------------------------------------------------------------*/
+
+static void sr_capture_write(struct sr_capture* cap)
+{
+    unsigned int off = 0;
+    ssize_t ret;
+
+    while(off < cap->len)
+    {
+        ++cap->writes;
+        if((ret = write(cap->fd, cap->buf + off, cap->len - off)) == -1)
+        {
+            if(errno == EINTR)
+            { continue; }
+            ++cap->errors;
+            break;
+        }
+        off += ret;
+        cap->bytes += ret;
+    }
+
+    cap->len = 0;
+} /* -- sr_capture_write -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_capture_room(..)
+ * Scope:  Local
+ *
+ * Make room for size more bytes in the buffer.
+ *
+ *---------------------------------------------------------------------*/
+
+static __inline__ void sr_capture_room(struct sr_capture* cap,
+                                       unsigned int size)
+{
+    if(cap->len + size > SR_CAPTURE_BUF_SIZE)
+    { sr_capture_write(cap); }
+} /* -- sr_capture_room -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_capture_idbs(..)
+ * Scope:  Local
+ *
+ * Describe interfaces up to and including ifindex in the current file.
+ * pcapng numbers interfaces in the order they are described, so every
+ * lower one is described too, without a name if it was never added.
+ *
+ *---------------------------------------------------------------------*/
+
+static void sr_capture_idbs(struct sr_capture* cap, unsigned int ifindex)
+{
+    unsigned int nifs = __atomic_load_n(&cap->nifs, __ATOMIC_ACQUIRE);
+    const struct sr_capture_if* ifs = 0;
+    unsigned int size;
+
+    while(cap->idbs <= ifindex)
+    {
+        ifs = cap->idbs < nifs ? &cap->ifs[cap->idbs] : 0;
+
+        sr_capture_room(cap, SR_PCAPNG_IDB_MAX);
+        size = sr_pcapng_idb(cap->buf + cap->len, LINKTYPE_ETHERNET,
+                             SR_CAPTURE_SNAP, ifs ? ifs->name : 0,
+                             ifs ? ifs->mac : 0);
+        cap->len        += size;
+        cap->file_bytes += size;
+        ++cap->idbs;
+    }
+} /* -- sr_capture_idbs -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_capture_header(..)
+ * Scope:  Local
+ *
+ * Buffer the header of a new file: the pcap file header, or a pcapng
+ * section header and a description of every interface known so far.
+ *
+ *---------------------------------------------------------------------*/
+
+static void sr_capture_header(struct sr_capture* cap)
+{
+    struct pcap_file_header hdr;
+    unsigned int nifs;
+
+    cap->idbs         = 0;
+    cap->file_bytes   = 0;
+    cap->file_packets = 0;
+
+    if(cap->format == SR_CAPTURE_PCAPNG)
+    {
+        sr_capture_room(cap, SR_PCAPNG_SHB_SIZE);
+        cap->len        += sr_pcapng_shb(cap->buf + cap->len);
+        cap->file_bytes += SR_PCAPNG_SHB_SIZE;
+
+        if((nifs = __atomic_load_n(&cap->nifs, __ATOMIC_ACQUIRE)) > 0)
+        { sr_capture_idbs(cap, nifs - 1); }
+        return;
+    }
+
+    hdr.magic         = TCPDUMP_MAGIC;
+    hdr.version_major = PCAP_VERSION_MAJOR;
+    hdr.version_minor = PCAP_VERSION_MINOR;
+    hdr.thiszone      = 0;
+    hdr.sigfigs       = 0;
+    hdr.snaplen       = SR_CAPTURE_SNAP;
+    hdr.linktype      = LINKTYPE_ETHERNET;
+
+    sr_capture_room(cap, sizeof(hdr));
+    memcpy(cap->buf + cap->len, &hdr, sizeof(hdr));
+    cap->len        += sizeof(hdr);
+    cap->file_bytes += sizeof(hdr);
+} /* -- sr_capture_header -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_capture_path(..)
+ * Scope:  Local
+ *
+ * Name of file n.  Without rotation that is just fname; with it the
+ * number goes in front of the extension, if there is one.
+ *
+ *---------------------------------------------------------------------*/
+
+static void sr_capture_path(const struct sr_capture* cap, unsigned int n,
+                            char* path)
+{
+    const char* base = strrchr(cap->fname, '/');
+    const char* ext  = strrchr(base ? base : cap->fname, '.');
+
+    if(cap->rotate.bytes == 0 && cap->rotate.secs == 0)
+    {
+        strcpy(path, cap->fname);
+        return;
+    }
+
+    if(ext == 0 || ext == cap->fname || ext == base + 1)
+    { ext = cap->fname + strlen(cap->fname); }
+
+    sprintf(path, "%.*s-%05u%s", (int)(ext - cap->fname), cap->fname, n, ext);
+} /* -- sr_capture_path -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_capture_start(..)
+ * Scope:  Local
+ *
+ * Open file number cap->file and buffer its header, dropping the file
+ * that falls out of the kept set.  Returns -1 if it can't be opened;
+ * packets are then lost until the next rotation tries again.
+ *
+ *---------------------------------------------------------------------*/
+
+static int sr_capture_start(struct sr_capture* cap)
+{
+    char path[SR_CAPTURE_PATH + 16];
+
+    if(strcmp(cap->fname, "-") == 0)
+    { cap->fd = STDOUT_FILENO; }
+    else
+    {
+        sr_capture_path(cap, cap->file, path);
+        if((cap->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644)) == -1)
+        {
+            fprintf(stderr, "sr_capture: can't open %s: %s\n", path,
+                    strerror(errno));
+            return -1;
+        }
+
+        if(cap->rotate.keep > 0 && cap->file >= cap->rotate.keep)
+        {
+            sr_capture_path(cap, cap->file - cap->rotate.keep, path);
+            unlink(path);
+        }
+    }
+
+    sr_capture_header(cap);
+    return 0;
+} /* -- sr_capture_start -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_capture_next(..)
+ * Scope:  Local
+ *
+ * Finish the current file and go on to the next.
+ *
+ *---------------------------------------------------------------------*/
+
+static void sr_capture_next(struct sr_capture* cap)
+{
+    sr_capture_write(cap);
+    if(cap->fd != -1)
+    { close(cap->fd); }
+
+    /* -- if the next file won't open, try again when it would be due -- */
+    cap->fd           = -1;
+    cap->file_bytes   = 0;
+    cap->file_packets = 0;
+
+    ++cap->file;
+    sr_capture_start(cap);
+} /* -- sr_capture_next -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_capture_due(..)
+ * Scope:  Local
+ *
+ * Whether a packet taking size bytes should go in a new file.  A file
+ * always gets at least one packet, however small the size limit.
+ *
+ *---------------------------------------------------------------------*/
+
+static __inline__ int sr_capture_due(const struct sr_capture* cap,
+                                     const struct sr_capture_slot* slot,
+                                     unsigned int size)
+{
+    if(cap->file_packets == 0)
+    { return 0; }
+
+    if(cap->rotate.bytes && cap->file_bytes + size > cap->rotate.bytes)
+    { return 1; }
+
+    /* -- producers on different threads may stamp slightly out of order -- */
+    return cap->rotate.secs && slot->ts > cap->file_start &&
+           slot->ts - cap->file_start >= cap->rotate.secs * SR_CAPTURE_NS;
+} /* -- sr_capture_due -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_capture_record(..)
+ * Scope:  Local
+ *
+ * Buffer one captured packet in the file's format.
+ *
+ *---------------------------------------------------------------------*/
+
+static void sr_capture_record(struct sr_capture* cap,
+                              const struct sr_capture_slot* slot)
+{
+    struct pcap_sf_pkthdr hdr;
+    unsigned int size;
+
+    if(cap->format == SR_CAPTURE_PCAPNG)
+    { size = SR_PCAPNG_EPB_SIZE(slot->caplen); }
+    else
+    { size = sizeof(hdr) + slot->caplen; }
+
+    if(sr_capture_due(cap, slot, size))
+    { sr_capture_next(cap); }
+
+    if(cap->file_packets++ == 0)
+    { cap->file_start = slot->ts; }
+
+    if(cap->format == SR_CAPTURE_PCAPNG)
+    {
+        if(slot->ifindex >= cap->idbs)
+        { sr_capture_idbs(cap, slot->ifindex); }
+
+        sr_capture_room(cap, size);
+        size = sr_pcapng_epb(cap->buf + cap->len, slot->ifindex, slot->ts,
+                             slot->dir, slot->data, slot->caplen, slot->len);
+    }
+    else
+    {
+        hdr.ts.tv_sec  = (int)(slot->ts / SR_CAPTURE_NS);
+        hdr.ts.tv_usec = (int)(slot->ts % SR_CAPTURE_NS / 1000);
+        hdr.caplen     = slot->caplen;
+        hdr.len        = slot->len;
+
+        sr_capture_room(cap, size);
+        memcpy(cap->buf + cap->len, &hdr, sizeof(hdr));
+        memcpy(cap->buf + cap->len + sizeof(hdr), slot->data, slot->caplen);
+    }
+
+    cap->len        += size;
+    cap->file_bytes += size;
+} /* -- sr_capture_record -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_capture_drain(..)
+ * Scope:  Local
+ *
+ * Move everything in the ring into the buffer, writing the buffer out
+ * whenever it fills.  Returns how many packets were taken.
+ *
+ *---------------------------------------------------------------------*/
+
+static unsigned int sr_capture_drain(struct sr_capture* cap)
+{
+    struct sr_capture_slot* slot = 0;
+    unsigned int n = 0;
+
+    for(;;)
+    {
+        slot = &cap->slots[cap->dequeue & (SR_CAPTURE_SLOTS - 1)];
+        if(__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != cap->dequeue + 1)
+        { break; }
+
+        sr_capture_record(cap, slot);
+
+        __atomic_store_n(&slot->seq, cap->dequeue + SR_CAPTURE_SLOTS,
+                         __ATOMIC_RELEASE);
+        ++cap->dequeue;
+        ++n;
+    }
+
+    cap->captured += n;
+    return n;
+} /* -- sr_capture_drain -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_capture_run(..)
+ * Scope:  Local
+ *
+ * Writer thread.  While packets keep coming the buffer only goes out
+ * when full; once the ring runs dry whatever is buffered is written and
+ * the thread naps.  On stop the ring is drained one last time.
+ *
+ *---------------------------------------------------------------------*/
+
+static void* sr_capture_run(void* arg)
+{
+    struct sr_capture* cap = (struct sr_capture*)arg;
+
+    while(!cap->stop)
+    {
+        if(sr_capture_drain(cap) > 0)
+        { continue; }
+
+        if(cap->len > 0)
+        { sr_capture_write(cap); }
+        usleep(SR_CAPTURE_NAP);
+    }
+
+    sr_capture_drain(cap);
+    sr_capture_write(cap);
+
+    return 0;
+} /* -- sr_capture_run -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_capture_format(..)
+ * Scope:  Global
+ *
+ * "pcap" or "pcapng" to SR_CAPTURE_PCAP or SR_CAPTURE_PCAPNG, -1 for
+ * anything else.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_capture_format(const char* name)
+{
+    /* -- REQUIRES -- */
+    assert(name);
+
+    if(strcmp(name, "pcap") == 0)
+    { return SR_CAPTURE_PCAP; }
+    if(strcmp(name, "pcapng") == 0)
+    { return SR_CAPTURE_PCAPNG; }
+
+    return -1;
+} /* -- sr_capture_format -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_capture_open(..)
+ * Scope:  Global
+ *
+ * Start capturing to fname ("-" for stdout, which can't be rotated)
+ * in the given format.  rotate may be 0 for one file that grows without
+ * bound.  Returns 0 if the file can't be opened.
+ *
+ *---------------------------------------------------------------------*/
+
+struct sr_capture* sr_capture_open(const char* fname, int format,
+                                   const struct sr_capture_rotate* rotate)
+{
+    struct sr_capture* cap = 0;
+    unsigned int i;
+
+    /* -- REQUIRES -- */
+    assert(fname);
+    assert(format == SR_CAPTURE_PCAP || format == SR_CAPTURE_PCAPNG);
+
+    if(strlen(fname) >= SR_CAPTURE_PATH)
+    {
+        fprintf(stderr, "sr_capture: file name too long\n");
+        return 0;
+    }
+
+    cap = (struct sr_capture*)calloc(1, sizeof(struct sr_capture));
+    assert(cap);
+
+    strcpy(cap->fname, fname);
+    cap->format = format;
+    cap->fd     = -1;
+    if(rotate)
+    { cap->rotate = *rotate; }
+
+    if(strcmp(fname, "-") == 0 && (cap->rotate.bytes || cap->rotate.secs))
+    {
+        fprintf(stderr, "sr_capture: can't rotate stdout\n");
+        free(cap);
+        return 0;
+    }
+
+    cap->slots = (struct sr_capture_slot*)malloc(SR_CAPTURE_SLOTS *
+                                                 sizeof(struct sr_capture_slot));
+    cap->buf   = (uint8_t*)malloc(SR_CAPTURE_BUF_SIZE);
+    assert(cap->slots);
+    assert(cap->buf);
+
+    /* -- the first file is opened here so a bad name is reported -- */
+    if(sr_capture_start(cap) == -1)
+    {
+        free(cap->slots);
+        free(cap->buf);
+        free(cap);
+        return 0;
+    }
+    sr_capture_write(cap);
+
+    for(i = 0; i < SR_CAPTURE_SLOTS; ++i)
+    { cap->slots[i].seq = i; }
+
+    if(pthread_create(&cap->thread, 0, sr_capture_run, cap) != 0)
+    {
+        perror("pthread_create(..):sr_capture.c::sr_capture_open");
+        if(cap->fd != STDOUT_FILENO)
+        { close(cap->fd); }
+        free(cap->slots);
+        free(cap->buf);
+        free(cap);
+        return 0;
+    }
+
+    return cap;
+} /* -- sr_capture_open -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_capture_add_interface(..)
+ * Scope:  Global
+ *
+ * Name an interface for pcapng files.  Must come before the first packet
+ * captured on it; interfaces are only ever added, once the hardware
+ * info is in.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_capture_add_interface(struct sr_capture* cap, unsigned int ifindex,
+                              const char* name, const uint8_t* mac)
+{
+    struct sr_capture_if* ifs = 0;
+
+    /* -- REQUIRES -- */
+    assert(cap);
+    assert(name);
+
+    if(ifindex >= SR_CAPTURE_IFS)
+    { return; }
+
+    ifs = &cap->ifs[ifindex];
+    strncpy(ifs->name, name, SR_PCAPNG_NAME_MAX);
+    ifs->name[SR_PCAPNG_NAME_MAX] = 0;
+    if(mac)
+    { memcpy(ifs->mac, mac, 6); }
+
+    if(ifindex >= cap->nifs)
+    { __atomic_store_n(&cap->nifs, ifindex + 1, __ATOMIC_RELEASE); }
+} /* -- sr_capture_add_interface -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_capture_packet(..)
+ * Scope:  Global
+ *
+ * Capture a frame received on (SR_CAPTURE_IN) or sent out of
+ * (SR_CAPTURE_OUT) interface ifindex, or count it dropped if the ring
+ * is full.  Safe to call from any thread; never blocks, unless the
+ * capture was set to wait for room instead.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_capture_packet(struct sr_capture* cap, const uint8_t* frame,
+                       unsigned int len, unsigned int ifindex, int dir)
+{
+    struct sr_capture_slot* slot = 0;
+    struct timespec ts;
+    uint64_t pos, seq;
+    int64_t dif;
+
+    /* -- REQUIRES -- */
+    assert(cap);
+    assert(frame);
+
+    pos = __atomic_load_n(&cap->enqueue, __ATOMIC_RELAXED);
+    for(;;)
+    {
+        slot = &cap->slots[pos & (SR_CAPTURE_SLOTS - 1)];
+        seq  = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+        dif  = (int64_t)(seq - pos);
+
+        if(dif == 0)
+        {
+            /* -- on failure pos is reloaded for us -- */
+            if(__atomic_compare_exchange_n(&cap->enqueue, &pos, pos + 1, 1,
+                                           __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+            { break; }
+        }
+        else if(dif < 0)
+        {
+            if(cap->wait)
+            {
+                sched_yield();
+                pos = __atomic_load_n(&cap->enqueue, __ATOMIC_RELAXED);
+                continue;
+            }
+            __atomic_fetch_add(&cap->dropped, 1, __ATOMIC_RELAXED);
+            return;
+        }
+        else
+        { pos = __atomic_load_n(&cap->enqueue, __ATOMIC_RELAXED); }
+    }
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    slot->ts      = (uint64_t)ts.tv_sec * SR_CAPTURE_NS + ts.tv_nsec;
+    slot->caplen  = min(len, SR_CAPTURE_SNAP);
+    slot->len     = len;
+    slot->ifindex = (uint16_t)ifindex;
+    slot->dir     = (uint16_t)dir;
+    memcpy(slot->data, frame, slot->caplen);
+
+    __atomic_store_n(&slot->seq, pos + 1, __ATOMIC_RELEASE);
+} /* -- sr_capture_packet -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_capture_close(..)
+ * Scope:  Global
+ *
+ * Stop the writer once it has written everything captured so far.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_capture_close(struct sr_capture* cap)
+{
+    /* -- REQUIRES -- */
+    assert(cap);
+
+    cap->stop = 1;
+    pthread_join(cap->thread, 0);
+
+    if(cap->fd != -1 && cap->fd != STDOUT_FILENO)
+    { close(cap->fd); }
+    cap->fd = -1;
+} /* -- sr_capture_close -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_capture_print_stats(..)
+ * Scope:  Global
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_capture_print_stats(const struct sr_capture* cap, FILE* out)
+{
+    /* -- REQUIRES -- */
+    assert(cap);
+    assert(out);
+
+    fprintf(out, "capture: %lu packets, %lu dropped, %lu bytes in %lu "
+            "writes (%.1f KB/write), %lu write errors, %s, file %u\n",
+            (unsigned long)cap->captured,
+            (unsigned long)__atomic_load_n(&cap->dropped, __ATOMIC_RELAXED),
+            (unsigned long)cap->bytes, (unsigned long)cap->writes,
+            cap->writes ? (double)cap->bytes / cap->writes / 1024 : 0.0,
+            (unsigned long)cap->errors,
+            cap->format == SR_CAPTURE_PCAPNG ? "pcapng" : "pcap", cap->file);
+} /* -- sr_capture_print_stats -- */
@@ -0,0 +1,137 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_capture.h
+ *
+ * Description:
+ *
+ * Packet capture for sr -l.  Every packet received or sent used to be
+ * written to the pcap file inline, an fwrite pair and an fflush on the
+ * forwarding thread for each one.  Now the packet path only copies the
+ * frame (up to the snap length) into a slot of a bounded lock-free ring
+ * and goes on; a writer thread drains the ring into a large buffer and
+ * writes it out in big sequential writes.
+ *
+ * Any thread may capture: the ring is multi producer, single consumer.
+ * Producers claim a slot with a compare and swap on the enqueue position
+ * and hand it over by publishing the slot's sequence number; the writer
+ * is the only consumer.  Should the writer fall behind (a slow disk) and
+ * the ring fill up, packets are dropped from the capture and counted,
+ * never held back.
+ *
+ * The file is either classic pcap or pcapng (sr -f).  pcapng records,
+ * per packet, the interface it came in or went out on and which of the
+ * two it was, with nanosecond timestamps; see sr_pcapng.h.  Either can
+ * be rotated (sr -R) once a file reaches a size or an age, keeping only
+ * the newest few, so that capture can be left running.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_CAPTURE_H
+#define SR_CAPTURE_H
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif /* _DARWIN_ */
+
+#include <stdio.h>
+#include <pthread.h>
+
+#include "sr_dumper.h"
+#include "sr_pcapng.h"
+
+#define SR_CAPTURE_SLOTS    4096          /* ring size, power of two */
+#define SR_CAPTURE_SNAP     1024          /* bytes kept of each frame */
+#define SR_CAPTURE_BUF_SIZE (256 * 1024)  /* bytes per write */
+#define SR_CAPTURE_NAP      1000          /* us the writer naps when idle */
+#define SR_CAPTURE_IFS      64            /* interfaces described by name */
+#define SR_CAPTURE_PATH     256
+
+/* -- file formats -- */
+#define SR_CAPTURE_PCAP     0
+#define SR_CAPTURE_PCAPNG   1
+
+/* -- direction, as in epb_flags -- */
+#define SR_CAPTURE_IN       SR_PCAPNG_INBOUND
+#define SR_CAPTURE_OUT      SR_PCAPNG_OUTBOUND
+
+struct sr_capture_slot
+{
+    uint64_t seq;      /* ring protocol, see sr_capture.c */
+    uint64_t ts;       /* ns since the epoch */
+    uint32_t len;      /* on the wire */
+    uint32_t caplen;   /* in data */
+    uint16_t ifindex;
+    uint16_t dir;      /* SR_CAPTURE_IN or SR_CAPTURE_OUT */
+    uint8_t  data[SR_CAPTURE_SNAP];
+};
+
+struct sr_capture_if
+{
+    char    name[SR_PCAPNG_NAME_MAX + 1];
+    uint8_t mac[6];
+};
+
+/* ----------------------------------------------------------------------------
+ * struct sr_capture_rotate
+ *
+ * When to start a new file; 0 means never for each limit.  Rotated files
+ * are numbered, "log.pcapng" becoming log-00000.pcapng, log-00001.pcapng
+ * and so on, and once there are more than 'keep' the oldest goes.
+ *
+ * -------------------------------------------------------------------------- */
+
+struct sr_capture_rotate
+{
+    uint64_t     bytes;
+    unsigned int secs;
+    unsigned int keep;
+};
+
+struct sr_capture
+{
+    /* -- producers -- */
+    uint64_t                 enqueue __attribute__((aligned(64)));
+    uint64_t                 dropped;   /* ring was full */
+    int                      wait;      /* wait for room rather than drop */
+
+    /* -- interfaces, filled in before packets that use them -- */
+    struct sr_capture_if     ifs[SR_CAPTURE_IFS];
+    unsigned int             nifs;
+
+    /* -- writer -- */
+    uint64_t                 dequeue __attribute__((aligned(64)));
+    int                      format;
+    struct sr_capture_rotate rotate;
+    char                     fname[SR_CAPTURE_PATH];
+    int                      fd;
+    pthread_t                thread;
+    volatile int             stop;
+    unsigned int             len;       /* bytes waiting in buf */
+    unsigned int             idbs;      /* interfaces described in this file */
+    unsigned int             file;      /* number of the current file */
+    uint64_t                 file_bytes;
+    uint64_t                 file_packets;
+    uint64_t                 file_start; /* ns, first packet */
+    uint64_t                 captured;
+    uint64_t                 bytes;
+    uint64_t                 writes;
+    uint64_t                 errors;
+
+    struct sr_capture_slot*  slots;
+    uint8_t*                 buf;
+};
+
+int sr_capture_format(const char* name);
+struct sr_capture* sr_capture_open(const char* fname, int format,
+                                   const struct sr_capture_rotate* rotate);
+void sr_capture_add_interface(struct sr_capture* cap, unsigned int ifindex,
+                              const char* name, const uint8_t* mac);
+void sr_capture_packet(struct sr_capture* cap, const uint8_t* frame,
+                       unsigned int len, unsigned int ifindex, int dir);
+void sr_capture_close(struct sr_capture* cap);
+void sr_capture_print_stats(const struct sr_capture* cap, FILE* out);
+
+#endif /* -- SR_CAPTURE_H -- */
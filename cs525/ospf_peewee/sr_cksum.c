@@ -0,0 +1,238 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_cksum.c
+ *
+ * Description:
+ *
+ * One's complement sum kernels behind sr_cksum().  Each kernel returns
+ * the plain (unfolded) sum of the native 16 bit words of an even length
+ * buffer in 64 bits; since one's complement addition is associative and
+ * commutative the words can be added in any grouping or order and folded
+ * once at the end.
+ *
+ *   scalar - 32 bit loads into a 64 bit accumulator
+ *   sse2   - 16 bytes per step, words split into 32 bit lanes
+ *   avx2   - the same with 32 byte vectors
+ *
+ * The vector kernels add each 32 bit lane's low and high word separately
+ * so a lane grows by at most 2 * 0xffff per step; they spill to 64 bits
+ * every SR_CKSUM_SPILL steps, well before a lane could overflow.
+ *
+ * sr_cksum_init() picks the widest kernel the CPU supports.  Buffers
+ * shorter than SR_CKSUM_SMALL (IP headers, mostly) always take the scalar
+ * path, which wins there.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <assert.h>
+#include <string.h>
+
+#include "sr_cksum.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SR_CKSUM_X86
+#include <immintrin.h>
+#endif
+
+#define SR_CKSUM_SPILL 16384
+#define SR_CKSUM_SMALL 64
+
+/*---------------------------------------------------------------------
+ * Method: sr_cksum_sum_scalar(..)
+ * Scope:  Local
+ *
+ *---------------------------------------------------------------------*/
+
+static uint64_t sr_cksum_sum_scalar(const void* buf, uint32_t len)
+{
+    const uint8_t* p = (const uint8_t*)buf;
+    uint64_t sum = 0;
+    uint32_t w32;
+    uint16_t w16;
+
+    while(len >= 16)
+    {
+        memcpy(&w32, p,      4); sum += w32;
+        memcpy(&w32, p + 4,  4); sum += w32;
+        memcpy(&w32, p + 8,  4); sum += w32;
+        memcpy(&w32, p + 12, 4); sum += w32;
+        p   += 16;
+        len -= 16;
+    }
+    while(len >= 4)
+    {
+        memcpy(&w32, p, 4); sum += w32;
+        p   += 4;
+        len -= 4;
+    }
+    if(len >= 2)
+    {
+        memcpy(&w16, p, 2); sum += w16;
+    }
+
+    return sum;
+} /* -- sr_cksum_sum_scalar -- */
+
+#ifdef SR_CKSUM_X86
+
+/*---------------------------------------------------------------------
+ * Method: sr_cksum_sum_sse2(..)
+ * Scope:  Local
+ *
+ *---------------------------------------------------------------------*/
+
+__attribute__((target("sse2")))
+static uint64_t sr_cksum_sum_sse2(const void* buf, uint32_t len)
+{
+    const uint8_t* p = (const uint8_t*)buf;
+    const __m128i lo = _mm_set1_epi32(0xffff);
+    uint64_t sum = 0;
+    uint32_t lanes[4];
+    uint32_t n;
+
+    while(len >= 16)
+    {
+        __m128i acc = _mm_setzero_si128();
+
+        for(n = 0; len >= 16 && n < SR_CKSUM_SPILL; ++n)
+        {
+            __m128i v = _mm_loadu_si128((const __m128i*)p);
+            acc = _mm_add_epi32(acc, _mm_and_si128(v, lo));
+            acc = _mm_add_epi32(acc, _mm_srli_epi32(v, 16));
+            p   += 16;
+            len -= 16;
+        }
+
+        _mm_storeu_si128((__m128i*)lanes, acc);
+        sum += (uint64_t)lanes[0] + lanes[1] + lanes[2] + lanes[3];
+    }
+
+    return sum + sr_cksum_sum_scalar(p, len);
+} /* -- sr_cksum_sum_sse2 -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_cksum_sum_avx2(..)
+ * Scope:  Local
+ *
+ *---------------------------------------------------------------------*/
+
+__attribute__((target("avx2")))
+static uint64_t sr_cksum_sum_avx2(const void* buf, uint32_t len)
+{
+    const uint8_t* p = (const uint8_t*)buf;
+    const __m256i lo = _mm256_set1_epi32(0xffff);
+    uint64_t sum = 0;
+    uint32_t lanes[8];
+    uint32_t n;
+
+    while(len >= 32)
+    {
+        __m256i acc = _mm256_setzero_si256();
+
+        for(n = 0; len >= 32 && n < SR_CKSUM_SPILL; ++n)
+        {
+            __m256i v = _mm256_loadu_si256((const __m256i*)p);
+            acc = _mm256_add_epi32(acc, _mm256_and_si256(v, lo));
+            acc = _mm256_add_epi32(acc, _mm256_srli_epi32(v, 16));
+            p   += 32;
+            len -= 32;
+        }
+
+        _mm256_storeu_si256((__m256i*)lanes, acc);
+        sum += (uint64_t)lanes[0] + lanes[1] + lanes[2] + lanes[3] +
+               lanes[4] + lanes[5] + lanes[6] + lanes[7];
+    }
+
+    return sum + sr_cksum_sum_scalar(p, len);
+} /* -- sr_cksum_sum_avx2 -- */
+
+static int sr_cksum_have_sse2(void)
+{
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("sse2");
+} /* -- sr_cksum_have_sse2 -- */
+
+static int sr_cksum_have_avx2(void)
+{
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+} /* -- sr_cksum_have_avx2 -- */
+
+#endif /* SR_CKSUM_X86 */
+
+/* -- widest last; sr_cksum_init takes the last one supported -- */
+const struct sr_cksum_kernel sr_cksum_kernels[] =
+{
+    { "scalar", sr_cksum_sum_scalar, 0 },
+#ifdef SR_CKSUM_X86
+    { "sse2",   sr_cksum_sum_sse2,   sr_cksum_have_sse2 },
+    { "avx2",   sr_cksum_sum_avx2,   sr_cksum_have_avx2 },
+#endif
+    { 0, 0, 0 }
+};
+
+const struct sr_cksum_kernel* sr_cksum_kernel = &sr_cksum_kernels[0];
+
+/*---------------------------------------------------------------------
+ * Method: sr_cksum_init(..)
+ * Scope:  Global
+ *
+ * Select the kernel sr_cksum() uses.  Until this is called it uses the
+ * scalar one.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_cksum_init(void)
+{
+    const struct sr_cksum_kernel* k = 0;
+
+    for(k = sr_cksum_kernels; k->name; ++k)
+    {
+        if(k->supported == 0 || k->supported())
+        { sr_cksum_kernel = k; }
+    }
+} /* -- sr_cksum_init -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_cksum_fold(..)
+ * Scope:  Global
+ *
+ * Fold a 64 bit sum of 16 bit words (plus an odd trailing byte, added
+ * as its value the way calculateChecksum always has) into the checksum.
+ *
+ *---------------------------------------------------------------------*/
+
+uint16_t sr_cksum_fold(uint64_t sum)
+{
+    sum = (sum & 0xffffffff) + (sum >> 32);
+    sum = (sum & 0xffffffff) + (sum >> 32);
+    sum = (sum & 0xffff) + (sum >> 16);
+    sum = (sum & 0xffff) + (sum >> 16);
+    sum = (sum & 0xffff) + (sum >> 16);
+
+    return (uint16_t)~sum;
+} /* -- sr_cksum_fold -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_cksum(..)
+ * Scope:  Global
+ *
+ * Internet checksum of len bytes at buf.
+ *
+ *---------------------------------------------------------------------*/
+
+uint16_t sr_cksum(const void* buf, uint32_t len)
+{
+    uint64_t sum;
+
+    /* -- REQUIRES -- */
+    assert(buf || len == 0);
+
+    if(len < SR_CKSUM_SMALL)
+    { sum = sr_cksum_sum_scalar(buf, len & ~1U); }
+    else
+    { sum = sr_cksum_kernel->sum(buf, len & ~1U); }
+    if(len & 1)
+    { sum += ((const uint8_t*)buf)[len - 1]; }
+
+    return sr_cksum_fold(sum);
+} /* -- sr_cksum -- */
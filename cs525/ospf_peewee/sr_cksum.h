@@ -0,0 +1,137 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_cksum.h
+ *
+ * Description:
+ *
+ * Internet checksums.  sr_cksum() computes one from scratch with the
+ * fastest kernel the CPU supports (see sr_cksum.c).
+ *
+ * Incremental updates (RFC 1624) cover everything else.  When a router
+ * changes a field it already knows the old and new value of, the new
+ * checksum follows from the old one in constant time:
+ *
+ *     HC' = ~(~HC + ~m + m')                          [RFC 1624, eqn. 3]
+ *
+ * Equation 3 is used rather than the RFC 1141 form because it never turns
+ * a checksum of 0x0000 into 0xffff.  The sum is byte order independent, so
+ * fields and checksums are both taken exactly as they sit in the packet.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_CKSUM_H
+#define SR_CKSUM_H
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif /* _DARWIN_ */
+
+#include <string.h>
+
+#include "sr_protocol.h"
+
+/* ----------------------------------------------------------------------------
+ * struct sr_cksum_kernel
+ *
+ * 'sum' adds up the 16 bit words of an even length buffer without folding.
+ * 'supported' is 0 for kernels that run everywhere.
+ *
+ * -------------------------------------------------------------------------- */
+
+struct sr_cksum_kernel
+{
+    const char* name;
+    uint64_t  (*sum)(const void* buf, uint32_t len);
+    int       (*supported)(void);
+};
+
+extern const struct sr_cksum_kernel  sr_cksum_kernels[]; /* 0 name ends it */
+extern const struct sr_cksum_kernel* sr_cksum_kernel;    /* the one in use */
+
+void     sr_cksum_init(void);
+uint16_t sr_cksum_fold(uint64_t sum);
+uint16_t sr_cksum(const void* buf, uint32_t len);
+
+/*---------------------------------------------------------------------
+ * Method: sr_cksum_adjust16(..)
+ *
+ * New checksum after the 16 bit word 'old' covered by 'sum' became 'new'.
+ *
+ *---------------------------------------------------------------------*/
+
+static __inline__ uint16_t sr_cksum_adjust16(uint16_t sum, uint16_t old,
+                                             uint16_t new)
+{
+    uint32_t s = (uint16_t)~sum + (uint16_t)~old + (uint32_t)new;
+
+    s = (s & 0xffff) + (s >> 16);
+    s = (s & 0xffff) + (s >> 16);
+
+    return (uint16_t)~s;
+} /* -- sr_cksum_adjust16 -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_cksum_adjust32(..)
+ *
+ * Same for a 32 bit field that starts on a 16 bit boundary, such as an
+ * address.
+ *
+ *---------------------------------------------------------------------*/
+
+static __inline__ uint16_t sr_cksum_adjust32(uint16_t sum, uint32_t old,
+                                             uint32_t new)
+{
+    uint16_t o[2], n[2];
+
+    memcpy(o, &old, sizeof(o));
+    memcpy(n, &new, sizeof(n));
+
+    sum = sr_cksum_adjust16(sum, o[0], n[0]);
+    return sr_cksum_adjust16(sum, o[1], n[1]);
+} /* -- sr_cksum_adjust32 -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_cksum_set8(..)
+ *
+ * Store 'value' in the byte at 'field' and return the updated checksum.
+ * 'base' is the start of the checksummed data; it tells which half of a
+ * 16 bit word the byte is.
+ *
+ *---------------------------------------------------------------------*/
+
+static __inline__ uint16_t sr_cksum_set8(uint16_t sum, const void* base,
+                                         uint8_t* field, uint8_t value)
+{
+    uint8_t* word = field - ((field - (const uint8_t*)base) & 1);
+    uint16_t old, new;
+
+    memcpy(&old, word, sizeof(old));
+    *field = value;
+    memcpy(&new, word, sizeof(new));
+
+    return sr_cksum_adjust16(sum, old, new);
+} /* -- sr_cksum_set8 -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_ip_set_ttl(..)
+ *
+ * Set the TTL of an IP header, updating its header checksum.  ip_ttl
+ * and ip_p share one 16 bit word.
+ *
+ *---------------------------------------------------------------------*/
+
+static __inline__ void sr_ip_set_ttl(struct ip* iphdr, uint8_t ttl)
+{
+    uint16_t old, new;
+
+    memcpy(&old, &iphdr->ip_ttl, sizeof(old));
+    iphdr->ip_ttl = ttl;
+    memcpy(&new, &iphdr->ip_ttl, sizeof(new));
+
+    iphdr->ip_sum = sr_cksum_adjust16(iphdr->ip_sum, old, new);
+} /* -- sr_ip_set_ttl -- */
+
+#endif /* -- SR_CKSUM_H -- */
@@ -0,0 +1,302 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_counters.c
+ *
+ * Description:
+ *
+ * Packet path counters, see sr_counters.h.
+ *
+ *---------------------------------------------------------------------------*/
+
+#define _DEFAULT_SOURCE  /* sigaction and SA_RESTART under -ansi */
+#define _BSD_SOURCE
+
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include <signal.h>
+
+#include "sr_counters.h"
+#include "sr_router.h"
+#include "sr_if.h"
+
+struct sr_counter_set sr_counters_all = { { { { 0 } } }, 1,
+                                          PTHREAD_MUTEX_INITIALIZER };
+
+/* -- until a thread registers it counts in the shared block -- */
+__thread struct sr_counters* sr_counters_self = &sr_counters_all.blocks[0];
+
+volatile sig_atomic_t sr_counters_dump = 0;
+
+static const char* sr_proto_names[SR_PROTO_MAX] =
+{
+    "arp", "ip", "icmp", "tcp", "udp", "pwospf", "ip-other", "other"
+};
+
+static const char* sr_drop_names[SR_DROP_MAX] =
+{
+    "rx-no-interface",
+    "rx-runt",
+    "arp-not-for-us",
+    "eth-runt",
+    "eth-unknown-type",
+    "arp-runt",
+    "arp-bad-op",
+    "ip-runt",
+    "ip-bad-cksum",
+    "ip-ttl-expired",
+    "ip-unknown-proto",
+    "icmp-runt",
+    "icmp-bad-cksum",
+    "icmp-for-us",
+    "tcp-for-us",
+    "udp-for-us",
+    "ospf-runt",
+    "ospf-bad-auth",
+    "ospf-bad-cksum",
+    "ospf-bad-area",
+    "ospf-bad-type",
+    "ospf-lsu-from-us",
+    "arp-unresolved",
+    "arp-queue-full",
+    "tx-error"
+};
+
+static const char* sr_event_names[SR_EV_MAX] =
+{
+    "odd-length",
+    "ospf-bad-version",
+    "ospf-hello",
+    "ospf-lsu",
+    "ospf-lsa-new",
+    "ospf-lsa-stale",
+    "arp-hit",
+    "arp-miss",
+    "arp-queued",
+    "arp-released",
+    "arp-request-sent",
+    "arp-reply-sent",
+    "icmp-echo-reply",
+    "icmp-time-exceeded",
+    "icmp-host-unreach",
+    "icmp-proto-unreach",
+    "icmp-port-unreach",
+    "icmp-error-other",
+    "icmp-limited-interface",
+    "icmp-limited-overall"
+};
+
+/*---------------------------------------------------------------------
+ * Method: sr_counters_register(..)
+ * Scope:  Global
+ *
+ * Give the calling thread a block of its own.  If all are taken it
+ * keeps counting in the shared one.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_counters_register(const char* name)
+{
+    struct sr_counters* c = 0;
+
+    /* -- REQUIRES -- */
+    assert(name);
+
+    pthread_mutex_lock(&sr_counters_all.lock);
+    if(sr_counters_all.n < SR_COUNTERS_THREADS)
+    {
+        c = &sr_counters_all.blocks[sr_counters_all.n];
+        strncpy(c->name, name, sizeof(c->name) - 1);
+        __atomic_store_n(&sr_counters_all.n, sr_counters_all.n + 1,
+                         __ATOMIC_RELEASE);
+        sr_counters_self = c;
+    }
+    pthread_mutex_unlock(&sr_counters_all.lock);
+} /* -- sr_counters_register -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_counters_add(..)
+ * Scope:  Local
+ *
+ * Add n counters of a block that may be counting right now.
+ *
+ *---------------------------------------------------------------------*/
+
+static void sr_counters_add(uint64_t* sum, const uint64_t* c, unsigned int n)
+{
+    unsigned int i;
+
+    for(i = 0; i < n; ++i)
+    { sum[i] += __atomic_load_n(&c[i], __ATOMIC_RELAXED); }
+} /* -- sr_counters_add -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_counters_sum(..)
+ * Scope:  Global
+ *
+ * Total of every thread's counters, from any thread.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_counters_sum(struct sr_counters* sum)
+{
+    const struct sr_counters* c = 0;
+    unsigned int i, n;
+
+    /* -- REQUIRES -- */
+    assert(sum);
+
+    memset(sum, 0, sizeof(struct sr_counters));
+    n = __atomic_load_n(&sr_counters_all.n, __ATOMIC_ACQUIRE);
+
+    for(i = 0; i < n; ++i)
+    {
+        c = &sr_counters_all.blocks[i];
+        sr_counters_add(sum->proto, c->proto, SR_PROTO_MAX);
+        sr_counters_add(sum->drop, c->drop, SR_DROP_MAX);
+        sr_counters_add(sum->event, c->event, SR_EV_MAX);
+        sr_counters_add((uint64_t*)sum->ifc, (const uint64_t*)c->ifc,
+                        SR_COUNTERS_IFS * sizeof(struct sr_if_counters) /
+                        sizeof(uint64_t));
+    }
+} /* -- sr_counters_sum -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_counters_drop_name(..)
+ * Scope:  Global
+ *
+ *---------------------------------------------------------------------*/
+
+const char* sr_counters_drop_name(unsigned int why)
+{
+    return why < SR_DROP_MAX ? sr_drop_names[why] : "?";
+} /* -- sr_counters_drop_name -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_counters_print_list(..)
+ * Scope:  Local
+ *
+ * The counters that aren't 0, a few to a line.
+ *
+ *---------------------------------------------------------------------*/
+
+static void sr_counters_print_list(FILE* out, const char* title,
+                                   const char** names, const uint64_t* c,
+                                   unsigned int n)
+{
+    unsigned int i, col = 0;
+
+    fprintf(out, "  %s:", title);
+    for(i = 0; i < n; ++i)
+    {
+        if(c[i] == 0)
+        { continue; }
+        if(col > 0 && col % 4 == 0)
+        { fprintf(out, "\n   "); }
+        fprintf(out, " %s %lu", names[i], (unsigned long)c[i]);
+        ++col;
+    }
+    fprintf(out, col ? "\n" : " none\n");
+} /* -- sr_counters_print_list -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_counters_print_stats(..)
+ * Scope:  Global
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_counters_print_stats(struct sr_instance* sr, FILE* out)
+{
+    struct sr_counters sum;
+    const struct sr_if_counters* ifc = 0;
+    struct sr_if* iface = 0;
+    uint64_t drops = 0;
+    unsigned int i;
+
+    /* -- REQUIRES -- */
+    assert(sr);
+    assert(out);
+
+    sr_counters_sum(&sum);
+    for(i = 0; i < SR_DROP_MAX; ++i)
+    { drops += sum.drop[i]; }
+
+    fprintf(out, "counters: %u threads, %lu drops\n",
+            __atomic_load_n(&sr_counters_all.n, __ATOMIC_ACQUIRE),
+            (unsigned long)drops);
+    fprintf(out, "  %-10s %12s %14s %12s %14s\n", "interface",
+            "rx packets", "rx bytes", "tx packets", "tx bytes");
+
+    for(i = 0; i < SR_COUNTERS_IFS && i < sr->if_count; ++i)
+    {
+        iface = sr_get_interface_by_index(sr, i);
+        ifc = &sum.ifc[i];
+        fprintf(out, "  %-10s %12lu %14lu %12lu %14lu\n",
+                iface ? iface->name : "-",
+                (unsigned long)ifc->rx_packets, (unsigned long)ifc->rx_bytes,
+                (unsigned long)ifc->tx_packets, (unsigned long)ifc->tx_bytes);
+    }
+
+    sr_counters_print_list(out, "protocols", sr_proto_names, sum.proto,
+                           SR_PROTO_MAX);
+    sr_counters_print_list(out, "drops", sr_drop_names, sum.drop,
+                           SR_DROP_MAX);
+    sr_counters_print_list(out, "events", sr_event_names, sum.event,
+                           SR_EV_MAX);
+} /* -- sr_counters_print_stats -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_counters_sigusr1(..)
+ * Scope:  Local
+ *
+ * Ask the reader to print the counters.  The signal knocks it out of
+ * poll, and it looks on every wakeup.
+ *
+ *---------------------------------------------------------------------*/
+
+static void sr_counters_sigusr1(int sig)
+{
+    sr_counters_dump = 1;
+} /* -- sr_counters_sigusr1 -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_counters_catch(..)
+ * Scope:  Global
+ *
+ * Handle SIGUSR1, but leave it blocked for now so that every thread
+ * started from here on inherits it blocked.  Call before starting any.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_counters_catch(void)
+{
+    struct sigaction sa;
+    sigset_t set;
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = sr_counters_sigusr1;
+    sa.sa_flags   = SA_RESTART;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGUSR1, &sa, 0);
+
+    sigemptyset(&set);
+    sigaddset(&set, SIGUSR1);
+    pthread_sigmask(SIG_BLOCK, &set, 0);
+} /* -- sr_counters_catch -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_counters_listen(..)
+ * Scope:  Global
+ *
+ * Take SIGUSR1 on the calling thread, the reader, once the others are
+ * running.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_counters_listen(void)
+{
+    sigset_t set;
+
+    sigemptyset(&set);
+    sigaddset(&set, SIGUSR1);
+    pthread_sigmask(SIG_UNBLOCK, &set, 0);
+} /* -- sr_counters_listen -- */
@@ -0,0 +1,227 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_counters.h
+ *
+ * Description:
+ *
+ * Packet path counters: rx/tx packets and bytes per interface, hits per
+ * protocol, a named counter for every reason a packet is dropped, and the
+ * ARP and ICMP events worth knowing about.
+ *
+ * Every thread that counts (the reader, the PWOSPF thread, the workers)
+ * registers once and from then on bumps its own block, on its own cache
+ * lines, with plain increments: nothing is shared on the way and nothing
+ * is locked.  Threads that never registered share block 0.  Reading sums
+ * the blocks; a sum taken while the router runs may be a packet or two
+ * behind, never torn.
+ *
+ * The sums are printed with the rest of the statistics, by the control
+ * socket's "counters" command (see sr_event.h) and on SIGUSR1.  Only the
+ * reader takes the signal, so it is sure to wake up and print them.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_COUNTERS_H
+#define SR_COUNTERS_H
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif /* _DARWIN_ */
+
+#include <stdio.h>
+#include <signal.h>
+#include <pthread.h>
+
+#include "sr_ring.h"
+
+#define SR_COUNTERS_THREADS 32  /* blocks, including the shared one */
+#define SR_COUNTERS_IFS     16  /* interfaces counted, by ifindex */
+
+struct sr_instance;
+
+/* -- hits per protocol, as frames arrive -- */
+enum sr_proto_ctr
+{
+    SR_PROTO_ARP = 0,
+    SR_PROTO_IP,             /* all of IPv4, then by what it carries */
+    SR_PROTO_ICMP,
+    SR_PROTO_TCP,
+    SR_PROTO_UDP,
+    SR_PROTO_OSPF,
+    SR_PROTO_IP_OTHER,
+    SR_PROTO_OTHER,          /* neither IPv4 nor ARP */
+    SR_PROTO_MAX
+};
+
+/* -- why a packet went no further -- */
+enum sr_drop_ctr
+{
+    SR_DROP_RX_NO_IF = 0,    /* from an interface we don't have */
+    SR_DROP_RX_RUNT,         /* too short for the server's packet header */
+    SR_DROP_ARP_NOT_US,      /* ARP for another router on the link */
+    SR_DROP_ETH_RUNT,
+    SR_DROP_ETH_TYPE,
+    SR_DROP_ARP_RUNT,
+    SR_DROP_ARP_OP,
+    SR_DROP_IP_RUNT,
+    SR_DROP_IP_CKSUM,
+    SR_DROP_IP_TTL,
+    SR_DROP_IP_PROTO,
+    SR_DROP_ICMP_RUNT,
+    SR_DROP_ICMP_CKSUM,
+    SR_DROP_ICMP_LOCAL,      /* for us, but not an echo request */
+    SR_DROP_TCP_LOCAL,
+    SR_DROP_UDP_LOCAL,
+    SR_DROP_OSPF_RUNT,
+    SR_DROP_OSPF_AUTH,
+    SR_DROP_OSPF_CKSUM,
+    SR_DROP_OSPF_AREA,
+    SR_DROP_OSPF_TYPE,
+    SR_DROP_OSPF_OURS,       /* an LSU we sent ourselves */
+    SR_DROP_ARP_UNRESOLVED,  /* gave up on the next hop */
+    SR_DROP_ARP_QUEUE_FULL,  /* too many waiting on the next hop already */
+    SR_DROP_TX_ERROR,
+    SR_DROP_MAX
+};
+
+/* -- everything else -- */
+enum sr_event_ctr
+{
+    SR_EV_ODD_LENGTH = 0,    /* odd length frame, let through */
+    SR_EV_OSPF_VERSION,      /* not PWOSPF version 2, let through */
+    SR_EV_OSPF_HELLO,
+    SR_EV_OSPF_LSU,
+    SR_EV_OSPF_LSA_NEW,
+    SR_EV_OSPF_LSA_STALE,    /* no newer than what we have, ignored */
+    SR_EV_ARP_HIT,
+    SR_EV_ARP_MISS,
+    SR_EV_ARP_QUEUED,        /* packets put on the ARP queue */
+    SR_EV_ARP_RELEASED,      /* and taken off it once resolved */
+    SR_EV_ARP_REQUEST,       /* requests sent, one per interface */
+    SR_EV_ARP_REPLY,
+    SR_EV_ICMP_ECHO_REPLY,
+    SR_EV_ICMP_TIME_EXCEEDED,
+    SR_EV_ICMP_HOST_UNREACH,
+    SR_EV_ICMP_PROTO_UNREACH,
+    SR_EV_ICMP_PORT_UNREACH,
+    SR_EV_ICMP_ERROR_OTHER,
+    SR_EV_ICMP_LIMITED_IF,   /* errors not sent, see sr_icmp.h */
+    SR_EV_ICMP_LIMITED,
+    SR_EV_MAX
+};
+
+struct sr_if_counters
+{
+    uint64_t rx_packets;
+    uint64_t rx_bytes;
+    uint64_t tx_packets;
+    uint64_t tx_bytes;
+};
+
+/* ----------------------------------------------------------------------------
+ * struct sr_counters
+ *
+ * One thread's counters.  Only its owner writes it.
+ *
+ * -------------------------------------------------------------------------- */
+
+struct sr_counters
+{
+    uint64_t              proto[SR_PROTO_MAX];
+    uint64_t              drop[SR_DROP_MAX];
+    uint64_t              event[SR_EV_MAX];
+    struct sr_if_counters ifc[SR_COUNTERS_IFS];
+    char                  name[16];
+} __attribute__((aligned(SR_CACHE_LINE)));
+
+struct sr_counter_set
+{
+    struct sr_counters blocks[SR_COUNTERS_THREADS];
+    unsigned int       n;     /* blocks handed out, 0 is shared */
+    pthread_mutex_t    lock;  /* registration */
+};
+
+extern struct sr_counter_set sr_counters_all;
+extern __thread struct sr_counters* sr_counters_self;
+extern volatile sig_atomic_t sr_counters_dump;
+
+void sr_counters_register(const char* name);
+void sr_counters_sum(struct sr_counters* sum);
+const char* sr_counters_drop_name(unsigned int why);
+void sr_counters_print_stats(struct sr_instance* sr, FILE* out);
+void sr_counters_catch(void);
+void sr_counters_listen(void);
+
+/*---------------------------------------------------------------------
+ * Method: sr_count(..), sr_count_drop(..)
+ * Scope:  Global
+ *
+ *---------------------------------------------------------------------*/
+
+static __inline__ void sr_count(unsigned int ev)
+{ ++sr_counters_self->event[ev]; }
+
+static __inline__ void sr_count_drop(unsigned int why)
+{ ++sr_counters_self->drop[why]; }
+
+/*---------------------------------------------------------------------
+ * Method: sr_count_rx(..)
+ * Scope:  Global
+ *
+ * A frame in on ifindex: count it against the interface and sort it by
+ * protocol, looking no further than the IP header's protocol field.
+ *
+ *---------------------------------------------------------------------*/
+
+static __inline__ void sr_count_rx(const uint8_t* frame, unsigned int len,
+                                   unsigned int ifindex)
+{
+    struct sr_counters* c = sr_counters_self;
+    unsigned int type = len >= 14 ? ((unsigned int)frame[12] << 8) | frame[13]
+                                  : 0;
+
+    if(ifindex < SR_COUNTERS_IFS)
+    {
+        ++c->ifc[ifindex].rx_packets;
+        c->ifc[ifindex].rx_bytes += len;
+    }
+
+    if(type == 0x0806)
+    { ++c->proto[SR_PROTO_ARP]; }
+    else if(type != 0x0800)
+    { ++c->proto[SR_PROTO_OTHER]; }
+    else
+    {
+        ++c->proto[SR_PROTO_IP];
+        switch(len >= 14 + 20 ? frame[14 + 9] : 0)
+        {
+            case 1:   ++c->proto[SR_PROTO_ICMP]; break;
+            case 6:   ++c->proto[SR_PROTO_TCP];  break;
+            case 17:  ++c->proto[SR_PROTO_UDP];  break;
+            case 89:  ++c->proto[SR_PROTO_OSPF]; break;
+            default:  ++c->proto[SR_PROTO_IP_OTHER]; break;
+        }
+    }
+} /* -- sr_count_rx -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_count_tx(..)
+ * Scope:  Global
+ *
+ *---------------------------------------------------------------------*/
+
+static __inline__ void sr_count_tx(unsigned int len, unsigned int ifindex)
+{
+    struct sr_counters* c = sr_counters_self;
+
+    if(ifindex < SR_COUNTERS_IFS)
+    {
+        ++c->ifc[ifindex].tx_packets;
+        c->ifc[ifindex].tx_bytes += len;
+    }
+} /* -- sr_count_tx -- */
+
+#endif /* -- SR_COUNTERS_H -- */
@@ -3,6 +3,8 @@
  * format as well as a set of operations for logging.
  */
 
+#ifndef SR_DUMPER_H
+#define SR_DUMPER_H
 
 #ifdef _LINUX_
 #include <stdint.h>
@@ -77,3 +79,5 @@ void sr_dump(FILE *fp, const struct pcap_pkthdr *h, const unsigned char *sp);
  * Close the file
  */
 void sr_dump_close(FILE *fp);
+
+#endif /* SR_DUMPER_H */
@@ -0,0 +1,194 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_epoch.c
+ *
+ * Description:
+ *
+ * Epoch based reclamation, see sr_epoch.h.
+ *
+ *---------------------------------------------------------------------------*/
+
+#define _POSIX_C_SOURCE 200112L  /* posix_memalign under -ansi */
+
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+
+#include "sr_epoch.h"
+
+/*---------------------------------------------------------------------
+ * Method: sr_epoch_reclaim_locked(..)
+ * Scope:  Local
+ *
+ * Free everything retired before the oldest read section still open.
+ * The fence pairs with the one in sr_epoch_enter: a reader either shows
+ * up in the scan or is sure to load the pointer that replaced what it
+ * might otherwise have found.
+ *
+ *---------------------------------------------------------------------*/
+
+static void sr_epoch_reclaim_locked(struct sr_epoch* epoch)
+{
+    struct sr_epoch_retired** link = 0;
+    struct sr_epoch_retired* r = 0;
+    uint64_t oldest = (uint64_t)-1, e;
+    unsigned int i;
+
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+    for(i = 0; i < epoch->nreaders; ++i)
+    {
+        e = __atomic_load_n(&epoch->readers[i].epoch, __ATOMIC_ACQUIRE);
+        if(e != 0 && e < oldest)
+        { oldest = e; }
+    }
+
+    link = &epoch->retired;
+    while((r = *link) != 0)
+    {
+        if(r->epoch < oldest)
+        {
+            *link = r->next;
+            r->fn(r->ptr);
+            free(r);
+            ++epoch->nfreed;
+        }
+        else
+        { link = &r->next; }
+    }
+} /* -- sr_epoch_reclaim_locked -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_epoch_create(..)
+ * Scope:  Global
+ *
+ *---------------------------------------------------------------------*/
+
+struct sr_epoch* sr_epoch_create(void)
+{
+    void* mem = 0;
+    struct sr_epoch* epoch = 0;
+
+    if(posix_memalign(&mem, SR_EPOCH_LINE, sizeof(struct sr_epoch)) != 0)
+    { return 0; }
+
+    epoch = (struct sr_epoch*)mem;
+    memset(epoch, 0, sizeof(struct sr_epoch));
+    pthread_mutex_init(&epoch->lock, 0);
+    epoch->global = 1;
+
+    return epoch;
+} /* -- sr_epoch_create -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_epoch_register(..)
+ * Scope:  Global
+ *
+ * Slot for a new reader thread, outside a read section.  Returns 0 if
+ * all SR_EPOCH_READERS are taken.
+ *
+ *---------------------------------------------------------------------*/
+
+struct sr_epoch_reader* sr_epoch_register(struct sr_epoch* epoch)
+{
+    struct sr_epoch_reader* reader = 0;
+
+    /* -- REQUIRES -- */
+    assert(epoch);
+
+    pthread_mutex_lock(&epoch->lock);
+    if(epoch->nreaders < SR_EPOCH_READERS)
+    {
+        reader = &epoch->readers[epoch->nreaders];
+        reader->epoch = 0;
+        __atomic_store_n(&epoch->nreaders, epoch->nreaders + 1,
+                         __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&epoch->lock);
+
+    return reader;
+} /* -- sr_epoch_register -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_epoch_retire(..)
+ * Scope:  Global
+ *
+ * Have fn(ptr) called once no reader can still see ptr.  The caller
+ * must already have swapped ptr out of wherever readers find it.  With
+ * no epoch (nothing has started reading yet) ptr is freed at once.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_epoch_retire(struct sr_epoch* epoch, void* ptr, sr_epoch_free_fn fn)
+{
+    struct sr_epoch_retired* r = 0;
+
+    /* -- REQUIRES -- */
+    assert(fn);
+
+    if(ptr == 0)
+    { return; }
+
+    if(epoch == 0)
+    {
+        fn(ptr);
+        return;
+    }
+
+    r = (struct sr_epoch_retired*)malloc(sizeof(struct sr_epoch_retired));
+    assert(r);
+    r->ptr = ptr;
+    r->fn  = fn;
+
+    pthread_mutex_lock(&epoch->lock);
+
+    /* -- readers that see the new epoch came after the swap -- */
+    r->epoch = epoch->global;
+    __atomic_store_n(&epoch->global, epoch->global + 1, __ATOMIC_RELEASE);
+
+    r->next = epoch->retired;
+    epoch->retired = r;
+    ++epoch->nretired;
+
+    sr_epoch_reclaim_locked(epoch);
+
+    pthread_mutex_unlock(&epoch->lock);
+} /* -- sr_epoch_retire -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_epoch_reclaim(..)
+ * Scope:  Global
+ *
+ * Free what has become safe to free since it was retired.  Called now
+ * and then so that retired tables don't wait for the next change.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_epoch_reclaim(struct sr_epoch* epoch)
+{
+    if(epoch == 0 || __atomic_load_n(&epoch->retired, __ATOMIC_RELAXED) == 0)
+    { return; }
+
+    pthread_mutex_lock(&epoch->lock);
+    sr_epoch_reclaim_locked(epoch);
+    pthread_mutex_unlock(&epoch->lock);
+} /* -- sr_epoch_reclaim -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_epoch_print_stats(..)
+ * Scope:  Global
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_epoch_print_stats(struct sr_epoch* epoch, FILE* out)
+{
+    /* -- REQUIRES -- */
+    assert(epoch);
+    assert(out);
+
+    pthread_mutex_lock(&epoch->lock);
+    fprintf(out, "epoch: %lu, %u readers, %lu retired, %lu freed, "
+            "%lu waiting\n", (unsigned long)epoch->global, epoch->nreaders,
+            (unsigned long)epoch->nretired, (unsigned long)epoch->nfreed,
+            (unsigned long)(epoch->nretired - epoch->nfreed));
+    pthread_mutex_unlock(&epoch->lock);
+} /* -- sr_epoch_print_stats -- */
@@ -0,0 +1,114 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_epoch.h
+ *
+ * Description:
+ *
+ * Epoch based reclamation for the tables the packet path reads without a
+ * lock: the FIB, the adjacency index (and the adjacencies swept out of
+ * it) and the PWOSPF neighbor snapshot.
+ * Writers never change a published table; they build a new one, swap the
+ * pointer and retire the old one, which is freed once no reader can still
+ * be looking at it.
+ *
+ * Every thread that reads those tables registers once and brackets its
+ * reads with sr_epoch_enter / sr_epoch_exit.  Entering records the global
+ * epoch; retiring bumps it.  Something retired in epoch e is freed as
+ * soon as every thread inside a read section entered after e.  Threads
+ * outside one (blocked in poll, a napping worker) hold nothing up.
+ *
+ * Entering and leaving are a store and a fence each.  Retiring and
+ * reclaiming take the epoch lock, and happen only on table changes and
+ * from the PWOSPF tick.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_EPOCH_H
+#define SR_EPOCH_H
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif /* _DARWIN_ */
+
+#include <stdio.h>
+#include <pthread.h>
+
+#define SR_EPOCH_READERS 32  /* most reader threads */
+#define SR_EPOCH_LINE    64
+
+typedef void (*sr_epoch_free_fn)(void* ptr);
+
+/* ----------------------------------------------------------------------------
+ * struct sr_epoch_reader
+ *
+ * One per reader thread, on its own cache line.  'epoch' is 0 while the
+ * thread is outside a read section.
+ *
+ * -------------------------------------------------------------------------- */
+
+struct sr_epoch_reader
+{
+    uint64_t epoch;
+    uint8_t  pad[SR_EPOCH_LINE - sizeof(uint64_t)];
+};
+
+struct sr_epoch_retired
+{
+    struct sr_epoch_retired* next;
+    void*                    ptr;
+    sr_epoch_free_fn         fn;
+    uint64_t                 epoch;  /* retired in */
+};
+
+struct sr_epoch
+{
+    struct sr_epoch_reader   readers[SR_EPOCH_READERS];
+    uint64_t                 global;  /* starts at 1 */
+    unsigned int             nreaders;
+    pthread_mutex_t          lock;    /* registration and the retired list */
+    struct sr_epoch_retired* retired;
+
+    /* -- statistics -- */
+    uint64_t                 nretired;
+    uint64_t                 nfreed;
+} __attribute__((aligned(SR_EPOCH_LINE)));
+
+struct sr_epoch* sr_epoch_create(void);
+struct sr_epoch_reader* sr_epoch_register(struct sr_epoch* epoch);
+void sr_epoch_retire(struct sr_epoch* epoch, void* ptr, sr_epoch_free_fn fn);
+void sr_epoch_reclaim(struct sr_epoch* epoch);
+void sr_epoch_print_stats(struct sr_epoch* epoch, FILE* out);
+
+/*---------------------------------------------------------------------
+ * Method: sr_epoch_enter(..)
+ *
+ * Start a read section.  The fence orders the store before any table
+ * pointer the section loads, against the writer's swap-then-scan.
+ *
+ *---------------------------------------------------------------------*/
+
+static __inline__ void sr_epoch_enter(struct sr_epoch* epoch,
+                                      struct sr_epoch_reader* reader)
+{
+    __atomic_store_n(&reader->epoch,
+                     __atomic_load_n(&epoch->global, __ATOMIC_RELAXED),
+                     __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+} /* -- sr_epoch_enter -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_epoch_exit(..)
+ *
+ * End a read section; no table pointer loaded in it may be used after.
+ *
+ *---------------------------------------------------------------------*/
+
+static __inline__ void sr_epoch_exit(struct sr_epoch_reader* reader)
+{
+    __atomic_store_n(&reader->epoch, 0, __ATOMIC_RELEASE);
+} /* -- sr_epoch_exit -- */
+
+#endif /* -- SR_EPOCH_H -- */
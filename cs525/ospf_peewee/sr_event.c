@@ -0,0 +1,317 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_event.c
+ *
+ * Description:
+ *
+ * Event loop, see sr_event.h.  epoll and timerfd are Linux only; other
+ * systems keep the threaded loop.
+ *
+ *---------------------------------------------------------------------------*/
+
+#define _DEFAULT_SOURCE  /* CLOCK_MONOTONIC and fdopen under -ansi */
+#define _BSD_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include "sr_router.h"
+#include "sr_event.h"
+
+#ifdef _LINUX_
+
+#include <time.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+
+#include "sr_timer.h"
+#include "sr_tx.h"
+#include "sr_worker.h"
+#include "sr_epoch.h"
+#include "sr_counters.h"
+#include "sr_hist.h"
+
+struct sr_event
+{
+    int      epfd;
+    int      tfd;
+    int      cfd;       /* listening control socket, or -1 */
+    int      clients;   /* control connections open */
+    uint64_t armed;     /* expiry the timerfd is set for, 0 if none */
+};
+
+static int sr_event_add(struct sr_event* ev, int fd)
+{
+    struct epoll_event e;
+
+    memset(&e, 0, sizeof(e));
+    e.events  = EPOLLIN;
+    e.data.fd = fd;
+
+    if(epoll_ctl(ev->epfd, EPOLL_CTL_ADD, fd, &e) == -1)
+    {
+        perror("epoll_ctl(..):sr_event.c::sr_event_add");
+        return -1;
+    }
+
+    return 0;
+} /* -- sr_event_add -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_event_arm(..)
+ * Scope:  Local
+ *
+ * Point the timerfd at the wheel's next expiry.  The wheel counts
+ * CLOCK_MONOTONIC milliseconds, so the expiry is set as an absolute
+ * time and needs no touching until it changes.
+ *
+ *---------------------------------------------------------------------*/
+
+static void sr_event_arm(struct sr_event* ev, const struct sr_timer_wheel* wheel)
+{
+    struct itimerspec its;
+    uint64_t expires = 0;
+    int next;
+
+    if((next = sr_timer_next(wheel)) >= 0)
+    { expires = wheel->now + (next > 0 ? next : 1); }
+
+    if(expires == ev->armed)
+    { return; }
+
+    memset(&its, 0, sizeof(its));
+    its.it_value.tv_sec  = expires / 1000;
+    its.it_value.tv_nsec = (expires % 1000) * 1000000;
+
+    if(timerfd_settime(ev->tfd, TFD_TIMER_ABSTIME, &its, 0) == -1)
+    {
+        perror("timerfd_settime(..):sr_event.c::sr_event_arm");
+        return;
+    }
+
+    ev->armed = expires;
+} /* -- sr_event_arm -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_event_listen(..)
+ * Scope:  Local
+ *
+ *---------------------------------------------------------------------*/
+
+static int sr_event_listen(const char* path)
+{
+    struct sockaddr_un addr;
+    int fd;
+
+    if(strlen(path) >= sizeof(addr.sun_path))
+    {
+        fprintf(stderr, "Error: control socket path too long %s\n", path);
+        return -1;
+    }
+
+    if((fd = socket(AF_UNIX, SOCK_STREAM, 0)) == -1)
+    {
+        perror("socket(..):sr_event.c::sr_event_listen");
+        return -1;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    unlink(path);
+
+    if(bind(fd, (struct sockaddr*)&addr, sizeof(addr)) == -1 ||
+       listen(fd, SR_CONTROL_MAX) == -1)
+    {
+        perror("bind(..):sr_event.c::sr_event_listen");
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+} /* -- sr_event_listen -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_event_control(..)
+ * Scope:  Local
+ *
+ * Answer the command waiting on control connection fd and hang up.
+ *
+ *---------------------------------------------------------------------*/
+
+static void sr_event_control(struct sr_instance* sr, struct sr_event* ev,
+                             int fd)
+{
+    char cmd[64];
+    FILE* out = 0;
+    int len;
+
+    len = read(fd, cmd, sizeof(cmd) - 1);
+    cmd[len > 0 ? len : 0] = 0;
+    cmd[strcspn(cmd, "\r\n")] = 0;
+
+    epoll_ctl(ev->epfd, EPOLL_CTL_DEL, fd, 0);
+    --ev->clients;
+
+    if((out = fdopen(fd, "w")) == 0)
+    {
+        close(fd);
+        return;
+    }
+
+    if(strcmp(cmd, "stats") == 0)
+    { sr_print_stats(sr, out); }
+    else if(strcmp(cmd, "counters") == 0)
+    { sr_counters_print_stats(sr, out); }
+    else if(strcmp(cmd, "hist") == 0)
+    { sr_hist_print_stats(out); }
+    else if(strcmp(cmd, "hist on") == 0 || strcmp(cmd, "hist off") == 0)
+    {
+        sr_hist_enable(cmd[6] == 'n');
+        fprintf(out, "latency histograms %s\n", cmd + 5);
+    }
+    else if(strcmp(cmd, "hist reset") == 0)
+    {
+        sr_hist_reset();
+        fprintf(out, "latency histograms reset\n");
+    }
+    else
+    { fprintf(out, "unknown command: %s\n", cmd); }
+
+    fclose(out);
+} /* -- sr_event_control -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_event_loop(..)
+ * Scope:  Global
+ *
+ * Run the router until the server goes away.  Returns what the last
+ * sr_read_commands did: 0 if the server closed the session, -1 on
+ * error.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_event_loop(struct sr_instance* sr, const char* control)
+{
+    struct epoll_event events[SR_EVENT_MAX];
+    struct sr_event ev;
+    uint64_t expirations;
+    int i, n, fd, timeout, ret = 1;
+
+    /* -- REQUIRES -- */
+    assert(sr);
+    assert(sr->timers);
+    assert(sr->event_loop);
+
+    memset(&ev, 0, sizeof(ev));
+    ev.cfd = -1;
+
+    if((ev.epfd = epoll_create(SR_EVENT_MAX)) == -1)
+    {
+        perror("epoll_create(..):sr_event.c::sr_event_loop");
+        return -1;
+    }
+
+    if((ev.tfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK)) == -1)
+    {
+        perror("timerfd_create(..):sr_event.c::sr_event_loop");
+        close(ev.epfd);
+        return -1;
+    }
+
+    if(control && (ev.cfd = sr_event_listen(control)) == -1)
+    { ret = -1; }
+
+    if(ret == 1 && (sr_event_add(&ev, sr->sockfd) == -1 ||
+                    sr_event_add(&ev, ev.tfd) == -1 ||
+                    (ev.cfd != -1 && sr_event_add(&ev, ev.cfd) == -1)))
+    { ret = -1; }
+
+    while(ret == 1)
+    {
+        sr_timer_advance(sr->timers, sr_timer_now(), sr);
+        if(sr->workers)
+        { sr_workers_reap(sr); }
+        sr_tx_flush(sr->tx);
+        sr_event_arm(&ev, sr->timers);
+
+        /* -- kill -USR1, see sr_counters.h -- */
+        if(sr_counters_dump)
+        {
+            sr_counters_dump = 0;
+            sr_counters_print_stats(sr, stderr);
+            if(sr_hist_on)
+            { sr_hist_print_stats(stderr); }
+        }
+
+        /* -- frames still with the workers are looked for every ms -- */
+        timeout = (sr->workers && sr->workers->inflight > 0) ? 1 : -1;
+
+        /* -- hold no tables while blocked, see sr_epoch.h -- */
+        sr_epoch_exit(sr->reader);
+        n = epoll_wait(ev.epfd, events, SR_EVENT_MAX, timeout);
+        sr_epoch_enter(sr->epoch, sr->reader);
+
+        if(n == -1)
+        {
+            if(errno == EINTR)
+            { continue; }
+            perror("epoll_wait(..):sr_event.c::sr_event_loop");
+            ret = -1;
+            break;
+        }
+
+        for(i = 0; i < n && ret == 1; ++i)
+        {
+            fd = events[i].data.fd;
+
+            if(fd == sr->sockfd)
+            { ret = sr_read_commands(sr); }
+            else if(fd == ev.tfd)
+            {
+                /* -- the wheel is run at the top of the loop -- */
+                if(read(ev.tfd, &expirations, sizeof(expirations)) > 0)
+                { ev.armed = 0; }
+            }
+            else if(fd == ev.cfd)
+            {
+                if((fd = accept(ev.cfd, 0, 0)) == -1)
+                { continue; }
+                if(ev.clients >= SR_CONTROL_MAX || sr_event_add(&ev, fd) == -1)
+                {
+                    close(fd);
+                    continue;
+                }
+                ++ev.clients;
+            }
+            else
+            { sr_event_control(sr, &ev, fd); }
+        }
+    }
+
+    if(ev.cfd != -1)
+    {
+        close(ev.cfd);
+        unlink(control);
+    }
+    close(ev.tfd);
+    close(ev.epfd);
+
+    return ret;
+} /* -- sr_event_loop -- */
+
+#else /* -- _LINUX_ -- */
+
+int sr_event_loop(struct sr_instance* sr, const char* control)
+{
+    fprintf(stderr, "Error: the event loop needs epoll, run without -e\n");
+    return -1;
+} /* -- sr_event_loop -- */
+
+#endif /* -- _LINUX_ -- */
@@ -0,0 +1,36 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_event.h
+ *
+ * Description:
+ *
+ * Single threaded event loop, the alternative to the blocking read loop
+ * plus PWOSPF thread (sr -e).  One epoll set waits on the server socket,
+ * a timerfd and, optionally, a control socket:
+ *
+ *   - the server socket is drained through the receive ring as usual;
+ *   - the timerfd is kept armed for the timer wheel's next expiry, and
+ *     the wheel now also runs the PWOSPF hello/LSU tick, so there is no
+ *     thread left to sleep and no lock to take on the packet path;
+ *   - the control socket (sr -e -C path) is a UNIX stream socket that
+ *     answers one command per connection: "stats" dumps the statistics,
+ *     "counters" just the packet path counters (see sr_counters.h),
+ *     "hist" the latency histograms and "hist on|off|reset" switches
+ *     or clears them (see sr_hist.h).
+ *
+ * Transmit is flushed once per wakeup, after the timers have run.  With
+ * forwarding workers (sr -e -w n) the loop itself stays single threaded;
+ * frames the workers hand back are picked up on every wakeup.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_EVENT_H
+#define SR_EVENT_H
+
+#define SR_EVENT_MAX   16   /* events taken per epoll_wait */
+#define SR_CONTROL_MAX 8    /* control connections open at once */
+
+struct sr_instance;
+
+int sr_event_loop(struct sr_instance* sr, const char* control);
+
+#endif /* -- SR_EVENT_H -- */
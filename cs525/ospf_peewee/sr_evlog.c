@@ -0,0 +1,433 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_evlog.c
+ *
+ * Description:
+ *
+ * Event log, see sr_evlog.h.
+ *
+ *---------------------------------------------------------------------------*/
+
+#define _DEFAULT_SOURCE  /* clock_gettime, localtime_r and usleep under -ansi */
+#define _BSD_SOURCE
+
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "sr_evlog.h"
+#include "sr_router.h"
+#include "sr_if.h"
+#include "sr_counters.h"
+
+/* ----------------------------------------------------------------------------
+ * struct sr_evlog_ring
+ *
+ * A thread's records.  The thread owns 'head', the limits and the
+ * statistics; the drain owns 'tail'.
+ *
+ * -------------------------------------------------------------------------- */
+
+struct sr_evlog_limit
+{
+    uint64_t sec;         /* current one second window */
+    uint32_t n;           /* logged in it */
+    uint32_t suppressed;  /* since the last one logged */
+};
+
+struct sr_evlog_ring
+{
+    uint32_t              head;
+    uint8_t               pad0[SR_CACHE_LINE - sizeof(uint32_t)];
+    uint32_t              tail;
+    uint8_t               pad1[SR_CACHE_LINE - sizeof(uint32_t)];
+    uint16_t              id;
+    char                  name[16];
+    struct sr_evlog_limit limit[SR_LOG_MAX];
+
+    /* -- statistics -- */
+    uint64_t              logged;
+    uint64_t              suppressed;
+    uint64_t              lost;       /* ring full */
+
+    struct sr_evlog_rec   rec[SR_EVLOG_RING];
+};
+
+struct sr_evlog_event
+{
+    const char*  name;
+    const char*  fmt;   /* %I address, %i interface, %D drop reason, %u */
+    unsigned int rate;  /* records a second, per thread */
+};
+
+static const struct sr_evlog_event sr_evlog_events[SR_LOG_MAX] =
+{
+    { "drop",           "dropped, %D, in on %i", 10 },
+    { "arp-request",    "ARP request for %I", 20 },
+    { "arp-give-up",    "no ARP reply from %I, %u packets unreachable", 10 },
+    { "icmp-error",     "ICMP type %u code %u to %I out %i", 10 },
+    { "tx-no-if",       "can't send out interface %u, no such interface", 5 },
+    { "tx-runt",        "can't send %u bytes out %i, runt", 5 },
+    { "tx-bad-src",     "can't send out %i, source MAC isn't the interface's", 5 },
+    { "tx-write",       "error writing %u bytes out %i", 5 },
+    { "ospf-nbr-up",    "PWOSPF neighbor %I (%I) up on %i", 10 },
+    { "ospf-nbr-no-if", "PWOSPF hello from %I on %i, no such interface", 5 },
+    { "ospf-lsa-stale", "PWOSPF LSA from %I for %I seq %u on %i is stale, ignored", 10 },
+    { "ospf-lsu-nbr",   "PWOSPF LSU: router %I behind %i", 10 }
+};
+
+struct sr_evlog
+{
+    pthread_mutex_t       lock;  /* attaching and draining */
+    struct sr_evlog_ring* rings[SR_EVLOG_THREADS];
+    unsigned int          n;
+    struct sr_instance*   sr;
+    FILE*                 out;
+    int                   on;
+    volatile int          stop;
+    pthread_t             thread;
+    uint64_t              unattached;  /* events from threads past the last ring */
+    uint64_t              written;
+};
+
+static struct sr_evlog sr_evlog = { PTHREAD_MUTEX_INITIALIZER };
+
+static __thread struct sr_evlog_ring* sr_evlog_self = 0;
+
+/*---------------------------------------------------------------------
+ * Method: sr_evlog_attach(..)
+ * Scope:  Local
+ *
+ * A ring for the calling thread, named after its counters (see
+ * sr_counters_register).  0 if there are too many threads already.
+ *
+ *---------------------------------------------------------------------*/
+
+static struct sr_evlog_ring* sr_evlog_attach(void)
+{
+    struct sr_evlog_ring* ring = 0;
+    void* mem = 0;
+
+    pthread_mutex_lock(&sr_evlog.lock);
+    if(sr_evlog.n < SR_EVLOG_THREADS &&
+       posix_memalign(&mem, SR_CACHE_LINE, sizeof(struct sr_evlog_ring)) == 0)
+    {
+        ring = (struct sr_evlog_ring*)mem;
+        memset(ring, 0, sizeof(struct sr_evlog_ring));
+        ring->id = sr_evlog.n;
+        snprintf(ring->name, sizeof(ring->name), "%s",
+                 sr_counters_self->name[0] ? sr_counters_self->name : "-");
+        sr_evlog.rings[sr_evlog.n] = ring;
+        __atomic_store_n(&sr_evlog.n, sr_evlog.n + 1, __ATOMIC_RELEASE);
+        sr_evlog_self = ring;
+    }
+    pthread_mutex_unlock(&sr_evlog.lock);
+
+    return ring;
+} /* -- sr_evlog_attach -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_log(..)
+ * Scope:  Global
+ *
+ * Log event id with its arguments (0 for those it doesn't have).
+ * Addresses are passed as they are in the packet, in network order.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_log(unsigned int id, uint32_t a, uint32_t b, uint32_t c, uint32_t d)
+{
+    struct sr_evlog_ring* ring = sr_evlog_self;
+    struct sr_evlog_limit* limit = 0;
+    struct sr_evlog_rec* rec = 0;
+    struct timespec ts;
+    uint32_t head;
+
+    /* -- REQUIRES -- */
+    assert(id < SR_LOG_MAX);
+
+    if(!__atomic_load_n(&sr_evlog.on, __ATOMIC_RELAXED))
+    { return; }
+
+    if(ring == 0 && (ring = sr_evlog_attach()) == 0)
+    {
+        __atomic_fetch_add(&sr_evlog.unattached, 1, __ATOMIC_RELAXED);
+        return;
+    }
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+
+    limit = &ring->limit[id];
+    if(limit->sec != (uint64_t)ts.tv_sec)
+    {
+        limit->sec = ts.tv_sec;
+        limit->n   = 0;
+    }
+    if(limit->n >= sr_evlog_events[id].rate)
+    {
+        ++limit->suppressed;
+        ++ring->suppressed;
+        return;
+    }
+
+    head = ring->head;
+    if(head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) == SR_EVLOG_RING)
+    {
+        ++ring->lost;
+        return;
+    }
+
+    rec = &ring->rec[head & (SR_EVLOG_RING - 1)];
+    rec->ns         = (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+    rec->arg[0]     = a;
+    rec->arg[1]     = b;
+    rec->arg[2]     = c;
+    rec->arg[3]     = d;
+    rec->id         = id;
+    rec->thread     = ring->id;
+    rec->suppressed = limit->suppressed;
+
+    limit->suppressed = 0;
+    ++limit->n;
+    ++ring->logged;
+    __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+} /* -- sr_log -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_evlog_format(..)
+ * Scope:  Local
+ *
+ * One record as a line of text.
+ *
+ *---------------------------------------------------------------------*/
+
+static void sr_evlog_format(FILE* out, const struct sr_evlog_rec* rec)
+{
+    const char* fmt = sr_evlog_events[rec->id].fmt;
+    struct sr_if* iface = 0;
+    const uint8_t* ip = 0;
+    time_t sec = (time_t)(rec->ns / 1000000000ULL);
+    struct tm tm;
+    uint32_t v;
+    unsigned int k = 0;
+
+    localtime_r(&sec, &tm);
+    fprintf(out, "%02d:%02d:%02d.%06lu %-10s ", tm.tm_hour, tm.tm_min,
+            tm.tm_sec, (unsigned long)(rec->ns % 1000000000ULL) / 1000,
+            sr_evlog.rings[rec->thread]->name);
+
+    for(; *fmt; ++fmt)
+    {
+        if(*fmt != '%' || fmt[1] == 0)
+        {
+            fputc(*fmt, out);
+            continue;
+        }
+
+        v = rec->arg[k < 4 ? k++ : 3];
+        switch(*++fmt)
+        {
+            case 'I':
+                ip = (const uint8_t*)&v;
+                fprintf(out, "%u.%u.%u.%u", ip[0], ip[1], ip[2], ip[3]);
+                break;
+            case 'i':
+                iface = sr_get_interface_by_index(sr_evlog.sr, v);
+                if(iface)
+                { fputs(iface->name, out); }
+                else
+                { fprintf(out, "if%u", v); }
+                break;
+            case 'D':
+                fputs(sr_counters_drop_name(v), out);
+                break;
+            default:
+                fprintf(out, "%lu", (unsigned long)v);
+                break;
+        }
+    }
+
+    if(rec->suppressed)
+    { fprintf(out, " [%lu more suppressed]", (unsigned long)rec->suppressed); }
+    fputc('\n', out);
+} /* -- sr_evlog_format -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_evlog_drain(..)
+ * Scope:  Global
+ *
+ * Write out everything logged so far, oldest first across threads.
+ * Called every SR_EVLOG_NAP ms by the drain thread, and on close.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_evlog_drain(void)
+{
+    uint32_t head[SR_EVLOG_THREADS];
+    uint32_t tail[SR_EVLOG_THREADS];
+    const struct sr_evlog_rec* rec = 0;
+    const struct sr_evlog_rec* best = 0;
+    unsigned int i, n, from = 0;
+
+    pthread_mutex_lock(&sr_evlog.lock);
+    if(sr_evlog.out == 0)
+    {
+        pthread_mutex_unlock(&sr_evlog.lock);
+        return;
+    }
+
+    n = sr_evlog.n;
+    for(i = 0; i < n; ++i)
+    {
+        head[i] = __atomic_load_n(&sr_evlog.rings[i]->head, __ATOMIC_ACQUIRE);
+        tail[i] = sr_evlog.rings[i]->tail;
+    }
+
+    for(;;)
+    {
+        best = 0;
+        for(i = 0; i < n; ++i)
+        {
+            if(tail[i] == head[i])
+            { continue; }
+            rec = &sr_evlog.rings[i]->rec[tail[i] & (SR_EVLOG_RING - 1)];
+            if(best == 0 || rec->ns < best->ns)
+            {
+                best = rec;
+                from = i;
+            }
+        }
+        if(best == 0)
+        { break; }
+
+        sr_evlog_format(sr_evlog.out, best);
+        ++sr_evlog.written;
+
+        /* -- the slot is the thread's again -- */
+        __atomic_store_n(&sr_evlog.rings[from]->tail, ++tail[from],
+                         __ATOMIC_RELEASE);
+    }
+
+    fflush(sr_evlog.out);
+    pthread_mutex_unlock(&sr_evlog.lock);
+} /* -- sr_evlog_drain -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_evlog_run(..)
+ * Scope:  Local
+ *
+ * Drain thread.
+ *
+ *---------------------------------------------------------------------*/
+
+static void* sr_evlog_run(void* arg)
+{
+    while(!sr_evlog.stop)
+    {
+        usleep(SR_EVLOG_NAP * 1000);
+        sr_evlog_drain();
+    }
+
+    return 0;
+} /* -- sr_evlog_run -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_evlog_open(..)
+ * Scope:  Global
+ *
+ * Start logging to path, or to stderr if it is 0.  Returns 0, or -1 if
+ * the file can't be opened.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_evlog_open(struct sr_instance* sr, const char* path)
+{
+    FILE* out = stderr;
+
+    /* -- REQUIRES -- */
+    assert(sr);
+    assert(sr_evlog.out == 0);
+
+    if(path && (out = fopen(path, "w")) == 0)
+    {
+        perror("fopen(..):sr_evlog.c::sr_evlog_open");
+        return -1;
+    }
+
+    sr_evlog.sr   = sr;
+    sr_evlog.out  = out;
+    sr_evlog.stop = 0;
+
+    if(pthread_create(&sr_evlog.thread, 0, sr_evlog_run, 0) != 0)
+    {
+        perror("pthread_create(..):sr_evlog.c::sr_evlog_open");
+        if(out != stderr)
+        { fclose(out); }
+        sr_evlog.out = 0;
+        return -1;
+    }
+
+    __atomic_store_n(&sr_evlog.on, 1, __ATOMIC_RELEASE);
+    return 0;
+} /* -- sr_evlog_open -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_evlog_close(..)
+ * Scope:  Global
+ *
+ * Stop logging and write out what is left.  The rings stay, other
+ * threads may still hold on to theirs.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_evlog_close(void)
+{
+    if(sr_evlog.out == 0)
+    { return; }
+
+    __atomic_store_n(&sr_evlog.on, 0, __ATOMIC_RELEASE);
+    sr_evlog.stop = 1;
+    pthread_join(sr_evlog.thread, 0);
+    sr_evlog_drain();
+
+    pthread_mutex_lock(&sr_evlog.lock);
+    if(sr_evlog.out != stderr)
+    { fclose(sr_evlog.out); }
+    sr_evlog.out = 0;
+    pthread_mutex_unlock(&sr_evlog.lock);
+} /* -- sr_evlog_close -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_evlog_print_stats(..)
+ * Scope:  Global
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_evlog_print_stats(FILE* out)
+{
+    const struct sr_evlog_ring* ring = 0;
+    uint64_t logged = 0, suppressed = 0, lost = 0;
+    unsigned int i, n;
+
+    /* -- REQUIRES -- */
+    assert(out);
+
+    n = __atomic_load_n(&sr_evlog.n, __ATOMIC_ACQUIRE);
+    for(i = 0; i < n; ++i)
+    {
+        ring = sr_evlog.rings[i];
+        logged     += __atomic_load_n(&ring->logged, __ATOMIC_RELAXED);
+        suppressed += __atomic_load_n(&ring->suppressed, __ATOMIC_RELAXED);
+        lost       += __atomic_load_n(&ring->lost, __ATOMIC_RELAXED);
+    }
+
+    fprintf(out, "evlog: %u threads, %lu logged, %lu written, %lu suppressed, "
+            "%lu lost (ring full), %lu lost (too many threads)\n", n,
+            (unsigned long)logged,
+            (unsigned long)__atomic_load_n(&sr_evlog.written, __ATOMIC_RELAXED),
+            (unsigned long)suppressed, (unsigned long)lost,
+            (unsigned long)__atomic_load_n(&sr_evlog.unattached,
+                                           __ATOMIC_RELAXED));
+} /* -- sr_evlog_print_stats -- */
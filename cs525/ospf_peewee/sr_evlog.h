@@ -0,0 +1,86 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_evlog.h
+ *
+ * Description:
+ *
+ * Event log.  The packet path and PWOSPF used to printf what they ran
+ * into (the address of every ARP request, the neighbor behind every LSU
+ * interface, ...), which under load left the router waiting on the
+ * terminal.  Now they log a fixed size binary record instead - an event
+ * id, a timestamp and up to four 32 bit arguments - and a drain thread
+ * formats the records and writes them out (sr -L, stderr by default).
+ *
+ * Each thread logs into a ring of its own, attached on its first event;
+ * the thread is the only producer and the drain the only consumer, so
+ * logging takes no lock.  Every event has a rate limit, per thread:
+ * past that many records in a second the rest are only counted, and the
+ * next record that gets through says how many were suppressed.  A full
+ * ring drops records rather than wait, and counts those too.
+ *
+ * Records from different threads are merged back into time order when
+ * drained.  Without sr_evlog_open nothing is recorded.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_EVLOG_H
+#define SR_EVLOG_H
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif /* _DARWIN_ */
+
+#include <stdio.h>
+
+#include "sr_ring.h"
+
+#define SR_EVLOG_RING    1024  /* records per thread, power of two */
+#define SR_EVLOG_THREADS 32    /* most threads that log */
+#define SR_EVLOG_NAP     100   /* ms between drains */
+
+struct sr_instance;
+
+/* -- events; arguments as in sr_evlog.c's table -- */
+enum sr_log_id
+{
+    SR_LOG_DROP = 0,         /* drop reason, ifindex */
+    SR_LOG_ARP_REQUEST,      /* next hop */
+    SR_LOG_ARP_GIVE_UP,      /* next hop, packets waiting */
+    SR_LOG_ICMP_ERROR,       /* type, code, destination, ifindex */
+    SR_LOG_TX_NO_IF,         /* ifindex */
+    SR_LOG_TX_RUNT,          /* length, ifindex */
+    SR_LOG_TX_BAD_SRC,       /* ifindex */
+    SR_LOG_TX_WRITE,         /* length, ifindex */
+    SR_LOG_OSPF_NBR_UP,      /* router id, neighbor address, ifindex */
+    SR_LOG_OSPF_NBR_NO_IF,   /* router id, ifindex */
+    SR_LOG_OSPF_LSA_STALE,   /* router id, subnet, sequence, ifindex */
+    SR_LOG_OSPF_LSU_NBR,     /* router id, ifindex */
+    SR_LOG_MAX
+};
+
+/* ----------------------------------------------------------------------------
+ * struct sr_evlog_rec
+ *
+ * One event, as logged.
+ *
+ * -------------------------------------------------------------------------- */
+
+struct sr_evlog_rec
+{
+    uint64_t ns;          /* CLOCK_REALTIME */
+    uint32_t arg[4];
+    uint16_t id;
+    uint16_t thread;      /* ring it came from */
+    uint32_t suppressed;  /* of this event since the last one logged */
+};
+
+int  sr_evlog_open(struct sr_instance* sr, const char* path);
+void sr_evlog_close(void);
+void sr_log(unsigned int id, uint32_t a, uint32_t b, uint32_t c, uint32_t d);
+void sr_evlog_drain(void);
+void sr_evlog_print_stats(FILE* out);
+
+#endif /* -- SR_EVLOG_H -- */
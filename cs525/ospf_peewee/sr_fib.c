@@ -0,0 +1,348 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_fib.c
+ *
+ * Description:
+ *
+ * Builds the DIR-16-8-8 forwarding trie described in sr_fib.h from the
+ * interface list, the static routing table and the PWOSPF dynamic table.
+ *
+ * Routes are inserted shortest prefix first so that a longer prefix simply
+ * overwrites the slots of any shorter one it covers; a child chunk is only
+ * created when a prefix ends below a stride boundary, and it starts out as
+ * a copy of the entry it replaces.  Equal prefixes are inserted least
+ * preferred first: higher administrative distance, then more hops, then
+ * earlier in their table.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "sr_fib.h"
+#include "sr_rt.h"
+#include "sr_router.h"
+#include "sr_pwospf.h"
+#include "sr_epoch.h"
+
+struct sr_fib_ent
+{
+    uint32_t prefix;  /* host byte order, already masked */
+    int      len;
+    uint32_t order;   /* position in sr_fib.routes */
+};
+
+/*---------------------------------------------------------------------
+ * Method: sr_fib_prefix_len(..)
+ * Scope:  Local
+ *
+ * Number of leading one bits in a (host order) mask.  Bits after the
+ * first zero are ignored, as they always have been by the router.
+ *
+ *---------------------------------------------------------------------*/
+
+static int sr_fib_prefix_len(uint32_t mask)
+{
+    int len = 0;
+
+    while(len < 32 && (mask & (0x80000000 >> len)))
+    { ++len; }
+
+    return len;
+} /* -- sr_fib_prefix_len -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_fib_new_chunk(..)
+ * Scope:  Local
+ *
+ * Allocate a child chunk with every slot set to 'fill' and return its
+ * index.
+ *
+ *---------------------------------------------------------------------*/
+
+static uint32_t sr_fib_new_chunk(struct sr_fib* fib, uint32_t fill)
+{
+    uint32_t i;
+    uint32_t* chunk;
+
+    if(fib->nchunks == fib->chunk_cap)
+    {
+        fib->chunk_cap = fib->chunk_cap ? fib->chunk_cap * 2 : 16;
+        fib->chunks = (uint32_t*)realloc(fib->chunks,
+                fib->chunk_cap * SR_FIB_CHUNK * sizeof(uint32_t));
+        assert(fib->chunks);
+    }
+
+    chunk = fib->chunks + fib->nchunks * SR_FIB_CHUNK;
+    for(i = 0; i < SR_FIB_CHUNK; ++i)
+    { chunk[i] = fill; }
+
+    return fib->nchunks++;
+} /* -- sr_fib_new_chunk -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_fib_insert(..)
+ * Scope:  Local
+ *
+ * Point every slot covered by prefix/len at next hop 'nh'.  Must be
+ * called in order of non-decreasing prefix length.
+ *
+ *---------------------------------------------------------------------*/
+
+static void sr_fib_insert(struct sr_fib* fib, uint32_t prefix, int len,
+                          uint32_t nh)
+{
+    uint32_t i, first, count, c2, c3, e;
+
+    if(len <= 16)
+    {
+        first = prefix >> 16;
+        count = 1 << (16 - len);
+        for(i = 0; i < count; ++i)
+        { fib->l1[first + i] = nh; }
+        return;
+    }
+
+    e = fib->l1[prefix >> 16];
+    if(e & SR_FIB_EXT)
+    { c2 = e & ~SR_FIB_EXT; }
+    else
+    {
+        c2 = sr_fib_new_chunk(fib, e);
+        fib->l1[prefix >> 16] = SR_FIB_EXT | c2;
+    }
+
+    if(len <= 24)
+    {
+        first = (prefix >> 8) & 0xff;
+        count = 1 << (24 - len);
+        for(i = 0; i < count; ++i)
+        { fib->chunks[c2 * SR_FIB_CHUNK + first + i] = nh; }
+        return;
+    }
+
+    e = fib->chunks[c2 * SR_FIB_CHUNK + ((prefix >> 8) & 0xff)];
+    if(e & SR_FIB_EXT)
+    { c3 = e & ~SR_FIB_EXT; }
+    else
+    {
+        c3 = sr_fib_new_chunk(fib, e);
+        fib->chunks[c2 * SR_FIB_CHUNK + ((prefix >> 8) & 0xff)] =
+            SR_FIB_EXT | c3;
+    }
+
+    first = prefix & 0xff;
+    count = 1 << (32 - len);
+    for(i = 0; i < count; ++i)
+    { fib->chunks[c3 * SR_FIB_CHUNK + first + i] = nh; }
+} /* -- sr_fib_insert -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_fib_add_route(..)
+ * Scope:  Local
+ *
+ *---------------------------------------------------------------------*/
+
+static void sr_fib_add_route(struct sr_fib* fib, uint32_t* cap,
+                             uint32_t dest, uint32_t gw, uint32_t mask,
+                             unsigned int ifindex, uint8_t source,
+                             uint8_t distance, uint8_t metric)
+{
+    struct sr_fib_route* r = 0;
+
+    if(fib->nroutes == *cap)
+    {
+        *cap *= 2;
+        fib->routes = (struct sr_fib_route*)realloc(fib->routes,
+                *cap * sizeof(struct sr_fib_route));
+        assert(fib->routes);
+    }
+
+    r = &fib->routes[fib->nroutes++];
+    r->dest.s_addr = dest;
+    r->gw.s_addr   = gw;
+    r->mask.s_addr = mask;
+    r->ifindex  = ifindex;
+    r->source   = source;
+    r->distance = distance;
+    r->metric   = metric;
+    r->adj      = 0;
+} /* -- sr_fib_add_route -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_fib_cmp_pref(..)
+ * Scope:  Local
+ *
+ * Orders routes for insertion; see the note at the top of the file.
+ *
+ *---------------------------------------------------------------------*/
+
+static const struct sr_fib_route* sr_fib_sort_routes;
+
+static int sr_fib_cmp_pref(const void* a, const void* b)
+{
+    const struct sr_fib_ent* x = (const struct sr_fib_ent*)a;
+    const struct sr_fib_ent* y = (const struct sr_fib_ent*)b;
+    const struct sr_fib_route* rx = &sr_fib_sort_routes[x->order];
+    const struct sr_fib_route* ry = &sr_fib_sort_routes[y->order];
+
+    if(x->len != y->len)
+    { return x->len - y->len; }
+    if(rx->distance != ry->distance)
+    { return ry->distance - rx->distance; }
+    if(rx->metric != ry->metric)
+    { return ry->metric - rx->metric; }
+    return (x->order < y->order) ? -1 : (x->order > y->order);
+} /* -- sr_fib_cmp_pref -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_fib_build(..)
+ * Scope:  Global
+ *
+ * Compile every route source of the router into a new trie.  Routes are
+ * copied in, so the trie does not depend on the tables it came from.
+ * Expired PWOSPF routes and ones without a known gateway are left out, as
+ * are static routes through an interface we don't have (yet).
+ *
+ * The caller must hold the pwospf lock once that subsystem is running.
+ *
+ *---------------------------------------------------------------------*/
+
+struct sr_fib* sr_fib_build(struct sr_instance* sr)
+{
+    struct sr_fib* fib = 0;
+    struct sr_fib_ent* ents = 0;
+    struct sr_if* if_walker = 0;
+    struct sr_if* rt_iface = 0;
+    struct sr_rt* rt_walker = 0;
+    dynrt* drt_walker = 0;
+    uint32_t cap = 16, n, i;
+
+    /* -- REQUIRES -- */
+    assert(sr);
+
+    fib = (struct sr_fib*)calloc(1, sizeof(struct sr_fib));
+    assert(fib);
+    fib->l1 = (uint32_t*)calloc(SR_FIB_L1_SIZE, sizeof(uint32_t));
+    assert(fib->l1);
+    fib->routes = (struct sr_fib_route*)calloc(cap,
+                                               sizeof(struct sr_fib_route));
+    assert(fib->routes);
+    fib->nroutes = 1; /* -- slot 0 is "no route" -- */
+
+    for(if_walker = sr->if_list; if_walker; if_walker = if_walker->next)
+    {
+        if(if_walker->ip == 0)
+        { continue; }
+        sr_fib_add_route(fib, &cap, if_walker->ip & if_walker->mask, 0,
+                         if_walker->mask, if_walker->ifindex,
+                         SR_FIB_CONNECTED, SR_FIB_AD_CONNECTED, 0);
+    }
+
+    for(rt_walker = sr->routing_table; rt_walker; rt_walker = rt_walker->next)
+    {
+        rt_iface = sr_get_interface(sr, rt_walker->interface);
+        if(rt_iface == 0)
+        { continue; }
+        sr_fib_add_route(fib, &cap, rt_walker->dest.s_addr,
+                         rt_walker->gw.s_addr, rt_walker->mask.s_addr,
+                         rt_iface->ifindex,
+                         SR_FIB_STATIC, SR_FIB_AD_STATIC, 0);
+    }
+
+    if(sr->ospf_subsys)
+    {
+        for(drt_walker = sr->ospf_subsys->drt; drt_walker;
+            drt_walker = drt_walker->next)
+        {
+            if(drt_walker->ttl == TIME_EXPIRED || drt_walker->gw.s_addr == 0)
+            { continue; }
+            sr_fib_add_route(fib, &cap, drt_walker->dest.s_addr,
+                             drt_walker->gw.s_addr, drt_walker->mask.s_addr,
+                             drt_walker->ifindex,
+                             SR_FIB_PWOSPF, SR_FIB_AD_PWOSPF,
+                             drt_walker->numHops);
+        }
+    }
+
+    n = fib->nroutes - 1;
+    if(n == 0)
+    { return fib; }
+
+    ents = (struct sr_fib_ent*)malloc(n * sizeof(struct sr_fib_ent));
+    assert(ents);
+
+    for(i = 0; i < n; ++i)
+    {
+        const struct sr_fib_route* r = &fib->routes[i + 1];
+        ents[i].len    = sr_fib_prefix_len(ntohl(r->mask.s_addr));
+        ents[i].prefix = ntohl(r->dest.s_addr) &
+                         (ents[i].len ? 0xffffffff << (32 - ents[i].len) : 0);
+        ents[i].order  = i + 1;
+    }
+
+    /* -- builds are serialised by the pwospf lock -- */
+    sr_fib_sort_routes = fib->routes;
+    qsort(ents, n, sizeof(struct sr_fib_ent), sr_fib_cmp_pref);
+
+    for(i = 0; i < n; ++i)
+    { sr_fib_insert(fib, ents[i].prefix, ents[i].len, ents[i].order); }
+
+    free(ents);
+    return fib;
+} /* -- sr_fib_build -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_fib_free(..)
+ * Scope:  Global
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_fib_free(struct sr_fib* fib)
+{
+    if(fib == 0)
+    { return; }
+
+    free(fib->l1);
+    free(fib->chunks);
+    free(fib->routes);
+    free(fib);
+} /* -- sr_fib_free -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_fib_rebuild(..)
+ * Scope:  Global
+ *
+ * Recompile the router's trie after any route source has changed.  Same
+ * locking rule as sr_fib_build.
+ *
+ * The forwarding path reads sr->fib without a lock, so the new table is
+ * published with a release store and the one it replaces is retired to
+ * the epoch (see sr_epoch.h), to be freed once no reader can hold it.
+ *
+ *---------------------------------------------------------------------*/
+
+static void sr_fib_release(void* fib)
+{
+    sr_fib_free((struct sr_fib*)fib);
+} /* -- sr_fib_release -- */
+
+void sr_fib_rebuild(struct sr_instance* sr)
+{
+    struct sr_fib* fib = 0;
+    struct sr_fib* old = 0;
+
+    /* -- REQUIRES -- */
+    assert(sr);
+
+    fib = sr_fib_build(sr);
+
+    old = sr->fib;
+    __atomic_store_n(&sr->fib, fib, __ATOMIC_RELEASE);
+    sr_epoch_retire(sr->epoch, old, sr_fib_release);
+} /* -- sr_fib_rebuild -- */
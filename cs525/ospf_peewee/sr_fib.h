@@ -0,0 +1,124 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_fib.h
+ *
+ * Description:
+ *
+ * Forwarding information base.  Connected subnets, static routes and
+ * routes learned through PWOSPF are merged into one table, so a single
+ * lookup resolves a packet's egress.  Lookups walk a three level multibit
+ * trie with 16-8-8 bit strides (DIR-16-8-8), so a longest prefix match
+ * costs at most three table reads no matter how many routes are loaded.
+ *
+ * The trie is never modified in place; whenever a route source changes a
+ * fresh one is built and swapped in.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_FIB_H
+#define SR_FIB_H
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif /* _DARWIN_ */
+
+#include <netinet/in.h>
+
+#include "sr_if.h"
+
+#define SR_FIB_L1_BITS   16
+#define SR_FIB_L1_SIZE   (1 << SR_FIB_L1_BITS)
+#define SR_FIB_CHUNK     256         /* entries in a level 2/3 chunk */
+#define SR_FIB_EXT       0x80000000  /* entry is a child chunk index */
+
+/* -- route sources, see struct sr_fib_route -- */
+#define SR_FIB_CONNECTED 0
+#define SR_FIB_PWOSPF    1
+#define SR_FIB_STATIC    2
+
+/* -- administrative preference between sources of an equal prefix; lower
+ *    wins.  Learned routes have always been trusted over the static file. -- */
+#define SR_FIB_AD_CONNECTED 0
+#define SR_FIB_AD_PWOSPF    10
+#define SR_FIB_AD_STATIC    20
+
+struct sr_instance;
+struct sr_adj;
+
+/* ----------------------------------------------------------------------------
+ * struct sr_fib_route
+ *
+ * A route as installed in the FIB.  These are copies, so they stay valid
+ * for the life of the trie even while the PWOSPF thread edits its table.
+ * A gateway of 0 means the destination is directly reachable.  'adj' is
+ * only ever set by the packet handling thread, with a release store;
+ * forwarding workers load it with acquire.
+ *
+ * -------------------------------------------------------------------------- */
+
+struct sr_fib_route
+{
+    struct in_addr dest;
+    struct in_addr gw;
+    struct in_addr mask;
+    unsigned int ifindex;
+    uint8_t source;    /* SR_FIB_CONNECTED etc. */
+    uint8_t distance;  /* administrative preference */
+    uint8_t metric;    /* hop count for PWOSPF routes */
+    struct sr_adj* adj; /* gateway's adjacency, bound on first use */
+};
+
+/* ----------------------------------------------------------------------------
+ * struct sr_fib
+ *
+ * Trie entries hold either a route index (0 means no route) or, with
+ * SR_FIB_EXT set, the index of a 256 entry chunk covering the next 8 bits.
+ *
+ * -------------------------------------------------------------------------- */
+
+struct sr_fib
+{
+    uint32_t*            l1;      /* indexed by the top 16 address bits */
+    uint32_t*            chunks;  /* level 2 and 3 chunks, back to back */
+    uint32_t             nchunks;
+    uint32_t             chunk_cap;
+    struct sr_fib_route* routes;  /* routes[0] is unused */
+    uint32_t             nroutes;
+};
+
+struct sr_fib* sr_fib_build(struct sr_instance* sr);
+void sr_fib_free(struct sr_fib* fib);
+void sr_fib_rebuild(struct sr_instance* sr);
+
+/*---------------------------------------------------------------------
+ * Method: sr_fib_lookup(..)
+ *
+ * Longest prefix match for an address in network byte order.  Returns
+ * the preferred route or 0 if nothing matches.
+ *
+ *---------------------------------------------------------------------*/
+
+static __inline__
+struct sr_fib_route* sr_fib_lookup(const struct sr_fib* fib, uint32_t ip_nbo)
+{
+    uint32_t a = ntohl(ip_nbo);
+    uint32_t e;
+
+    if(fib == 0)
+    { return 0; }
+
+    e = fib->l1[a >> 16];
+    if(e & SR_FIB_EXT)
+    {
+        e = fib->chunks[(e & ~SR_FIB_EXT) * SR_FIB_CHUNK + ((a >> 8) & 0xff)];
+        if(e & SR_FIB_EXT)
+        { e = fib->chunks[(e & ~SR_FIB_EXT) * SR_FIB_CHUNK + (a & 0xff)]; }
+    }
+
+    return e ? &fib->routes[e] : 0;
+} /* -- sr_fib_lookup -- */
+
+#endif /* -- SR_FIB_H -- */
@@ -0,0 +1,127 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_graph.c
+ *
+ * Description:
+ *
+ * Scheduling and statistics for the packet processing graph described in
+ * sr_graph.h.  The nodes themselves live in sr_router.c.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+
+#include "sr_graph.h"
+
+/*---------------------------------------------------------------------
+ * Method: sr_graph_init(..)
+ * Scope:  Global
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_graph_init(struct sr_graph* graph)
+{
+    /* -- REQUIRES -- */
+    assert(graph);
+
+    memset(graph, 0, sizeof(struct sr_graph));
+} /* -- sr_graph_init -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_graph_register(..)
+ * Scope:  Global
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_graph_register(struct sr_graph* graph, unsigned int id,
+                       const char* name, sr_node_fn fn)
+{
+    /* -- REQUIRES -- */
+    assert(graph);
+    assert(id < SR_NODE_COUNT);
+    assert(name);
+    assert(fn);
+
+    graph->nodes[id].name = name;
+    graph->nodes[id].fn   = fn;
+} /* -- sr_graph_register -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_graph_run_node(..)
+ * Scope:  Global
+ *
+ * Give node 'id' its pending vector.  The node only enqueues to nodes
+ * after it, so its own vector can be handed over in place and emptied
+ * once it returns.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_graph_run_node(struct sr_graph* graph, struct sr_instance* sr,
+                       unsigned int id)
+{
+    struct sr_node* node = &graph->nodes[id];
+    unsigned int n = node->npending;
+    uint64_t start;
+
+    if(n == 0)
+    { return; }
+
+    start = sr_graph_clock();
+    node->fn(sr, node->pending, n);
+    node->cycles += sr_graph_clock() - start;
+
+    node->npending = 0;
+    node->calls   += 1;
+    node->packets += n;
+} /* -- sr_graph_run_node -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_graph_run(..)
+ * Scope:  Global
+ *
+ * Run every node with pending packets, in order, until none are left.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_graph_run(struct sr_graph* graph, struct sr_instance* sr)
+{
+    unsigned int id;
+
+    /* -- REQUIRES -- */
+    assert(graph);
+
+    for(id = 0; id < SR_NODE_COUNT; ++id)
+    { sr_graph_run_node(graph, sr, id); }
+} /* -- sr_graph_run -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_graph_print_stats(..)
+ * Scope:  Global
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_graph_print_stats(const struct sr_graph* graph, FILE* out)
+{
+    const struct sr_node* node = 0;
+    unsigned int id;
+
+    /* -- REQUIRES -- */
+    assert(graph);
+    assert(out);
+
+    fprintf(out, "%-16s %12s %12s %12s %12s\n",
+            "node", "calls", "packets", "cycles/pkt", "pkts/call");
+
+    for(id = 0; id < SR_NODE_COUNT; ++id)
+    {
+        node = &graph->nodes[id];
+        if(node->name == 0)
+        { continue; }
+
+        fprintf(out, "%-16s %12lu %12lu %12.1f %12.1f\n", node->name,
+                (unsigned long)node->calls, (unsigned long)node->packets,
+                node->packets ? (double)node->cycles / node->packets : 0.0,
+                node->calls ? (double)node->packets / node->calls : 0.0);
+    }
+} /* -- sr_graph_print_stats -- */
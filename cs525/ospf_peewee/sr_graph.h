@@ -0,0 +1,159 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_graph.h
+ *
+ * Description:
+ *
+ * Packet processing graph.  Received packets are handled by a fixed set of
+ * nodes (ethernet-input, arp-input, ip4-input, ...), each of which takes a
+ * vector of up to SR_VECTOR_SIZE packets, does one step of the work for all
+ * of them and hands each packet on to the next node.  Running one small
+ * loop over many packets keeps that node's code and data hot in the cache,
+ * and lets it prefetch the headers of the packet after the one it is on.
+ *
+ * Node ids are in topological order: a node only ever enqueues packets to
+ * nodes with a higher id, so one pass over the nodes drains the graph.
+ *
+ * Every node counts the calls made to it, the packets it has seen and the
+ * cycles (TSC ticks where available) it has spent.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_GRAPH_H
+#define SR_GRAPH_H
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif /* _DARWIN_ */
+
+#include <stdio.h>
+#include <sys/time.h>
+
+#include "sr_protocol.h"
+
+#define SR_VECTOR_SIZE 256   /* most packets handed to a node per call */
+
+/* -- node ids, in the order the nodes run -- */
+#define SR_NODE_ETHERNET_INPUT  0
+#define SR_NODE_ARP_INPUT       1
+#define SR_NODE_IP4_INPUT       2
+#define SR_NODE_ICMP_LOCAL      3
+#define SR_NODE_OSPF_INPUT      4
+#define SR_NODE_IP4_LOOKUP      5
+#define SR_NODE_IP4_REWRITE     6
+#define SR_NODE_ERROR_DROP      7
+#define SR_NODE_COUNT           8
+
+struct sr_instance;
+struct sr_if;
+struct sr_adj;
+
+/* ----------------------------------------------------------------------------
+ * struct sr_pkt
+ *
+ * A received packet and what the nodes have learned about it so far.  The
+ * buffer is lent by the caller for the duration of the graph run.
+ *
+ * -------------------------------------------------------------------------- */
+
+struct sr_pkt
+{
+    uint8_t*       buf;      /* complete ethernet frame */
+    unsigned int   len;
+    unsigned int   ifindex;  /* interface it was received on */
+    struct ip*     ip;       /* ip4-input: the IP header */
+    struct sr_if*  local;    /* ip4-input: our interface it is addressed to */
+    struct sr_adj* adj;      /* ip4-lookup: where to send it */
+    uint8_t        orig[sizeof(struct ip) + 8]; /* quoted by ICMP errors */
+    uint64_t       t0;       /* clock when its vector came in, 0 untimed */
+};
+
+typedef void (*sr_node_fn)(struct sr_instance* sr,
+                           struct sr_pkt** pkts, unsigned int n);
+
+struct sr_node
+{
+    const char*    name;
+    sr_node_fn     fn;
+    struct sr_pkt* pending[SR_VECTOR_SIZE];
+    unsigned int   npending;
+
+    /* -- statistics -- */
+    uint64_t       calls;
+    uint64_t       packets;
+    uint64_t       cycles;
+};
+
+struct sr_graph
+{
+    struct sr_node nodes[SR_NODE_COUNT];
+};
+
+void sr_graph_init(struct sr_graph* graph);
+void sr_graph_register(struct sr_graph* graph, unsigned int id,
+                       const char* name, sr_node_fn fn);
+void sr_graph_run_node(struct sr_graph* graph, struct sr_instance* sr,
+                       unsigned int id);
+void sr_graph_run(struct sr_graph* graph, struct sr_instance* sr);
+void sr_graph_print_stats(const struct sr_graph* graph, FILE* out);
+
+/*---------------------------------------------------------------------
+ * Method: sr_graph_clock(..)
+ *
+ * Cycle counter for the node statistics.  Falls back to microseconds on
+ * machines without a TSC.
+ *
+ *---------------------------------------------------------------------*/
+
+static __inline__ uint64_t sr_graph_clock(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __builtin_ia32_rdtsc();
+#else
+    struct timeval tv;
+    gettimeofday(&tv, 0);
+    return (uint64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+#endif
+} /* -- sr_graph_clock -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_graph_enqueue(..)
+ *
+ * Hand a packet to node 'id'.  Should its vector be full the node is run
+ * at once to make room.
+ *
+ *---------------------------------------------------------------------*/
+
+static __inline__ void sr_graph_enqueue(struct sr_graph* graph,
+                                        struct sr_instance* sr,
+                                        unsigned int id, struct sr_pkt* pkt)
+{
+    struct sr_node* node = &graph->nodes[id];
+
+    if(node->npending == SR_VECTOR_SIZE)
+    { sr_graph_run_node(graph, sr, id); }
+
+    node->pending[node->npending++] = pkt;
+} /* -- sr_graph_enqueue -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_pkt_prefetch(..)
+ *
+ * Start loading the headers of a packet a node will get to shortly.  The
+ * Ethernet and IP headers fit in one cache line unless the buffer starts
+ * near the end of one, so the line holding the end of the IP header is
+ * fetched as well.
+ *
+ *---------------------------------------------------------------------*/
+
+static __inline__ void sr_pkt_prefetch(const struct sr_pkt* pkt)
+{
+    __builtin_prefetch(pkt->buf);
+    __builtin_prefetch(pkt->buf + sizeof(struct sr_ethernet_hdr) +
+                       sizeof(struct ip) - 1);
+} /* -- sr_pkt_prefetch -- */
+
+#endif /* -- SR_GRAPH_H -- */
@@ -0,0 +1,84 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_hash.h
+ *
+ * Description:
+ *
+ * What the router's open addressing tables (the ARP cache, the ARP queue,
+ * the adjacency index and the local address set) have in common: the
+ * hash of an IPv4 address and backward shift deletion for linear probing.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_HASH_H
+#define SR_HASH_H
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif /* _DARWIN_ */
+
+#include <stddef.h>
+#include <string.h>
+
+/*---------------------------------------------------------------------
+ * Method: sr_hash32(..)
+ *
+ * Murmur3 finalizer.  Neighbors tend to share their leading octets, so
+ * every address bit has to reach the low bits tables index with.
+ *
+ *---------------------------------------------------------------------*/
+
+static __inline__ uint32_t sr_hash32(uint32_t x)
+{
+    x ^= x >> 16;
+    x *= 0x85ebca6bU;
+    x ^= x >> 13;
+    x *= 0xc2b2ae35U;
+    x ^= x >> 16;
+
+    return x;
+} /* -- sr_hash32 -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_hash_remove(..)
+ *
+ * Backward shift deletion from a table of mask + 1 slots of size bytes
+ * each, hashed with sr_hash32 and probed linearly.  'key' tells whether
+ * a slot is in use and, if it is, puts its key in *k.  After slot 'hole'
+ * has been given up, later members of its probe run whose home slot does
+ * not lie between the hole and their current position are pulled
+ * forward, so no tombstones are needed.  Returns the slot left over,
+ * which the caller empties.
+ *
+ *---------------------------------------------------------------------*/
+
+typedef int (*sr_hash_key_fn)(const void* slot, uint32_t* k);
+
+static __inline__ uint32_t sr_hash_remove(void* slots, size_t size,
+                                          uint32_t mask, uint32_t hole,
+                                          sr_hash_key_fn key)
+{
+    uint8_t* s = (uint8_t*)slots;
+    uint32_t i = hole, k, home;
+
+    for(;;)
+    {
+        i = (i + 1) & mask;
+        if(!key(s + i * size, &k))
+        { break; }
+
+        home = sr_hash32(k) & mask;
+        if(((i - home) & mask) >= ((i - hole) & mask))
+        {
+            memcpy(s + hole * size, s + i * size, size);
+            hole = i;
+        }
+    }
+
+    return hole;
+} /* -- sr_hash_remove -- */
+
+#endif /* -- SR_HASH_H -- */
@@ -0,0 +1,327 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_hist.c
+ *
+ * Description:
+ *
+ * Latency histograms, see sr_hist.h.
+ *
+ *---------------------------------------------------------------------------*/
+
+#define _DEFAULT_SOURCE  /* sigaction, SA_RESTART and clock_gettime under -ansi */
+#define _BSD_SOURCE
+
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "sr_hist.h"
+#include "sr_counters.h"
+
+int sr_hist_on = 0;
+uint64_t sr_hist_gen = 1;
+__thread struct sr_hist_block* sr_hist_self = 0;
+
+/* -- threads that found every block taken stop asking -- */
+static __thread int sr_hist_left_out = 0;
+
+static struct
+{
+    struct sr_hist_block* blocks[SR_HIST_THREADS];
+    unsigned int          n;
+    unsigned int          left_out;
+    double                cycles_per_us;
+    pthread_mutex_t       lock;
+} sr_hist = { { 0 }, 0, 0, 0.0, PTHREAD_MUTEX_INITIALIZER };
+
+static const char* sr_hist_names[SR_HIST_MAX] =
+{
+    "transit",
+    "icmp-local",
+    "arp",
+    "ospf-hello",
+    "ospf-lsu",
+    "handlepackets",
+    "checkArpcache",
+    "findAdjacency",
+    "forwardPacket",
+    "generateICMP",
+    "lsu-handler",
+    "sr_send_packet"
+};
+
+/*---------------------------------------------------------------------
+ * Method: sr_hist_attach(..)
+ * Scope:  Global
+ *
+ * The calling thread's histograms, cleared for the current generation.
+ * Allocated, and named after the thread's counters, the first time.  0
+ * if there are too many threads already.
+ *
+ *---------------------------------------------------------------------*/
+
+struct sr_hist_block* sr_hist_attach(void)
+{
+    struct sr_hist_block* b = sr_hist_self;
+    void* mem = 0;
+
+    if(b == 0)
+    {
+        if(sr_hist_left_out)
+        { return 0; }
+
+        pthread_mutex_lock(&sr_hist.lock);
+        if(sr_hist.n < SR_HIST_THREADS &&
+           posix_memalign(&mem, SR_CACHE_LINE,
+                          sizeof(struct sr_hist_block)) == 0)
+        {
+            b = (struct sr_hist_block*)mem;
+            memset(b, 0, sizeof(struct sr_hist_block));
+            strncpy(b->name, sr_counters_self->name[0] ?
+                    sr_counters_self->name : "-", sizeof(b->name));
+            sr_hist.blocks[sr_hist.n] = b;
+            __atomic_store_n(&sr_hist.n, sr_hist.n + 1, __ATOMIC_RELEASE);
+            sr_hist_self = b;
+        }
+        else
+        {
+            ++sr_hist.left_out;
+            sr_hist_left_out = 1;
+        }
+        pthread_mutex_unlock(&sr_hist.lock);
+
+        if(b == 0)
+        { return 0; }
+    }
+    else
+    {
+        /* -- hide it from readers while it's being cleared -- */
+        __atomic_store_n(&b->gen, 0, __ATOMIC_RELEASE);
+        memset(b->h, 0, sizeof(b->h));
+    }
+
+    __atomic_store_n(&b->gen, __atomic_load_n(&sr_hist_gen, __ATOMIC_RELAXED),
+                     __ATOMIC_RELEASE);
+    return b;
+} /* -- sr_hist_attach -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_hist_calibrate(..)
+ * Scope:  Local
+ *
+ * Clock ticks per microsecond, so that what is printed is in time.
+ *
+ *---------------------------------------------------------------------*/
+
+static double sr_hist_calibrate(void)
+{
+    struct timespec t0, t1, nap = { 0, 20000000 };
+    uint64_t c0, c1;
+    double us;
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    c0 = sr_graph_clock();
+    nanosleep(&nap, 0);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    c1 = sr_graph_clock();
+
+    us = (t1.tv_sec - t0.tv_sec) * 1e6 + (t1.tv_nsec - t0.tv_nsec) / 1e3;
+    return us > 0 && c1 > c0 ? (c1 - c0) / us : 1.0;
+} /* -- sr_hist_calibrate -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_hist_enable(..)
+ * Scope:  Global
+ *
+ * Turn recording on or off.  What was recorded is kept either way.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_hist_enable(int on)
+{
+    pthread_mutex_lock(&sr_hist.lock);
+    if(on && sr_hist.cycles_per_us == 0.0)
+    { sr_hist.cycles_per_us = sr_hist_calibrate(); }
+    pthread_mutex_unlock(&sr_hist.lock);
+
+    __atomic_store_n(&sr_hist_on, on ? 1 : 0, __ATOMIC_RELAXED);
+} /* -- sr_hist_enable -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_hist_reset(..)
+ * Scope:  Global
+ *
+ * Forget everything recorded so far.  Safe from a signal handler.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_hist_reset(void)
+{
+    __atomic_fetch_add(&sr_hist_gen, 1, __ATOMIC_RELAXED);
+} /* -- sr_hist_reset -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_hist_sigusr2(..)
+ * Scope:  Local
+ *
+ *---------------------------------------------------------------------*/
+
+static void sr_hist_sigusr2(int sig)
+{
+    sr_hist_reset();
+} /* -- sr_hist_sigusr2 -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_hist_catch(..)
+ * Scope:  Global
+ *
+ * Reset on SIGUSR2, taken by whichever thread.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_hist_catch(void)
+{
+    struct sigaction sa;
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = sr_hist_sigusr2;
+    sa.sa_flags   = SA_RESTART;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGUSR2, &sa, 0);
+} /* -- sr_hist_catch -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_hist_top(..)
+ * Scope:  Local
+ *
+ * Largest value that lands in bucket i.
+ *
+ *---------------------------------------------------------------------*/
+
+static uint64_t sr_hist_top(unsigned int i)
+{
+    unsigned int e;
+
+    if(i < SR_HIST_SUB)
+    { return i; }
+
+    e = (i - SR_HIST_SUB) / SR_HIST_HALF + 1;
+    return ((uint64_t)((i - SR_HIST_SUB) % SR_HIST_HALF + SR_HIST_HALF + 1)
+            << e) - 1;
+} /* -- sr_hist_top -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_hist_percentile(..)
+ * Scope:  Local
+ *
+ * Value at or below which a fraction q of what was recorded lies, as
+ * the top of its bucket, but never past the largest value recorded.
+ *
+ *---------------------------------------------------------------------*/
+
+static uint64_t sr_hist_percentile(const struct sr_hist* h, double q)
+{
+    uint64_t want, seen = 0, top;
+    unsigned int i;
+
+    want = (uint64_t)(q * h->count + 0.5);
+    if(want == 0)
+    { want = 1; }
+
+    for(i = 0; i < SR_HIST_BUCKETS; ++i)
+    {
+        seen += h->b[i];
+        if(seen >= want)
+        { break; }
+    }
+
+    top = sr_hist_top(i < SR_HIST_BUCKETS ? i : SR_HIST_BUCKETS - 1);
+    return top < h->max ? top : h->max;
+} /* -- sr_hist_percentile -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_hist_sum(..)
+ * Scope:  Local
+ *
+ * Histogram id of every thread with one of the current generation.
+ *
+ *---------------------------------------------------------------------*/
+
+static void sr_hist_sum(struct sr_hist* sum, unsigned int id, uint64_t gen)
+{
+    const struct sr_hist* h = 0;
+    unsigned int i, j, n;
+    uint64_t max;
+
+    memset(sum, 0, sizeof(struct sr_hist));
+    n = __atomic_load_n(&sr_hist.n, __ATOMIC_ACQUIRE);
+
+    for(i = 0; i < n; ++i)
+    {
+        if(__atomic_load_n(&sr_hist.blocks[i]->gen, __ATOMIC_ACQUIRE) != gen)
+        { continue; }
+
+        h = &sr_hist.blocks[i]->h[id];
+        sum->count += __atomic_load_n(&h->count, __ATOMIC_RELAXED);
+        sum->sum   += __atomic_load_n(&h->sum, __ATOMIC_RELAXED);
+        max = __atomic_load_n(&h->max, __ATOMIC_RELAXED);
+        if(max > sum->max)
+        { sum->max = max; }
+        for(j = 0; j < SR_HIST_BUCKETS; ++j)
+        { sum->b[j] += __atomic_load_n(&h->b[j], __ATOMIC_RELAXED); }
+    }
+} /* -- sr_hist_sum -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_hist_print_stats(..)
+ * Scope:  Global
+ *
+ * Every histogram with something in it, summed over threads, in
+ * microseconds.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_hist_print_stats(FILE* out)
+{
+    struct sr_hist sum;
+    double us;
+    uint64_t gen;
+    unsigned int i, shown = 0;
+
+    /* -- REQUIRES -- */
+    assert(out);
+
+    us  = sr_hist.cycles_per_us > 0.0 ? sr_hist.cycles_per_us : 1.0;
+    gen = __atomic_load_n(&sr_hist_gen, __ATOMIC_RELAXED);
+
+    fprintf(out, "latency: %s, %u threads",
+            __atomic_load_n(&sr_hist_on, __ATOMIC_RELAXED) ? "on" : "off",
+            __atomic_load_n(&sr_hist.n, __ATOMIC_ACQUIRE));
+    if(sr_hist.cycles_per_us > 0.0)
+    { fprintf(out, ", %.0f cycles/us", us); }
+    if(sr_hist.left_out)
+    { fprintf(out, ", %u threads not recorded", sr_hist.left_out); }
+    fprintf(out, "\n  %-15s %10s %9s %9s %9s %9s %9s\n", "us", "count",
+            "mean", "p50", "p99", "p99.9", "max");
+
+    for(i = 0; i < SR_HIST_MAX; ++i)
+    {
+        sr_hist_sum(&sum, i, gen);
+        if(sum.count == 0)
+        { continue; }
+
+        fprintf(out, "  %-15s %10lu %9.2f %9.2f %9.2f %9.2f %9.2f\n",
+                sr_hist_names[i], (unsigned long)sum.count,
+                (double)sum.sum / sum.count / us,
+                sr_hist_percentile(&sum, 0.50) / us,
+                sr_hist_percentile(&sum, 0.99) / us,
+                sr_hist_percentile(&sum, 0.999) / us,
+                sum.max / us);
+        ++shown;
+    }
+
+    if(shown == 0)
+    { fprintf(out, "  nothing recorded\n"); }
+} /* -- sr_hist_print_stats -- */
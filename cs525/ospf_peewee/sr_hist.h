@@ -0,0 +1,175 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_hist.h
+ *
+ * Description:
+ *
+ * Latency histograms (sr -H), for the tail the graph's cycles/packet
+ * averages hide.  Two kinds:
+ *
+ *   - per packet class (transit, ICMP to us, ARP, PWOSPF hello and LSU):
+ *     from the packet's vector coming into sr_handlepackets (or a
+ *     worker) to the packet being done with, so time spent waiting on
+ *     the packets ahead of it in the vector counts;
+ *   - per stage: one call of sr_handlepackets (a vector), checkArpcache,
+ *     findAdjacency, forwardPacket, generateICMP, the LSU handler and
+ *     sr_send_packet.
+ *
+ * Values are TSC cycles (see sr_graph_clock) in HDR style buckets: exact
+ * below 64, then 32 buckets per power of two, so anything read back is
+ * within 3% of what was recorded, from a few cycles up to 2^64.
+ *
+ * Each thread records into histograms of its own, attached on its first
+ * value; nothing is shared or locked.  Readers sum them.  Resetting bumps
+ * a generation: readers skip histograms of an older one and each thread
+ * clears its own the next time it records, so a reset never races a
+ * thread that is recording.
+ *
+ * With histograms off each timing point costs a load and a branch.  They
+ * can be turned on and off, read and reset while the router runs, from
+ * the control socket ("hist", "hist on|off|reset") or, for the reset,
+ * with SIGUSR2; SIGUSR1 prints them along with the counters.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_HIST_H
+#define SR_HIST_H
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif /* _DARWIN_ */
+
+#include <stdio.h>
+
+#include "sr_ring.h"
+#include "sr_graph.h"
+
+#define SR_HIST_SUB_BITS 6                        /* 2^6 exact values */
+#define SR_HIST_SUB      (1 << SR_HIST_SUB_BITS)
+#define SR_HIST_HALF     (SR_HIST_SUB / 2)        /* buckets per octave */
+#define SR_HIST_BUCKETS  (SR_HIST_SUB + (64 - SR_HIST_SUB_BITS) * SR_HIST_HALF)
+#define SR_HIST_THREADS  32                       /* most threads recording */
+
+enum sr_hist_id
+{
+    /* -- per packet class -- */
+    SR_HIST_TRANSIT = 0,
+    SR_HIST_ICMP_LOCAL,
+    SR_HIST_ARP,
+    SR_HIST_OSPF_HELLO,
+    SR_HIST_OSPF_LSU,
+
+    /* -- per stage -- */
+    SR_HIST_HANDLEPACKETS,
+    SR_HIST_CHECK_ARPCACHE,
+    SR_HIST_FIND_ADJACENCY,
+    SR_HIST_FORWARD_PACKET,
+    SR_HIST_GENERATE_ICMP,
+    SR_HIST_LSU_HANDLER,
+    SR_HIST_SEND_PACKET,
+    SR_HIST_MAX
+};
+
+struct sr_hist
+{
+    uint64_t count;
+    uint64_t sum;
+    uint64_t max;
+    uint64_t b[SR_HIST_BUCKETS];
+};
+
+/* ----------------------------------------------------------------------------
+ * struct sr_hist_block
+ *
+ * One thread's histograms.  Only its owner writes it.
+ *
+ * -------------------------------------------------------------------------- */
+
+struct sr_hist_block
+{
+    uint64_t       gen;       /* of sr_hist_gen when last cleared */
+    char           name[16];
+    struct sr_hist h[SR_HIST_MAX];
+} __attribute__((aligned(SR_CACHE_LINE)));
+
+extern int sr_hist_on;
+extern uint64_t sr_hist_gen;
+extern __thread struct sr_hist_block* sr_hist_self;
+
+void sr_hist_enable(int on);
+void sr_hist_reset(void);
+void sr_hist_catch(void);
+struct sr_hist_block* sr_hist_attach(void);
+void sr_hist_print_stats(FILE* out);
+
+/*---------------------------------------------------------------------
+ * Method: sr_hist_index(..)
+ *
+ * Bucket of value v.
+ *
+ *---------------------------------------------------------------------*/
+
+static __inline__ unsigned int sr_hist_index(uint64_t v)
+{
+    unsigned int e;
+
+    if(v < SR_HIST_SUB)
+    { return (unsigned int)v; }
+
+    e = 63 - __builtin_clzll(v) - (SR_HIST_SUB_BITS - 1);
+    return SR_HIST_SUB + (e - 1) * SR_HIST_HALF +
+           (unsigned int)(v >> e) - SR_HIST_HALF;
+} /* -- sr_hist_index -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_hist_record(..)
+ *
+ * Add v cycles to histogram id of the calling thread.
+ *
+ *---------------------------------------------------------------------*/
+
+static __inline__ void sr_hist_record(unsigned int id, uint64_t v)
+{
+    struct sr_hist_block* b = sr_hist_self;
+    struct sr_hist* h = 0;
+
+    if(b == 0 || b->gen != __atomic_load_n(&sr_hist_gen, __ATOMIC_RELAXED))
+    {
+        if((b = sr_hist_attach()) == 0)
+        { return; }
+    }
+
+    h = &b->h[id];
+    ++h->count;
+    h->sum += v;
+    if(v > h->max)
+    { h->max = v; }
+    ++h->b[sr_hist_index(v)];
+} /* -- sr_hist_record -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_hist_clock(..), sr_hist_since(..)
+ *
+ * Bracket what is to be timed:
+ *
+ *     uint64_t t0 = sr_hist_clock();
+ *     ...
+ *     sr_hist_since(SR_HIST_..., t0);
+ *
+ * With histograms off the clock isn't read and nothing is recorded.
+ *
+ *---------------------------------------------------------------------*/
+
+static __inline__ uint64_t sr_hist_clock(void)
+{ return sr_hist_on ? sr_graph_clock() : 0; }
+
+static __inline__ void sr_hist_since(unsigned int id, uint64_t t0)
+{
+    if(t0 != 0)
+    { sr_hist_record(id, sr_graph_clock() - t0); }
+} /* -- sr_hist_since -- */
+
+#endif /* -- SR_HIST_H -- */
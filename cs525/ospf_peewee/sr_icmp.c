@@ -0,0 +1,246 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_icmp.c
+ *
+ * Description:
+ *
+ * ICMP error limits and templates, see sr_icmp.h.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+
+#include "sr_icmp.h"
+#include "sr_if.h"
+#include "sr_counters.h"
+#include "includes.h"
+
+/*---------------------------------------------------------------------
+ * Method: sr_icmp_create(..)
+ * Scope:  Global
+ *
+ * limits may be 0 for the defaults.
+ *
+ *---------------------------------------------------------------------*/
+
+struct sr_icmp* sr_icmp_create(const struct sr_icmp_limits* limits)
+{
+    struct sr_icmp* icmp = 0;
+
+    if((icmp = (struct sr_icmp*)calloc(1, sizeof(struct sr_icmp))) == 0)
+    { return 0; }
+
+    if(limits)
+    { icmp->limits = *limits; }
+    else
+    {
+        icmp->limits.if_rate  = SR_ICMP_IF_RATE;
+        icmp->limits.if_burst = SR_ICMP_IF_BURST;
+        icmp->limits.rate     = SR_ICMP_RATE;
+        icmp->limits.burst    = SR_ICMP_BURST;
+    }
+
+    /* -- a bucket that never holds a whole token would stay shut -- */
+    if(icmp->limits.if_burst == 0)
+    { icmp->limits.if_burst = 1; }
+    if(icmp->limits.burst == 0)
+    { icmp->limits.burst = 1; }
+
+    return icmp;
+} /* -- sr_icmp_create -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_icmp_destroy(..)
+ * Scope:  Global
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_icmp_destroy(struct sr_icmp* icmp)
+{
+    free(icmp);
+} /* -- sr_icmp_destroy -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_icmp_take(..)
+ * Scope:  Local
+ *
+ * Take a token from bucket b, topping it up first for the time since
+ * it was last looked at.  Starts out full.
+ *
+ *---------------------------------------------------------------------*/
+
+static int sr_icmp_take(struct sr_icmp_bucket* b, unsigned int rate,
+                        unsigned int burst, uint64_t now)
+{
+    if(rate == 0)
+    { return 1; }
+
+    if(now > b->last)
+    {
+        b->tokens += (now - b->last) * rate;
+        if(b->tokens > (uint64_t)burst * 1000)
+        { b->tokens = (uint64_t)burst * 1000; }
+        b->last = now;
+    }
+
+    if(b->tokens < 1000)
+    { return 0; }
+
+    b->tokens -= 1000;
+    return 1;
+} /* -- sr_icmp_take -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_icmp_allow(..)
+ * Scope:  Global
+ *
+ * May an error go out of ifindex at 'now' (ms, see sr_timer_now)?
+ * Counts the answer either way.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_icmp_allow(struct sr_icmp* icmp, unsigned int ifindex, uint64_t now)
+{
+    struct sr_icmp_if* ifx = 0;
+
+    /* -- REQUIRES -- */
+    assert(icmp);
+
+    ifx = &icmp->ifs[ifindex < SR_ICMP_IFS ? ifindex : SR_ICMP_IFS];
+
+    if(!sr_icmp_take(&ifx->bucket, icmp->limits.if_rate,
+                     icmp->limits.if_burst, now))
+    {
+        ++ifx->limited;
+        sr_count(SR_EV_ICMP_LIMITED_IF);
+        return 0;
+    }
+
+    if(!sr_icmp_take(&icmp->bucket, icmp->limits.rate,
+                     icmp->limits.burst, now))
+    {
+        /* -- the interface's token wasn't used after all -- */
+        if(icmp->limits.if_rate)
+        { ifx->bucket.tokens += 1000; }
+        ++ifx->limited;
+        ++icmp->limited;
+        sr_count(SR_EV_ICMP_LIMITED);
+        return 0;
+    }
+
+    ++ifx->sent;
+    return 1;
+} /* -- sr_icmp_allow -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_icmp_build(..)
+ * Scope:  Local
+ *
+ * Fill in the template of iface.
+ *
+ *---------------------------------------------------------------------*/
+
+static void sr_icmp_build(uint8_t* frame, struct sr_if* iface)
+{
+    struct sr_ethernet_hdr* eth = (struct sr_ethernet_hdr*)frame;
+    struct ip* ip = (struct ip*)(frame + sizeof(struct sr_ethernet_hdr));
+    struct icmpPayload* icmp = (struct icmpPayload*)(ip + 1);
+
+    memset(frame, 0, SR_ICMP_FRAME);
+
+    memcpy(eth->ether_shost, iface->addr, ETHER_ADDR_LEN);
+    eth->ether_type = htons(ETHERTYPE_IP);
+
+    ip->ip_v   = 4;
+    ip->ip_hl  = sizeof(struct ip) >> 2;
+    ip->ip_len = htons(sizeof(struct ip) + sizeof(struct icmpPayload));
+    ip->ip_off = htons(IP_DF);
+    ip->ip_ttl = DEFAULT_TTL;
+    ip->ip_p   = IPPROTO_ICMP;
+    ip->ip_src.s_addr = iface->ip;
+    ip->ip_sum = sr_cksum(ip, sizeof(struct ip));
+
+    icmp->checksum = sr_cksum(icmp, sizeof(struct icmpPayload));
+} /* -- sr_icmp_build -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_icmp_template(..)
+ * Scope:  Global
+ *
+ * The frame an error going out of iface starts from, SR_ICMP_FRAME
+ * bytes.  Its destinations, type, code and quoted bytes are zero.
+ *
+ *---------------------------------------------------------------------*/
+
+const uint8_t* sr_icmp_template(struct sr_icmp* icmp, struct sr_if* iface)
+{
+    struct sr_icmp_if* ifx = 0;
+    const struct ip* ip = 0;
+
+    /* -- REQUIRES -- */
+    assert(icmp);
+    assert(iface);
+
+    ifx = &icmp->ifs[iface->ifindex < SR_ICMP_IFS ? iface->ifindex
+                                                  : SR_ICMP_IFS];
+    ip  = (const struct ip*)(ifx->frame + sizeof(struct sr_ethernet_hdr));
+
+    if(!ifx->ready || ip->ip_src.s_addr != iface->ip ||
+       memcmp(ifx->frame + ETHER_ADDR_LEN, iface->addr, ETHER_ADDR_LEN) != 0)
+    {
+        sr_icmp_build(ifx->frame, iface);
+        ifx->ready = 1;
+    }
+
+    return ifx->frame;
+} /* -- sr_icmp_template -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_icmp_print_stats(..)
+ * Scope:  Global
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_icmp_print_stats(struct sr_icmp* icmp, struct sr_instance* sr,
+                         FILE* out)
+{
+    const struct sr_icmp_if* ifx = 0;
+    struct sr_if* iface = 0;
+    uint64_t sent = 0, limited = 0;
+    unsigned int i;
+
+    /* -- REQUIRES -- */
+    assert(icmp);
+    assert(sr);
+    assert(out);
+
+    for(i = 0; i <= SR_ICMP_IFS; ++i)
+    {
+        sent    += icmp->ifs[i].sent;
+        limited += icmp->ifs[i].limited;
+    }
+
+    fprintf(out, "icmp errors: %lu sent, %lu suppressed (%lu by the "
+            "interface limit, %lu by the overall one)\n",
+            (unsigned long)sent, (unsigned long)limited,
+            (unsigned long)(limited - icmp->limited),
+            (unsigned long)icmp->limited);
+    fprintf(out, "  limits: %u/s burst %u per interface, %u/s burst %u "
+            "overall (0/s: none)\n",
+            icmp->limits.if_rate, icmp->limits.if_burst,
+            icmp->limits.rate, icmp->limits.burst);
+
+    for(i = 0; i <= SR_ICMP_IFS; ++i)
+    {
+        ifx = &icmp->ifs[i];
+        if(ifx->sent == 0 && ifx->limited == 0)
+        { continue; }
+
+        iface = i < SR_ICMP_IFS ? sr_get_interface_by_index(sr, i) : 0;
+        fprintf(out, "  %-10s %10lu sent %10lu suppressed\n",
+                i == SR_ICMP_IFS ? "others" : iface ? iface->name : "-",
+                (unsigned long)ifx->sent, (unsigned long)ifx->limited);
+    }
+} /* -- sr_icmp_print_stats -- */
@@ -0,0 +1,104 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_icmp.h
+ *
+ * Description:
+ *
+ * ICMP error limits and templates for generateICMP.
+ *
+ * Every time exceeded, host, protocol or port unreachable used to be
+ * sent, so a traceroute storm or a flood towards an unreachable prefix
+ * came back out as an ICMP flood of the same rate, competing with
+ * forwarding.  Errors now have to get past two token buckets: one per
+ * interface they go out of and one for the router as a whole (sr -E).
+ * Those that don't are counted and not built at all.  The buckets run
+ * off the timer wheel's clock (see sr_timer.h), which is brought up to
+ * date on every wakeup, so an error costs no clock read of its own.
+ *
+ * Those that do start from a template of the interface they go out of:
+ * Ethernet, IP and ICMP headers filled in and checksummed once, with the
+ * destination, type, code and quoted bytes left zero.  Per error only
+ * those are written and the checksums patched (see sr_cksum.h).  A
+ * template is rebuilt if its interface's address changes.
+ *
+ * Interfaces from SR_ICMP_IFS up share one bucket and one template slot.
+ * Only the thread handling packets sends ICMP errors (forwarding workers
+ * hand those packets back, see sr_worker.h), so nothing here is locked.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_ICMP_H
+#define SR_ICMP_H
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif /* _DARWIN_ */
+
+#include <stdio.h>
+
+#include "sr_protocol.h"
+
+#define SR_ICMP_IFS       16   /* interfaces with a bucket of their own */
+
+/* -- default limits, errors per second and burst -- */
+#define SR_ICMP_IF_RATE   100
+#define SR_ICMP_IF_BURST  25
+#define SR_ICMP_RATE      250
+#define SR_ICMP_BURST     50
+
+/* -- Ethernet, IP, ICMP header and the quoted IP header plus 8 bytes -- */
+#define SR_ICMP_FRAME     (sizeof(struct sr_ethernet_hdr) + \
+                           2 * sizeof(struct ip) + 16)
+
+struct sr_if;
+struct sr_instance;
+
+/* ----------------------------------------------------------------------------
+ * struct sr_icmp_limits
+ *
+ * A rate of 0 means no limit.
+ *
+ * -------------------------------------------------------------------------- */
+
+struct sr_icmp_limits
+{
+    unsigned int if_rate;   /* per interface, errors per second */
+    unsigned int if_burst;
+    unsigned int rate;      /* all interfaces together */
+    unsigned int burst;
+};
+
+struct sr_icmp_bucket
+{
+    uint64_t tokens;  /* thousandths of an error */
+    uint64_t last;    /* ms, see sr_timer_now */
+};
+
+struct sr_icmp_if
+{
+    uint8_t               frame[SR_ICMP_FRAME];  /* the template */
+    uint8_t               ready;
+    struct sr_icmp_bucket bucket;
+    uint64_t              sent;
+    uint64_t              limited;
+};
+
+struct sr_icmp
+{
+    struct sr_icmp_limits limits;
+    struct sr_icmp_bucket bucket;                /* all interfaces */
+    struct sr_icmp_if     ifs[SR_ICMP_IFS + 1];  /* the last one shared */
+    uint64_t              limited;               /* by 'bucket' */
+};
+
+struct sr_icmp* sr_icmp_create(const struct sr_icmp_limits* limits);
+void sr_icmp_destroy(struct sr_icmp* icmp);
+int  sr_icmp_allow(struct sr_icmp* icmp, unsigned int ifindex, uint64_t now);
+const uint8_t* sr_icmp_template(struct sr_icmp* icmp, struct sr_if* iface);
+void sr_icmp_print_stats(struct sr_icmp* icmp, struct sr_instance* sr,
+                         FILE* out);
+
+#endif /* -- SR_ICMP_H -- */
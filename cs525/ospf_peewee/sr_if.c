@@ -23,6 +23,7 @@
 #include <arpa/inet.h>
 
 #include "sr_if.h"
+#include "sr_hash.h"
 #include "sr_router.h"
 
 /*--------------------------------------------------------------------- 
@@ -54,28 +55,133 @@ struct sr_if* sr_get_interface(struct sr_instance* sr, const char* name)
     return 0;
 } /* -- sr_get_interface -- */
 
+/*--------------------------------------------------------------------- 
+ * Method: sr_get_interface_by_index
+ * Scope: Global
+ *
+ * Given an interface index return the interface record or 0 if it doesn't
+ * exist.
+ *
+ *---------------------------------------------------------------------*/
+
+struct sr_if* sr_get_interface_by_index(struct sr_instance* sr,
+                                        unsigned int ifindex)
+{
+    /* -- REQUIRES -- */
+    assert(sr);
+
+    if(ifindex >= sr->if_count)
+    { return 0; }
+
+    return sr->if_table[ifindex];
+} /* -- sr_get_interface_by_index -- */
+
+/*--------------------------------------------------------------------- 
+ * Method: sr_get_interface_by_ip
+ * Scope: Global
+ *
+ * Return the interface that owns the given address (network byte order)
+ * or 0 if it isn't one of ours.  Looks in a small open addressing set
+ * that is rebuilt whenever an address is assigned.
+ *
+ *---------------------------------------------------------------------*/
+
+struct sr_if* sr_get_interface_by_ip(struct sr_instance* sr, uint32_t ip_nbo)
+{
+    uint32_t i;
+
+    /* -- REQUIRES -- */
+    assert(sr);
+
+    if(sr->if_addrs == 0 || ip_nbo == 0)
+    { return 0; }
+
+    for(i = sr_hash32(ip_nbo) & sr->if_addrs_mask; sr->if_addrs[i];
+        i = (i + 1) & sr->if_addrs_mask)
+    {
+        if(sr->if_addrs[i]->ip == ip_nbo)
+        { return sr->if_addrs[i]; }
+    }
+
+    return 0;
+} /* -- sr_get_interface_by_ip -- */
+
+/*--------------------------------------------------------------------- 
+ * Method: sr_index_if_addrs(..)
+ * Scope: Local
+ *
+ * Rebuild the local address set, keeping it at most a quarter full.
+ *
+ *---------------------------------------------------------------------*/
+
+static void sr_index_if_addrs(struct sr_instance* sr)
+{
+    uint32_t size = SR_IFADDRS_MIN_SIZE, i;
+    unsigned int j;
+
+    while(size < sr->if_count * 4)
+    { size *= 2; }
+
+    free(sr->if_addrs);
+    sr->if_addrs = (struct sr_if**)calloc(size, sizeof(struct sr_if*));
+    assert(sr->if_addrs);
+    sr->if_addrs_mask = size - 1;
+
+    for(j = 0; j < sr->if_count; ++j)
+    {
+        if(sr->if_table[j]->ip == 0 ||
+           sr_get_interface_by_ip(sr, sr->if_table[j]->ip))
+        { continue; }
+
+        i = sr_hash32(sr->if_table[j]->ip) & sr->if_addrs_mask;
+        while(sr->if_addrs[i])
+        { i = (i + 1) & sr->if_addrs_mask; }
+        sr->if_addrs[i] = sr->if_table[j];
+    }
+} /* -- sr_index_if_addrs -- */
+
 /*--------------------------------------------------------------------- 
  * Method: sr_add_interface(..)
  * Scope: Global
  *
- * Add and interface to the router's list
+ * Add and interface to the router's list.  Interfaces are numbered in the
+ * order they are added, which is also their slot in if_table.  There
+ * may be at most SR_IF_MAX of them (the ARP cache keeps ifindex in a
+ * byte).
  *
  *---------------------------------------------------------------------*/
 
 void sr_add_interface(struct sr_instance* sr, const char* name)
 {
     struct sr_if* if_walker = 0;
+    struct sr_if* iface = 0;
+    size_t len;
 
     /* -- REQUIRES -- */
     assert(name);
     assert(sr);
+    assert(sr->if_count < SR_IF_MAX);
+
+    iface = (struct sr_if*)calloc(1, sizeof(struct sr_if));
+    assert(iface);
+
+    /* -- names are printed with %s, so always leave the terminator -- */
+    len = strlen(name);
+    if(len > SR_IFACE_NAMELEN - 1)
+    { len = SR_IFACE_NAMELEN - 1; }
+    memcpy(iface->name, name, len);
+    iface->ifindex = sr->if_count;
+    iface->next = 0;
+
+    sr->if_table = (struct sr_if**)realloc(sr->if_table,
+            (sr->if_count + 1) * sizeof(struct sr_if*));
+    assert(sr->if_table);
+    sr->if_table[sr->if_count++] = iface;
 
     /* -- empty list special case -- */
     if(sr->if_list == 0)
     {
-        sr->if_list = (struct sr_if*)malloc(sizeof(struct sr_if));
-        sr->if_list->next = 0;
-        strncpy(sr->if_list->name,name,SR_IFACE_NAMELEN);
+        sr->if_list = iface;
         return;
     }
 
@@ -84,10 +190,7 @@ void sr_add_interface(struct sr_instance* sr, const char* name)
     while(if_walker->next)
     {if_walker = if_walker->next; }
 
-    if_walker->next = (struct sr_if*)malloc(sizeof(struct sr_if));
-    if_walker = if_walker->next;
-    strncpy(if_walker->name,name,SR_IFACE_NAMELEN);
-    if_walker->next = 0;
+    if_walker->next = iface;
 } /* -- sr_add_interface -- */ 
 
 /*--------------------------------------------------------------------- 
@@ -161,6 +264,8 @@ void sr_set_ether_ip(struct sr_instance* sr, uint32_t ip_nbo)
     /* -- copy address -- */
     if_walker->ip = ip_nbo;
 
+    sr_index_if_addrs(sr);
+
 } /* -- sr_set_ether_ip -- */
 
 /*--------------------------------------------------------------------- 
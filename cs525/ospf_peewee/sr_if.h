@@ -28,6 +28,9 @@
 #define SR_IFACE_NAMELEN 32
 #define sr_IFACE_NAMELEN 32
 
+#define SR_IFADDRS_MIN_SIZE 16 /* local address set slots, power of two */
+#define SR_IF_MAX           255 /* interfaces, ifindex fits in a uint8_t */
+
 struct sr_instance;
 
 /* ----------------------------------------------------------------------------
@@ -44,10 +47,14 @@ struct sr_if
     uint32_t ip;
     uint32_t speed;
     volatile uint32_t mask;
+    unsigned int ifindex; /* slot in sr_instance.if_table */
     struct sr_if* next;
 };
 
 struct sr_if* sr_get_interface(struct sr_instance* sr, const char* name);
+struct sr_if* sr_get_interface_by_index(struct sr_instance* sr,
+                                        unsigned int ifindex);
+struct sr_if* sr_get_interface_by_ip(struct sr_instance* sr, uint32_t ip_nbo);
 void sr_add_interface(struct sr_instance*, const char*);
 void sr_set_ether_addr(struct sr_instance*, const unsigned char*);
 void sr_set_ether_ip(struct sr_instance*, uint32_t ip_nbo);
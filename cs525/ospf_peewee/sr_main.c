@@ -20,6 +20,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <assert.h>
+#include <ctype.h>
 #include <string.h>
 #include <unistd.h>
 #include <pwd.h>
@@ -32,6 +33,19 @@
 #include "sr_dumper.h"
 #include "sr_router.h"
 #include "sr_rt.h"
+#include "sr_cksum.h"
+#include "sr_graph.h"
+#include "sr_rx.h"
+#include "sr_tx.h"
+#include "sr_event.h"
+#include "sr_worker.h"
+#include "sr_epoch.h"
+#include "sr_capture.h"
+#include "sr_replay.h"
+#include "sr_counters.h"
+#include "sr_evlog.h"
+#include "sr_hist.h"
+#include "sr_icmp.h"
 
 extern char* optarg;
 
@@ -48,6 +62,10 @@ static void usage(char* );
 static void sr_init_instance(struct sr_instance* );
 static void sr_destroy_instance(struct sr_instance* );
 static void sr_set_user(struct sr_instance* );
+static int  sr_parse_cpus(char* , int* , unsigned int );
+static int  sr_parse_ulongs(char* , unsigned long* , unsigned int );
+static int  sr_parse_rotate(char* , struct sr_capture_rotate* );
+static int  sr_parse_icmp(char* , struct sr_icmp_limits* );
 
 /*-----------------------------------------------------------------------------
  *---------------------------------------------------------------------------*/
@@ -62,9 +80,26 @@ int main(int argc, char **argv)
     unsigned int port = DEFAULT_PORT;
     unsigned int topo = DEFAULT_TOPO;
     char *logfile = 0;
+    char *evlogfile = 0;
+    int log_format = -1;
+    struct sr_capture_rotate rotate;
+    int log_rotate = 0;
+    int tx_policy = SR_TX_BATCH;
+    int event_loop = 0;
+    char *control = 0;
+    unsigned int workers = 0;
+    int cpus[SR_WORKER_MAX];
+    int ncpus = 0;
+    char *trace = 0;
+    char *ifconfig = 0;
+    char *outfile = 0;
+    int paced = 0;
+    int hist = 0;
+    struct sr_icmp_limits icmp_limits;
+    int icmp_limited = 0;
     struct sr_instance sr;
 
-    while ((c = getopt(argc, argv, "hs:v:p:c:t:r:l:")) != EOF)
+    while ((c = getopt(argc, argv, "hs:v:p:c:t:r:l:L:Hf:R:b:eC:w:P:i:I:o:aE:")) != EOF)
     {
         switch (c) 
         {
@@ -90,15 +125,117 @@ int main(int argc, char **argv)
             case 'l':
                 logfile = optarg; 
                 break;
+            case 'L':
+                evlogfile = optarg;
+                break;
+            case 'H':
+                hist = 1;
+                break;
+            case 'E':
+                if(sr_parse_icmp(optarg, &icmp_limits) == -1)
+                {
+                    usage(argv[0]);
+                    exit(1);
+                }
+                icmp_limited = 1;
+                break;
+            case 'f':
+                if((log_format = sr_capture_format(optarg)) == -1)
+                {
+                    usage(argv[0]);
+                    exit(1);
+                }
+                break;
+            case 'R':
+                if(sr_parse_rotate(optarg, &rotate) == -1)
+                {
+                    usage(argv[0]);
+                    exit(1);
+                }
+                log_rotate = 1;
+                break;
             case 'r':
                 rtable = optarg; 
                 break;
+            case 'e':
+                event_loop = 1;
+                break;
+            case 'C':
+                control = optarg;
+                break;
+            case 'i':
+                trace = optarg;
+                break;
+            case 'I':
+                ifconfig = optarg;
+                break;
+            case 'o':
+                outfile = optarg;
+                break;
+            case 'a':
+                paced = 1;
+                break;
+            case 'b':
+                if((tx_policy = sr_tx_policy(optarg)) == -1)
+                {
+                    usage(argv[0]);
+                    exit(1);
+                }
+                break;
+            case 'w':
+                workers = atoi((char *) optarg);
+                if(workers > SR_WORKER_MAX)
+                {
+                    usage(argv[0]);
+                    exit(1);
+                }
+                break;
+            case 'P':
+                if((ncpus = sr_parse_cpus(optarg, cpus, SR_WORKER_MAX)) <= 0)
+                {
+                    usage(argv[0]);
+                    exit(1);
+                }
+                break;
         } /* switch */
     } /* -- while -- */
 
+    if((control && !event_loop) || (ncpus > 0 && workers == 0) ||
+       (log_rotate && logfile == 0) ||
+       (log_format != -1 && logfile == 0 && outfile == 0) ||
+       ((ifconfig || outfile || paced) && trace == 0) ||
+       (trace && (ifconfig == 0 || workers > 0 || event_loop)))
+    {
+        usage(argv[0]);
+        exit(1);
+    }
+
     /* -- zero out sr instance -- */
     sr_init_instance(&sr);
 
+    /* -- ICMP error limits other than the defaults, see sr_icmp.h -- */
+    if(icmp_limited && (sr.icmp = sr_icmp_create(&icmp_limits)) == 0)
+    {
+        exit(1);
+    }
+
+    /* -- pick the fastest checksum routine this CPU has -- */
+    sr_cksum_init();
+
+    /* -- before any thread starts, see sr_counters_catch -- */
+    sr_counters_catch();
+    sr_hist_catch();
+
+    /* -- latency histograms, can also be switched on later -- */
+    if(hist)
+    { sr_hist_enable(1); }
+
+    /* -- events are written out by a thread of their own -- */
+    if(sr_evlog_open(&sr, evlogfile) != 0)
+    {
+        exit(1);
+    }
+
     /* -- set up routing table from file -- */
     if(sr_load_rt(&sr, rtable) != 0)
     {
@@ -114,6 +251,8 @@ int main(int argc, char **argv)
     printf("---------------------------------------------\n");
 
     sr.topo_id = topo;
+    sr.tx_policy = tx_policy;
+    sr.event_loop = event_loop;
     strncpy(sr.host,host,32);
 
     if(! client )
@@ -121,11 +260,13 @@ int main(int argc, char **argv)
     else
     { strncpy(sr.user, client, 32); }
 
-    /* -- set up file pointer for logging of raw packets -- */
+    /* -- set up capture of raw packets, see sr_capture.h -- */
     if(logfile != 0)
     {
-        sr.logfile = sr_dump_open(logfile,0,PACKET_DUMP_SIZE);  
-        if(!sr.logfile)
+        sr.capture = sr_capture_open(logfile,
+                log_format == -1 ? SR_CAPTURE_PCAP : log_format,
+                log_rotate ? &rotate : 0);
+        if(!sr.capture)
         {
             fprintf(stderr,"Error opening up dump file %s\n",
                     logfile);
@@ -133,6 +274,28 @@ int main(int argc, char **argv)
         }
     }
 
+    /* -- offline: interfaces from a local config, packets from a trace -- */
+    if(trace != 0)
+    {
+        if(sr_replay_connect(&sr) != 0)
+        {
+            return 1;
+        }
+
+        sr_init(&sr);
+        if(sr_replay_config(&sr, ifconfig) != 0 ||
+           sr_verify_routing_table(&sr) != 0 ||
+           (sr.replay = sr_replay_open(&sr, trace, paced, outfile,
+                log_format == -1 ? SR_CAPTURE_PCAP : log_format)) == 0)
+        {
+            return 1;
+        }
+
+        sr_replay_run(&sr, sr.replay);
+        sr_destroy_instance(&sr);
+        return 0;
+    }
+
     Debug("Client %s connecting to Server %s:%d\n", sr.user, server, port);
     Debug("Requesting topology %d\n", topo);
 
@@ -144,9 +307,21 @@ int main(int argc, char **argv)
 
     /* call router init (for arp subsystem etc.) */
     sr_init(&sr); 
+
+    /* -- spread forwarding over worker threads -- */
+    if(workers > 0 && sr_workers_start(&sr, workers, cpus, ncpus) == -1)
+    {
+        return 1;
+    }
     
+    /* -- kill -USR1 prints the counters, see sr_counters.h -- */
+    sr_counters_listen();
+
     /* -- whizbang main loop ;-) */
-    while( sr_read_from_server(&sr) == 1);
+    if(sr.event_loop)
+    { sr_event_loop(&sr, control); }
+    else
+    { while( sr_read_from_server(&sr) == 1); }
 
     sr_destroy_instance(&sr);
 
@@ -163,7 +338,13 @@ static void usage(char* argv0)
     printf("Simple Router Client\n");
     printf("Format: %s [-h] [-v host] [-s server] [-p port] \n",argv0);
     printf("           [-t topo id] [-r routing table] \n");
-    printf("           [-l log file] \n");
+    printf("           [-l log file [-f pcap|pcapng] [-R MB[,secs[,keep]]]] \n");
+    printf("           [-L event log file] [-H] \n");
+    printf("           [-b write|cork|batch] \n");
+    printf("           [-E rate[,burst[,overall rate[,burst]]]] \n");
+    printf("           [-e [-C control socket]] \n");
+    printf("           [-w workers [-P cpu,cpu,...]] \n");
+    printf("           [-i trace[@if,if,...] -I if config [-o out file] [-a]] \n");
     printf("   defaults server=%s port=%d host=%s  \n",
             DEFAULT_SERVER, DEFAULT_PORT, DEFAULT_HOST ); 
 } /* -- usage -- */
@@ -193,6 +374,137 @@ void sr_set_user(struct sr_instance* sr)
 
 } /* -- sr_set_user -- */
 
+/*-----------------------------------------------------------------------------
+ * Method: sr_parse_cpus(..)
+ * Scope: local
+ *
+ * Parse a comma separated list of CPU numbers into cpus.  Returns how
+ * many there were, or -1 if the list is malformed or too long.
+ *
+ *---------------------------------------------------------------------------*/
+
+static int sr_parse_cpus(char* list, int* cpus, unsigned int max)
+{
+    unsigned int n = 0;
+    char* end = 0;
+    long cpu;
+
+    /* REQUIRES */
+    assert(list);
+    assert(cpus);
+
+    for(;;)
+    {
+        cpu = strtol(list, &end, 10);
+        if(end == list || cpu < 0 || n == max)
+        { return -1; }
+        cpus[n++] = (int)cpu;
+
+        if(*end == 0)
+        { break; }
+        if(*end != ',')
+        { return -1; }
+        list = end + 1;
+    }
+
+    return n;
+} /* -- sr_parse_cpus -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_parse_ulongs(..)
+ * Scope: local
+ *
+ * Parse up to max comma separated decimal numbers into v, leaving the
+ * rest of v as it is.  strtoul would take "-1" for ULONG_MAX, so each
+ * number has to start with a digit.  Returns how many there were, -1
+ * if malformed.
+ *
+ *---------------------------------------------------------------------------*/
+
+static int sr_parse_ulongs(char* spec, unsigned long* v, unsigned int max)
+{
+    unsigned int n = 0;
+    char* end = 0;
+
+    /* REQUIRES */
+    assert(spec);
+    assert(v);
+
+    for(;;)
+    {
+        if(!isdigit((unsigned char)*spec))
+        { return -1; }
+        v[n++] = strtoul(spec, &end, 10);
+
+        if(*end == 0)
+        { break; }
+        if(*end != ',' || n == max)
+        { return -1; }
+        spec = end + 1;
+    }
+
+    return (int)n;
+} /* -- sr_parse_ulongs -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_parse_rotate(..)
+ * Scope: local
+ *
+ * Parse "MB[,secs[,keep]]": start a new log file every MB megabytes
+ * and/or every secs seconds, keeping the newest keep files (0 for no
+ * limit, or all of them).  Returns -1 if malformed or nothing would
+ * ever rotate.
+ *
+ *---------------------------------------------------------------------------*/
+
+static int sr_parse_rotate(char* spec, struct sr_capture_rotate* rotate)
+{
+    unsigned long v[3] = { 0, 0, 0 };
+
+    /* REQUIRES */
+    assert(spec);
+    assert(rotate);
+
+    if(sr_parse_ulongs(spec, v, 3) == -1)
+    { return -1; }
+
+    rotate->bytes = (uint64_t)v[0] * 1024 * 1024;
+    rotate->secs  = (unsigned int)v[1];
+    rotate->keep  = (unsigned int)v[2];
+
+    return (rotate->bytes || rotate->secs) ? 0 : -1;
+} /* -- sr_parse_rotate -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_parse_icmp(..)
+ * Scope: local
+ *
+ * Parse "rate[,burst[,overall rate[,burst]]]": ICMP errors per second
+ * and burst out of each interface, then for the router as a whole.
+ * What is left out keeps its default; a rate of 0 is no limit.
+ *
+ *---------------------------------------------------------------------------*/
+
+static int sr_parse_icmp(char* spec, struct sr_icmp_limits* limits)
+{
+    unsigned long v[4] = { SR_ICMP_IF_RATE, SR_ICMP_IF_BURST,
+                           SR_ICMP_RATE, SR_ICMP_BURST };
+
+    /* REQUIRES */
+    assert(spec);
+    assert(limits);
+
+    if(sr_parse_ulongs(spec, v, 4) == -1)
+    { return -1; }
+
+    limits->if_rate  = (unsigned int)v[0];
+    limits->if_burst = (unsigned int)v[1];
+    limits->rate     = (unsigned int)v[2];
+    limits->burst    = (unsigned int)v[3];
+
+    return 0;
+} /* -- sr_parse_icmp -- */
+
 /*-----------------------------------------------------------------------------
  * Method: sr_destroy_instance(..)
  * Scope: Local 
@@ -205,9 +517,28 @@ static void sr_destroy_instance(struct sr_instance* sr)
     /* REQUIRES */
     assert(sr);
 
-    if(sr->logfile)
+    if(sr->workers)
+    {
+        sr_workers_stop(sr);
+    }
+
+    if(sr->replay)
     {
-        sr_dump_close(sr->logfile);
+        sr_replay_close(sr->replay);
+    }
+
+    if(sr->capture)
+    {
+        sr_capture_close(sr->capture);
+    }
+
+    sr_evlog_close();
+    sr_print_stats(sr, stderr);
+
+    if(sr->icmp)
+    {
+        sr_icmp_destroy(sr->icmp);
+        sr->icmp = 0;
     }
 
     /*
@@ -215,6 +546,69 @@ static void sr_destroy_instance(struct sr_instance* sr)
     */
 } /* -- sr_destroy_instance -- */
 
+/*-----------------------------------------------------------------------------
+ * Method: sr_print_stats(..)
+ * Scope: Global
+ *
+ * Dump the packet path's counters.
+ *
+ *----------------------------------------------------------------------------*/
+
+void sr_print_stats(struct sr_instance* sr, FILE* out)
+{
+    /* REQUIRES */
+    assert(sr);
+    assert(out);
+
+    if(sr->graph)
+    {
+        sr_graph_print_stats(sr->graph, out);
+    }
+
+    if(sr->rx)
+    {
+        sr_rx_print_stats(sr->rx, out);
+    }
+
+    if(sr->tx)
+    {
+        sr_tx_print_stats(sr->tx, out);
+    }
+
+    if(sr->workers)
+    {
+        sr_workers_print_stats(sr->workers, out);
+    }
+
+    if(sr->epoch)
+    {
+        sr_epoch_print_stats(sr->epoch, out);
+    }
+
+    if(sr->capture)
+    {
+        sr_capture_print_stats(sr->capture, out);
+    }
+
+    if(sr->replay)
+    {
+        sr_replay_print_stats(sr->replay, out);
+    }
+
+    if(sr->icmp)
+    {
+        sr_icmp_print_stats(sr->icmp, sr, out);
+    }
+
+    sr_evlog_print_stats(out);
+    sr_counters_print_stats(sr, out);
+
+    if(sr_hist_on)
+    {
+        sr_hist_print_stats(out);
+    }
+} /* -- sr_print_stats -- */
+
 /*-----------------------------------------------------------------------------
  * Method: sr_init_instance(..)
  * Scope: Local 
@@ -232,8 +626,27 @@ static void sr_init_instance(struct sr_instance* sr)
     sr->host[0] = 0;
     sr->topo_id = 0;
     sr->if_list = 0;
+    sr->if_table = 0;
+    sr->if_count = 0;
+    sr->if_addrs = 0;
+    sr->if_addrs_mask = 0;
     sr->routing_table = 0;
-    sr->logfile = 0;
+    sr->fib = 0;
+    sr->epoch = 0;
+    sr->reader = 0;
+    sr->adj = 0;
+    sr->timers = 0;
+    sr->arpq = 0;
+    sr->icmp = 0;
+    sr->graph = 0;
+    sr->rx = 0;
+    sr->tx = 0;
+    sr->tx_policy = SR_TX_BATCH;
+    sr->event_loop = 0;
+    sr->workers = 0;
+    sr->capture = 0;
+    sr->replay = 0;
+    sr->ospf_subsys = 0;
 } /* -- sr_init_instance -- */
 
 /*-----------------------------------------------------------------------------
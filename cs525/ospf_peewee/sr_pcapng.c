@@ -0,0 +1,173 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_pcapng.c
+ *
+ * Description:
+ *
+ * pcapng block encoding, see sr_pcapng.h.  Every block is
+ *
+ *   type, total length, body, options, total length
+ *
+ * with the body and each option padded to 32 bits.  Each function writes
+ * one block at buf and returns its length; buf must have room for it.
+ *
+ *---------------------------------------------------------------------------*/
+
+#define _POSIX_C_SOURCE 200809L  /* strnlen under -ansi */
+
+#include <string.h>
+#include <assert.h>
+
+#include "sr_pcapng.h"
+
+static __inline__ uint8_t* put16(uint8_t* p, uint16_t v)
+{ memcpy(p, &v, 2); return p + 2; }
+
+static __inline__ uint8_t* put32(uint8_t* p, uint32_t v)
+{ memcpy(p, &v, 4); return p + 4; }
+
+/*---------------------------------------------------------------------
+ * Method: sr_pcapng_opt(..)
+ * Scope:  Local
+ *
+ * Write one option, value padded with zeros to 32 bits.
+ *
+ *---------------------------------------------------------------------*/
+
+static uint8_t* sr_pcapng_opt(uint8_t* p, uint16_t code, const void* val,
+                              uint16_t len)
+{
+    unsigned int pad = ((len + 3) & ~3U) - len;
+
+    p = put16(p, code);
+    p = put16(p, len);
+    memcpy(p, val, len);
+    memset(p + len, 0, pad);
+
+    return p + len + pad;
+} /* -- sr_pcapng_opt -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_pcapng_end(..)
+ * Scope:  Local
+ *
+ * Close a block started at buf and ending at p: opt_endofopt if any
+ * options were written, then the trailing length, which also goes in
+ * the header.
+ *
+ *---------------------------------------------------------------------*/
+
+static unsigned int sr_pcapng_end(uint8_t* buf, uint8_t* p, int opts)
+{
+    uint32_t total;
+
+    if(opts)
+    {
+        p = put16(p, SR_PCAPNG_OPT_END);
+        p = put16(p, 0);
+    }
+
+    total = (uint32_t)(p - buf) + 4;
+    put32(p, total);
+    put32(buf + 4, total);
+
+    return total;
+} /* -- sr_pcapng_end -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_pcapng_shb(..)
+ * Scope:  Global
+ *
+ * Section Header Block, version 1.0, section length unknown.
+ *
+ *---------------------------------------------------------------------*/
+
+unsigned int sr_pcapng_shb(uint8_t* buf)
+{
+    uint8_t* p = buf;
+
+    /* -- REQUIRES -- */
+    assert(buf);
+
+    p = put32(p, SR_PCAPNG_SHB);
+    p = put32(p, 0);
+    p = put32(p, SR_PCAPNG_MAGIC);
+    p = put16(p, 1);
+    p = put16(p, 0);
+    p = put32(p, 0xffffffff);
+    p = put32(p, 0xffffffff);
+
+    return sr_pcapng_end(buf, p, 0);
+} /* -- sr_pcapng_shb -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_pcapng_idb(..)
+ * Scope:  Global
+ *
+ * Interface Description Block with nanosecond timestamps.  name is cut
+ * to SR_PCAPNG_NAME_MAX; name and mac may be 0.
+ *
+ *---------------------------------------------------------------------*/
+
+unsigned int sr_pcapng_idb(uint8_t* buf, uint16_t linktype, uint32_t snaplen,
+                           const char* name, const uint8_t* mac)
+{
+    uint8_t* p = buf;
+    uint8_t tsresol = 9;  /* 10^-9 */
+
+    /* -- REQUIRES -- */
+    assert(buf);
+
+    p = put32(p, SR_PCAPNG_IDB);
+    p = put32(p, 0);
+    p = put16(p, linktype);
+    p = put16(p, 0);
+    p = put32(p, snaplen);
+
+    if(name && name[0])
+    {
+        p = sr_pcapng_opt(p, SR_PCAPNG_IF_NAME, name,
+                          strnlen(name, SR_PCAPNG_NAME_MAX));
+    }
+    if(mac)
+    { p = sr_pcapng_opt(p, SR_PCAPNG_IF_MACADDR, mac, 6); }
+    p = sr_pcapng_opt(p, SR_PCAPNG_IF_TSRESOL, &tsresol, 1);
+
+    return sr_pcapng_end(buf, p, 1);
+} /* -- sr_pcapng_idb -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_pcapng_epb(..)
+ * Scope:  Global
+ *
+ * Enhanced Packet Block.  ts_ns is nanoseconds since the epoch, matching
+ * the if_tsresol of the IDBs above; flags goes in epb_flags unless 0.
+ *
+ *---------------------------------------------------------------------*/
+
+unsigned int sr_pcapng_epb(uint8_t* buf, uint32_t ifid, uint64_t ts_ns,
+                           uint32_t flags, const uint8_t* data,
+                           uint32_t caplen, uint32_t len)
+{
+    uint8_t* p = buf;
+    unsigned int pad = ((caplen + 3) & ~3U) - caplen;
+
+    /* -- REQUIRES -- */
+    assert(buf);
+    assert(data || caplen == 0);
+
+    p = put32(p, SR_PCAPNG_EPB);
+    p = put32(p, 0);
+    p = put32(p, ifid);
+    p = put32(p, (uint32_t)(ts_ns >> 32));
+    p = put32(p, (uint32_t)ts_ns);
+    p = put32(p, caplen);
+    p = put32(p, len);
+    memcpy(p, data, caplen);
+    memset(p + caplen, 0, pad);
+    p += caplen + pad;
+
+    if(flags)
+    { p = sr_pcapng_opt(p, SR_PCAPNG_EPB_FLAGS, &flags, 4); }
+
+    return sr_pcapng_end(buf, p, flags != 0);
+} /* -- sr_pcapng_epb -- */
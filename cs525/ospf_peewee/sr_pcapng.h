@@ -0,0 +1,59 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_pcapng.h
+ *
+ * Description:
+ *
+ * pcapng blocks, written into memory.  A capture file is a Section Header
+ * Block, one Interface Description Block per router interface (interface
+ * id i is the interface with ifindex i) and then an Enhanced Packet Block
+ * per packet, each carrying its interface, a nanosecond timestamp and,
+ * in the epb_flags option, whether the packet was received or sent.
+ *
+ * Blocks are written in host byte order; the section header's byte order
+ * magic tells readers which that is.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_PCAPNG_H
+#define SR_PCAPNG_H
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif /* _DARWIN_ */
+
+#define SR_PCAPNG_SHB          0x0A0D0D0A
+#define SR_PCAPNG_IDB          0x00000001
+#define SR_PCAPNG_SPB          0x00000003
+#define SR_PCAPNG_EPB          0x00000006
+#define SR_PCAPNG_MAGIC        0x1A2B3C4D
+
+/* -- options -- */
+#define SR_PCAPNG_OPT_END      0
+#define SR_PCAPNG_IF_NAME      2
+#define SR_PCAPNG_IF_MACADDR   6
+#define SR_PCAPNG_IF_TSRESOL   9
+#define SR_PCAPNG_EPB_FLAGS    2
+
+/* -- epb_flags direction, bits 0-1 -- */
+#define SR_PCAPNG_INBOUND      1
+#define SR_PCAPNG_OUTBOUND     2
+
+#define SR_PCAPNG_NAME_MAX     32   /* longest if_name written */
+
+/* -- upper bounds on block sizes, for sizing buffers -- */
+#define SR_PCAPNG_SHB_SIZE     28
+#define SR_PCAPNG_IDB_MAX      (20 + 4 + SR_PCAPNG_NAME_MAX + 12 + 8 + 4)
+#define SR_PCAPNG_EPB_SIZE(caplen) (32 + (((caplen) + 3) & ~3U) + 12)
+
+unsigned int sr_pcapng_shb(uint8_t* buf);
+unsigned int sr_pcapng_idb(uint8_t* buf, uint16_t linktype, uint32_t snaplen,
+                           const char* name, const uint8_t* mac);
+unsigned int sr_pcapng_epb(uint8_t* buf, uint32_t ifid, uint64_t ts_ns,
+                           uint32_t flags, const uint8_t* data,
+                           uint32_t caplen, uint32_t len);
+
+#endif /* -- SR_PCAPNG_H -- */
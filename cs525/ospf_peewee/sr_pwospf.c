@@ -10,6 +10,10 @@
 #include "sr_pwospf.h"
 #include "sr_router.h"
 #include "pwospf_protocol.h"
+#include "sr_tx.h"
+#include "sr_epoch.h"
+#include "sr_counters.h"
+#include "sr_evlog.h"
 
 #include <stdio.h>
 #include <unistd.h>
@@ -17,8 +21,12 @@
 #include <malloc.h>
 #include <string.h>
 
+uint32_t currSeq;
+
 /* -- declaration of main thread function for pwospf subsystem --- */
 static void* pwospf_run_thread(void* arg);
+static void  pwospf_run_timer(void* ctx, void* arg);
+static void  pwospf_tick(struct sr_instance* sr);
 
 /*---------------------------------------------------------------------
  * Method: pwospf_init(..)
@@ -42,8 +50,22 @@ int pwospf_init(struct sr_instance* sr)
     /* -- handle subsystem initialization here! -- */
     sr->ospf_subsys->drt = NULL; 
     sr->ospf_subsys->dif = NULL;
+    sr->ospf_subsys->nbrs = NULL;
+    sr->ospf_subsys->time = 0;
+    sr->ospf_subsys->time2 = 0;
+    currSeq = 0;
+
+    /* -- the event loop runs everything on one thread, see sr_event.h -- */
+    if(sr->event_loop)
+    {
+        sr->ospf_subsys->threaded = 0;
+        sr_timer_init(&sr->ospf_subsys->timer, pwospf_run_timer, 0);
+        sr_timer_arm(sr->timers, &sr->ospf_subsys->timer, 0);
+        return 0;
+    }
 
     /* -- start thread subsystem -- */
+    sr->ospf_subsys->threaded = 1;
     if( pthread_create(&sr->ospf_subsys->thread, 0, pwospf_run_thread, sr)) { 
         perror("pthread_create");
         assert(0);
@@ -56,12 +78,15 @@ int pwospf_init(struct sr_instance* sr)
 /*---------------------------------------------------------------------
  * Method: pwospf_lock
  *
- * Lock mutex associated with pwospf_subsys
+ * Lock mutex associated with pwospf_subsys.  Without a pwospf thread
+ * there is nothing to lock against.
  *
  *---------------------------------------------------------------------*/
 
 void pwospf_lock(struct pwospf_subsys* subsys)
 {
+  if ( ! subsys->threaded )
+      { return; }
   if ( pthread_mutex_lock(&subsys->lock) )
       { assert(0); }
 } /* -- pwospf_subsys -- */
@@ -75,6 +100,8 @@ void pwospf_lock(struct pwospf_subsys* subsys)
 
 void pwospf_unlock(struct pwospf_subsys* subsys)
 {
+    if ( ! subsys->threaded )
+    { return; }
     if ( pthread_mutex_unlock(&subsys->lock) )
     { assert(0); }
 } /* -- pwospf_subsys -- */
@@ -85,16 +112,16 @@ void pwospf_unlock(struct pwospf_subsys* subsys)
  * Return the matching interface of a router connected to this
  * interface.  If none found, the default value is zero.
  **************************************************************/
-uint32_t findAttachedInterface(dynif *dIf, uint32_t qIp, char *interface){
+uint32_t findAttachedInterface(dynif *dIf, uint32_t qIp, unsigned int ifindex){
 
   dynif *walker = dIf;
   
   while(walker != NULL){
 
     /* if( walker->neighborRid.s_addr  == qIp ){ */
-    if( strcmp(interface, walker->interface) == 0 ){
+    if( walker->ifindex == ifindex ){
       /*fprintf(stderr, "RETURNING FROM findAttached....: ");*/
-      printIp(walker->neighborRid.s_addr);
+      sr_log(SR_LOG_OSPF_LSU_NBR, walker->neighborRid.s_addr, ifindex, 0, 0);
       return walker->neighborRid.s_addr;
     } else {
       /*printf("\t\t%X  VS  %X\n", walker->ourIp.s_addr, qIp);*/
@@ -106,6 +133,43 @@ uint32_t findAttachedInterface(dynif *dIf, uint32_t qIp, char *interface){
   return 0;
 }
 
+/*---------------------------------------------------------------------
+ * Method: pwospf_publish_nbrs
+ *
+ * Copy the neighbors that are still up (helloInt > 1) into a fresh
+ * snapshot and swap it in for the LSU flood.  Call with the lock held
+ * whenever a neighbor comes up or goes down; the old snapshot is
+ * retired to the epoch, see sr_epoch.h.
+ *
+ *---------------------------------------------------------------------*/
+
+void pwospf_publish_nbrs(struct sr_instance* sr)
+{
+  struct pwospf_nbrs *nbrs, *old = sr->ospf_subsys->nbrs;
+  dynif *walker;
+  unsigned int n = 0;
+
+  for (walker = sr->ospf_subsys->dif; walker != NULL; walker = walker->next)
+    if (walker->helloInt > 1)
+      ++n;
+
+  nbrs = (struct pwospf_nbrs*) malloc(sizeof(struct pwospf_nbrs) +
+                                      n * sizeof(dynif));
+  assert(nbrs);
+  nbrs->n = 0;
+
+  for (walker = sr->ospf_subsys->dif; walker != NULL; walker = walker->next) {
+    if (walker->helloInt > 1) {
+      nbrs->nbr[nbrs->n] = *walker;
+      nbrs->nbr[nbrs->n].next = NULL;
+      ++nbrs->n;
+    }
+  }
+
+  __atomic_store_n(&sr->ospf_subsys->nbrs, nbrs, __ATOMIC_RELEASE);
+  sr_epoch_retire(sr->epoch, old, free);
+} /* -- pwospf_publish_nbrs -- */
+
 
 
 
@@ -133,7 +197,7 @@ printDrt(dynrt *drt) {
     printIp(drt->mask.s_addr);
     printf("Gateway is: ");
     printIp(drt->gw.s_addr);
-    printf("Via interface: %s\n", drt->interface);
+    printf("Via interface: %u\n", drt->ifindex);
     printf("TTL: %d NumHops: %d Seq# %d\n",
 	   drt->ttl, drt->numHops, drt->lastSeqNumber);
     printf("---------------------------\n");
@@ -145,104 +209,40 @@ printDrt(dynrt *drt) {
 }
 
 uint32_t
-getNextHopsIp(struct sr_instance *sr, char *interface) {
+getNextHopsIp(struct sr_instance *sr, unsigned int ifindex) {
   uint32_t next;
   
   dynif *dif = sr->ospf_subsys->dif;
   while (dif != NULL) {
-    if (strcmp( interface, dif->interface) == 0) {
+    if (dif->ifindex == ifindex) {
       return dif->neighborIp.s_addr;
     }
     dif = dif->next;
   }
 
-  struct sr_if *iflist = sr->if_list;
-  while (iflist != NULL) {
-
-
-    if ( strcmp(iflist->name, interface) == 0) {
-      next = ntohl(iflist->ip); /* TODO: this is network order? */
-      if (next % 2 != 0) {
-	--next;
-      } else {
-	++next;
-      }
-      /*fprintf(stderr,
-	"Terrible, yet awful is happening! %d\n", htonl(next));*/
-      return htonl(next);
+  struct sr_if *iface = sr_get_interface_by_index(sr, ifindex);
+  if (iface != NULL) {
+    next = ntohl(iface->ip); /* TODO: this is network order? */
+    if (next % 2 != 0) {
+      --next;
+    } else {
+      ++next;
     }
+    /*fprintf(stderr,
+      "Terrible, yet awful is happening! %d\n", htonl(next));*/
+    return htonl(next);
   }
 
   /* 0 is not quite right... oh well */
   return 0;
 }
 
-/**************************************************
- * This uses the dynamic routing table, and looks up the query
- * it assumes that the query is in network byte order.
- **************************************************/
-dynrt *
-dynamicLongestPrefixMatch(uint32_t query, dynrt *drt){
-  
-  uint32_t i, j, mask, dest, longestMatch = 0, skip;
-  dynrt *bestMatch = NULL;
-
-  query = htonl(query);
-  while (drt != NULL ) {
-    skip = 0;
- 
-    dest = htonl(drt->dest.s_addr);
-    mask = htonl(drt->mask.s_addr);
-
-    if (drt->ttl) { /* only look at the entry if it's not timed out */
-
-      for (j = 0; j < 32; ++j) {
-	i = 1 << (31-j);
-	/*       if the mask is set to 1 for the jth bit  */
-	if ((i & mask) != 0) {
-	  if ( (i & dest) != (i & query)) {
-	    skip = 1; /* bits don't agree */
-	    break; 
-	  }
-	} else 
-	  break;
-      }
-      
-      if (skip==0) {
-	if ( j > longestMatch) {
-	    if(bestMatch == NULL){
-	      /*fprintf(stderr, "INITIALIZING dynamicLonges....\n");*/
-	    }
-	    else{
-	      /*fprintf(stderr, "Better match found existing: %d  vs.  new:  %d  newj: %d  oldj = %d\n", bestMatch->numHops,
-		drt->numHops, longestMatch, j);*/
-	    }
-	  longestMatch = j;
-	  bestMatch = drt;
-
-	} else if (j == longestMatch) {
-	  /* if the prefix match is as large, favor the smaller number of hops */
-	  if (bestMatch == NULL || bestMatch->numHops > drt->numHops){
-	    if(bestMatch == NULL){
-	      /*fprintf(stderr, "INITIALIZING dynamicLonges....\n");*/
-	    }
-	    else{
-	      /*fprintf(stderr, "UPDATE: Better match found existing: %d  vs.  new:  %d  newj: %d  oldj = %d\n", bestMatch->numHops,
-		drt->numHops, longestMatch, j);*/
-	    }
-	    bestMatch = drt;
-	  }
-	}
-      }
-    }
-    drt = drt->next;
-  }
-
-
-  return bestMatch;
-}
-
-
+/*---------------------------------------------------------------------
+ * Method: pwospf_run_thread
+ *
+ * Main thread of pwospf subsystem, when there is one: a tick a second.
+ *
+ *---------------------------------------------------------------------*/
 
 static
 void* pwospf_run_thread(void* arg)
@@ -252,6 +252,41 @@ void* pwospf_run_thread(void* arg)
   if(sr == NULL){
     fprintf(stderr, "SR is NULL!!!\n");
   }
+  sr_counters_register("pwospf");
+
+  while(1){
+    pwospf_tick(sr);
+    sleep(1); /* matt and august changed this from "2" */
+  }
+
+  return 0;
+} /* -- run_ospf_thread -- */
+
+/*---------------------------------------------------------------------
+ * Method: pwospf_run_timer
+ *
+ * The same tick driven by the timer wheel, for the event loop.
+ *
+ *---------------------------------------------------------------------*/
+
+static void pwospf_run_timer(void* ctx, void* arg)
+{
+  struct sr_instance* sr = (struct sr_instance*)ctx;
+
+  pwospf_tick(sr);
+  sr_timer_arm(sr->timers, &sr->ospf_subsys->timer, OSPF_TICK_MS);
+} /* -- pwospf_run_timer -- */
+
+/*---------------------------------------------------------------------
+ * Method: pwospf_tick
+ *
+ * One second's worth of pwospf work: age the dynamic routes and
+ * neighbors, and send hellos and LSUs when they are due.
+ *
+ *---------------------------------------------------------------------*/
+
+static void pwospf_tick(struct sr_instance* sr)
+{
 
   /* initialize the new packet to send */
   uint8_t packet[sizeof(struct sr_ethernet_hdr) + sizeof(struct ip) 
@@ -290,12 +325,11 @@ void* pwospf_run_thread(void* arg)
   ipHdr->ip_p = OSPF_TYPE;
   ipHdr->ip_dst.s_addr = htonl(OSPF_AllSPFRouters);
   
-  uint64_t time = 0, time2 = 0;
+  uint64_t time = sr->ospf_subsys->time, time2 = sr->ospf_subsys->time2;
   dynrt *dynamicRt;
   dynif *dynamicIf;
-  currSeq = 0;
+  int routesExpired, nbrsDown;
 
-  while(1){
     /* -- PWOSPF subsystem functionality should start  here! -- */
     pwospf_lock(sr->ospf_subsys);
     
@@ -304,14 +338,24 @@ void* pwospf_run_thread(void* arg)
 
     /* decrement TTL for dynamic routing table and 
        dynamic interface list */
+    routesExpired = 0;
     while (dynamicRt != NULL) {
-      if (dynamicRt->ttl < 2)
+      if (dynamicRt->ttl < 2) {
+	/* only routes the forwarding table has change it */
+	if (dynamicRt->ttl != TIME_EXPIRED && dynamicRt->gw.s_addr != 0)
+	  routesExpired = 1;
 	dynamicRt->ttl = TIME_EXPIRED;
+      }
       else
 	--(dynamicRt->ttl);
       dynamicRt = dynamicRt->next;
     }
 
+    /* expired routes have to leave the forwarding table */
+    if (routesExpired)
+      sr_fib_rebuild(sr);
+
+    nbrsDown = 0;
     while(dynamicIf != NULL){
       if(dynamicIf->helloInt < 2){
 	if (dynamicIf->helloInt != OSPF_DEFAULT_LSUINT)
@@ -320,10 +364,17 @@ void* pwospf_run_thread(void* arg)
 	dynamicIf->helloInt = TIME_EXPIRED;
 	
       }
-      else
-	--(dynamicIf->helloInt);
+      else if (--(dynamicIf->helloInt) < 2)
+	nbrsDown = 1;
       dynamicIf = dynamicIf->next;
     }
+
+    /* neighbors that went quiet are no longer flooded to */
+    if (nbrsDown)
+      pwospf_publish_nbrs(sr);
+
+    /* and tables replaced since the last tick can likely go */
+    sr_epoch_reclaim(sr->epoch);
     
     /*******************************************
      * Broadcast an OSPF HELLO packet
@@ -371,7 +422,7 @@ void* pwospf_run_thread(void* arg)
 	ospfHdr->csum = ospfCheckSum;
 	/*fprintf(stderr, "Sending HELLO\n");*/
 	/* send packet */
-	sr_send_packet(sr, packet, helloLen, walker->name);
+	sr_send_packet(sr, packet, helloLen, walker->ifindex);
 
 	/* iterate */
 	walker = walker->next;
@@ -427,7 +478,7 @@ void* pwospf_run_thread(void* arg)
 	  /* This should be the RID of the router at the other 
 	     end of this interface; if none yet exists, set it to 0 */
 	  uint32_t tempRid = findAttachedInterface(sr->ospf_subsys->dif, 
-						   lsuPacket->subnet, walker->name); 
+						   lsuPacket->subnet, walker->ifindex); 
 	  lsuPacket->rid = tempRid;/*walker->ip;tempRid;*/
 	  
 	  ++numAttachedInterfaces;
@@ -509,7 +560,7 @@ void* pwospf_run_thread(void* arg)
 	  memset(ethHdr->ether_dhost, 255, ETHER_ADDR_LEN);
 	  /*fprintf(stderr, "Sending out some LSU packet action\n");*/
 	  /* send packet */
-	  sr_send_packet(sr, packet, lsuLen - barf, walker->name);
+	  sr_send_packet(sr, packet, lsuLen - barf, walker->ifindex);
 	  
 	  /* iterate */
 	  walker = walker->next;
@@ -519,11 +570,12 @@ void* pwospf_run_thread(void* arg)
       
     }/* -- LSU generation -- */
     
+    /* -- the hellos and LSUs go out together -- */
+    sr_tx_flush(sr->tx);
+
+    sr->ospf_subsys->time  = time + 1;
+    sr->ospf_subsys->time2 = time2 + 1;
+
     pwospf_unlock(sr->ospf_subsys);
-    sleep(1); /* matt and august changed this from "2" */
-    
-    ++time;
-    ++time2;
-  };
-} /* -- run_ospf_thread -- */
+} /* -- pwospf_tick -- */
 
@@ -12,13 +12,17 @@
 
 #include <pthread.h>
 #include "includes.h"
+#include "sr_timer.h"
 
 /* forward declare */
 struct sr_instance;
 
 #define TIME_EXPIRED 0
+#define OSPF_TICK_MS 1000
 #define MAX_INTERFACES 4
-uint32_t currSeq;
+
+/* -- sequence number of our next LSU, defined in sr_pwospf.c -- */
+extern uint32_t currSeq;
 
 
 typedef struct dynamic_rt {
@@ -26,7 +30,7 @@ typedef struct dynamic_rt {
   struct in_addr gw;
   struct in_addr mask;
   struct in_addr rid;
-  char interface[sr_IFACE_NAMELEN];
+  unsigned int ifindex;
   uint8_t ttl;
   uint16_t lastSeqNumber;
   uint8_t numHops;
@@ -39,36 +43,46 @@ typedef struct dynamic_if {
   uint8_t helloInt;
   struct in_addr neighborRid;
   struct in_addr neighborIp;
-  char interface[sr_IFACE_NAMELEN];
+  unsigned int ifindex;
   char srcMac[ETHER_ADDR_LEN];
   char dstMac[ETHER_ADDR_LEN];
 
   struct dynamic_if *next;
 } dynif;
 
+/* -- the neighbors LSUs are flooded to, as one immutable snapshot that
+ *    packet handling reads without the lock; see pwospf_publish_nbrs -- */
+struct pwospf_nbrs {
+  unsigned int n;
+  dynif nbr[1]; /* n of them, 'next' unused */
+};
+
 struct pwospf_subsys
 {
   /* -- pwospf subsystem state variables here -- */
   dynrt *drt; /* dynamic routing table */  
   dynif *dif;
+  struct pwospf_nbrs *nbrs; /* live entries of dif, published copy */
+  uint64_t time;  /* ticks so far */
+  uint64_t time2; /* ticks since an LSU was last forced */
   /* -- thread and single lock for pwospf subsystem -- */
   pthread_t thread;
   pthread_mutex_t lock;
+  int threaded;   /* 0 under the event loop: no thread, no locking */
+  struct sr_timer timer; /* drives the ticks under the event loop */
 };
 
 int pwospf_init(struct sr_instance* sr);
 void pwospf_unlock(struct pwospf_subsys* subsys);
 void pwospf_lock(struct pwospf_subsys* subsys);
+void pwospf_publish_nbrs(struct sr_instance* sr);
 void printDrt(dynrt *drt);
 /**************************************************
  *
  **************************************************/
-uint32_t findAttachedInterface(dynif *dIf, uint32_t qIp, char *interface);
-
-dynrt *
-dynamicLongestPrefixMatch(uint32_t query, dynrt *drt);
+uint32_t findAttachedInterface(dynif *dIf, uint32_t qIp, unsigned int ifindex);
 
 uint32_t
-getNextHopsIp(struct sr_instance *sr, char *interface);
+getNextHopsIp(struct sr_instance *sr, unsigned int ifindex);
 
 #endif /* SR_PWOSPF_H */
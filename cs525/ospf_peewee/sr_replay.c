@@ -0,0 +1,816 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_replay.c
+ *
+ * Description:
+ *
+ * Offline trace replay, see sr_replay.h.
+ *
+ * Trace packets are lent to the packet path straight out of the file
+ * image, the way frames are lent out of the receive ring, so the router
+ * may rewrite them in place; each is replayed once.
+ *
+ *---------------------------------------------------------------------------*/
+
+#define _DEFAULT_SOURCE  /* inet_aton, nanosleep and CLOCK_MONOTONIC */
+#define _BSD_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "sr_router.h"
+#include "sr_if.h"
+#include "sr_graph.h"
+#include "sr_timer.h"
+#include "sr_tx.h"
+#include "sr_epoch.h"
+#include "sr_capture.h"
+#include "sr_replay.h"
+#include "sr_counters.h"
+
+#define SR_REPLAY_NS      1000000000ULL
+#define PCAP_NSEC_MAGIC   0xa1b23c4d
+#define SR_REPLAY_EXP2    32   /* finest if_tsresol, power of two */
+#define SR_REPLAY_EXP10   19   /* finest if_tsresol, power of ten */
+
+/* ----------------------------------------------------------------------------
+ * struct sr_replay_if
+ *
+ * An interface of the trace: pcapng describes them one IDB at a time,
+ * a classic pcap has just the one.
+ *
+ * -------------------------------------------------------------------------- */
+
+struct sr_replay_if
+{
+    uint16_t linktype;
+    uint8_t  tsresol;   /* as in if_tsresol */
+    int      ifindex;   /* router interface, -1 to go by MAC */
+};
+
+static __inline__ uint16_t get16(const uint8_t* p)
+{ uint16_t v; memcpy(&v, p, 2); return v; }
+
+static __inline__ uint32_t get32(const uint8_t* p)
+{ uint32_t v; memcpy(&v, p, 4); return v; }
+
+/*---------------------------------------------------------------------
+ * Method: sr_replay_clock(..)
+ * Scope:  Local
+ *
+ * Nanoseconds on a clock that never steps backwards.
+ *
+ *---------------------------------------------------------------------*/
+
+static uint64_t sr_replay_clock(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * SR_REPLAY_NS + ts.tv_nsec;
+} /* -- sr_replay_clock -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_replay_ns(..)
+ * Scope:  Local
+ *
+ * A pcapng timestamp in units of if_tsresol to nanoseconds.  The high
+ * bit of tsresol means a negative power of two, else of ten.  Past
+ * SR_REPLAY_EXP2 or SR_REPLAY_EXP10 the scale would overflow; the IDB
+ * has been refused by then, 0 is just to be safe.
+ *
+ *---------------------------------------------------------------------*/
+
+static uint64_t sr_replay_ns(uint64_t ts, uint8_t tsresol)
+{
+    unsigned int exp = tsresol & 0x7f;
+    uint64_t scale = 1;
+
+    if(tsresol & 0x80)
+    {
+        if(exp > SR_REPLAY_EXP2)
+        { return 0; }
+        return (ts >> exp) * SR_REPLAY_NS +
+               (((ts & ((1ULL << exp) - 1)) * SR_REPLAY_NS) >> exp);
+    }
+
+    if(exp > SR_REPLAY_EXP10)
+    { return 0; }
+
+    if(exp <= 9)
+    {
+        while(exp++ < 9)
+        { scale *= 10; }
+        return ts * scale;
+    }
+
+    while(exp-- > 9)
+    { scale *= 10; }
+    return ts / scale;
+} /* -- sr_replay_ns -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_replay_add(..)
+ * Scope:  Local
+ *
+ * Queue a trace packet for replay on the interface its trace interface
+ * maps to, or by destination MAC.
+ *
+ *---------------------------------------------------------------------*/
+
+static void sr_replay_add(struct sr_instance* sr, struct sr_replay* rp,
+                          const struct sr_replay_if* tif, uint64_t ts,
+                          uint8_t* data, uint32_t caplen, uint32_t len)
+{
+    struct sr_replay_pkt* pkt = 0;
+    struct sr_if* iface = 0;
+
+    if(tif == 0 || tif->linktype != LINKTYPE_ETHERNET || caplen < len ||
+       len < sizeof(struct sr_ethernet_hdr))
+    {
+        ++rp->skipped;
+        return;
+    }
+
+    if(rp->npkts == rp->maxpkts)
+    {
+        rp->maxpkts = rp->maxpkts ? rp->maxpkts * 2 : 4096;
+        rp->pkts = (struct sr_replay_pkt*)realloc(rp->pkts,
+                                rp->maxpkts * sizeof(struct sr_replay_pkt));
+        assert(rp->pkts);
+    }
+
+    pkt = &rp->pkts[rp->npkts++];
+    pkt->ts   = ts;
+    pkt->data = data;
+    pkt->len  = len;
+
+    if(tif->ifindex >= 0)
+    {
+        pkt->ifindex = tif->ifindex;
+        return;
+    }
+
+    for(iface = sr->if_list; iface; iface = iface->next)
+    {
+        if(memcmp(iface->addr, data, ETHER_ADDR_LEN) == 0)
+        {
+            pkt->ifindex = iface->ifindex;
+            return;
+        }
+    }
+
+    pkt->ifindex = 0;
+    ++rp->untagged;
+} /* -- sr_replay_add -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_replay_pcap(..)
+ * Scope:  Local
+ *
+ * Read the packets of a classic pcap image, micro or nanosecond.
+ *
+ *---------------------------------------------------------------------*/
+
+static int sr_replay_pcap(struct sr_instance* sr, struct sr_replay* rp,
+                          uint8_t* image, size_t size, int ifindex)
+{
+    struct pcap_file_header fh;
+    struct pcap_sf_pkthdr ph;
+    struct sr_replay_if tif;
+    uint64_t unit;
+    size_t off = sizeof(fh);
+
+    memcpy(&fh, image, sizeof(fh));
+    unit = fh.magic == PCAP_NSEC_MAGIC ? 1 : 1000;
+
+    tif.linktype = (uint16_t)fh.linktype;
+    tif.tsresol  = 9;
+    tif.ifindex  = ifindex;
+
+    while(off + sizeof(ph) <= size)
+    {
+        memcpy(&ph, image + off, sizeof(ph));
+        off += sizeof(ph);
+        if(ph.caplen > size - off)
+        { return -1; }
+
+        sr_replay_add(sr, rp, &tif,
+                      (uint64_t)(uint32_t)ph.ts.tv_sec * SR_REPLAY_NS +
+                      (uint64_t)(uint32_t)ph.ts.tv_usec * unit,
+                      image + off, ph.caplen, ph.len);
+        off += ph.caplen;
+    }
+
+    return off == size ? 0 : -1;
+} /* -- sr_replay_pcap -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_replay_idb(..)
+ * Scope:  Local
+ *
+ * Read an Interface Description Block: its link type, timestamp
+ * resolution and, unless tagged, the router interface of the same name.
+ * Returns -1 for a resolution too fine to scale to nanoseconds.
+ *
+ *---------------------------------------------------------------------*/
+
+static int sr_replay_idb(struct sr_instance* sr, struct sr_replay_if* tif,
+                          const uint8_t* blk, uint32_t len, int tag)
+{
+    char name[SR_IFACE_NAMELEN];
+    struct sr_if* iface = 0;
+    uint32_t off = 16;
+    uint16_t code, olen;
+
+    tif->linktype = get16(blk + 8);
+    tif->tsresol  = 6;
+    tif->ifindex  = tag;
+
+    while(off + 4 <= len - 4)
+    {
+        code = get16(blk + off);
+        olen = get16(blk + off + 2);
+        if(code == SR_PCAPNG_OPT_END || off + 4 + olen > len - 4)
+        { break; }
+
+        if(code == SR_PCAPNG_IF_TSRESOL && olen >= 1)
+        { tif->tsresol = blk[off + 4]; }
+        else if(code == SR_PCAPNG_IF_NAME && tag < 0 &&
+                olen < SR_IFACE_NAMELEN)
+        {
+            memcpy(name, blk + off + 4, olen);
+            name[olen] = 0;
+            if((iface = sr_get_interface(sr, name)) != 0)
+            { tif->ifindex = iface->ifindex; }
+        }
+
+        off += 4 + ((olen + 3) & ~3U);
+    }
+
+    if(tif->tsresol & 0x80)
+    { return (tif->tsresol & 0x7f) > SR_REPLAY_EXP2 ? -1 : 0; }
+    return tif->tsresol > SR_REPLAY_EXP10 ? -1 : 0;
+} /* -- sr_replay_idb -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_replay_epb_flags(..)
+ * Scope:  Local
+ *
+ * epb_flags of an Enhanced Packet Block whose options start at off,
+ * 0 if it has none.
+ *
+ *---------------------------------------------------------------------*/
+
+static uint32_t sr_replay_epb_flags(const uint8_t* blk, uint32_t len,
+                                    uint32_t off)
+{
+    uint16_t code, olen;
+
+    while(off + 4 <= len - 4)
+    {
+        code = get16(blk + off);
+        olen = get16(blk + off + 2);
+        if(code == SR_PCAPNG_OPT_END || off + 4 + olen > len - 4)
+        { break; }
+
+        if(code == SR_PCAPNG_EPB_FLAGS && olen == 4)
+        { return get32(blk + off + 4); }
+
+        off += 4 + ((olen + 3) & ~3U);
+    }
+
+    return 0;
+} /* -- sr_replay_epb_flags -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_replay_pcapng(..)
+ * Scope:  Local
+ *
+ * Read the packets of a pcapng image, every section of it.  tags maps
+ * trace interface ids to router interfaces.
+ *
+ *---------------------------------------------------------------------*/
+
+static int sr_replay_pcapng(struct sr_instance* sr, struct sr_replay* rp,
+                            uint8_t* image, size_t size,
+                            const int* tags, unsigned int ntags)
+{
+    struct sr_replay_if ifs[SR_REPLAY_TAGS];
+    const struct sr_replay_if* tif = 0;
+    unsigned int nifs = 0;
+    uint8_t* blk = 0;
+    uint32_t type, len, id, caplen;
+    size_t off = 0;
+
+    while(off + 12 <= size)
+    {
+        blk  = image + off;
+        type = get32(blk);
+        len  = get32(blk + 4);
+        if(len < 12 || (len & 3) || len > size - off)
+        { return -1; }
+
+        switch(type)
+        {
+            case SR_PCAPNG_SHB:
+                if(len < 28 || get32(blk + 8) != SR_PCAPNG_MAGIC)
+                {
+                    fprintf(stderr, "sr_replay: byte swapped pcapng\n");
+                    return -1;
+                }
+                nifs = 0;
+                break;
+
+            case SR_PCAPNG_IDB:
+                if(len < 20)
+                { return -1; }
+                if(nifs < SR_REPLAY_TAGS &&
+                   sr_replay_idb(sr, &ifs[nifs], blk, len,
+                                 nifs < ntags ? tags[nifs] : -1) != 0)
+                { return -1; }
+                ++nifs;
+                break;
+
+            case SR_PCAPNG_EPB:
+                if(len < 32)
+                { return -1; }
+                id     = get32(blk + 8);
+                caplen = get32(blk + 20);
+                if(caplen > len - 32)
+                { return -1; }
+
+                /* -- what the captured router sent isn't input -- */
+                if((sr_replay_epb_flags(blk, len, 28 + ((caplen + 3) & ~3U))
+                    & 3) == SR_PCAPNG_OUTBOUND)
+                {
+                    ++rp->skipped;
+                    break;
+                }
+
+                tif = id < nifs && id < SR_REPLAY_TAGS ? &ifs[id] : 0;
+                sr_replay_add(sr, rp, tif,
+                              tif ? sr_replay_ns(((uint64_t)get32(blk + 12) << 32)
+                                                 | get32(blk + 16), tif->tsresol)
+                                  : 0,
+                              blk + 28, caplen, get32(blk + 24));
+                break;
+
+            case SR_PCAPNG_SPB: /* -- interface 0, no time -- */
+                if(len < 16)
+                { return -1; }
+                caplen = min(get32(blk + 8), len - 16);
+                sr_replay_add(sr, rp, nifs > 0 ? &ifs[0] : 0,
+                              rp->npkts ? rp->pkts[rp->npkts - 1].ts : 0,
+                              blk + 12, caplen, get32(blk + 8));
+                break;
+
+            default:
+                break;
+        } /* -- switch -- */
+
+        off += get32(blk + 4);
+    }
+
+    return off == size ? 0 : -1;
+} /* -- sr_replay_pcapng -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_replay_tags(..)
+ * Scope:  Local
+ *
+ * Parse "eth0,eth1,..." into router interface indices.  Returns how
+ * many, or -1 if one isn't a router interface.
+ *
+ *---------------------------------------------------------------------*/
+
+static int sr_replay_tags(struct sr_instance* sr, char* list, int* tags)
+{
+    struct sr_if* iface = 0;
+    unsigned int n = 0;
+    char* name = 0;
+
+    for(name = strtok(list, ","); name; name = strtok(0, ","))
+    {
+        if(n == SR_REPLAY_TAGS || (iface = sr_get_interface(sr, name)) == 0)
+        {
+            fprintf(stderr, "sr_replay: no interface %s to tag with\n", name);
+            return -1;
+        }
+        tags[n++] = iface->ifindex;
+    }
+
+    return n;
+} /* -- sr_replay_tags -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_replay_read(..)
+ * Scope:  Local
+ *
+ * The whole of file fname, in memory.
+ *
+ *---------------------------------------------------------------------*/
+
+static uint8_t* sr_replay_read(const char* fname, size_t* size)
+{
+    uint8_t* image = 0;
+    FILE* fp = 0;
+    long len;
+
+    if((fp = fopen(fname, "rb")) == 0)
+    {
+        fprintf(stderr, "sr_replay: can't open %s: %s\n", fname,
+                strerror(errno));
+        return 0;
+    }
+
+    if(fseek(fp, 0, SEEK_END) == 0 && (len = ftell(fp)) >= 0 &&
+       fseek(fp, 0, SEEK_SET) == 0 &&
+       (image = (uint8_t*)malloc(len ? len : 1)) != 0 &&
+       fread(image, 1, len, fp) == (size_t)len)
+    {
+        *size = len;
+        fclose(fp);
+        return image;
+    }
+
+    fprintf(stderr, "sr_replay: can't read %s\n", fname);
+    free(image);
+    fclose(fp);
+    return 0;
+} /* -- sr_replay_read -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_replay_connect(..)
+ * Scope:  Global
+ *
+ * Stand-in for sr_connect_to_server: a transmit batch that writes to
+ * /dev/null, so that sends still pay for it.  Corking needs a socket,
+ * so that policy batches instead.  Returns -1 on error.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_replay_connect(struct sr_instance* sr)
+{
+    int fd;
+
+    /* -- REQUIRES -- */
+    assert(sr);
+    assert(sr->tx == 0);
+
+    if((fd = open("/dev/null", O_WRONLY)) == -1)
+    {
+        perror("open(..):sr_replay.c::sr_replay_connect");
+        return -1;
+    }
+
+    sr->tx = (struct sr_tx*)malloc(sizeof(struct sr_tx));
+    assert(sr->tx);
+    sr_tx_init(sr->tx, fd, sr->tx_policy == SR_TX_CORK ? SR_TX_BATCH
+                                                       : sr->tx_policy, 1);
+
+    return 0;
+} /* -- sr_replay_connect -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_replay_config(..)
+ * Scope:  Global
+ *
+ * Set up the router's interfaces from a local config file, see
+ * sr_replay.h, as VNSHWINFO would.  Returns -1 on error.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_replay_config(struct sr_instance* sr, const char* fname)
+{
+    char line[256], name[SR_IFACE_NAMELEN], ip[64], mask[64], mac[64];
+    struct in_addr ip_nbo, mask_nbo;
+    unsigned int m[6], lineno = 0, i;
+    unsigned char addr[6];
+    FILE* fp = 0;
+
+    /* -- REQUIRES -- */
+    assert(sr);
+    assert(fname);
+
+    if((fp = fopen(fname, "r")) == 0)
+    {
+        fprintf(stderr, "sr_replay: can't open %s: %s\n", fname,
+                strerror(errno));
+        return -1;
+    }
+
+    while(fgets(line, sizeof(line), fp))
+    {
+        ++lineno;
+        if(sscanf(line, "%31s", name) != 1 || name[0] == '#')
+        { continue; }
+
+        if(sscanf(line, "%31s %63s %63s %63s", name, ip, mask, mac) != 4 ||
+           inet_aton(ip, &ip_nbo) == 0 || inet_aton(mask, &mask_nbo) == 0 ||
+           sscanf(mac, "%x:%x:%x:%x:%x:%x", &m[0], &m[1], &m[2], &m[3],
+                  &m[4], &m[5]) != 6)
+        {
+            fprintf(stderr, "sr_replay: %s:%u: expected name ip mask mac\n",
+                    fname, lineno);
+            fclose(fp);
+            return -1;
+        }
+
+        for(i = 0; i < 6; ++i)
+        { addr[i] = (unsigned char)m[i]; }
+
+        sr_add_interface(sr, name);
+        sr_set_ether_addr(sr, addr);
+        sr_set_ether_ip(sr, ip_nbo.s_addr);
+        sr_set_ether_mask(sr, mask_nbo.s_addr);
+    }
+    fclose(fp);
+
+    if(sr->if_list == 0)
+    {
+        fprintf(stderr, "sr_replay: no interfaces in %s\n", fname);
+        return -1;
+    }
+
+    sr_hw_ready(sr);
+
+    return 0;
+} /* -- sr_replay_config -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_replay_open(..)
+ * Scope:  Global
+ *
+ * Load the trace "file[@tag,tag,...]" for replay once the interfaces
+ * are set up.  Frames sent go to out in the given capture format,
+ * unless out is 0.  Returns 0 on error.
+ *
+ *---------------------------------------------------------------------*/
+
+struct sr_replay* sr_replay_open(struct sr_instance* sr, const char* spec,
+                                 int paced, const char* out, int format)
+{
+    struct sr_replay* rp = 0;
+    struct sr_if* iface = 0;
+    int tags[SR_REPLAY_TAGS];
+    int ntags = 0, ret = -1;
+    char* fname = 0;
+    char* at = 0;
+    size_t size = 0;
+    uint32_t magic;
+
+    /* -- REQUIRES -- */
+    assert(sr);
+    assert(spec);
+
+    fname = (char*)malloc(strlen(spec) + 1);
+    assert(fname);
+    strcpy(fname, spec);
+    if((at = strrchr(fname, '@')) != 0)
+    {
+        *at = 0;
+        if((ntags = sr_replay_tags(sr, at + 1, tags)) < 0)
+        {
+            free(fname);
+            return 0;
+        }
+    }
+
+    rp = (struct sr_replay*)calloc(1, sizeof(struct sr_replay));
+    assert(rp);
+    rp->paced = paced;
+
+    if((rp->image = sr_replay_read(fname, &size)) != 0 &&
+       size >= sizeof(struct pcap_file_header))
+    {
+        magic = get32(rp->image);
+        if(magic == TCPDUMP_MAGIC || magic == PCAP_NSEC_MAGIC)
+        {
+            ret = sr_replay_pcap(sr, rp, rp->image, size,
+                                 ntags > 0 ? tags[0] : -1);
+        }
+        else if(magic == SR_PCAPNG_SHB)
+        { ret = sr_replay_pcapng(sr, rp, rp->image, size, tags, ntags); }
+        else
+        { fprintf(stderr, "sr_replay: %s is not pcap or pcapng\n", fname); }
+    }
+
+    if(ret == -1)
+    {
+        if(rp->image)
+        { fprintf(stderr, "sr_replay: %s is corrupt\n", fname); }
+        free(fname);
+        free(rp->image);
+        free(rp->pkts);
+        free(rp);
+        return 0;
+    }
+    free(fname);
+
+    if(out)
+    {
+        if((rp->out = sr_capture_open(out, format, 0)) == 0)
+        {
+            free(rp->image);
+            free(rp->pkts);
+            free(rp);
+            return 0;
+        }
+
+        /* -- the output is the result, it can't drop frames -- */
+        rp->out->wait = 1;
+        for(iface = sr->if_list; iface; iface = iface->next)
+        {
+            sr_capture_add_interface(rp->out, iface->ifindex, iface->name,
+                                     iface->addr);
+        }
+    }
+
+    fprintf(stderr, "sr_replay: %u packets to replay, %lu skipped, "
+            "%lu by first interface\n", rp->npkts,
+            (unsigned long)rp->skipped, (unsigned long)rp->untagged);
+
+    return rp;
+} /* -- sr_replay_open -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_replay_wait(..)
+ * Scope:  Local
+ *
+ * Sleep until ns have passed or the next timer is due, outside a read
+ * section.
+ *
+ *---------------------------------------------------------------------*/
+
+static void sr_replay_wait(struct sr_instance* sr, uint64_t ns)
+{
+    struct timespec ts;
+    int next = sr->timers ? sr_timer_next(sr->timers) : -1;
+
+    if(next >= 0 && (uint64_t)next * 1000000 < ns)
+    { ns = (uint64_t)next * 1000000; }
+
+    ts.tv_sec  = ns / SR_REPLAY_NS;
+    ts.tv_nsec = ns % SR_REPLAY_NS;
+
+    sr_epoch_exit(sr->reader);
+    nanosleep(&ts, 0);
+    sr_epoch_enter(sr->epoch, sr->reader);
+} /* -- sr_replay_wait -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_replay_run(..)
+ * Scope:  Global
+ *
+ * Replay the trace through the packet path, in vectors of up to
+ * SR_VECTOR_SIZE as the read loop would; paced, a vector holds what has
+ * come due.  After each vector timers run and sends are flushed, and
+ * that, with the vector itself, is the time counted as busy.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_replay_run(struct sr_instance* sr, struct sr_replay* rp)
+{
+    struct sr_pkt pkts[SR_VECTOR_SIZE];
+    struct sr_replay_pkt* pkt = 0;
+    unsigned int i = 0, n;
+    uint64_t start, base, now, t0, at = 0;
+
+    /* -- REQUIRES -- */
+    assert(sr);
+    assert(rp);
+
+    base  = rp->npkts ? rp->pkts[0].ts : 0;
+    start = sr_replay_clock();
+
+    while(i < rp->npkts)
+    {
+        now = sr_replay_clock();
+
+        for(n = 0; i < rp->npkts && n < SR_VECTOR_SIZE; ++n, ++i)
+        {
+            pkt = &rp->pkts[i];
+
+            at = pkt->ts > base ? pkt->ts - base : 0;
+            if(rp->paced && at > now - start)
+            { break; }
+
+            if(sr->capture)
+            {
+                sr_capture_packet(sr->capture, pkt->data, pkt->len,
+                                  pkt->ifindex, SR_CAPTURE_IN);
+            }
+
+            sr_count_rx(pkt->data, pkt->len, pkt->ifindex);
+
+            pkts[n].buf     = pkt->data;
+            pkts[n].len     = pkt->len;
+            pkts[n].ifindex = pkt->ifindex;
+        }
+
+        if(n > 0)
+        {
+            t0 = sr_replay_clock();
+            sr_handlepackets(sr, pkts, n);
+            sr_timer_advance(sr->timers, sr_timer_now(), sr);
+            sr_tx_flush(sr->tx);
+            rp->busy += sr_replay_clock() - t0;
+
+            /* -- a quiescent point for sr_epoch.h -- */
+            sr_epoch_exit(sr->reader);
+            sr_epoch_enter(sr->epoch, sr->reader);
+            continue;
+        }
+
+        /* -- paced, and the next packet isn't due yet -- */
+        sr_timer_advance(sr->timers, sr_timer_now(), sr);
+        sr_tx_flush(sr->tx);
+        sr_replay_wait(sr, at - (now - start));
+    }
+
+    rp->elapsed = sr_replay_clock() - start;
+
+    return 0;
+} /* -- sr_replay_run -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_replay_sent(..)
+ * Scope:  Global
+ *
+ * A frame the router sent out of ifindex.  Any thread.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_replay_sent(struct sr_replay* rp, const uint8_t* frame,
+                    unsigned int len, unsigned int ifindex)
+{
+    /* -- REQUIRES -- */
+    assert(rp);
+
+    __atomic_fetch_add(&rp->sent, 1, __ATOMIC_RELAXED);
+
+    if(rp->out)
+    { sr_capture_packet(rp->out, frame, len, ifindex, SR_CAPTURE_OUT); }
+} /* -- sr_replay_sent -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_replay_close(..)
+ * Scope:  Global
+ *
+ * Finish writing the output and let go of the trace.  What was
+ * counted stays, for sr_replay_print_stats.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_replay_close(struct sr_replay* rp)
+{
+    /* -- REQUIRES -- */
+    assert(rp);
+
+    if(rp->out)
+    { sr_capture_close(rp->out); }
+
+    free(rp->image);
+    free(rp->pkts);
+    rp->image = 0;
+    rp->pkts  = 0;
+} /* -- sr_replay_close -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_replay_print_stats(..)
+ * Scope:  Global
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_replay_print_stats(const struct sr_replay* rp, FILE* out)
+{
+    double secs = rp->elapsed / (double)SR_REPLAY_NS;
+
+    /* -- REQUIRES -- */
+    assert(rp);
+    assert(out);
+
+    fprintf(out, "replay: %u packets in %.3f s (%s), %.0f pps, "
+            "%.1f ns/packet busy, %lu sent, %lu skipped, "
+            "%lu by first interface\n",
+            rp->npkts, secs, rp->paced ? "paced" : "full speed",
+            secs > 0 ? rp->npkts / secs : 0.0,
+            rp->npkts ? (double)rp->busy / rp->npkts : 0.0,
+            (unsigned long)__atomic_load_n(&rp->sent, __ATOMIC_RELAXED),
+            (unsigned long)rp->skipped, (unsigned long)rp->untagged);
+
+    if(rp->out)
+    {
+        fprintf(out, "replay output ");
+        sr_capture_print_stats(rp->out, out);
+    }
+} /* -- sr_replay_print_stats -- */
@@ -0,0 +1,89 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_replay.h
+ *
+ * Description:
+ *
+ * Offline replay (sr -i).  Instead of connecting to a VNS server the
+ * router reads its interfaces from a local config file (sr -I) and a
+ * trace, classic pcap or pcapng, whose packets it hands to the packet
+ * path exactly as the read loop would, in vectors.  Frames it sends
+ * still go through the transmit batch, which writes to /dev/null, and
+ * to an output file (sr -o) if there is one.
+ *
+ * The interface config has a line per interface, in order,
+ *
+ *   # name  ip          mask            mac
+ *   eth0    10.0.1.1    255.255.255.0   00:00:00:00:00:01
+ *
+ * and the routing table comes from sr -r as usual.
+ *
+ * Each trace packet arrives on the interface it is tagged with.  Tags
+ * can be given after the file name, "trace@eth0,eth1" putting packets
+ * from trace interface 0 on eth0 and from trace interface 1 on eth1
+ * (a classic pcap only has interface 0).  Untagged trace interfaces
+ * are matched to router interfaces by pcapng if_name, and failing that
+ * each packet goes to the interface its destination MAC belongs to, or
+ * else to the first one.  Packets a pcapng trace marks as outbound are
+ * what the captured router sent, and are skipped.
+ *
+ * The trace is read into memory before the clock starts.  By default it
+ * is replayed as fast as the router takes it; with sr -a, at the pace
+ * it was recorded.  Either way the time spent in the packet path is
+ * reported as packets per second and ns per packet.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_REPLAY_H
+#define SR_REPLAY_H
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif /* _DARWIN_ */
+
+#include <stdio.h>
+
+#define SR_REPLAY_TAGS 64  /* most trace interfaces tagged */
+
+struct sr_instance;
+struct sr_capture;
+
+struct sr_replay_pkt
+{
+    uint64_t       ts;       /* ns, as recorded */
+    uint8_t*       data;     /* in the trace image */
+    uint32_t       len;
+    uint32_t       ifindex;  /* router interface it arrives on */
+};
+
+struct sr_replay
+{
+    uint8_t*              image;  /* the whole trace file */
+    struct sr_replay_pkt* pkts;
+    unsigned int          npkts;
+    unsigned int          maxpkts;
+    int                   paced;  /* at recorded pace (sr -a) */
+    struct sr_capture*    out;    /* frames sent (sr -o), or 0 */
+
+    /* -- statistics -- */
+    uint64_t              skipped;   /* outbound, truncated or not ethernet */
+    uint64_t              untagged;  /* went to the first interface */
+    uint64_t              sent;
+    uint64_t              elapsed;   /* ns, first packet to last */
+    uint64_t              busy;      /* ns in the packet path */
+};
+
+int sr_replay_connect(struct sr_instance* sr);
+int sr_replay_config(struct sr_instance* sr, const char* fname);
+struct sr_replay* sr_replay_open(struct sr_instance* sr, const char* spec,
+                                 int paced, const char* out, int format);
+int sr_replay_run(struct sr_instance* sr, struct sr_replay* rp);
+void sr_replay_sent(struct sr_replay* rp, const uint8_t* frame,
+                    unsigned int len, unsigned int ifindex);
+void sr_replay_close(struct sr_replay* rp);
+void sr_replay_print_stats(const struct sr_replay* rp, FILE* out);
+
+#endif /* -- SR_REPLAY_H -- */
@@ -0,0 +1,134 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_ring.h
+ *
+ * Description:
+ *
+ * Single producer, single consumer ring of packet descriptors, used to
+ * pass packets between the reader and the forwarding workers (see
+ * sr_worker.h).  No locks: each side owns one index and publishes it with
+ * a release store, and keeps a cached copy of the other side's index so
+ * it only touches the other side's cache line when the ring looks full
+ * (or empty).  The two indices live on separate cache lines.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_RING_H
+#define SR_RING_H
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif /* _DARWIN_ */
+
+#include <stdlib.h>
+#include <assert.h>
+
+#define SR_CACHE_LINE 64
+
+struct sr_rxbuf;
+
+/* ----------------------------------------------------------------------------
+ * struct sr_desc
+ *
+ * A frame in flight to a worker and back.  'rxbuf' holds a reference to
+ * the receive buffer the frame lives in; only the reader drops it.
+ *
+ * -------------------------------------------------------------------------- */
+
+struct sr_desc
+{
+    uint8_t*         frame;
+    struct sr_rxbuf* rxbuf;
+    unsigned int     len;
+    unsigned int     ifindex;
+    unsigned int     verdict;  /* set by the worker, see sr_worker.h */
+};
+
+struct sr_ring
+{
+    /* -- producer's line -- */
+    uint32_t        tail;
+    uint32_t        head_cache;
+    uint8_t         pad0[SR_CACHE_LINE - 2 * sizeof(uint32_t)];
+
+    /* -- consumer's line -- */
+    uint32_t        head;
+    uint32_t        tail_cache;
+    uint8_t         pad1[SR_CACHE_LINE - 2 * sizeof(uint32_t)];
+
+    uint32_t        mask;      /* number of slots - 1 */
+    struct sr_desc* slots;
+};
+
+/*---------------------------------------------------------------------
+ * Method: sr_ring_init(..)
+ *
+ * 'size' must be a power of two.
+ *
+ *---------------------------------------------------------------------*/
+
+static __inline__ void sr_ring_init(struct sr_ring* ring, uint32_t size)
+{
+    assert(ring);
+    assert(size && (size & (size - 1)) == 0);
+
+    ring->tail = ring->head_cache = 0;
+    ring->head = ring->tail_cache = 0;
+    ring->mask  = size - 1;
+    ring->slots = (struct sr_desc*)calloc(size, sizeof(struct sr_desc));
+    assert(ring->slots);
+} /* -- sr_ring_init -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_ring_push(..)
+ *
+ * Producer only.  Returns 0 if the ring is full.
+ *
+ *---------------------------------------------------------------------*/
+
+static __inline__ int sr_ring_push(struct sr_ring* ring,
+                                   const struct sr_desc* desc)
+{
+    uint32_t tail = ring->tail;
+
+    if(tail - ring->head_cache > ring->mask)
+    {
+        ring->head_cache = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+        if(tail - ring->head_cache > ring->mask)
+        { return 0; }
+    }
+
+    ring->slots[tail & ring->mask] = *desc;
+    __atomic_store_n(&ring->tail, tail + 1, __ATOMIC_RELEASE);
+
+    return 1;
+} /* -- sr_ring_push -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_ring_pop(..)
+ *
+ * Consumer only.  Returns 0 if the ring is empty.
+ *
+ *---------------------------------------------------------------------*/
+
+static __inline__ int sr_ring_pop(struct sr_ring* ring, struct sr_desc* desc)
+{
+    uint32_t head = ring->head;
+
+    if(head == ring->tail_cache)
+    {
+        ring->tail_cache = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+        if(head == ring->tail_cache)
+        { return 0; }
+    }
+
+    *desc = ring->slots[head & ring->mask];
+    __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+
+    return 1;
+} /* -- sr_ring_pop -- */
+
+#endif /* -- SR_RING_H -- */
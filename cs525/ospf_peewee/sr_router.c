@@ -32,15 +32,48 @@
 #include "sr_protocol.h"
 #include "pwospf_protocol.h"
 #include "sr_pwospf.h"
+#include "sr_graph.h"
+#include "sr_epoch.h"
+#include "sr_counters.h"
+#include "sr_evlog.h"
+#include "sr_hist.h"
+#include "sr_icmp.h"
 
  /* the ARP cache  */
-Arpcache arpcache[REALLYBIG];
+struct sr_arpcache arpcache;
+
+/* sweeps aged out entries from the ARP cache */
+static struct sr_timer arpcacheAging;
 
 /* the interface that represents "us" */
 struct sr_if US;
 
 /*struct sr_rt *longestPrefixMatch(uint32_t query, struct sr_rt *sr);*/
 
+static void sr_graph_setup(struct sr_instance* sr);
+
+/* count and log why a packet is dropped, and hand it to error-drop */
+static __inline__ void drop_packet(struct sr_instance* sr, struct sr_pkt* p,
+                                   unsigned int why)
+{
+  sr_count_drop(why);
+  sr_log(SR_LOG_DROP, why, p->ifindex, 0, 0);
+  sr_graph_enqueue(sr->graph, sr, SR_NODE_ERROR_DROP, p);
+}
+
+/**************************************************
+ * ARP CACHE (AND ADJACENCY) AGING, RUN OFF sr->timers
+ **************************************************/
+static void ageArpcache(void *ctx, void *arg)
+{
+  struct sr_instance *sr = (struct sr_instance*) ctx;
+  time_t now = time(NULL);
+
+  sr_arpcache_expire((struct sr_arpcache*) arg, now);
+  sr_adj_expire(sr->adj, sr->fib, now);
+  sr_timer_arm(sr->timers, &arpcacheAging, SR_ARPCACHE_SWEEP);
+}
+
 /**************************************************
  * ROUTER INITIALIZER
  **************************************************/
@@ -48,19 +81,33 @@ void sr_init(struct sr_instance* sr)
 {
     /* REQUIRES */
     assert(sr);
-    int i;
-    for (i = 0; i < REALLYBIG; ++i)
-      arpcache[i].timeInSeconds = 0;
+    sr_counters_register("reader");
+    sr->timers = (struct sr_timer_wheel*)malloc(sizeof(struct sr_timer_wheel));
+    sr_timer_wheel_init(sr->timers, sr_timer_now());
+    sr_arpcache_init(&arpcache);
+    sr_timer_init(&arpcacheAging, ageArpcache, &arpcache);
+    sr_timer_arm(sr->timers, &arpcacheAging, SR_ARPCACHE_SWEEP);
+    sr->epoch = sr_epoch_create();
+    assert(sr->epoch);
+    sr->reader = sr_epoch_register(sr->epoch);
+    sr_epoch_enter(sr->epoch, sr->reader);
+    sr->adj = (struct sr_adjtab*)malloc(sizeof(struct sr_adjtab));
+    sr_adj_init(sr->adj, sr->epoch);
+    sr->arpq = (struct sr_arpq*)malloc(sizeof(struct sr_arpq));
+    sr_arpq_init(sr->arpq, sr->timers);
+    /* unless sr -E set limits of its own */
+    if(sr->icmp == NULL)
+      sr->icmp = sr_icmp_create(NULL);
+    assert(sr->icmp);
+    sr_graph_setup(sr);
     
     setChecking(CLEAR);
 
     pwospf_init(sr); 
 } /* -- sr_init -- */
 
-
-
 /*---------------------------------------------------------------------
- * Method: sr_handlepacket(uint8_t* p,char* interface)
+ * Method: sr_handlepacket(uint8_t* p,unsigned int ifindex)
  * Scope:  Global
  *
  * This method is called each time the router receives a packet on the
@@ -68,8 +115,8 @@ void sr_init(struct sr_instance* sr)
  * interface are passed in as parameters. The packet is complete with
  * ethernet headers.
  *
- * Note: Both the packet buffer and the character's memory are handled
- * by sr_vns_comm.c that means do NOT delete either.  Make a copy of the
+ * Note: The packet buffer is handled by sr_vns_comm.c that means do NOT
+ * delete it.  Make a copy of the
  * packet instead if you intend to keep it around beyond the scope of
  * the method call.
  *
@@ -77,662 +124,759 @@ void sr_init(struct sr_instance* sr)
 void sr_handlepacket(struct sr_instance* sr, 
         uint8_t * packet/* lent */,
         unsigned int len,
-        char* interface/* lent */)
+        unsigned int ifindex)
+{
+    struct sr_pkt pkt;
+
+    pkt.buf     = packet;
+    pkt.len     = len;
+    pkt.ifindex = ifindex;
+
+    sr_handlepackets(sr, &pkt, 1);
+} /* -- sr_handlepacket -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_handlepackets(..)
+ * Scope:  Global
+ *
+ * Run a vector of received packets through the processing graph.  The
+ * buffers are lent, as for sr_handlepacket.
+ *
+ *---------------------------------------------------------------------*/
+void sr_handlepackets(struct sr_instance* sr,
+        struct sr_pkt* pkts /* lent */,
+        unsigned int n)
 {
-   /* REQUIRES */
+    unsigned int i;
+    uint64_t t0 = sr_hist_clock();
+
+    /* REQUIRES */
     assert(sr);
-    assert(packet);
-    assert(interface);
+    assert(pkts);
     checkRT(sr);
 
-    /* function-wide variables */
-    struct sr_rt *routingTable = sr->routing_table; 
-    struct sr_ethernet_hdr *etherpacket = (struct sr_ethernet_hdr*) packet;
     US = *(sr->if_list);
 
+    for (i = 0; i < n; ++i) {
+      pkts[i].t0 = t0;
+      sr_graph_enqueue(sr->graph, sr, SR_NODE_ETHERNET_INPUT, &pkts[i]);
+    }
+
+    sr_graph_run(sr->graph, sr);
+
+    /* CHECK ARP QUEUE IF NOT ALREADY */
+    if(getChecking() == CLEAR){
+      checkQueue(sr, sr->routing_table, &arpcache, &US);
+    }
+
+    sr_hist_since(SR_HIST_HANDLEPACKETS, t0);
+} /* -- sr_handlepackets -- */
+
+/*---------------------------------------------------------------------
+ * Method: ethernet_input(..)
+ * Scope:  Local
+ *
+ * Sort frames by ethertype.
+ *
+ *---------------------------------------------------------------------*/
+static void ethernet_input(struct sr_instance* sr, struct sr_pkt** pkts,
+                           unsigned int n)
+{
+  unsigned int i;
+
+  for (i = 0; i < n; ++i) {
+    struct sr_pkt *p = pkts[i];
+    struct sr_ethernet_hdr *etherpacket = (struct sr_ethernet_hdr*) p->buf;
+
+    if (i + 1 < n)
+      sr_pkt_prefetch(pkts[i + 1]);
+
     /* grossly malformed packet */
-    if (len < sizeof(struct sr_ethernet_hdr))
-      return;
+    if (p->len < sizeof(struct sr_ethernet_hdr)) {
+      drop_packet(sr, p, SR_DROP_ETH_RUNT);
+      continue;
+    }
 
     /* check for odd-length packets */
-    if(len % 2 != 0){
-      fprintf(stderr, "Got and odd length packet.\n");
+    if(p->len % 2 != 0){
+      sr_count(SR_EV_ODD_LENGTH);
     }
 
-    /**************************/
-    /*    GOT AN IP PACKET    */
-    /**************************/
-    if (htons(ETHERTYPE_IP) == etherpacket->ether_type) {
-      
-      if (len < sizeof(struct sr_ethernet_hdr) + sizeof(struct ip))
-	return;
-  
-
-      struct ip *iphdr = (struct ip*) (packet + sizeof(struct sr_ethernet_hdr));
-      uint8_t clone[ sizeof(struct ip) + 8];
-      uint32_t diff = len - sizeof(struct ip) - sizeof(struct sr_ethernet_hdr);
-      /* make a deep copy of the incoming IP packet */
-      if (diff < 8) {
-	memcpy(clone, iphdr, sizeof(struct ip) + diff);
-        memset( &clone[ sizeof(struct ip) + diff], 0, 8-diff); 
-      } else 
-        memcpy(clone, iphdr, sizeof(struct ip) + 8); 
-      
-      uint16_t oldcheck = iphdr->ip_sum;
-      iphdr->ip_sum = 0; /* SO AS TO CALCULATE CORRECT CHECKSUM */
-      uint16_t ipchecksum = calculateChecksum((void*)iphdr, sizeof(struct ip));
-      iphdr->ip_sum = ipchecksum;
-      
-      /******************/
-      /* CHECK CHECKSUM */
-      /******************/
-      if (ipchecksum != oldcheck && iphdr->ip_p != TCP_PROTOCOL && iphdr->ip_p != UDP_PROTOCOL) {
-	printf("Dropping IP packet. Checksum mismatch: %u %u\n", 
-	       ipchecksum, oldcheck);
-	return; /* drop packet. bad checksum */
+    if (htons(ETHERTYPE_IP) == etherpacket->ether_type)
+      sr_graph_enqueue(sr->graph, sr, SR_NODE_IP4_INPUT, p);
+    else if (htons(ETHERTYPE_ARP) == etherpacket->ether_type)
+      sr_graph_enqueue(sr->graph, sr, SR_NODE_ARP_INPUT, p);
+    /********************************************/
+    /*  GOT A NON-IP, NON-ARP PACKET (UDP, TCP?)*/
+    /*  WE DROP THIS PACKET                     */
+    /********************************************/
+    else {
+      drop_packet(sr, p, SR_DROP_ETH_TYPE);
+    }
+  }
+} /* -- ethernet_input -- */
+
+/*---------------------------------------------------------------------
+ * Method: arp_input(..)
+ * Scope:  Local
+ *
+ * Learn from ARP requests and replies, answer requests for our own
+ * addresses and pass the rest on to their target.
+ *
+ *---------------------------------------------------------------------*/
+static void arp_input(struct sr_instance* sr, struct sr_pkt** pkts,
+                      unsigned int n)
+{
+  unsigned int i;
+
+  for (i = 0; i < n; ++i) {
+    struct sr_pkt *p = pkts[i];
+    struct sr_ethernet_hdr *etherpacket = (struct sr_ethernet_hdr*) p->buf;
+    struct sr_arphdr *arpheader = (struct sr_arphdr*) (p->buf + (sizeof(struct sr_ethernet_hdr)));
+
+    if (i + 1 < n)
+      sr_pkt_prefetch(pkts[i + 1]);
+
+    if (p->len < sizeof(struct sr_ethernet_hdr) + sizeof(struct sr_arphdr)) {
+      drop_packet(sr, p, SR_DROP_ARP_RUNT);
+      continue;
+    }
+
+    /********************************************/
+    /*  GOT AN ETHERNET/ARP ARP REQUEST PACKET  */
+    /********************************************/
+    if (htons(ARP_REQUEST) == arpheader->ar_op) {
+
+      addToArpcache(arpheader->ar_sip, arpheader->ar_sha, &arpcache, sr, p->ifindex);
+
+      /* see if arp target is one of us (interfaces) */
+      struct sr_if *walker = oneOfUs(sr, arpheader->ar_tip);
+
+      /* ARP REQUEST was not for us */
+      if (walker == NULL) {
+        struct sr_arpentry *cHit = checkArpcache(arpheader->ar_tip, &arpcache, sr);
+
+        /*  NOT IN CACHE, ADD TO ARP QUEUE */
+        if(cHit == NULL){
+          add2queue(p->buf, p->len, arpheader->ar_tip, p->ifindex, sr);
+        }
+        /* CACHE HIT, FORWARD TO TARGET IP */
+        else{
+          memcpy(etherpacket->ether_dhost, cHit->mac, ETHER_ADDR_LEN);
+          /*memcpy(etherpacket->ether_shost, walker->addr, ETHER_ADDR_LEN);*/
+          sr_send_packet(sr, p->buf, p->len, p->ifindex);
+        }
+      }
+      /* ARP REQUEST was for us, send ARP_REPLY */
+      else {
+        /*printf("\t\t GOT AN ARP REQUEST! SENDING A RESPONSE!\n");*/
+        arpheader->ar_op = htons(ARP_REPLY);
+        memcpy( arpheader->ar_tha, arpheader->ar_sha, ETHER_ADDR_LEN);
+        memcpy( arpheader->ar_sha, walker->addr, ETHER_ADDR_LEN);
+        arpheader->ar_tip = arpheader->ar_sip;
+        arpheader->ar_sip = walker->ip;
+
+        memcpy(etherpacket->ether_dhost, etherpacket->ether_shost, ETHER_ADDR_LEN);
+        memcpy(etherpacket->ether_shost, walker->addr, ETHER_ADDR_LEN);
+        sr_send_packet(sr, p->buf, p->len, walker->ifindex);
+        sr_count(SR_EV_ARP_REPLY);
+      }
+      sr_hist_since(SR_HIST_ARP, p->t0);
+    }
+    /********************************************/
+    /*  GOT AN ETHERNET/ARP ARP REPLY PACKET    */
+    /********************************************/
+    else if (htons(ARP_REPLY) == arpheader->ar_op) {
+      /* GOT AN ARP REPLY; ADD TO ARP CACHE */
+      addToArpcache(arpheader->ar_sip, arpheader->ar_sha, &arpcache, sr, p->ifindex);
+      sr_hist_since(SR_HIST_ARP, p->t0);
+    }
+    /********************************************/
+    /*  GOT AN UNDEFINED ETHERNET/ARP PACKET    */
+    /********************************************/
+    else {
+      drop_packet(sr, p, SR_DROP_ARP_OP);
+    }
+  }
+} /* -- arp_input -- */
+
+/*---------------------------------------------------------------------
+ * Method: ip4_input(..)
+ * Scope:  Local
+ *
+ * Validate IP packets, age the ones passing through and sort them into
+ * local delivery, PWOSPF and forwarding.
+ *
+ *---------------------------------------------------------------------*/
+static void ip4_input(struct sr_instance* sr, struct sr_pkt** pkts,
+                      unsigned int n)
+{
+  unsigned int i;
+
+  for (i = 0; i < n; ++i) {
+    struct sr_pkt *p = pkts[i];
+    struct ip *iphdr = (struct ip*) (p->buf + sizeof(struct sr_ethernet_hdr));
+
+    if (i + 1 < n)
+      sr_pkt_prefetch(pkts[i + 1]);
+
+    if (p->len < sizeof(struct sr_ethernet_hdr) + sizeof(struct ip)) {
+      drop_packet(sr, p, SR_DROP_IP_RUNT);
+      continue;
+    }
+
+    p->ip = iphdr;
+
+    uint32_t diff = p->len - sizeof(struct ip) - sizeof(struct sr_ethernet_hdr);
+    /* make a deep copy of the incoming IP packet */
+    if (diff < 8) {
+      memcpy(p->orig, iphdr, sizeof(struct ip) + diff);
+      memset( &p->orig[ sizeof(struct ip) + diff], 0, 8-diff);
+    } else
+      memcpy(p->orig, iphdr, sizeof(struct ip) + 8);
+
+    uint16_t oldcheck = iphdr->ip_sum;
+    iphdr->ip_sum = 0; /* SO AS TO CALCULATE CORRECT CHECKSUM */
+    uint16_t ipchecksum = calculateChecksum((void*)iphdr, sizeof(struct ip));
+    iphdr->ip_sum = ipchecksum;
+
+    /******************/
+    /* CHECK CHECKSUM */
+    /******************/
+    if (ipchecksum != oldcheck && iphdr->ip_p != TCP_PROTOCOL && iphdr->ip_p != UDP_PROTOCOL) {
+      drop_packet(sr, p, SR_DROP_IP_CKSUM);
+      continue; /* drop packet. bad checksum */
+    }
+
+    /********************************/
+    /* FORWARD PACKET IF NOT FOR US */
+    /********************************/
+    p->local = oneOfUs(sr, iphdr->ip_dst.s_addr);
+    if(p->local == NULL){
+
+      /*********************************************/
+      /* PACKET HAS TIMED OUT, GENERATE ICMP ERROR */
+      /*********************************************/
+      if(iphdr->ip_ttl < 2){
+        generateICMP(sr, iphdr->ip_src.s_addr, TIMEOUT_TYPE,
+                     TIMEOUT_CODE, p->buf, &arpcache, p->orig, p->ifindex, 0);
+        drop_packet(sr, p, SR_DROP_IP_TTL);
+        continue;
+      }
+
+      /* DECREMENT TTL on IP packets not for us; the checksum is
+         patched rather than recomputed */
+      sr_ip_set_ttl(iphdr, iphdr->ip_ttl - 1);
+    }
+
+    switch (iphdr->ip_p) {
+
+    case IPPROTO_ICMP:
+      if (p->len < sizeof(struct sr_ethernet_hdr) + sizeof(struct ip) + sizeof(struct icmpPayload)) {
+        drop_packet(sr, p, SR_DROP_ICMP_RUNT);
+        break;
+      }
+      /* fall through */
+    case TCP_PROTOCOL:
+    case UDP_PROTOCOL:
+      sr_graph_enqueue(sr->graph, sr, p->local ? SR_NODE_ICMP_LOCAL
+                                               : SR_NODE_IP4_LOOKUP, p);
+      break;
+
+    case OSPF_TYPE:
+      sr_graph_enqueue(sr->graph, sr, SR_NODE_OSPF_INPUT, p);
+      break;
+
+    /***********************************************/
+    /* IP TYPE WAS UNDEFINED                       */
+    /***********************************************/
+    default:
+      drop_packet(sr, p, SR_DROP_IP_PROTO);
+      break;
+    }
+  }
+} /* -- ip4_input -- */
+
+/*---------------------------------------------------------------------
+ * Method: icmp_local(..)
+ * Scope:  Local
+ *
+ * ICMP, TCP and UDP addressed to one of our interfaces: answer echo
+ * requests and turn away everything else.
+ *
+ *---------------------------------------------------------------------*/
+static void icmp_local(struct sr_instance* sr, struct sr_pkt** pkts,
+                       unsigned int n)
+{
+  unsigned int i;
+
+  for (i = 0; i < n; ++i) {
+    struct sr_pkt *p = pkts[i];
+    struct sr_ethernet_hdr *etherpacket = (struct sr_ethernet_hdr*) p->buf;
+    struct ip *iphdr = p->ip;
+
+    if (i + 1 < n)
+      sr_pkt_prefetch(pkts[i + 1]);
+
+    /********************************/
+    /*   IP PACKET IS ICMP TYPE     */
+    /********************************/
+    if (IPPROTO_ICMP == iphdr->ip_p) {
+      struct icmpPayload *icmp = (struct icmpPayload*) (p->buf + sizeof(struct sr_ethernet_hdr) + sizeof(struct ip));
+
+      /* only echo requests are answered, anything else for us is ignored */
+      if (icmp->type != ECHO_REQUEST) {
+        drop_packet(sr, p, SR_DROP_ICMP_LOCAL);
+        continue;
+      }
+
+      /* do checksumming */
+      uint16_t oldcheck = icmp->checksum;
+      icmp->checksum = 0;
+      uint16_t newcheck = calculateChecksum( (void*) icmp,
+                                             p->len - (sizeof(struct sr_ethernet_hdr) + sizeof(struct ip)));
+
+      if (oldcheck != newcheck) {
+        drop_packet(sr, p, SR_DROP_ICMP_CKSUM);
+        continue;
+      }
+
+      /* only the type changes, no need to sum the payload again */
+      icmp->checksum = oldcheck;
+      icmp->checksum = sr_cksum_set8(icmp->checksum, icmp, &icmp->type, ECHO_REPLY);
+
+      /* ipheader fun; swapping the addresses leaves the sum alone */
+      struct in_addr temp;
+      temp.s_addr = p->local->ip;
+      iphdr->ip_dst = iphdr->ip_src;
+      iphdr->ip_src = temp;
+      sr_ip_set_ttl(iphdr, DEFAULT_TTL);
+
+      /* etherpacket header fun; the reply goes back the way it came */
+      struct sr_if *rxIf = sr_get_interface_by_index(sr, p->ifindex);
+      memcpy( etherpacket->ether_dhost, etherpacket->ether_shost, ETHER_ADDR_LEN);
+      memcpy( etherpacket->ether_shost, rxIf->addr, ETHER_ADDR_LEN);
+
+      sr_send_packet(sr, p->buf, p->len, p->ifindex);
+      sr_count(SR_EV_ICMP_ECHO_REPLY);
+      sr_hist_since(SR_HIST_ICMP_LOCAL, p->t0);
+    }
+    /* TCP message for one of our interfaces, protocol unreachable */
+    else if (iphdr->ip_p == TCP_PROTOCOL) {
+      generateICMP(sr, iphdr->ip_src.s_addr, DEST_UNREACHABLE_TYPE,
+                   PROTOCOL_UNREACHABLE, p->buf, &arpcache, p->orig, p->ifindex, 0);
+      drop_packet(sr, p, SR_DROP_TCP_LOCAL);
+    }
+    /* UDP for us; only traceroute's probes get a port unreachable */
+    else if (iphdr->ip_p == UDP_PROTOCOL) {
+      if (iphdr->ip_ttl <= 2) {
+        generateICMP(sr, iphdr->ip_src.s_addr, DEST_UNREACHABLE_TYPE,
+                     PORT_UNREACHABLE, p->buf, &arpcache, p->orig, p->ifindex, iphdr->ip_dst.s_addr);
       }
+      drop_packet(sr, p, SR_DROP_UDP_LOCAL);
+    }
+  }
+} /* -- icmp_local -- */
+
+/*---------------------------------------------------------------------
+ * Method: ospf_input(..)
+ * Scope:  Local
+ *
+ * PWOSPF hellos and link state updates.
+ *
+ *---------------------------------------------------------------------*/
+static void ospf_input(struct sr_instance* sr, struct sr_pkt** pkts,
+                       unsigned int n)
+{
+  unsigned int i;
+
+  for (i = 0; i < n; ++i) {
+    struct sr_pkt *p = pkts[i];
+    uint8_t *packet = p->buf;
+    unsigned int len = p->len;
+    unsigned int ifindex = p->ifindex;
+    struct sr_ethernet_hdr *etherpacket = (struct sr_ethernet_hdr*) packet;
+    struct ip *iphdr = p->ip;
+
+    if (i + 1 < n)
+      sr_pkt_prefetch(pkts[i + 1]);
+
+    uint32_t innerOffset = sizeof(struct sr_ethernet_hdr) + sizeof(struct ip) + sizeof(struct ospfv2_hdr);
+
+    /* Bad packet length, disregard */
+    if( len < innerOffset ) {
+      drop_packet(sr, p, SR_DROP_OSPF_RUNT);
+      continue;
+    }
+
+    /*parse PWOSPF packet */
+    struct ospfv2_hdr *ospfHdr = (struct ospfv2_hdr*) (packet + sizeof(struct sr_ethernet_hdr) + sizeof(struct ip));
+
+    /* check that version number is 2 */
+    if(ospfHdr->version != 2) {
+      sr_count(SR_EV_OSPF_VERSION);
+      /*	  return; */
+    }
+
+    /* check that authentication types match */
+    /* TODO: are these different checks?  */
+    /* ensure auth type and data fields are zero */
+    uint8_t aid = (uint8_t) ( ( ntohl(sr->if_list->ip) & 0xFF000000) >> 24);
+    if( ospfHdr->autype != 0 || ospfHdr->audata != 0 ){
+      drop_packet(sr, p, SR_DROP_OSPF_AUTH);
+      continue;
+    }
+
+    /* check checksum of PWOSPF's packet contents (excluding 64-bit auth field */
+    uint16_t oldCheckSum = ospfHdr->csum;
+    ospfHdr->csum = 0;
+    uint16_t ospfCheckSum = calculateChecksum(ospfHdr,
+                                              (len - sizeof(struct sr_ethernet_hdr) - sizeof(struct ip)));
+
+    ospfHdr->csum = oldCheckSum;
 
-      /********************************/
-      /* FORWARD PACKET IF NOT FOR US */
-      /********************************/
-      struct sr_if *isUs = oneOfUs(sr->if_list, iphdr->ip_dst.s_addr);
-      if(isUs == NULL){
-
-	/*********************************************/
-	/* PACKET HAS TIMED OUT, GENERATE ICMP ERROR */
-	/*********************************************/
-	if(iphdr->ip_ttl < 2){
-
-	  /*printf("\t\t GENERATING ICMP VIA TTL \n");
-	    printIp(iphdr->ip_dst.s_addr);*/
-
-	  generateICMP(sr, iphdr->ip_src.s_addr, TIMEOUT_TYPE,
-                       TIMEOUT_CODE, packet, arpcache, clone, interface, 0);
-	  
-	  if(getChecking() == CLEAR)
-	    checkQueue(sr, routingTable, arpcache, &US);
-	  
-	  return;
-	}
-
-      
-	/* DECREMENT TTL on IP packets not for us */
-	iphdr->ip_ttl--;
-
-	/* REGENERATE CHECKSUM for ICMP, NOT TCP/UDP*/
-	if(IPPROTO_ICMP == iphdr->ip_p){
-	  iphdr->ip_sum = 0; 
-	  uint16_t ipchecksum2 = calculateChecksum((void*)iphdr, sizeof(struct ip));
-	  iphdr->ip_sum = ipchecksum2;
-	}
-      } 
-      
-      /********************************/
-      /*   IP PACKET IS ICMP TYPE     */
-      /********************************/
-      if (IPPROTO_ICMP == iphdr->ip_p) {
-
-	if (len < sizeof(struct sr_ethernet_hdr) + sizeof(struct ip) + sizeof(struct icmpPayload))
-	  return;
-
-        struct icmpPayload *icmp = (struct icmpPayload*) (packet + sizeof(struct sr_ethernet_hdr) + sizeof(struct ip));
-
-	/***********************************/
-	/* IP/ICMP TYPE IS AN ECHO REQUEST */
-	/***********************************/
-        if (icmp->type == ECHO_REQUEST) {
-
-	  /* ECHO REQUEST is NOT for us */
-	  if (isUs == NULL) {
-
-	    uint32_t index = checkArpcache(iphdr->ip_dst.s_addr, arpcache, sr);
-	    
-	    /* IP not in ARP cache */
-	    if(index == -1){
-	      /*fprintf(stderr, "ICMP ECHO REQUEST WAS NOT IN THE ARPCACHE\n");*/
-	      add2queue(packet, len, iphdr->ip_dst.s_addr, interface, sr);
-	    }
-	    /* IP in ARP cache, forward to that MAC */
-	    else{
-	      struct sr_if *ifTemp = sr_get_interface(sr, arpcache[index].interface);
-	      memcpy(etherpacket->ether_shost, ifTemp->addr, ETHER_ADDR_LEN);
-	      memcpy(etherpacket->ether_dhost, arpcache[index].mac, ETHER_ADDR_LEN);
-
-	      /*printf("\t\t MACS used to forward... shost, dhost");
-	      printMac(etherpacket->ether_shost);
-	      printMac(etherpacket->ether_dhost);
-	      printf("from interface: %s\n", arpcache[index].interface);*/
-
-	      sr_send_packet(sr, packet, len, arpcache[index].interface);
-	    }
-          } 
-	  /* ECHO REQUEST is for us, respond with ECHO_REPLY*/
-	  else {
-	    
-	    /* do checksumming */
-	    oldcheck = icmp->checksum;
-	    icmp->checksum = 0;
-            uint16_t newcheck = calculateChecksum( (void*) icmp, 
-						   len - (sizeof(struct sr_ethernet_hdr) + sizeof(struct ip)));
-            
-	    if (oldcheck != newcheck) {
-	      printf("Icmp checksums disagree: %X %X\n", oldcheck, newcheck);
-	      return;
-            }
-
-            icmp->type = ECHO_REPLY;
-            icmp->checksum = 0;
-	    icmp->checksum = calculateChecksum( (void*) icmp, 
-						len - (sizeof(struct sr_ethernet_hdr) + sizeof(struct ip)));
-
-	    /* ipheader fun */
-   	    struct in_addr temp;
-            temp.s_addr = isUs->ip;
-            iphdr->ip_dst = iphdr->ip_src;
-            iphdr->ip_src = temp;
-	    iphdr->ip_ttl = DEFAULT_TTL; 
-	    iphdr->ip_sum = 0;
-	    iphdr->ip_sum = calculateChecksum( (void*) iphdr, sizeof(struct ip));
-
-	    /*fprintf(stderr, "GOT AN ECHO REQUEST FOR US\n");*/
-
-	    /* etherpacket header fun */
-            memcpy( etherpacket->ether_dhost, etherpacket->ether_shost, ETHER_ADDR_LEN);
-            memcpy( etherpacket->ether_shost, sr->if_list->addr, ETHER_ADDR_LEN);
-	    
-            sr_send_packet(sr, packet, len, sr->if_list->name);
+    if(ospfCheckSum != oldCheckSum){
+      drop_packet(sr, p, SR_DROP_OSPF_CKSUM);
+      continue;
+    }
+
+    /* check that area ID matches our area ID */
+    if ( aid  != ntohl(ospfHdr->aid)) {
+      drop_packet(sr, p, SR_DROP_OSPF_AREA);
+      continue;
+    }
+
+    /***************************************/
+    /*     OSPF packet type was HELLO      */
+    /***************************************/
+    if(ospfHdr->type == OSPF_TYPE_HELLO){
+
+      /*fprintf(stderr, "GOT an ospf HELLO packet!\n");*/
+      sr_count(SR_EV_OSPF_HELLO);
+      struct ospfv2_hello_hdr *hello = (struct ospfv2_hello_hdr*) (packet + sizeof(struct sr_ethernet_hdr) + sizeof(struct ip) + sizeof(struct ospfv2_hdr));
+
+      /* add this information to our ARP cache */
+      addToArpcache(iphdr->ip_src.s_addr, etherpacket->ether_shost, &arpcache, sr, ifindex);
+
+      dynif *ourDif;
+      dynif *prev = NULL;
+
+      pwospf_lock(sr->ospf_subsys);
+      ourDif = sr->ospf_subsys->dif;
+
+      /* check to see if we have an iface for this HELLO packet */
+      while (ourDif != NULL) {
+
+        /* update the neighbor's entry, if found */
+        if(ospfHdr->rid == ourDif->neighborRid.s_addr &&
+           iphdr->ip_src.s_addr == ourDif->neighborIp.s_addr){
+
+          int wasDown = ourDif->helloInt < 2;
+
+          ourDif->helloInt = OSPF_NEIGHBOR_TIMEOUT;
+          /* a neighbor back from the dead is flooded to again */
+          if (wasDown) {
+            sr_log(SR_LOG_OSPF_NBR_UP, ospfHdr->rid, iphdr->ip_src.s_addr,
+                   ifindex, 0);
+            pwospf_publish_nbrs(sr);
           }
-        } 
-	/********************************/
-	/* IP/ICMP TYPE IS AN ECHO REPLY */
-	/********************************/
-	else if (icmp->type == ECHO_REPLY) {
-	  
-	  /* ICMP_REPLY WAS NOT FOR US, FORWARD IT */
-	  if(isUs == NULL){
-	    /*fprintf(stderr, "FORWARDING ECHO REPLY\n");*/
-	    uint32_t index = checkArpcache(iphdr->ip_dst.s_addr, arpcache, sr);
-	    
-	    /* generate arp request for un-indexed IP */
-	    if(index == -1){/* && isApp == 0){*/
-	      add2queue(packet, len, iphdr->ip_dst.s_addr, interface, sr);
-	    } else
-	      forwardPacket(sr, packet, len, iphdr->ip_dst.s_addr, &US, arpcache, index);
-
-	  }
-	  /* ECHO REPLY WAS FOR US */
-	  else{
-	    
-	  }
-	}
-	/**************************************************/
-	/*                                                */
-	/**************************************************/
-	else if(icmp->type == DEST_UNREACHABLE_TYPE){
-	  struct sr_if *isUs = oneOfUs(&US, iphdr->ip_dst.s_addr);
-	
-	  /* TCP message for one of our interfaces, protocol unreachable */
-	  if(isUs == NULL){
-	    /* forward the packet, if not for us */
-	    uint32_t index = checkArpcache(iphdr->ip_dst.s_addr, arpcache, sr);
-	    
-	    /* generate arp request for un-indexed IP */
-	    if(index == -1){/* && isApp == 0){*/
-	      add2queue(packet, len, iphdr->ip_dst.s_addr, interface, sr);
-	    }
-	    /* forward the packet, otherwise */
-	    else{
-	      forwardPacket(sr, packet, len, iphdr->ip_dst.s_addr,
-			    &US, arpcache, index);
-	    }
-	  }
-	}
-	/**************************************/
-	/* IP/ICMP TYPE WAS UNDEFINED, IGNORE */
-	/**************************************/
-	else {
-	  struct sr_if *isUs = oneOfUs(&US, iphdr->ip_dst.s_addr);
-
-	  if (isUs == NULL) {
-	    /*printf("Port unreachable!\n");*/
-	    uint32_t index = checkArpcache(iphdr->ip_dst.s_addr, arpcache, sr);
-
-	    if(index == -1){
-	      add2queue(packet, len, iphdr->ip_dst.s_addr, interface, sr);
-	    }
-	    else{
-	    forwardPacket(sr, packet, len, iphdr->ip_dst.s_addr, &US,
-			  arpcache, index);
-	    }
-	  }
-	  /* generateICMP(sr, iphdr->ip_src.s_addr, DEST_UNREACHABLE_TYPE,
-	     PORT_UNREACHABLE, packet, arpcache, clone, interface);*/
-	  
+          break;
         }
+
+        prev = ourDif;
+        ourDif = ourDif->next;
       }
-      /***********************************************/
-      /* IP TYPE WAS TCP                             */
-      /***********************************************/
-      else if(iphdr->ip_p == TCP_PROTOCOL){
-	/*printf("Got a TCP packet!!!\n");*/
-	struct sr_if *isUs = oneOfUs(&US, iphdr->ip_dst.s_addr);
-	
-	/* TCP message for one of our interfaces, protocol unreachable */
-	if(isUs != NULL){
-	  generateICMP(sr, iphdr->ip_src.s_addr, DEST_UNREACHABLE_TYPE,
-		       PROTOCOL_UNREACHABLE, packet, arpcache, clone, interface, 0);
-	}
-	/* forward the packet, if not for us */
-	else{
-	  uint32_t index = checkArpcache(iphdr->ip_dst.s_addr, arpcache, sr);
-	  
-	  /* generate arp request for un-indexed IP */
-	  if(index == -1){/* && isApp == 0){*/
-	    /*fprintf(stderr, "TCP FORWARD ADDING TO QUEUE");*/
-	    add2queue(packet, len, iphdr->ip_dst.s_addr, interface, sr);
-	  }
-	  /* forward the packet, otherwise */
-	  else{
-	    /*fprintf(stderr, "TCP FORWARD FORWARDING");*/
-	    forwardPacket(sr, packet, len, iphdr->ip_dst.s_addr,
-			  &US, arpcache, index);
-	  }
-	}
+
+      /* entry not found in our dynamic interface, add it */
+      if(ourDif == NULL){
+        dynif *add = (dynif*) malloc(sizeof(dynif));
+
+        struct sr_if *ourIPFound = sr_get_interface_by_index(sr, ifindex);
+        add->ourIp.s_addr = ourIPFound->ip;/*ospfHdr->rid;*/
+        add->mask.s_addr = hello->nmask;
+        add->helloInt = OSPF_NEIGHBOR_TIMEOUT;
+        add->neighborRid.s_addr = ospfHdr->rid;
+        add->neighborIp.s_addr = ospfHdr->rid; /*iphdr->ip_src;*/
+        add->ifindex = ifindex;
+        uint8_t *tempMac = getMacForInterface(sr, ifindex);
+
+        if(tempMac != NULL){
+          memcpy(add->srcMac, tempMac, ETHER_ADDR_LEN);
+          memcpy(add->dstMac, etherpacket->ether_shost, ETHER_ADDR_LEN);
+          add->next = NULL;
+
+          /* initialize the list */
+          if (prev == NULL)
+            sr->ospf_subsys->dif = add;
+          else /* or add to the list */
+            prev->next = add;
+          sr_log(SR_LOG_OSPF_NBR_UP, ospfHdr->rid, iphdr->ip_src.s_addr,
+                 ifindex, 0);
+          pwospf_publish_nbrs(sr);
+        }
+        else{
+          sr_log(SR_LOG_OSPF_NBR_NO_IF, ospfHdr->rid, ifindex, 0, 0);
+          free(add);
+        }
       }
-      /***********************************************/
-      /* IP TYPE WAS UDP                             */
-      /***********************************************/
-      else if(iphdr->ip_p == UDP_PROTOCOL) {
-	/*printf("Got a UDP packet!!!\n");*/
-	struct sr_if *isUs = oneOfUs(sr->if_list, iphdr->ip_dst.s_addr);
-	
-	/* TCP message for one of our interfaces, protocol unreachable */
-	if(isUs != NULL){
-	  /*
-	    if (iphdr->ip_ttl < 2){
-	    generateICMP(sr, iphdr->ip_src.s_addr, TIMEOUT_TYPE, 
-			 TIMEOUT_CODE, packet, arpcache, clone, interface); 
-	  }
-	  
-	  else{
-	    generateICMP(sr, iphdr->ip_src.s_addr, DEST_UNREACHABLE_TYPE,
-			 PORT_UNREACHABLE, packet, arpcache, clone, interface); 
-			 }*/
-
-	  if (iphdr->ip_ttl <= 2) {
-
-	    generateICMP(sr, iphdr->ip_src.s_addr, DEST_UNREACHABLE_TYPE,
-			 PORT_UNREACHABLE, packet, arpcache, clone, interface, iphdr->ip_dst.s_addr); 
-	  }
-
-	}
-	/* forward the packet, if not for us */
-	else{
-	  uint32_t index = checkArpcache(iphdr->ip_dst.s_addr, arpcache, sr);
-	  
-	  /* generate arp request for un-indexed IP */
-	  if(index == -1){/* && isApp == 0){*/
-	    /*fprintf(stderr, "UDP FORWARD ADDING TO QUEUE");*/
-	    add2queue(packet, len, iphdr->ip_dst.s_addr, interface, sr);
-	  }
-	  /* forward the packet, otherwise */
-	  else{
-	    /*	    struct sr_if *ifTemp = sr_get_interface(sr, arpcache[index].interface);
-
-	    memcpy(etherpacket->shost, ifTemp->addr, ETHER_ADDR_LEN);
-	    memcpy(etherpacket->dhost, arpcache[index].mac, ETHER_ADDR_LEN);
-	    
-	    fprintf(stderr, "UDP FORWARD FORWARDING");
-	    sr_send_packet(sr, packet, len, arpcache[index].interface);*/
-	    forwardPacket(sr, packet, len, iphdr->ip_dst.s_addr,
-			  &US, arpcache, index);
-	  }
-	}
+      pwospf_unlock(sr->ospf_subsys);
+      sr_hist_since(SR_HIST_OSPF_HELLO, p->t0);
+    }
+    /***************************************/
+    /*     OSPF packet type was LSU        */
+    /***************************************/
+    else if(ospfHdr->type == OSPF_TYPE_LSU){
+      /*fprintf(stderr, "GOT an ospf LSU packet!\n");*/
+      sr_count(SR_EV_OSPF_LSU);
+
+      if (len < sizeof(struct sr_ethernet_hdr) + sizeof(struct ip) + sizeof(struct ospfv2_hdr)
+          + sizeof(struct ospfv2_lsu) + sizeof(struct ospfv2_lsu_hdr)) {
+        drop_packet(sr, p, SR_DROP_OSPF_RUNT);
+        continue;
       }
-      /***********************************************/
-      /* OSPF IP TYPE                                */
-      /***********************************************/
-      else if(iphdr->ip_p == OSPF_TYPE) {
-
-
-	uint32_t innerOffset = sizeof(struct sr_ethernet_hdr) + sizeof(struct ip) + sizeof(struct ospfv2_hdr);
-
-	/* Bad packet length, disregard */
-	if( len < innerOffset ) {
-	  fprintf(stderr, "Dropping packet: len is too small. %d vs %d\n", len, innerOffset);
-	  return;
-	}
-
-	/*parse PWOSPF packet */
-	struct ospfv2_hdr *ospfHdr = (struct ospfv2_hdr*) (packet + sizeof(struct sr_ethernet_hdr) + sizeof(struct ip));
-	
-	/* check that version number is 2 */
-	if(ospfHdr->version != 2) {
-	  fprintf(stderr, "Dropping packet: ospf version is: %d\n", ospfHdr->version);
-	  /*	  return; */
-	}
-
-	/* check that authentication types match */
-	/* TODO: are these different checks?  */
-	/* ensure auth type and data fields are zero */
-	uint8_t aid = (uint8_t) ( ( ntohl(sr->if_list->ip) & 0xFF000000) >> 24);
-	if( ospfHdr->autype != 0 || ospfHdr->audata != 0 ){
-	  fprintf(stderr, "Dropping packet; bad AUTH values\n");
-	  return;
-	}
-
-	/* check checksum of PWOSPF's packet contents (excluding 64-bit auth field */
-	uint16_t oldCheckSum = ospfHdr->csum;
-	ospfHdr->csum = 0;
-	uint16_t ospfCheckSum = calculateChecksum(ospfHdr, 
-						  (len - sizeof(struct sr_ethernet_hdr) - sizeof(struct ip)));
-
-	if(ospfCheckSum != oldCheckSum){
-	  fprintf(stderr, "OSPF checksum mismatch.  Aborting. %d vs %d\n",
-		  oldCheckSum, ospfCheckSum);
-	  return;
-	}
-	
-
-	/* check that area ID matches our area ID */
-	if ( aid  != ntohl(ospfHdr->aid)) {
-	  fprintf(stderr, "Dropping packet; bad AID\n%u vs %u\n", aid, ntohl(ospfHdr->aid));
-	  return;
-	}
-
-	/***************************************/
-	/*     OSPF packet type was HELLO      */
-	/***************************************/
-	if(ospfHdr->type == OSPF_TYPE_HELLO){
-
-	  /*fprintf(stderr, "GOT an ospf HELLO packet!\n");*/
-	  struct ospfv2_hello_hdr *hello = (struct ospfv2_hello_hdr*) (packet + sizeof(struct sr_ethernet_hdr) + sizeof(struct ip) + sizeof(struct ospfv2_hdr));
-	  
-	  /* add this information to our ARP cache */
-	  addToArpcache(iphdr->ip_src.s_addr, etherpacket->ether_shost, arpcache, sr, interface);
-	  
-	  dynif *ourDif = sr->ospf_subsys->dif;
-	  dynif *prev = NULL;
-	  
-	  pwospf_lock(sr->ospf_subsys);
-
-	  /* check to see if we have an iface for this HELLO packet */
-	  while (ourDif != NULL) {
-
-	    /* update the neighbor's entry, if found */
-	    if(ospfHdr->rid == ourDif->neighborRid.s_addr &&
-	       iphdr->ip_src.s_addr == ourDif->neighborIp.s_addr){
-	      
-	      ourDif->helloInt = OSPF_NEIGHBOR_TIMEOUT;
-	      break;
-	    }
-
-	    prev = ourDif;
-	    ourDif = ourDif->next;
-	  }
-	  
-	  /* entry not found in our dynamic interface, add it */
-	  if(ourDif == NULL){
-	    dynif *add = (dynif*) malloc(sizeof(dynif));
-	    
-	    struct sr_if *ourIPFound = sr_get_interface(sr, interface);
-	    add->ourIp.s_addr = ourIPFound->ip;/*ospfHdr->rid;*/
-	    add->mask.s_addr = hello->nmask;
-	    add->helloInt = OSPF_NEIGHBOR_TIMEOUT;
-	    add->neighborRid.s_addr = ospfHdr->rid;
-	    add->neighborIp.s_addr = ospfHdr->rid; /*iphdr->ip_src;*/
-	    strcpy(add->interface, interface);
-	    uint8_t *tempMac = getMacForInterface(sr, interface);
-	    
-	    if(tempMac != NULL){
-	      memcpy(add->srcMac, tempMac, ETHER_ADDR_LEN);
-	      memcpy(add->dstMac, etherpacket->ether_shost, ETHER_ADDR_LEN);
-	      add->next = NULL;
-
-	      /* initialize the list */
-	      if (prev == NULL)
-		sr->ospf_subsys->dif = add;
-	      else /* or add to the list */
-		prev->next = add;	    
-	    }
-	    else{
-	      fprintf(stderr, "No matching interface found for dynif.\n");
-	      free(add);
-	    }
-	  }
-	  pwospf_unlock(sr->ospf_subsys);
-	}
-	/***************************************/
-	/*     OSPF packet type was LSU        */
-	/***************************************/
-	else if(ospfHdr->type == OSPF_TYPE_LSU){
-	  /*fprintf(stderr, "GOT an ospf LSU packet!\n");*/
-
-	  if (len < sizeof(struct sr_ethernet_hdr) + sizeof(struct ip) + sizeof(struct ospfv2_hdr) 
-	      + sizeof(struct ospfv2_lsu) + sizeof(struct ospfv2_lsu_hdr))
-	    return;
-	  struct ospfv2_lsu_hdr *lsuHdr = (struct ospfv2_lsu_hdr*)(packet + sizeof(struct sr_ethernet_hdr) 
-+ sizeof(struct ip) + sizeof(struct ospfv2_hdr));
-	  struct ospfv2_lsu *lsuPacket = (struct ospfv2_lsu*)(packet + sizeof(struct sr_ethernet_hdr) + sizeof(struct ip) + sizeof(struct ospfv2_hdr) + sizeof(struct ospfv2_lsu_hdr));
-
-	  
-	  uint8_t advertise = 0;
-	  uint16_t sequenceNum = ntohs(lsuHdr->seq);
-	  uint32_t numAdvertisements = ntohl(lsuHdr->num_adv);
-	  uint32_t advertisementOffset = sizeof(struct sr_ethernet_hdr) + sizeof(struct ip) + sizeof(struct ospfv2_hdr) + sizeof(struct ospfv2_lsu_hdr);
-	  
-	  /* the sending address was us... that'd be bad */
-	  if ( NULL != oneOfUs(sr->if_list, iphdr->ip_src.s_addr )) {
-	    fprintf(stderr, "Dropping packet. Sent from us?!\n");
-	    return;
-	  }
-
-	  pwospf_lock(sr->ospf_subsys);
-	  int j;
-
-	  for (j = 0; j < numAdvertisements; ++j, advertisementOffset += sizeof(struct ospfv2_lsu)) {
-	    
-	    lsuPacket = (struct ospfv2_lsu*) (packet + advertisementOffset);
-	    /*fprintf(stderr, "Does this make sense?: Length is: %lu vs size of LSU: %lu\n",
-		    len - (sizeof(struct sr_ethernet_hdr) + sizeof(struct ip) + sizeof(struct ospfv2_hdr) + sizeof(struct ospfv2_lsu_hdr)) ,
-		    sizeof(struct ospfv2_lsu));
-		    fprintf(stderr, "Sequence number is: %u\n", sequenceNum); */
-	    dynrt *prev = NULL, *drt = sr->ospf_subsys->drt;
-
-	    while (drt != NULL) {
-	    /* the message is redundant iff the originator of the message is the 
-	       same, and if it arrived via the same interface */
-	      /*fprintf(stderr, "!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!\n");
-	      fprintf(stderr, "Comparing drt's dest vs.  lsu's dest \n");
-	      printIp(drt->dest.s_addr);
-	      printIp(lsuPacket->subnet);
-	      fprintf(stderr, "Comparing drt's mask vs.  lsu's mask \n");
-	      printIp(drt->mask.s_addr);
-	      printIp(lsuPacket->mask);
-	      fprintf(stderr, "!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!\n");*/
-	      if ((drt->dest.s_addr == lsuPacket->subnet)
-		  && (drt->mask.s_addr == lsuPacket->mask) 
-		  && (strcmp(drt->interface, interface) == 0) ){
-	
-		/*fprintf(stderr,"FOUND A DRT MATCH\n");*/
-		break;
-	      }
-	      prev = drt;
-	      drt = drt->next;
-	    }
-
-	    if (drt == NULL) { /* create a new packet */
-
-	      dynrt *add = (dynrt*) malloc(sizeof(dynrt));
-	      
-	      add->dest.s_addr = lsuPacket->subnet;/*iphdr->ip_src; */
-	      /*struct sr_if *ifaceLookup = sr_get_interface(sr, interface);*/
-	      add->gw.s_addr = getNextHopsIp(sr, interface);
-
-	      add->mask.s_addr = lsuPacket->mask;
-	      strcpy(add->interface, interface);
-	      /* TODO: CHECK TO SEE IF THIS IS YOUR NEIGHBOR */
-	      add->ttl = OSPF_TOPO_ENTRY_TIMEOUT; 
-	      add->next = NULL;
-	      add->lastSeqNumber = ntohs(lsuHdr->seq); 
-
-	      add->rid.s_addr = lsuPacket->rid;
-	      add->numHops = DEFAULT_TTL - lsuHdr->ttl ;
-	      advertise = 1;
-
-	      if (sr->ospf_subsys->drt == NULL)
-		sr->ospf_subsys->drt = add;
-	      else{
-		prev->next = add;
-	      }
-
-	    } 
-	    /* update the info for this packet */
-	    else if (drt->lastSeqNumber < sequenceNum){
-	      
-	      drt->dest.s_addr = lsuPacket->subnet;/*iphdr->ip_src;*/
-	      drt->gw.s_addr = getNextHopsIp(sr, interface);
-	      drt->mask.s_addr = lsuPacket->mask;
-	      strcpy(drt->interface, interface);
-	      drt->lastSeqNumber = sequenceNum;
-	      drt->ttl = OSPF_TOPO_ENTRY_TIMEOUT;  
-	      drt->rid.s_addr = lsuPacket->rid;
-	      /* the distance between this router and the router 
-		 that originated this message */
-	      drt->numHops = DEFAULT_TTL - lsuHdr->ttl ;
-	      advertise = 1;
-	      
-	    }
-	    else{
-	      printf("Ignoring LSU packet.\n");
-	    }
-	  }
-
-	  pwospf_unlock(sr->ospf_subsys);	  
-
-	  /* forward LSU updates, if database has changed */
-	  if(advertise && lsuHdr->ttl > 1){
-	    dynif *walker = sr->ospf_subsys->dif;
-
-	    /* decrement the ttl, and recalc the checksums */
-	    --(lsuHdr->ttl);
-	    
-	    while(walker != NULL){
-	      
-	      /* don't forward to originating interface */
-	      if(strcmp(walker->interface, interface) == 0) {
-		walker = walker->next;
-		continue;
-	      }
-	      /* forward the packet if the ttl is valid and it exists in the dynrt */
-	      if(walker->helloInt > 1){
-		memcpy(etherpacket->ether_shost, walker->srcMac, ETHER_ADDR_LEN);
-		memcpy(etherpacket->ether_dhost, walker->dstMac, ETHER_ADDR_LEN);
-		iphdr->ip_dst = walker->neighborIp; 
-		/* lsuPacket->subnet = walker->ip; */
-		lsuPacket->mask = walker->mask.s_addr;
-
-		iphdr->ip_sum = 0;
-		iphdr->ip_sum = calculateChecksum(iphdr, sizeof(struct ip));
-		
-		ospfHdr->csum = 0;
-		uint16_t ospfCheckSum = calculateChecksum(ospfHdr, 
-							  (len - sizeof(struct sr_ethernet_hdr) - sizeof(struct ip)));
-		ospfHdr->csum = ospfCheckSum;
-
-		sr_send_packet(sr, packet, len, walker->interface);
-	      }
-
-	      walker = walker->next;
-	    }
-	  }
-	}
-	/***************************************/
-	/*     OSPF packet type is undefined   */
-	/***************************************/
-	else{
-	  fprintf(stderr, "Got and undefined OSPF packet type.\n");
-	  return;
-	}
+      uint64_t lsuStart = sr_hist_clock();
+      struct ospfv2_lsu_hdr *lsuHdr = (struct ospfv2_lsu_hdr*)(packet + sizeof(struct sr_ethernet_hdr)
+                                                               + sizeof(struct ip) + sizeof(struct ospfv2_hdr));
+      struct ospfv2_lsu *lsuPacket = (struct ospfv2_lsu*)(packet + sizeof(struct sr_ethernet_hdr) + sizeof(struct ip) + sizeof(struct ospfv2_hdr) + sizeof(struct ospfv2_lsu_hdr));
+
+
+      uint8_t advertise = 0, changed = 0;
+      uint16_t sequenceNum = ntohs(lsuHdr->seq);
+      uint32_t numAdvertisements = ntohl(lsuHdr->num_adv);
+      uint32_t advertisementOffset = sizeof(struct sr_ethernet_hdr) + sizeof(struct ip) + sizeof(struct ospfv2_hdr) + sizeof(struct ospfv2_lsu_hdr);
+
+      /* claims more advertisements than it carries, don't read past the end */
+      if (numAdvertisements > (len - advertisementOffset) / sizeof(struct ospfv2_lsu)) {
+        drop_packet(sr, p, SR_DROP_OSPF_RUNT);
+        continue;
       }
-      /***********************************************/
-      /* IP TYPE WAS UNDEFINED                       */
-      /***********************************************/
-      else{
+
+      /* the sending address was us... that'd be bad */
+      if ( NULL != oneOfUs(sr, iphdr->ip_src.s_addr )) {
+        drop_packet(sr, p, SR_DROP_OSPF_OURS);
+        continue;
       }
-    } 
-    /********************************/
-    /*  GOT AN ETHERNET/ARP PACKET  */
-    /********************************/
-    else if (htons(ETHERTYPE_ARP) == etherpacket->ether_type) {
-
-      struct sr_arphdr *arpheader = (struct sr_arphdr*) (packet + (sizeof(struct sr_ethernet_hdr)));
-
-      /********************************************/
-      /*  GOT AN ETHERNET/ARP ARP REQUEST PACKET  */
-      /********************************************/
-      if (htons(ARP_REQUEST) == arpheader->ar_op) {
-
-        addToArpcache(arpheader->ar_sip, arpheader->ar_sha, arpcache, sr, interface);
-	
-	/* see if arp target is one of us (interfaces) */
-	struct sr_if *walker = oneOfUs(&US, arpheader->ar_tip);
-
-	/* ARP REQUEST was not for us */
-        if (walker == NULL) {
-	  uint32_t cIndex = checkArpcache(arpheader->ar_tip, arpcache, sr);
-	  
-	  /*  NOT IN CACHE, ADD TO ARP QUEUE */
-	  if(cIndex == -1){
-	    add2queue(packet, len, arpheader->ar_tip, interface, sr);
-	  }
-	  /* CACHE HIT, FORWARD TO TARGET IP */
-	  else{
-	    memcpy(etherpacket->ether_dhost, arpcache[cIndex].mac, ETHER_ADDR_LEN);
-	    /*memcpy(etherpacket->ether_shost, walker->addr, ETHER_ADDR_LEN);*/
-	    sr_send_packet(sr, packet, len, interface);
-	  }
-        } 
-	/* ARP REQUEST was for us, send ARP_REPLY */
-	else {
-	  /*printf("\t\t GOT AN ARP REQUEST! SENDING A RESPONSE!\n");*/
- 	  arpheader->ar_op = htons(ARP_REPLY);
-          memcpy( arpheader->ar_tha, arpheader->ar_sha, ETHER_ADDR_LEN);
-          memcpy( arpheader->ar_sha, walker->addr, ETHER_ADDR_LEN);
-	  arpheader->ar_tip = arpheader->ar_sip;  
-	  arpheader->ar_sip = walker->ip;
- 
-          memcpy(etherpacket->ether_dhost, etherpacket->ether_shost, ETHER_ADDR_LEN);
-          memcpy(etherpacket->ether_shost, walker->addr, ETHER_ADDR_LEN);
-          sr_send_packet(sr, packet, len, walker->name);
+
+      pwospf_lock(sr->ospf_subsys);
+      int j;
+
+      for (j = 0; j < numAdvertisements; ++j, advertisementOffset += sizeof(struct ospfv2_lsu)) {
+
+        lsuPacket = (struct ospfv2_lsu*) (packet + advertisementOffset);
+        dynrt *prev = NULL, *drt = sr->ospf_subsys->drt;
+
+        while (drt != NULL) {
+          /* the message is redundant iff the originator of the message is the
+             same, and if it arrived via the same interface */
+          if ((drt->dest.s_addr == lsuPacket->subnet)
+              && (drt->mask.s_addr == lsuPacket->mask)
+              && (drt->ifindex == ifindex) ){
+
+            /*fprintf(stderr,"FOUND A DRT MATCH\n");*/
+            break;
+          }
+          prev = drt;
+          drt = drt->next;
+        }
+
+        if (drt == NULL) { /* create a new packet */
+
+          dynrt *add = (dynrt*) malloc(sizeof(dynrt));
+
+          add->dest.s_addr = lsuPacket->subnet;/*iphdr->ip_src; */
+          add->gw.s_addr = getNextHopsIp(sr, ifindex);
+
+          add->mask.s_addr = lsuPacket->mask;
+          add->ifindex = ifindex;
+          /* TODO: CHECK TO SEE IF THIS IS YOUR NEIGHBOR */
+          add->ttl = OSPF_TOPO_ENTRY_TIMEOUT;
+          add->next = NULL;
+          add->lastSeqNumber = ntohs(lsuHdr->seq);
+
+          add->rid.s_addr = lsuPacket->rid;
+          add->numHops = DEFAULT_TTL - lsuHdr->ttl ;
+          advertise = 1;
+          changed = 1;
+          sr_count(SR_EV_OSPF_LSA_NEW);
+
+          if (sr->ospf_subsys->drt == NULL)
+            sr->ospf_subsys->drt = add;
+          else{
+            prev->next = add;
+          }
+
+        }
+        /* update the info for this packet */
+        else if (drt->lastSeqNumber < sequenceNum){
+          uint32_t gw = getNextHopsIp(sr, ifindex);
+
+          /* a refresh of the same route only has to be flooded; the
+             forwarding table changes if the route does, or comes back */
+          if (drt->ttl == TIME_EXPIRED || drt->gw.s_addr != gw
+              || drt->dest.s_addr != lsuPacket->subnet
+              || drt->mask.s_addr != lsuPacket->mask
+              || drt->ifindex != ifindex
+              || drt->numHops != (uint8_t)(DEFAULT_TTL - lsuHdr->ttl))
+            changed = 1;
+
+          drt->dest.s_addr = lsuPacket->subnet;/*iphdr->ip_src;*/
+          drt->gw.s_addr = gw;
+          drt->mask.s_addr = lsuPacket->mask;
+          drt->ifindex = ifindex;
+          drt->lastSeqNumber = sequenceNum;
+          drt->ttl = OSPF_TOPO_ENTRY_TIMEOUT;
+          drt->rid.s_addr = lsuPacket->rid;
+          /* the distance between this router and the router
+             that originated this message */
+          drt->numHops = DEFAULT_TTL - lsuHdr->ttl ;
+          advertise = 1;
+          sr_count(SR_EV_OSPF_LSA_NEW);
+
+        }
+        else{
+          sr_count(SR_EV_OSPF_LSA_STALE);
+          sr_log(SR_LOG_OSPF_LSA_STALE, lsuPacket->rid, lsuPacket->subnet,
+                 sequenceNum, ifindex);
+        }
+      }
+
+      /* the forwarding table has to pick up new or changed routes */
+      if(changed)
+        sr_fib_rebuild(sr);
+
+      pwospf_unlock(sr->ospf_subsys);
+
+      /* forward LSU updates, if database has changed */
+      if(advertise && lsuHdr->ttl > 1){
+        /* the published neighbors, so no lock; see pwospf_publish_nbrs */
+        const struct pwospf_nbrs *nbrs =
+          __atomic_load_n(&sr->ospf_subsys->nbrs, __ATOMIC_ACQUIRE);
+        unsigned int k;
+
+        /* decrement the ttl, and patch the checksums */
+        ospfHdr->csum = sr_cksum_set8(ospfHdr->csum, ospfHdr, &lsuHdr->ttl,
+                                      lsuHdr->ttl - 1);
+
+        for (k = 0; nbrs != NULL && k < nbrs->n; ++k) {
+          const dynif *walker = &nbrs->nbr[k];
+
+          /* don't forward to originating interface */
+          if(walker->ifindex == ifindex)
+            continue;
+
+          /* only live neighbors are published, so just forward */
+          memcpy(etherpacket->ether_shost, walker->srcMac, ETHER_ADDR_LEN);
+          memcpy(etherpacket->ether_dhost, walker->dstMac, ETHER_ADDR_LEN);
+          iphdr->ip_sum = sr_cksum_adjust32(iphdr->ip_sum, iphdr->ip_dst.s_addr,
+                                            walker->neighborIp.s_addr);
+          iphdr->ip_dst = walker->neighborIp;
+          /* lsuPacket->subnet = walker->ip; */
+          ospfHdr->csum = sr_cksum_adjust32(ospfHdr->csum, lsuPacket->mask,
+                                            walker->mask.s_addr);
+          lsuPacket->mask = walker->mask.s_addr;
+
+          sr_send_packet(sr, packet, len, walker->ifindex);
         }
-      } 
-      /********************************************/
-      /*  GOT AN ETHERNET/ARP ARP REPLY PACKET    */
-      /********************************************/
-      else if (htons(ARP_REPLY) == arpheader->ar_op) {
-	/* GOT AN ARP REPLY; ADD TO ARP CACHE */
-        addToArpcache(arpheader->ar_sip, arpheader->ar_sha, arpcache, sr, interface);
-      } 
-      /********************************************/
-      /*  GOT AN UNDEFINED ETHERNET/ARP PACKET    */
-      /********************************************/
-      else {
-	fprintf(stderr, "Should never happen! Opcode: %u\n", arpheader->ar_op);
-	return;
       }
+      sr_hist_since(SR_HIST_LSU_HANDLER, lsuStart);
+      sr_hist_since(SR_HIST_OSPF_LSU, p->t0);
     }
-    /********************************************/
-    /*  GOT A NON-IP, NON-ARP PACKET (UDP, TCP?)*/
-    /*  WE DROP THIS PACKET                     */
-    /********************************************/
-    else {
-      printf("Last catch!\n");
+    /***************************************/
+    /*     OSPF packet type is undefined   */
+    /***************************************/
+    else{
+      drop_packet(sr, p, SR_DROP_OSPF_TYPE);
     }
+  }
+} /* -- ospf_input -- */
 
-    /* CHECK ARP QUEUE IF NOT ALREADY */
-    if(getChecking() == CLEAR){
-      checkQueue(sr, routingTable, arpcache, &US);
-    }
-}/* end sr_ForwardPacket */
+/*---------------------------------------------------------------------
+ * Method: ip4_lookup(..)
+ * Scope:  Local
+ *
+ * Find the adjacency of each packet's next hop.  Packets whose next hop
+ * has not been resolved yet wait in the ARP queue.
+ *
+ *---------------------------------------------------------------------*/
+static void ip4_lookup(struct sr_instance* sr, struct sr_pkt** pkts,
+                       unsigned int n)
+{
+  const struct sr_fib *fib = sr->fib;
+  unsigned int i;
+
+  for (i = 0; i < n; ++i) {
+    struct sr_pkt *p = pkts[i];
+    uint32_t dst = p->ip->ip_dst.s_addr;
+
+    /* the next packet's top level trie entry */
+    if (i + 1 < n && fib != NULL)
+      __builtin_prefetch(&fib->l1[ntohl(pkts[i + 1]->ip->ip_dst.s_addr) >> SR_FIB_L1_BITS]);
+
+    p->adj = findAdjacency(dst, sr);
+
+    /* IP not in ARP cache */
+    if (p->adj == NULL)
+      add2queue(p->buf, p->len, dst, p->ifindex, sr);
+    else
+      sr_graph_enqueue(sr->graph, sr, SR_NODE_IP4_REWRITE, p);
+  }
+} /* -- ip4_lookup -- */
+
+/*---------------------------------------------------------------------
+ * Method: ip4_rewrite(..)
+ * Scope:  Local
+ *
+ * Put the next hop's Ethernet header on and send.
+ *
+ *---------------------------------------------------------------------*/
+static void ip4_rewrite(struct sr_instance* sr, struct sr_pkt** pkts,
+                        unsigned int n)
+{
+  unsigned int i;
 
+  for (i = 0; i < n; ++i) {
+    struct sr_pkt *p = pkts[i];
+
+    if (i + 1 < n)
+      __builtin_prefetch(pkts[i + 1]->adj);
+
+    forwardPacket(sr, p->buf, p->len, p->ip->ip_dst.s_addr, &US, p->adj);
+    sr_hist_since(SR_HIST_TRANSIT, p->t0);
+  }
+} /* -- ip4_rewrite -- */
+
+/*---------------------------------------------------------------------
+ * Method: error_drop(..)
+ * Scope:  Local
+ *
+ * Sink for packets that are dropped; its packet counter is the number
+ * of drops.
+ *
+ *---------------------------------------------------------------------*/
+static void error_drop(struct sr_instance* sr, struct sr_pkt** pkts,
+                       unsigned int n)
+{
+} /* -- error_drop -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_graph_setup(..)
+ * Scope:  Local
+ *
+ *---------------------------------------------------------------------*/
+static void sr_graph_setup(struct sr_instance* sr)
+{
+    sr->graph = (struct sr_graph*)malloc(sizeof(struct sr_graph));
+    assert(sr->graph);
+    sr_graph_init(sr->graph);
+
+    sr_graph_register(sr->graph, SR_NODE_ETHERNET_INPUT, "ethernet-input",
+                      ethernet_input);
+    sr_graph_register(sr->graph, SR_NODE_ARP_INPUT, "arp-input", arp_input);
+    sr_graph_register(sr->graph, SR_NODE_IP4_INPUT, "ip4-input", ip4_input);
+    sr_graph_register(sr->graph, SR_NODE_ICMP_LOCAL, "icmp-local", icmp_local);
+    sr_graph_register(sr->graph, SR_NODE_OSPF_INPUT, "ospf-input", ospf_input);
+    sr_graph_register(sr->graph, SR_NODE_IP4_LOOKUP, "ip4-lookup", ip4_lookup);
+    sr_graph_register(sr->graph, SR_NODE_IP4_REWRITE, "ip4-rewrite",
+                      ip4_rewrite);
+    sr_graph_register(sr->graph, SR_NODE_ERROR_DROP, "error-drop", error_drop);
+} /* -- sr_graph_setup -- */
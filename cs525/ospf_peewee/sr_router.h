@@ -34,6 +34,20 @@
 /* forward declare */
 struct sr_if;
 struct sr_rt;
+struct sr_fib;
+struct sr_epoch;
+struct sr_epoch_reader;
+struct sr_adjtab;
+struct sr_arpq;
+struct sr_icmp;
+struct sr_timer_wheel;
+struct sr_graph;
+struct sr_pkt;
+struct sr_rx;
+struct sr_tx;
+struct sr_workers;
+struct sr_capture;
+struct sr_replay;
 
 struct pwospf_subsys;
 
@@ -52,8 +66,26 @@ struct sr_instance
     unsigned short topo_id;
     struct sockaddr_in sr_addr; /* address to server */
     struct sr_if* if_list; /* list of interfaces */
+    struct sr_if** if_table; /* the same interfaces, indexed by ifindex */
+    unsigned int if_count;
+    struct sr_if** if_addrs; /* set of local addresses, see sr_if.c */
+    uint32_t if_addrs_mask;
     struct sr_rt* routing_table; /* routing table */
-    FILE* logfile;
+    struct sr_fib* volatile fib; /* forwarding table, see sr_fib.h */
+    struct sr_epoch* epoch;      /* reclaims replaced tables, see sr_epoch.h */
+    struct sr_epoch_reader* reader; /* this thread's read section */
+    struct sr_adjtab* adj;       /* next hop rewrites, see sr_adj.h */
+    struct sr_timer_wheel* timers; /* ARP retries and aging, see sr_timer.h */
+    struct sr_arpq* arpq;        /* packets waiting for ARP, see sr_arpq.h */
+    struct sr_icmp* icmp;        /* ICMP error limits, see sr_icmp.h */
+    struct sr_graph* graph;      /* packet processing nodes, see sr_graph.h */
+    struct sr_rx* rx;            /* receive ring, see sr_rx.h */
+    struct sr_tx* tx;            /* transmit batch, see sr_tx.h */
+    int tx_policy;               /* SR_TX_WRITE, SR_TX_CORK or SR_TX_BATCH */
+    int event_loop;              /* single threaded, see sr_event.h */
+    struct sr_workers* workers;  /* forwarding threads, see sr_worker.h */
+    struct sr_capture* capture;  /* packet log (sr -l), see sr_capture.h */
+    struct sr_replay* replay;    /* offline trace (sr -i), see sr_replay.h */
     volatile uint8_t  hw_init; /* bool : hardware has been initialized */
 
     /* -- pwospf subsystem -- */
@@ -62,15 +94,19 @@ struct sr_instance
 
 /* -- sr_main.c -- */
 int sr_verify_routing_table(struct sr_instance* sr);
+void sr_print_stats(struct sr_instance* sr, FILE* out);
 
 /* -- sr_vns_comm.c -- */
-int sr_send_packet(struct sr_instance* , uint8_t* , unsigned int , const char*);
+int sr_send_packet(struct sr_instance* , uint8_t* , unsigned int , unsigned int );
 int sr_connect_to_server(struct sr_instance* ,unsigned short , char* );
 int sr_read_from_server(struct sr_instance* );
+int sr_read_commands(struct sr_instance* );
+void sr_hw_ready(struct sr_instance* );
 
 /* -- sr_router.c -- */
 void sr_init(struct sr_instance* );
-void sr_handlepacket(struct sr_instance* , uint8_t * , unsigned int , char* );
+void sr_handlepacket(struct sr_instance* , uint8_t * , unsigned int , unsigned int );
+void sr_handlepackets(struct sr_instance* , struct sr_pkt* , unsigned int );
 
 /* -- sr_if.c -- */
 void sr_add_interface(struct sr_instance* , const char* );
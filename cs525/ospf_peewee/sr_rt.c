@@ -20,7 +20,12 @@
 #include <arpa/inet.h>
 
 #include "sr_rt.h"
+#include "sr_fib.h"
 #include "sr_router.h"
+#include "sr_pwospf.h"
+
+static void sr_append_rt_entry(struct sr_instance*, struct in_addr,
+        struct in_addr, struct in_addr, char*);
 
 /*--------------------------------------------------------------------- 
  * Method:
@@ -73,36 +78,71 @@ int sr_load_rt(struct sr_instance* sr,const char* filename)
                     mask);
             return -1; 
         }
-        sr_add_rt_entry(sr,dest_addr,gw_addr,mask_addr,iface);
+        sr_append_rt_entry(sr,dest_addr,gw_addr,mask_addr,iface);
     } /* -- while -- */
 
+    /* -- one trie rebuild for the whole file -- */
+    sr_fib_rebuild(sr);
+
     return 0; /* -- success -- */
 } /* -- sr_load_rt -- */
 
 /*--------------------------------------------------------------------- 
- * Method:
+ * Method: sr_add_rt_entry(..)
+ *
+ * Add a route and recompile the forwarding table.
  *
  *---------------------------------------------------------------------*/
 
 void sr_add_rt_entry(struct sr_instance* sr, struct in_addr dest,
         struct in_addr gw, struct in_addr mask,char* if_name)
+{
+    if(sr->ospf_subsys)
+    { pwospf_lock(sr->ospf_subsys); }
+
+    sr_append_rt_entry(sr, dest, gw, mask, if_name);
+    sr_fib_rebuild(sr);
+
+    if(sr->ospf_subsys)
+    { pwospf_unlock(sr->ospf_subsys); }
+} /* -- sr_add_rt_entry -- */
+
+/*--------------------------------------------------------------------- 
+ * Method: sr_append_rt_entry(..)
+ * Scope:  Local
+ *
+ * Append a route to the list without touching the trie.
+ *
+ *---------------------------------------------------------------------*/
+
+static void sr_append_rt_entry(struct sr_instance* sr, struct in_addr dest,
+        struct in_addr gw, struct in_addr mask,char* if_name)
 {
     struct sr_rt* rt_walker = 0;
+    struct sr_rt* entry = 0;
+    size_t len = 0;
 
     /* -- REQUIRES -- */
     assert(if_name);
     assert(sr);
 
+    entry = (struct sr_rt*)malloc(sizeof(struct sr_rt));
+    entry->next = 0;
+    entry->dest = dest;
+    entry->gw   = gw;
+    entry->mask = mask;
+
+    /* -- names are printed with %s, so always leave the terminator -- */
+    len = strlen(if_name);
+    if(len > SR_IFACE_NAMELEN - 1)
+    { len = SR_IFACE_NAMELEN - 1; }
+    memcpy(entry->interface, if_name, len);
+    entry->interface[len] = 0;
+
     /* -- empty list special case -- */
     if(sr->routing_table == 0)
     {
-        sr->routing_table = (struct sr_rt*)malloc(sizeof(struct sr_rt));
-        sr->routing_table->next = 0;
-        sr->routing_table->dest = dest;
-        sr->routing_table->gw   = gw;
-        sr->routing_table->mask = mask;
-        strncpy(sr->routing_table->interface,if_name,SR_IFACE_NAMELEN);
-
+        sr->routing_table = entry;
         return;
     }
 
@@ -111,16 +151,8 @@ void sr_add_rt_entry(struct sr_instance* sr, struct in_addr dest,
     while(rt_walker->next)
     {rt_walker = rt_walker->next; }
 
-    rt_walker->next = (struct sr_rt*)malloc(sizeof(struct sr_rt));
-    rt_walker = rt_walker->next;
-
-    rt_walker->next = 0;
-    rt_walker->dest = dest;
-    rt_walker->gw   = gw;
-    rt_walker->mask = mask;
-    strncpy(rt_walker->interface,if_name,SR_IFACE_NAMELEN);
-
-} /* -- sr_add_entry -- */
+    rt_walker->next = entry;
+} /* -- sr_append_rt_entry -- */
 
 /*--------------------------------------------------------------------- 
  * Method:
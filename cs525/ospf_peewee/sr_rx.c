@@ -0,0 +1,246 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_rx.c
+ *
+ * Description:
+ *
+ * Receive ring, see sr_rx.h.  Commands are not aligned within a buffer;
+ * everything that parses them already copes with that, since the frame
+ * inside a VNSPACKET never was.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include <errno.h>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "sr_rx.h"
+#include "vnscommand.h"
+
+/*---------------------------------------------------------------------
+ * Method: sr_rx_get(..)
+ * Scope:  Local
+ *
+ * An empty buffer, from the free list if there is one.
+ *
+ *---------------------------------------------------------------------*/
+
+static struct sr_rxbuf* sr_rx_get(struct sr_rx* rx)
+{
+    struct sr_rxbuf* buf = rx->free;
+
+    if(buf)
+    {
+        rx->free = buf->next;
+        --rx->nfree;
+    }
+    else
+    {
+        buf = (struct sr_rxbuf*)malloc(sizeof(struct sr_rxbuf));
+        assert(buf);
+        ++rx->allocs;
+    }
+
+    buf->next = 0;
+    buf->refs = 1;
+    buf->head = 0;
+    buf->tail = 0;
+
+    return buf;
+} /* -- sr_rx_get -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_rx_put(..)
+ * Scope:  Global
+ *
+ * Drop a reference to buf, recycling it once nobody uses it.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_rx_put(struct sr_rx* rx, struct sr_rxbuf* buf)
+{
+    /* -- REQUIRES -- */
+    assert(rx);
+    assert(buf);
+    assert(buf->refs > 0);
+
+    if(--buf->refs > 0)
+    { return; }
+
+    if(rx->nfree >= SR_RX_POOL_MAX)
+    {
+        free(buf);
+        return;
+    }
+
+    buf->next = rx->free;
+    rx->free  = buf;
+    ++rx->nfree;
+} /* -- sr_rx_put -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_rx_init(..)
+ * Scope:  Global
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_rx_init(struct sr_rx* rx)
+{
+    /* -- REQUIRES -- */
+    assert(rx);
+
+    memset(rx, 0, sizeof(struct sr_rx));
+    rx->cur = sr_rx_get(rx);
+} /* -- sr_rx_init -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_rx_destroy(..)
+ * Scope:  Global
+ *
+ * Free the ring's buffers.  Nobody may hold one any more.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_rx_destroy(struct sr_rx* rx)
+{
+    struct sr_rxbuf* buf = 0;
+
+    /* -- REQUIRES -- */
+    assert(rx);
+    assert(rx->cur->refs == 1);
+
+    free(rx->cur);
+    while((buf = rx->free) != 0)
+    {
+        rx->free = buf->next;
+        free(buf);
+    }
+
+    rx->cur   = 0;
+    rx->nfree = 0;
+} /* -- sr_rx_destroy -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_rx_fill(..)
+ * Scope:  Global
+ *
+ * Read whatever the socket has, up to the room left in the buffer, with
+ * a single recv.  There is always room for at least one maximum size
+ * command.  Returns the number of bytes read, 0 if the server closed the
+ * connection or -1 on error (errno is set).
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_rx_fill(struct sr_rx* rx, int fd)
+{
+    struct sr_rxbuf* buf   = 0;
+    struct sr_rxbuf* fresh = 0;
+    unsigned int left;
+    int ret = 0;
+
+    /* -- REQUIRES -- */
+    assert(rx);
+
+    buf = rx->cur;
+
+    if(buf->head == buf->tail && buf->refs == 1)
+    {
+        /* -- fully parsed and nobody holds on to it: start over -- */
+        buf->head = 0;
+        buf->tail = 0;
+    }
+    else if(SR_RX_BUF_SIZE - buf->tail < SR_RX_CMD_MAX)
+    {
+        left  = buf->tail - buf->head;
+        fresh = sr_rx_get(rx);
+        memcpy(fresh->data, buf->data + buf->head, left);
+        fresh->tail = left;
+        rx->carried += left;
+
+        rx->cur = fresh;
+        sr_rx_put(rx, buf);
+        buf = fresh;
+    }
+
+    do
+    { /* -- just in case SIGALRM breaks recv -- */
+        ret = recv(fd, buf->data + buf->tail, SR_RX_BUF_SIZE - buf->tail, 0);
+    } while(ret == -1 && errno == EINTR);
+
+    if(ret > 0)
+    {
+        buf->tail += ret;
+        rx->bytes += ret;
+        ++rx->reads;
+    }
+
+    return ret;
+} /* -- sr_rx_fill -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_rx_next(..)
+ * Scope:  Global
+ *
+ * Point *cmd at the next complete command in the ring and *len at its
+ * length.  Returns 1 if there was one, 0 if more bytes are needed and -1
+ * if the length field is out of range, after which the stream cannot be
+ * trusted.  The command stays valid until the next sr_rx_fill.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_rx_next(struct sr_rx* rx, uint8_t** cmd, unsigned int* len)
+{
+    struct sr_rxbuf* buf = 0;
+    uint32_t n;
+
+    /* -- REQUIRES -- */
+    assert(rx);
+    assert(cmd);
+    assert(len);
+
+    buf = rx->cur;
+
+    if(buf->tail - buf->head < sizeof(uint32_t))
+    { return 0; }
+
+    memcpy(&n, buf->data + buf->head, sizeof(uint32_t));
+    n = ntohl(n);
+
+    if(n < sizeof(c_base) || n > SR_RX_CMD_MAX)
+    { return -1; }
+
+    if(buf->tail - buf->head < n)
+    { return 0; }
+
+    *cmd = buf->data + buf->head;
+    *len = n;
+    buf->head += n;
+    ++rx->cmds;
+
+    return 1;
+} /* -- sr_rx_next -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_rx_print_stats(..)
+ * Scope:  Global
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_rx_print_stats(const struct sr_rx* rx, FILE* out)
+{
+    /* -- REQUIRES -- */
+    assert(rx);
+    assert(out);
+
+    fprintf(out, "rx: %lu commands, %lu bytes in %lu reads "
+            "(%.1f commands/read), %lu bytes carried over, %lu buffers\n",
+            (unsigned long)rx->cmds, (unsigned long)rx->bytes,
+            (unsigned long)rx->reads,
+            rx->reads ? (double)rx->cmds / rx->reads : 0.0,
+            (unsigned long)rx->carried, (unsigned long)rx->allocs);
+} /* -- sr_rx_print_stats -- */
@@ -0,0 +1,81 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_rx.h
+ *
+ * Description:
+ *
+ * Receive ring for the server connection.  The socket is drained into a
+ * large buffer with one recv per wakeup, and complete commands are parsed
+ * out of it in place; a VNSPACKET's Ethernet frame is handed to the router
+ * right where it was read, so receiving costs no allocation and no copy.
+ *
+ * When the buffer runs short of room for another maximum size command the
+ * ring moves on to a fresh one, carrying over the partial command at its
+ * end.  Buffers are reference counted and recycled through a small free
+ * list.  The ring holds a reference to the buffer it is filling; anyone
+ * keeping a frame past the batch it arrived in takes one with sr_rx_hold.
+ *
+ * Only the thread reading from the server touches the ring.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_RX_H
+#define SR_RX_H
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif /* _DARWIN_ */
+
+#include <stdio.h>
+
+#define SR_RX_BUF_SIZE   (256 * 1024) /* bytes per receive buffer */
+#define SR_RX_CMD_MAX    10000        /* largest command the server sends */
+#define SR_RX_POOL_MAX   4            /* idle buffers kept for reuse */
+
+struct sr_rxbuf
+{
+    struct sr_rxbuf* next;   /* free list */
+    unsigned int     refs;
+    unsigned int     head;   /* start of the next command */
+    unsigned int     tail;   /* end of the bytes read */
+    uint8_t          data[SR_RX_BUF_SIZE];
+};
+
+struct sr_rx
+{
+    struct sr_rxbuf* cur;    /* buffer being filled */
+    struct sr_rxbuf* free;
+    unsigned int     nfree;
+
+    /* -- statistics -- */
+    uint64_t         reads;  /* recv calls that returned data */
+    uint64_t         cmds;
+    uint64_t         bytes;
+    uint64_t         carried; /* bytes moved to a fresh buffer */
+    uint64_t         allocs;
+};
+
+void sr_rx_init(struct sr_rx* rx);
+void sr_rx_destroy(struct sr_rx* rx);
+int  sr_rx_fill(struct sr_rx* rx, int fd);
+int  sr_rx_next(struct sr_rx* rx, uint8_t** cmd, unsigned int* len);
+void sr_rx_put(struct sr_rx* rx, struct sr_rxbuf* buf);
+void sr_rx_print_stats(const struct sr_rx* rx, FILE* out);
+
+/*---------------------------------------------------------------------
+ * Method: sr_rx_hold(..)
+ *
+ * Keep the buffer the last parsed command lives in, until sr_rx_put.
+ *
+ *---------------------------------------------------------------------*/
+
+static __inline__ struct sr_rxbuf* sr_rx_hold(struct sr_rx* rx)
+{
+    ++rx->cur->refs;
+    return rx->cur;
+} /* -- sr_rx_hold -- */
+
+#endif /* -- SR_RX_H -- */
@@ -0,0 +1,278 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_timer.c
+ *
+ * Description:
+ *
+ * Timer wheel, see sr_timer.h.  Level k slot i holds timers whose expiry,
+ * shifted right by 6k bits, ends in i.  A level k slot is cascaded into
+ * the levels below on the tick that is a multiple of 2^6k and selects it;
+ * at that point all its timers are due within the next 2^6k ticks.
+ *
+ *---------------------------------------------------------------------------*/
+
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include <limits.h>
+#include <time.h>
+
+#include "sr_timer.h"
+
+#define SR_TIMER_MASK  (SR_TIMER_SLOTS - 1)
+#define SR_TIMER_SPAN  ((uint64_t)1 << (SR_TIMER_BITS * SR_TIMER_LEVELS))
+
+/*---------------------------------------------------------------------
+ * Method: sr_timer_now(..)
+ * Scope:  Global
+ *
+ * Milliseconds on a clock that never steps backwards.
+ *
+ *---------------------------------------------------------------------*/
+
+uint64_t sr_timer_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+} /* -- sr_timer_now -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_timer_link(..)
+ * Scope:  Local
+ *
+ * File timer in the wheel relative to tick 'base'.  Anything already due
+ * goes in base's own level 0 slot.
+ *
+ *---------------------------------------------------------------------*/
+
+static void sr_timer_link(struct sr_timer_wheel* wheel,
+                          struct sr_timer* timer, uint64_t base)
+{
+    uint64_t e = timer->expires, delta;
+    struct sr_timer** slot = 0;
+    int level = 0;
+
+    if(e < base)
+    { e = base; }
+    delta = e - base;
+
+    if(delta >= SR_TIMER_SPAN)
+    {
+        e = base + SR_TIMER_SPAN - 1;
+        delta = SR_TIMER_SPAN - 1;
+    }
+
+    while(level < SR_TIMER_LEVELS - 1 &&
+          delta >= ((uint64_t)1 << (SR_TIMER_BITS * (level + 1))))
+    { ++level; }
+
+    slot = &wheel->slots[level][(e >> (SR_TIMER_BITS * level)) &
+                                SR_TIMER_MASK];
+
+    timer->next = *slot;
+    if(*slot)
+    { (*slot)->pprev = &timer->next; }
+    timer->pprev = slot;
+    *slot = timer;
+} /* -- sr_timer_link -- */
+
+static void sr_timer_unlink(struct sr_timer* timer)
+{
+    *timer->pprev = timer->next;
+    if(timer->next)
+    { timer->next->pprev = timer->pprev; }
+    timer->next  = 0;
+    timer->pprev = 0;
+} /* -- sr_timer_unlink -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_timer_wheel_init(..)
+ * Scope:  Global
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_timer_wheel_init(struct sr_timer_wheel* wheel, uint64_t now)
+{
+    /* -- REQUIRES -- */
+    assert(wheel);
+
+    memset(wheel, 0, sizeof(struct sr_timer_wheel));
+    wheel->now = now;
+} /* -- sr_timer_wheel_init -- */
+
+void sr_timer_init(struct sr_timer* timer, sr_timer_fn fn, void* arg)
+{
+    /* -- REQUIRES -- */
+    assert(timer);
+    assert(fn);
+
+    memset(timer, 0, sizeof(struct sr_timer));
+    timer->fn  = fn;
+    timer->arg = arg;
+} /* -- sr_timer_init -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_timer_add(..)
+ * Scope:  Global
+ *
+ * Arm an idle timer to fire on the first tick at or after 'expires', and
+ * never on the tick the wheel has already run.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_timer_add(struct sr_timer_wheel* wheel, struct sr_timer* timer,
+                  uint64_t expires)
+{
+    /* -- REQUIRES -- */
+    assert(wheel);
+    assert(timer);
+    assert(!sr_timer_pending(timer));
+
+    timer->expires = expires;
+    sr_timer_link(wheel, timer, wheel->now + 1);
+    ++wheel->pending;
+} /* -- sr_timer_add -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_timer_cancel(..)
+ * Scope:  Global
+ *
+ * Disarm timer; harmless if it isn't armed.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_timer_cancel(struct sr_timer_wheel* wheel, struct sr_timer* timer)
+{
+    /* -- REQUIRES -- */
+    assert(wheel);
+    assert(timer);
+
+    if(!sr_timer_pending(timer))
+    { return; }
+
+    sr_timer_unlink(timer);
+    --wheel->pending;
+} /* -- sr_timer_cancel -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_timer_cascade(..)
+ * Scope:  Local
+ *
+ * Refile every timer of a coarse slot relative to the tick being run.
+ *
+ *---------------------------------------------------------------------*/
+
+static void sr_timer_cascade(struct sr_timer_wheel* wheel, int level,
+                             unsigned int index)
+{
+    struct sr_timer* timer = wheel->slots[level][index];
+    struct sr_timer* next  = 0;
+
+    wheel->slots[level][index] = 0;
+
+    for(; timer; timer = next)
+    {
+        next = timer->next;
+        sr_timer_link(wheel, timer, wheel->now);
+    }
+} /* -- sr_timer_cascade -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_timer_advance(..)
+ * Scope:  Global
+ *
+ * Run every tick up to 'now', firing the timers that come due.  A
+ * callback may arm or cancel any timer, itself included; a timer armed
+ * from a callback fires on a later tick at the earliest.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_timer_advance(struct sr_timer_wheel* wheel, uint64_t now, void* ctx)
+{
+    struct sr_timer** slot = 0;
+    struct sr_timer* due   = 0;
+    struct sr_timer* timer = 0;
+    unsigned int index;
+    int level;
+
+    /* -- REQUIRES -- */
+    assert(wheel);
+
+    while(wheel->now < now)
+    {
+        if(wheel->pending == 0)
+        {
+            wheel->now = now;
+            break;
+        }
+
+        ++wheel->now;
+
+        for(level = 1; level < SR_TIMER_LEVELS; ++level)
+        {
+            if(wheel->now & (((uint64_t)1 << (SR_TIMER_BITS * level)) - 1))
+            { break; }
+            index = (wheel->now >> (SR_TIMER_BITS * level)) & SR_TIMER_MASK;
+            sr_timer_cascade(wheel, level, index);
+        }
+
+        /* -- detach the slot first: a timer re-armed 64 ticks out from a
+         *    callback goes right back into it -- */
+        slot = &wheel->slots[0][wheel->now & SR_TIMER_MASK];
+        due = *slot;
+        *slot = 0;
+        if(due)
+        { due->pprev = &due; }
+
+        while((timer = due) != 0)
+        {
+            sr_timer_unlink(timer);
+            --wheel->pending;
+            timer->fn(ctx, timer->arg);
+        }
+    }
+} /* -- sr_timer_advance -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_timer_next(..)
+ * Scope:  Global
+ *
+ * Milliseconds from the last tick run until the wheel next has work to
+ * do (a timer or a cascade), or -1 if nothing is armed.  Suitable as a
+ * poll() timeout.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_timer_next(const struct sr_timer_wheel* wheel)
+{
+    uint64_t best = 0, ticks, base;
+    unsigned int i;
+    int level;
+
+    /* -- REQUIRES -- */
+    assert(wheel);
+
+    if(wheel->pending == 0)
+    { return -1; }
+
+    for(level = 0; level < SR_TIMER_LEVELS; ++level)
+    {
+        base = wheel->now >> (SR_TIMER_BITS * level);
+        for(i = 1; i <= SR_TIMER_SLOTS; ++i)
+        {
+            if(wheel->slots[level][(base + i) & SR_TIMER_MASK] == 0)
+            { continue; }
+
+            ticks = ((base + i) << (SR_TIMER_BITS * level)) - wheel->now;
+            if(best == 0 || ticks < best)
+            { best = ticks; }
+            break;
+        }
+    }
+
+    return best > INT_MAX ? INT_MAX : (int)best;
+} /* -- sr_timer_next -- */
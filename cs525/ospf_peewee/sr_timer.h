@@ -0,0 +1,86 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_timer.h
+ *
+ * Description:
+ *
+ * Hierarchical timer wheel with millisecond ticks.  Four levels of 64
+ * slots cover 2^24 ms (about four and a half hours); a timer is filed in
+ * the finest level whose span covers its delay and moves down a level
+ * each time the coarser slot it sits in comes due.  Arming, cancelling
+ * and firing a timer are constant time no matter how many are pending.
+ *
+ * Timers are embedded in whatever they time out.  They are run by the
+ * main loop, between packets and while it waits for the server, so the
+ * callbacks execute on the packet handling thread.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_TIMER_H
+#define SR_TIMER_H
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif /* _DARWIN_ */
+
+#define SR_TIMER_BITS    6
+#define SR_TIMER_SLOTS   (1 << SR_TIMER_BITS)
+#define SR_TIMER_LEVELS  4
+
+typedef void (*sr_timer_fn)(void* ctx, void* arg);
+
+/* ----------------------------------------------------------------------------
+ * struct sr_timer
+ *
+ * 'pprev' is 0 while the timer is not armed.
+ *
+ * -------------------------------------------------------------------------- */
+
+struct sr_timer
+{
+    struct sr_timer*  next;
+    struct sr_timer** pprev;
+    uint64_t          expires;  /* ms, see sr_timer_now */
+    sr_timer_fn       fn;
+    void*             arg;
+};
+
+struct sr_timer_wheel
+{
+    uint64_t         now;      /* last tick run */
+    unsigned int     pending;
+    struct sr_timer* slots[SR_TIMER_LEVELS][SR_TIMER_SLOTS];
+};
+
+uint64_t sr_timer_now(void);
+void sr_timer_wheel_init(struct sr_timer_wheel* wheel, uint64_t now);
+void sr_timer_init(struct sr_timer* timer, sr_timer_fn fn, void* arg);
+void sr_timer_add(struct sr_timer_wheel* wheel, struct sr_timer* timer,
+                  uint64_t expires);
+void sr_timer_cancel(struct sr_timer_wheel* wheel, struct sr_timer* timer);
+void sr_timer_advance(struct sr_timer_wheel* wheel, uint64_t now, void* ctx);
+int  sr_timer_next(const struct sr_timer_wheel* wheel);
+
+/*---------------------------------------------------------------------
+ * Method: sr_timer_arm(..)
+ *
+ * (Re)arm timer to fire 'ms' milliseconds after the wheel's last tick.
+ *
+ *---------------------------------------------------------------------*/
+
+static __inline__ void sr_timer_arm(struct sr_timer_wheel* wheel,
+                                    struct sr_timer* timer, uint32_t ms)
+{
+    sr_timer_cancel(wheel, timer);
+    sr_timer_add(wheel, timer, wheel->now + ms);
+} /* -- sr_timer_arm -- */
+
+static __inline__ int sr_timer_pending(const struct sr_timer* timer)
+{
+    return timer->pprev != 0;
+} /* -- sr_timer_pending -- */
+
+#endif /* -- SR_TIMER_H -- */
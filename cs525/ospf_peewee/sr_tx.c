@@ -0,0 +1,307 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_tx.c
+ *
+ * Description:
+ *
+ * Transmit batching, see sr_tx.h.
+ *
+ *---------------------------------------------------------------------------*/
+
+#define _DEFAULT_SOURCE  /* TCP_CORK and clock_gettime under -ansi */
+#define _BSD_SOURCE
+
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#include "sr_tx.h"
+
+static const char* sr_tx_policies[] = { "write", "cork", "batch" };
+
+static uint64_t sr_tx_clock(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+} /* -- sr_tx_clock -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_tx_writev(..)
+ * Scope:  Local
+ *
+ * writev the whole of iov, picking up after short writes and signals.
+ * Adjusts iov as it goes.  Returns 0, or -1 on error.
+ *
+ *---------------------------------------------------------------------*/
+
+static int sr_tx_writev(struct sr_tx* tx, struct iovec* iov, int iovcnt)
+{
+    ssize_t ret;
+
+    while(iovcnt > 0)
+    {
+        ++tx->syscalls;
+        if((ret = writev(tx->fd, iov, iovcnt)) == -1)
+        {
+            if(errno == EINTR)
+            { continue; }
+            return -1;
+        }
+
+        /* -- skip what went out -- */
+        while(iovcnt > 0 && (size_t)ret >= iov->iov_len)
+        {
+            ret -= iov->iov_len;
+            ++iov;
+            --iovcnt;
+        }
+        if(iovcnt > 0)
+        {
+            iov->iov_base = (uint8_t*)iov->iov_base + ret;
+            iov->iov_len -= ret;
+        }
+    }
+
+    return 0;
+} /* -- sr_tx_writev -- */
+
+static __inline__ void sr_tx_lock(struct sr_tx* tx)
+{
+    if(tx->shared)
+    { pthread_mutex_lock(&tx->lock); }
+} /* -- sr_tx_lock -- */
+
+static __inline__ void sr_tx_unlock(struct sr_tx* tx)
+{
+    if(tx->shared)
+    { pthread_mutex_unlock(&tx->lock); }
+} /* -- sr_tx_unlock -- */
+
+static void sr_tx_setopt(struct sr_tx* tx, int opt, int on)
+{
+    /* -- not a socket when replaying a trace, see sr_replay.h -- */
+    ++tx->syscalls;
+    if(setsockopt(tx->fd, IPPROTO_TCP, opt, &on, sizeof(on)) == -1 &&
+       errno != ENOTSOCK)
+    { perror("setsockopt(..):sr_tx.c::sr_tx_setopt"); }
+} /* -- sr_tx_setopt -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_tx_flush_locked(..)
+ * Scope:  Local
+ *
+ *---------------------------------------------------------------------*/
+
+static int sr_tx_flush_locked(struct sr_tx* tx)
+{
+    struct iovec iov;
+    int ret = 0;
+
+    if(tx->len > 0)
+    {
+        iov.iov_base = tx->buf;
+        iov.iov_len  = tx->len;
+        ret = sr_tx_writev(tx, &iov, 1);
+        tx->len = 0;
+    }
+
+#ifdef TCP_CORK
+    if(tx->corked)
+    {
+        sr_tx_setopt(tx, TCP_CORK, 0);
+        tx->corked = 0;
+    }
+#endif /* TCP_CORK */
+
+    return ret;
+} /* -- sr_tx_flush_locked -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_tx_init(..)
+ * Scope:  Global
+ *
+ * Set up transmission on the connected socket fd.  Where the system has
+ * no TCP_CORK, SR_TX_CORK falls back to SR_TX_WRITE.  Unless 'shared',
+ * only one thread ever sends and the lock is skipped.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_tx_init(struct sr_tx* tx, int fd, int policy, int shared)
+{
+    /* -- REQUIRES -- */
+    assert(tx);
+    assert(policy >= SR_TX_WRITE && policy <= SR_TX_BATCH);
+
+    memset(tx, 0, sizeof(struct sr_tx));
+    pthread_mutex_init(&tx->lock, 0);
+    tx->fd     = fd;
+    tx->policy = policy;
+    tx->shared = shared;
+
+#ifndef TCP_CORK
+    if(tx->policy == SR_TX_CORK)
+    { tx->policy = SR_TX_WRITE; }
+#endif /* TCP_CORK */
+
+    sr_tx_setopt(tx, TCP_NODELAY, 1);
+} /* -- sr_tx_init -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_tx_policy(..)
+ * Scope:  Global
+ *
+ * The policy called 'name', or -1 if there is none.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_tx_policy(const char* name)
+{
+    int i;
+
+    /* -- REQUIRES -- */
+    assert(name);
+
+    for(i = SR_TX_WRITE; i <= SR_TX_BATCH; ++i)
+    {
+        if(strcmp(name, sr_tx_policies[i]) == 0)
+        { return i; }
+    }
+
+    return -1;
+} /* -- sr_tx_policy -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_tx_send(..)
+ * Scope:  Global
+ *
+ * Send the VNS header 'hdr' followed by 'frame', now or at the next
+ * flush depending on the policy.  Both are copied or written before this
+ * returns, so they may be reused straight away.  Returns 0, or -1 if a
+ * write failed (in which case anything batched with the frame is lost).
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_tx_send(struct sr_tx* tx, const uint8_t* hdr, unsigned int hdr_len,
+               const uint8_t* frame, unsigned int len)
+{
+    struct iovec iov[2];
+    uint64_t now;
+    int ret = 0;
+
+    /* -- REQUIRES -- */
+    assert(tx);
+    assert(hdr);
+    assert(frame);
+    assert(hdr_len + len <= SR_TX_BUF_SIZE);
+
+    sr_tx_lock(tx);
+
+    ++tx->packets;
+    tx->bytes += hdr_len + len;
+
+    if(tx->policy != SR_TX_BATCH)
+    {
+#ifdef TCP_CORK
+        if(tx->policy == SR_TX_CORK && !tx->corked)
+        {
+            sr_tx_setopt(tx, TCP_CORK, 1);
+            tx->corked = 1;
+        }
+#endif /* TCP_CORK */
+
+        iov[0].iov_base = (void*)hdr;
+        iov[0].iov_len  = hdr_len;
+        iov[1].iov_base = (void*)frame;
+        iov[1].iov_len  = len;
+        ret = sr_tx_writev(tx, iov, 2);
+
+        sr_tx_unlock(tx);
+        return ret;
+    }
+
+    if(tx->len + hdr_len + len > SR_TX_BUF_SIZE)
+    {
+        ++tx->flush_full;
+        ret = sr_tx_flush_locked(tx);
+    }
+
+    memcpy(tx->buf + tx->len, hdr, hdr_len);
+    memcpy(tx->buf + tx->len + hdr_len, frame, len);
+
+    now = sr_tx_clock();
+    if(tx->len == 0)
+    { tx->first = now; }
+    tx->len += hdr_len + len;
+
+    if(now - tx->first >= SR_TX_MAX_DELAY)
+    {
+        ++tx->flush_late;
+        if(sr_tx_flush_locked(tx) == -1)
+        { ret = -1; }
+    }
+
+    sr_tx_unlock(tx);
+
+    return ret;
+} /* -- sr_tx_send -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_tx_flush(..)
+ * Scope:  Global
+ *
+ * Put everything sent so far on the wire.  Cheap when there is nothing
+ * to flush.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_tx_flush(struct sr_tx* tx)
+{
+    int ret = 0;
+
+    /* -- REQUIRES -- */
+    assert(tx);
+
+    if(tx->len == 0 && !tx->corked)
+    { return 0; }
+
+    sr_tx_lock(tx);
+    if(tx->len > 0 || tx->corked)
+    {
+        ++tx->flush_sync;
+        ret = sr_tx_flush_locked(tx);
+    }
+    sr_tx_unlock(tx);
+
+    return ret;
+} /* -- sr_tx_flush -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_tx_print_stats(..)
+ * Scope:  Global
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_tx_print_stats(const struct sr_tx* tx, FILE* out)
+{
+    /* -- REQUIRES -- */
+    assert(tx);
+    assert(out);
+
+    fprintf(out, "tx (%s): %lu packets, %lu bytes in %lu syscalls "
+            "(%.2f syscalls/packet), flushes %lu done %lu full %lu late\n",
+            sr_tx_policies[tx->policy],
+            (unsigned long)tx->packets, (unsigned long)tx->bytes,
+            (unsigned long)tx->syscalls,
+            tx->packets ? (double)tx->syscalls / tx->packets : 0.0,
+            (unsigned long)tx->flush_sync, (unsigned long)tx->flush_full,
+            (unsigned long)tx->flush_late);
+} /* -- sr_tx_print_stats -- */
@@ -0,0 +1,84 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_tx.h
+ *
+ * Description:
+ *
+ * Transmit side of the server connection.  Frames handed to sr_send_packet
+ * come in bursts: a vector of forwarded packets, an ARP request out of
+ * every interface, a round of hellos or LSUs.  Rather than pay a syscall
+ * for each, the frames of a burst can be coalesced and sent together when
+ * the burst is over.  How is up to the flush policy:
+ *
+ *   SR_TX_WRITE  every frame is written as it is sent (one writev each).
+ *   SR_TX_CORK   every frame is written as it is sent, but the socket is
+ *                corked until the flush so the kernel packs the frames
+ *                into full segments.  Frames are never copied.
+ *   SR_TX_BATCH  frames are copied into a buffer and the whole buffer is
+ *                written at the flush, one syscall for the burst.
+ *
+ * Whoever finishes a burst calls sr_tx_flush: the read loop after each
+ * receive batch and after running timers, the PWOSPF thread after each
+ * tick.  A batch is also flushed when the buffer fills up or when its
+ * oldest frame has waited SR_TX_MAX_DELAY microseconds.  Nagle is always
+ * off, since it would only hold back what a flush sends.
+ *
+ * Both the packet thread and the PWOSPF thread send, as do forwarding
+ * workers (see sr_worker.h), so everything here is done under the
+ * transmit lock; it also keeps their frames from interleaving on the
+ * stream.  Under the event loop without workers there is only the one
+ * thread and no locking.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_TX_H
+#define SR_TX_H
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif /* _DARWIN_ */
+
+#include <stdio.h>
+#include <pthread.h>
+#include <sys/uio.h>
+
+#define SR_TX_BUF_SIZE   (64 * 1024) /* bytes coalesced per batch */
+#define SR_TX_MAX_DELAY  1000        /* us the oldest batched frame waits */
+
+/* -- flush policies -- */
+#define SR_TX_WRITE  0
+#define SR_TX_CORK   1
+#define SR_TX_BATCH  2
+
+struct sr_tx
+{
+    pthread_mutex_t lock;
+    int             shared;   /* sent to by more than one thread */
+    int             fd;
+    int             policy;
+    int             corked;
+    unsigned int    len;      /* bytes waiting in buf */
+    uint64_t        first;    /* when the oldest of them was queued, us */
+
+    /* -- statistics -- */
+    uint64_t        packets;
+    uint64_t        bytes;
+    uint64_t        syscalls;
+    uint64_t        flush_full;
+    uint64_t        flush_late;
+    uint64_t        flush_sync;
+
+    uint8_t         buf[SR_TX_BUF_SIZE];
+};
+
+void sr_tx_init(struct sr_tx* tx, int fd, int policy, int shared);
+int  sr_tx_policy(const char* name);
+int  sr_tx_send(struct sr_tx* tx, const uint8_t* hdr, unsigned int hdr_len,
+                const uint8_t* frame, unsigned int len);
+int  sr_tx_flush(struct sr_tx* tx);
+void sr_tx_print_stats(const struct sr_tx* tx, FILE* out);
+
+#endif /* -- SR_TX_H -- */
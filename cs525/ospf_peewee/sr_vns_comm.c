@@ -35,19 +35,34 @@
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <sys/time.h>
+#include <poll.h>
 
 #include "sr_dumper.h"
 #include "sr_router.h"
 #include "sr_if.h"
 #include "sr_protocol.h"
+#include "sr_fib.h"
+#include "sr_timer.h"
+#include "sr_graph.h"
+#include "sr_rx.h"
+#include "sr_tx.h"
+#include "sr_worker.h"
+#include "sr_epoch.h"
+#include "sr_capture.h"
+#include "sr_replay.h"
+#include "sr_counters.h"
+#include "sr_evlog.h"
+#include "sr_hist.h"
 
 #include "vnscommand.h"
 
-static void sr_log_packet(struct sr_instance* , uint8_t* , int );
+static void sr_log_packet(struct sr_instance* , uint8_t* , int ,
+                          unsigned int , int );
+static int  sr_wait_for_server(struct sr_instance* sr);
 static int  sr_arp_req_not_for_us(struct sr_instance* sr, 
                                   uint8_t * packet /* lent */,
                                   unsigned int len,
-                                  char* interface  /* lent */);
+                                  struct sr_if* iface /* lent */);
 
 /*-----------------------------------------------------------------------------
  * Method: sr_connect_to_server()
@@ -122,9 +137,65 @@ int sr_connect_to_server(struct sr_instance* sr,unsigned short port,
         return -1;
     }
 
+    /* -- everything the server sends from here on goes through the ring -- */
+    if(sr->rx == 0)
+    {
+        sr->rx = (struct sr_rx*)malloc(sizeof(struct sr_rx));
+        assert(sr->rx);
+        sr_rx_init(sr->rx);
+    }
+
+    /* -- and everything we send through the transmit batch -- */
+    if(sr->tx == 0)
+    {
+        sr->tx = (struct sr_tx*)malloc(sizeof(struct sr_tx));
+        assert(sr->tx);
+        sr_tx_init(sr->tx, sr->sockfd, sr->tx_policy, !sr->event_loop);
+    }
+
     return 0;
 } /* -- sr_connect_to_server -- */
 
+/*-----------------------------------------------------------------------------
+ * Method: sr_hw_ready(..)
+ * scope: global
+ *
+ * All interfaces are in, from VNSHWINFO or from a local config when
+ * replaying a trace (see sr_replay.h).  Name them in the capture, route
+ * their subnets and let the rest of the router get going.
+ *
+ *---------------------------------------------------------------------------*/
+
+void sr_hw_ready(struct sr_instance* sr)
+{
+    struct sr_if* iface = 0;
+
+    /* REQUIRES */
+    assert(sr);
+
+    sr_print_if_list(sr);
+
+    /* -- name the interfaces in the capture, for pcapng -- */
+    if(sr->capture)
+    {
+        for(iface = sr->if_list; iface; iface = iface->next)
+        {
+            sr_capture_add_interface(sr->capture, iface->ifindex,
+                                     iface->name, iface->addr);
+        }
+    }
+
+    /* -- connected subnets are now known, add them to the forwarding table -- */
+    if(sr->ospf_subsys)
+    { pwospf_lock(sr->ospf_subsys); }
+    sr_fib_rebuild(sr);
+    if(sr->ospf_subsys)
+    { pwospf_unlock(sr->ospf_subsys); }
+
+    /* flag that hardware has been initialized */
+    sr->hw_init = 1;
+} /* -- sr_hw_ready -- */
+
 /*-----------------------------------------------------------------------------
  * Method: sr_handle_hwinfo(..) 
  * scope: global 
@@ -187,10 +258,7 @@ int sr_handle_hwinfo(struct sr_instance* sr, c_hwinfo* hwinfo)
         } /* -- switch -- */
     } /* -- for -- */
 
-    sr_print_if_list(sr);
-
-    /* flag that hardware has been initialized */
-    sr->hw_init = 1;
+    sr_hw_ready(sr);
 
     return num_entries;
 } /* -- sr_handle_hwinfo -- */
@@ -205,144 +273,254 @@ int sr_handle_hwinfo(struct sr_instance* sr, c_hwinfo* hwinfo)
 
 int sr_read_from_server(struct sr_instance* sr /* borrowed */)
 {
-    int command, len;
-    unsigned char *buf = 0;
-    c_packet_ethernet_header* sr_pkt = 0;
-    int ret = 0, bytes_read = 0;
+    /* REQUIRES */
+    assert(sr);
+
+    /* -- keep the timers running until the server has something for us -- */
+    if(sr_wait_for_server(sr) == -1)
+    { return -1; }
+
+    return sr_read_commands(sr);
+}/* -- sr_read_from_server -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_read_commands(..) 
+ * Scope: global 
+ *
+ * Read everything the server has sent so far into the receive ring (see
+ * sr_rx.h) and handle every complete command in it.  Packets are passed
+ * to the router in vectors, straight out of the ring; other commands are
+ * handled in order between them.  The socket must be readable.
+ *
+ * Returns 1 to carry on, 0 if the server closed the session or -1 on
+ * error.
+ *
+ *---------------------------------------------------------------------------*/
+
+int sr_read_commands(struct sr_instance* sr /* borrowed */)
+{
+    struct sr_pkt pkts[SR_VECTOR_SIZE];
+    unsigned int npkts = 0;
+    int command;
+    unsigned int len;
+    uint8_t* buf = 0;
+    struct sr_if* iface = 0;
+    int taken = 0;
+    int ret = 0;
 
     /* REQUIRES */
     assert(sr);
+    assert(sr->rx);
 
     /*---------------------------------------------------------------------------
-      Read a command from the server 
+      Read as much as the server has sent
       -------------------------------------------------------------------------*/
 
-    bytes_read = 0;
+    if((ret = sr_rx_fill(sr->rx, sr->sockfd)) <= 0)
+    {
+        if(ret == 0)
+        { fprintf(stderr,"Error: server closed the connection\n"); }
+        else
+        { perror("recv(..):sr_client.c::sr_read_from_server"); }
+        close(sr->sockfd);
+        return -1;
+    }
 
-    /* attempt to read the size of the incoming packet */
-    while( bytes_read < 4)
+    while((ret = sr_rx_next(sr->rx, &buf, &len)) == 1)
     {
-        do
-        { /* -- just in case SIGALRM breaks recv -- */
-            errno = 0; /* -- hacky glibc workaround -- */
-            if((ret = recv(sr->sockfd,((uint8_t*)&len) + bytes_read, 
-                            4 - bytes_read, 0)) == -1)
-            {
-                if ( errno == EINTR )
-                { continue; }
-
-                perror("recv(..):sr_client.c::sr_read_from_server");
-                return -1;
-            }
-            bytes_read += ret;
-        } while ( errno == EINTR); /* be mindful of signals */
+        command = ntohl(((c_base*)buf)->mType);
+
+        /* -- anything but a packet waits for the packets before it -- */
+        if(command != VNSPACKET && npkts > 0)
+        {
+            sr_handlepackets(sr, pkts, npkts);
+            npkts = 0;
+        }
 
+        switch (command)
+        {
+            /* -------------        VNSPACKET     -------------------- */
+
+            case VNSPACKET:
+                /* -- neither has an interface yet, SR_IF_MAX stands in -- */
+                if(len < sizeof(c_packet_ethernet_header))
+                {
+                    sr_count_drop(SR_DROP_RX_RUNT);
+                    sr_log(SR_LOG_DROP, SR_DROP_RX_RUNT, SR_IF_MAX, 0, 0);
+                    break;
+                }
+
+                /* -- the router only deals in interface indices from here on -- */
+                iface = sr_get_interface(sr, (char*)(buf + sizeof(c_base)));
+                if ( iface == 0 )
+                {
+                    sr_count_drop(SR_DROP_RX_NO_IF);
+                    sr_log(SR_LOG_DROP, SR_DROP_RX_NO_IF, SR_IF_MAX, 0, 0);
+                    break;
+                }
+
+                sr_count_rx(buf + sizeof(c_packet_header),
+                            len - sizeof(c_packet_header), iface->ifindex);
+
+                /* -- check if it is an ARP to another router if so drop   -- */
+                if ( sr_arp_req_not_for_us(sr, 
+                        (buf+sizeof(c_packet_header)),
+                        len - sizeof(c_packet_header),
+                        iface) )
+                {
+                    sr_count_drop(SR_DROP_ARP_NOT_US);
+                    break;
+                }
+
+                /* -- log packet -- */
+                sr_log_packet(sr, buf + sizeof(c_packet_header),
+                        len - sizeof(c_packet_header), iface->ifindex,
+                        SR_CAPTURE_IN);
+
+                /* -- IPv4 goes to the workers if there are any -- */
+                if(sr->workers)
+                {
+                    taken = sr_workers_dispatch(sr,
+                                                buf + sizeof(c_packet_header),
+                                                len - sizeof(c_packet_header),
+                                                iface->ifindex);
+                    if(taken == SR_WORKERS_BUSY)
+                    {
+                        /* -- reaping runs the packet graph, so the packets
+                         *    held here have to go through it first -- */
+                        if(npkts > 0)
+                        {
+                            sr_handlepackets(sr, pkts, npkts);
+                            npkts = 0;
+                        }
+                        sr_workers_wait(sr, buf + sizeof(c_packet_header),
+                                        len - sizeof(c_packet_header));
+                        taken = sr_workers_dispatch(sr,
+                                                buf + sizeof(c_packet_header),
+                                                len - sizeof(c_packet_header),
+                                                iface->ifindex);
+                    }
+                    if(taken == 1)
+                    { break; }
+                }
+
+                /* -- queue for the router, student's code takes over there -- */
+                pkts[npkts].buf     = buf + sizeof(c_packet_header);
+                pkts[npkts].len     = len - sizeof(c_packet_header);
+                pkts[npkts].ifindex = iface->ifindex;
+                if(++npkts == SR_VECTOR_SIZE)
+                {
+                    sr_handlepackets(sr, pkts, npkts);
+                    npkts = 0;
+                }
+
+                break;
+
+                /* -------------        VNSCLOSE      -------------------- */
+
+            case VNSCLOSE:
+                fprintf(stderr,"vns server closed session.\n");
+                fprintf(stderr,"Reason: %s\n",((c_close*)buf)->mErrorMessage);
+                sr_tx_flush(sr->tx);
+                return 0;      
+                break;
+
+                /* -------------     VNSHWINFO     -------------------- */
+
+            case VNSHWINFO:
+                sr_handle_hwinfo(sr,(c_hwinfo*)buf); 
+                if(sr_verify_routing_table(sr) != 0)
+                {
+                    fprintf(stderr,"Routing table not consistent with hardware\n");
+                    return -1;
+                }
+                break;
+
+            default:
+                Debug("unknown command: %d\n", command);
+                break;
+
+        }/* -- switch -- */
     }
 
-    len = ntohl(len);
+    if(npkts > 0)
+    { sr_handlepackets(sr, pkts, npkts); }
 
-    if ( len > 10000 || len < 0 )
+    /* -- and whatever the workers punted back so far -- */
+    if(sr->workers)
+    { sr_workers_reap(sr); }
+
+    /* -- whatever the batch sent goes out now -- */
+    sr_tx_flush(sr->tx);
+
+    if(ret == -1)
     {
-        fprintf(stderr,"Error: command length to large %d\n",len);
+        fprintf(stderr,"Error: bad command length from server\n");
         close(sr->sockfd); 
         return -1;
     }
 
-    if((buf = malloc(len)) == 0)
-    {
-        fprintf(stderr,"Error: out of memory (sr_read_from_server)\n");
-        return -1;
-    }
+    return 1;
+}/* -- sr_read_commands -- */
 
-    /* set first field of command since we've already read it */ 
-    *((int *)buf) = htonl(len);
+/*-----------------------------------------------------------------------------
+ * Method: sr_wait_for_server(..)
+ * Scope: Local
+ *
+ * Block until the server socket is readable, firing timers as they come
+ * due in the meantime.  Timers that are already due are run first, so
+ * they keep time under a steady stream of packets too.  Anything they
+ * send is flushed before going to sleep.  So are frames the workers hand
+ * back.
+ *
+ *---------------------------------------------------------------------------*/
 
-    bytes_read = 0;
+static int sr_wait_for_server(struct sr_instance* sr)
+{
+    struct pollfd pfd;
+    int ret = 0, timeout;
 
-    /* read the rest of the command */
-    while ( bytes_read < len - 4)
-    {
-        do
-        {/* -- just in case SIGALRM breaks recv -- */
-            errno = 0; /* -- hacky glibc workaround -- */
-            if ((ret = read(sr->sockfd, buf+4+bytes_read, len - 4 - bytes_read)) ==
-                    -1)
-            {
-                if ( errno == EINTR )
-                { continue; }
-                fprintf(stderr,"Error: failed reading command body %d\n",ret);
-                close(sr->sockfd); 
-                return -1;
-            }
-            bytes_read += ret;
-        } while (errno == EINTR); /* be mindful of signals */
-    } 
-
-    /* My entry for most unreadable line of code - guido */
-    /* ... you win - mc                                  */
-    command = *(((int *)buf)+1) = ntohl(*(((int *)buf)+1));
-
-    switch (command)
+    for(;;)
     {
-        /* -------------        VNSPACKET     -------------------- */
-
-        case VNSPACKET:
-            sr_pkt = (c_packet_ethernet_header *)buf;
-
-            /* -- check if it is an ARP to another router if so drop   -- */
-            if ( sr_arp_req_not_for_us(sr, 
-                    (buf+sizeof(c_packet_header)),
-                    len - sizeof(c_packet_ethernet_header) +
-                    sizeof(struct sr_ethernet_hdr),
-                    buf + sizeof(c_base)) )
-            { 
-	      /*fprintf(stderr, "Dropping packet! ARP request not for us!\n");*/
-	      break; }
-
-            /* -- log packet -- */
-            sr_log_packet(sr, buf + sizeof(c_packet_header),
-                    ntohl(sr_pkt->mLen) - sizeof(c_packet_header));
-
-            /* -- pass to router, student's code should take over here -- */
-            sr_handlepacket(sr,
-                    (buf+sizeof(c_packet_header)),
-                    len - sizeof(c_packet_ethernet_header) +
-                    sizeof(struct sr_ethernet_hdr),
-                    buf + sizeof(c_base));
-
-            break;
-
-            /* -------------        VNSCLOSE      -------------------- */
-
-        case VNSCLOSE:
-            fprintf(stderr,"vns server closed session.\n");
-            fprintf(stderr,"Reason: %s\n",((c_close*)buf)->mErrorMessage);
-            if(buf)
-            { free(buf); }
-            return 0;      
-            break;
-
-            /* -------------     VNSHWINFO     -------------------- */
-
-        case VNSHWINFO:
-            sr_handle_hwinfo(sr,(c_hwinfo*)buf); 
-            if(sr_verify_routing_table(sr) != 0)
-            {
-                fprintf(stderr,"Routing table not consistent with hardware\n");
-                return -1;
-            }
-            break;
-
-        default:
-            Debug("unknown command: %d\n", command);
-            break;
-
-    }/* -- switch -- */
-
-    if(buf)
-    { free(buf); }
-    return 1;
-}/* -- sr_read_from_server -- */
+        if(sr->timers)
+        { sr_timer_advance(sr->timers, sr_timer_now(), sr); }
+        if(sr->workers)
+        { sr_workers_reap(sr); }
+        sr_tx_flush(sr->tx);
+
+        /* -- kill -USR1, see sr_counters.h -- */
+        if(sr_counters_dump)
+        {
+            sr_counters_dump = 0;
+            sr_counters_print_stats(sr, stderr);
+            if(sr_hist_on)
+            { sr_hist_print_stats(stderr); }
+        }
+
+        pfd.fd      = sr->sockfd;
+        pfd.events  = POLLIN;
+        pfd.revents = 0;
+
+        /* -- frames still with the workers are looked for every ms -- */
+        timeout = sr->timers ? sr_timer_next(sr->timers) : -1;
+        if(sr->workers && sr->workers->inflight > 0 &&
+           (timeout < 0 || timeout > 1))
+        { timeout = 1; }
+
+        /* -- hold no tables while blocked, see sr_epoch.h -- */
+        sr_epoch_exit(sr->reader);
+        ret = poll(&pfd, 1, timeout);
+        sr_epoch_enter(sr->epoch, sr->reader);
+        if(ret > 0)
+        { return 0; }
+
+        if(ret == -1 && errno != EINTR)
+        {
+            perror("poll(..):sr_vns_comm.c::sr_wait_for_server");
+            return -1;
+        }
+    }
+} /* -- sr_wait_for_server -- */
 
 /*-----------------------------------------------------------------------------
  * Method: sr_ether_addrs_match_interface(..)
@@ -356,30 +534,19 @@ static
 int 
 sr_ether_addrs_match_interface( struct sr_instance* sr, /* borrowed */
                                 uint8_t* buf, /* borrowed */
-                                const char* name /* borrowed */ )
+                                struct sr_if* iface /* borrowed */ )
 {
     struct sr_ethernet_hdr* ether_hdr = 0;
-    struct sr_if* iface = 0;
 
     /* -- REQUIRES -- */
     assert(sr);
     assert(buf);
-    assert(name);
+    assert(iface);
 
     ether_hdr = (struct sr_ethernet_hdr*)buf;
-    iface = sr_get_interface(sr, name);
-
-    if ( iface == 0 )
-    {
-        fprintf( stderr, "** Error, interface %s, does not exist\n", name);
-        return 0;
-    }
 
     if ( memcmp( ether_hdr->ether_shost, iface->addr, ETHER_ADDR_LEN) != 0 )
-    {
-      fprintf( stderr, "** Error, source address does not match interface\n");
-      return 0;
-    }
+    { return 0; }
 
     /* TODO */
     /* Check destination, hardware address.  If it is private (i.e. destined
@@ -396,58 +563,75 @@ sr_ether_addrs_match_interface( struct sr_instance* sr, /* borrowed */
  * Scope: Global
  *
  * Send a packet (ethernet header included!) of length 'len' to the server
- * to be injected onto the wire.
+ * to be injected onto the wire out of interface 'ifindex'.  This is where
+ * the index is turned back into the name the server knows it by.
+ *
+ * The VNS header is built on the stack and handed to the transmit batch
+ * together with the caller's buffer; see sr_tx.h for when it is written.
+ * The buffer may be reused as soon as this returns.
  *
  *---------------------------------------------------------------------------*/
 
 int sr_send_packet(struct sr_instance* sr /* borrowed */, 
                          uint8_t* buf /* borrowed */ ,
                          unsigned int len, 
-                         const char* iface /* borrowed */)
+                         unsigned int ifindex)
 {
-    c_packet_header *sr_pkt;
+    c_packet_header hdr;
     unsigned int total_len =  len + (sizeof(c_packet_header));
+    struct sr_if* iface = 0;
+    uint64_t start = sr_hist_clock();
 
     /* REQUIRES */
     assert(sr);
+    assert(sr->tx);
     assert(buf);
-    assert(iface);
+
+    iface = sr_get_interface_by_index(sr, ifindex);
+    if ( iface == 0 )
+    {
+        sr_log(SR_LOG_TX_NO_IF, ifindex, 0, 0, 0);
+        sr_count_drop(SR_DROP_TX_ERROR);
+        return -1;
+    }
 
     /* don't waste my time ... */
     if ( len < sizeof(struct sr_ethernet_hdr) )
     {
-        fprintf(stderr , "** Error: packet is way to short \n");
+        sr_log(SR_LOG_TX_RUNT, len, ifindex, 0, 0);
+        sr_count_drop(SR_DROP_TX_ERROR);
         return -1;
     }
 
-    /* Create packet */
-    sr_pkt = (c_packet_header *)malloc(len +
-            sizeof(c_packet_header));
-    assert(sr_pkt);
-    sr_pkt->mLen  = htonl(total_len);
-    sr_pkt->mType = htonl(VNSPACKET);
-    strncpy(sr_pkt->mInterfaceName,iface,16);
-    memcpy(((uint8_t*)sr_pkt) + sizeof(c_packet_header),
-            buf,len);
+    /* Create header */
+    hdr.mLen  = htonl(total_len);
+    hdr.mType = htonl(VNSPACKET);
+    strncpy(hdr.mInterfaceName,iface->name,16);
 
     /* -- log packet -- */
-    sr_log_packet(sr,buf,len);
+    sr_log_packet(sr,buf,len,ifindex,SR_CAPTURE_OUT);
 
     if ( ! sr_ether_addrs_match_interface( sr, buf, iface) )
     {
-        fprintf( stderr, "*** Error: problem with ethernet header, check log\n");
-        free ( sr_pkt );
+        sr_log(SR_LOG_TX_BAD_SRC, ifindex, 0, 0, 0);
+        sr_count_drop(SR_DROP_TX_ERROR);
         return -1; 
     }
 
-    if( write(sr->sockfd, sr_pkt, total_len) < total_len ) 
+    /* -- replaying a trace, see sr_replay.h -- */
+    if(sr->replay)
+    { sr_replay_sent(sr->replay, buf, len, ifindex); }
+
+    if( sr_tx_send(sr->tx, (uint8_t*)&hdr, sizeof(c_packet_header),
+                   buf, len) < 0 ) 
     {
-        fprintf(stderr, "Error writing packet\n");
-        free(sr_pkt);
+        sr_log(SR_LOG_TX_WRITE, len, ifindex, 0, 0);
+        sr_count_drop(SR_DROP_TX_ERROR);
         return -1;
     }
 
-    free(sr_pkt);
+    sr_count_tx(len, ifindex);
+    sr_hist_since(SR_HIST_SEND_PACKET, start);
 
     return 0;
 } /* -- sr_send_packet -- */
@@ -458,25 +642,17 @@ int sr_send_packet(struct sr_instance* sr /* borrowed */,
  *
  *---------------------------------------------------------------------------*/
 
-void sr_log_packet(struct sr_instance* sr, uint8_t* buf, int len )
+void sr_log_packet(struct sr_instance* sr, uint8_t* buf, int len,
+                   unsigned int ifindex, int dir)
 {
-    struct pcap_pkthdr h;
-    int size;
-
     /* REQUIRES */
     assert(sr);
 
-    if(!sr->logfile)
+    if(!sr->capture)
     {return; }
 
-    size = min(PACKET_DUMP_SIZE, len);
-
-    gettimeofday(&h.ts, 0);
-    h.caplen = size;
-    h.len = (size < PACKET_DUMP_SIZE) ? size : PACKET_DUMP_SIZE;
-
-    sr_dump(sr->logfile, &h, buf);
-    fflush(sr->logfile);
+    /* -- copied to the capture ring, written out by its own thread -- */
+    sr_capture_packet(sr->capture, buf, len, ifindex, dir);
 } /* -- sr_log_packet -- */
 
 /*-----------------------------------------------------------------------------
@@ -488,9 +664,8 @@ void sr_log_packet(struct sr_instance* sr, uint8_t* buf, int len )
 int  sr_arp_req_not_for_us(struct sr_instance* sr, 
                            uint8_t * packet /* lent */,
                            unsigned int len,
-                           char* interface  /* lent */)
+                           struct sr_if* iface /* lent */)
 {
-    struct sr_if* iface = sr_get_interface(sr, interface);
     struct sr_ethernet_hdr* e_hdr = 0;
     struct sr_arphdr*       a_hdr = 0;
 
@@ -0,0 +1,497 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_worker.c
+ *
+ * Description:
+ *
+ * Forwarding workers, see sr_worker.h.
+ *
+ *---------------------------------------------------------------------------*/
+
+#define _GNU_SOURCE  /* pthread_setaffinity_np, usleep and posix_memalign */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <sched.h>
+
+#include "sr_router.h"
+#include "sr_if.h"
+#include "sr_fib.h"
+#include "sr_adj.h"
+#include "sr_hash.h"
+#include "sr_cksum.h"
+#include "sr_graph.h"
+#include "sr_rx.h"
+#include "sr_tx.h"
+#include "sr_worker.h"
+#include "sr_epoch.h"
+#include "sr_counters.h"
+#include "sr_hist.h"
+#include "includes.h"
+
+/*---------------------------------------------------------------------
+ * Method: sr_worker_hash(..)
+ * Scope:  Local
+ *
+ * Flow hash of an IPv4 packet: addresses, protocol and, for the first
+ * (or only) fragment of a TCP or UDP packet, the ports.  Later fragments
+ * carry no ports, so fragmented packets are hashed on the addresses and
+ * protocol alone to keep every fragment with its flow.  Mixed with the
+ * murmur3 finalizer (sr_hash32) so that neighboring addresses spread out.
+ *
+ *---------------------------------------------------------------------*/
+
+static uint32_t sr_worker_hash(const struct ip* iphdr, unsigned int len)
+{
+    uint32_t h, ports = 0;
+
+    h = iphdr->ip_src.s_addr ^ (iphdr->ip_dst.s_addr * 0x9e3779b1U) ^
+        iphdr->ip_p;
+
+    if((iphdr->ip_p == TCP_PROTOCOL || iphdr->ip_p == UDP_PROTOCOL) &&
+       (ntohs(iphdr->ip_off) & (IP_MF | IP_OFFMASK)) == 0 &&
+       len >= (unsigned int)iphdr->ip_hl * 4 + sizeof(ports))
+    {
+        memcpy(&ports, (const uint8_t*)iphdr + iphdr->ip_hl * 4,
+               sizeof(ports));
+        h ^= ports * 0x85ebca6bU;
+    }
+
+    return sr_hash32(h);
+} /* -- sr_worker_hash -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_worker_forward(..)
+ * Scope:  Local
+ *
+ * Forward one frame if it can be done without touching anything but
+ * the frame.  Returns its verdict; punted frames are left as they were.
+ * The checks follow ip4-input, ip4-lookup and ip4-rewrite in
+ * sr_router.c, which get the packets that fail them.
+ *
+ *---------------------------------------------------------------------*/
+
+static unsigned int sr_worker_forward(struct sr_worker* w,
+                                      struct sr_desc* desc, time_t now)
+{
+    struct sr_instance* sr = w->sr;
+    struct ip* iphdr = (struct ip*)(desc->frame + sizeof(struct sr_ethernet_hdr));
+    struct sr_fib_route* route = 0;
+    struct sr_adj* adj = 0;
+    uint32_t dst;
+
+    if(desc->len < sizeof(struct sr_ethernet_hdr) + sizeof(struct ip) ||
+       iphdr->ip_v != 4 || iphdr->ip_hl != 5 ||
+       sr_cksum(iphdr, sizeof(struct ip)) != 0 ||
+       iphdr->ip_ttl < 2)
+    { return SR_DESC_PUNT; }
+
+    switch(iphdr->ip_p)
+    {
+        case IPPROTO_ICMP:
+            if(desc->len < sizeof(struct sr_ethernet_hdr) + sizeof(struct ip) +
+                           sizeof(struct icmpPayload))
+            { return SR_DESC_PUNT; }
+            break;
+        case TCP_PROTOCOL:
+        case UDP_PROTOCOL:
+            break;
+        default:
+            return SR_DESC_PUNT;
+    }
+
+    dst = iphdr->ip_dst.s_addr;
+    if(sr_get_interface_by_ip(sr, dst))
+    { return SR_DESC_PUNT; }
+
+    /* -- as findAdjacency, except that only the reader binds adjacencies -- */
+    route = sr_fib_lookup(__atomic_load_n(&sr->fib, __ATOMIC_ACQUIRE), dst);
+    if(route && route->gw.s_addr != 0)
+    {
+        adj = __atomic_load_n(&route->adj, __ATOMIC_ACQUIRE);
+        if(adj == 0)
+        { adj = sr_adj_find(sr->adj, route->gw.s_addr); }
+        if(!sr_adj_usable(adj, now))
+        { adj = 0; }
+    }
+    if(adj == 0)
+    {
+        adj = sr_adj_find(sr->adj, dst);
+        if(!sr_adj_usable(adj, now))
+        { return SR_DESC_PUNT; }
+    }
+
+    sr_count(SR_EV_ARP_HIT);
+    sr_ip_set_ttl(iphdr, iphdr->ip_ttl - 1);
+    forwardPacket(sr, desc->frame, desc->len, dst, 0, adj);
+
+    return SR_DESC_DONE;
+} /* -- sr_worker_forward -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_worker_run(..)
+ * Scope:  Local
+ *
+ * Worker thread.  Takes a vector of frames off its ring at a time,
+ * flushes what it sent, then hands the descriptors back.  When the ring
+ * stays empty it naps rather than spin a core flat out.
+ *
+ *---------------------------------------------------------------------*/
+
+static void* sr_worker_run(void* arg)
+{
+    struct sr_worker* w = (struct sr_worker*)arg;
+    struct sr_desc descs[SR_VECTOR_SIZE];
+    unsigned int i, n, idle = 0;
+    uint64_t start, t0;
+    time_t now;
+    char name[16];
+
+    sprintf(name, "worker %u", w->id);
+    sr_counters_register(name);
+
+    while(!w->stop)
+    {
+        for(n = 0; n < SR_VECTOR_SIZE && sr_ring_pop(&w->in, &descs[n]); ++n);
+
+        if(n == 0)
+        {
+            if(++idle >= SR_WORKER_SPIN)
+            { usleep(SR_WORKER_NAP); }
+            continue;
+        }
+        idle = 0;
+
+        start = sr_graph_clock();
+        t0    = sr_hist_on ? start : 0;
+        now   = time(0);
+        sr_epoch_enter(w->sr->epoch, w->reader);
+
+        for(i = 0; i < n; ++i)
+        {
+            if(i + 1 < n)
+            { __builtin_prefetch(descs[i + 1].frame +
+                                 sizeof(struct sr_ethernet_hdr)); }
+
+            descs[i].verdict = sr_worker_forward(w, &descs[i], now);
+            if(descs[i].verdict == SR_DESC_DONE)
+            {
+                ++w->forwarded;
+                sr_hist_since(SR_HIST_TRANSIT, t0);
+            }
+            else
+            { ++w->punted; }
+        }
+        sr_epoch_exit(w->reader);
+        sr_tx_flush(w->sr->tx);
+
+        w->packets += n;
+        ++w->vectors;
+        w->cycles += sr_graph_clock() - start;
+
+        /* -- the reader never has more in flight than the ring holds -- */
+        for(i = 0; i < n; ++i)
+        {
+            while(!sr_ring_push(&w->out, &descs[i]));
+        }
+    }
+
+    return 0;
+} /* -- sr_worker_run -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_workers_start(..)
+ * Scope:  Global
+ *
+ * Start n workers.  If cpus are given worker i is pinned to
+ * cpus[i % ncpus].  Must be called once the connection to the server is
+ * up, since the workers send through it.  Returns 0, or -1 on error.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_workers_start(struct sr_instance* sr, unsigned int n,
+                     const int* cpus, unsigned int ncpus)
+{
+    struct sr_workers* workers = 0;
+    struct sr_worker* w = 0;
+    void* mem = 0;
+    unsigned int i;
+
+    /* -- REQUIRES -- */
+    assert(sr);
+    assert(sr->tx);
+    assert(n > 0 && n <= SR_WORKER_MAX);
+
+    workers = (struct sr_workers*)calloc(1, sizeof(struct sr_workers));
+    if(workers == 0 ||
+       posix_memalign(&mem, SR_CACHE_LINE, n * sizeof(struct sr_worker)) != 0)
+    {
+        fprintf(stderr, "Error: no memory for %u workers\n", n);
+        free(workers);
+        return -1;
+    }
+    memset(mem, 0, n * sizeof(struct sr_worker));
+    workers->w = (struct sr_worker*)mem;
+    workers->n = n;
+
+    /* -- from here on more than one thread sends -- */
+    sr->tx->shared = 1;
+    sr->workers = workers;
+
+    for(i = 0; i < n; ++i)
+    {
+        w = &workers->w[i];
+        sr_ring_init(&w->in, SR_WORKER_RING);
+        sr_ring_init(&w->out, SR_WORKER_RING);
+        w->sr  = sr;
+        w->id  = i;
+        w->cpu = ncpus ? cpus[i % ncpus] : -1;
+        w->reader = sr_epoch_register(sr->epoch);
+        assert(w->reader);
+
+        if(pthread_create(&w->thread, 0, sr_worker_run, w) != 0)
+        {
+            perror("pthread_create(..):sr_worker.c::sr_workers_start");
+            workers->n = i;
+            sr_workers_stop(sr);
+            return -1;
+        }
+
+#ifdef _LINUX_
+        if(w->cpu >= 0)
+        {
+            cpu_set_t set;
+
+            CPU_ZERO(&set);
+            CPU_SET(w->cpu, &set);
+            if(pthread_setaffinity_np(w->thread, sizeof(set), &set) != 0)
+            { fprintf(stderr, "Warning: can't pin worker %u to cpu %d\n",
+                      i, w->cpu); }
+        }
+#endif /* _LINUX_ */
+    }
+
+    return 0;
+} /* -- sr_workers_start -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_workers_pick(..)
+ * Scope:  Local
+ *
+ * The worker an IPv4 frame's flow belongs to, 0 for anything else.
+ *
+ *---------------------------------------------------------------------*/
+
+static struct sr_worker* sr_workers_pick(struct sr_workers* workers,
+                                         uint8_t* frame, unsigned int len)
+{
+    struct sr_ethernet_hdr* ehdr = (struct sr_ethernet_hdr*)frame;
+
+    if(len < sizeof(struct sr_ethernet_hdr) + sizeof(struct ip) ||
+       ehdr->ether_type != htons(ETHERTYPE_IP))
+    { return 0; }
+
+    return &workers->w[sr_worker_hash((struct ip*)(frame +
+                                      sizeof(struct sr_ethernet_hdr)),
+                                      len - sizeof(struct sr_ethernet_hdr)) %
+                       workers->n];
+} /* -- sr_workers_pick -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_workers_dispatch(..)
+ * Scope:  Global
+ *
+ * Hand the frame the receive ring just parsed to the worker its flow
+ * belongs to.  Returns 1 if the frame was taken, 0 if the caller should
+ * handle it itself and SR_WORKERS_BUSY if the worker's ring is full.
+ * Busy doesn't reap: the caller first deals with the frames it still
+ * holds, then waits with sr_workers_wait(..) and tries again.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_workers_dispatch(struct sr_instance* sr, uint8_t* frame,
+                        unsigned int len, unsigned int ifindex)
+{
+    struct sr_workers* workers = sr->workers;
+    struct sr_worker* w = 0;
+    struct sr_desc desc;
+
+    /* -- REQUIRES -- */
+    assert(workers);
+    assert(frame);
+
+    if((w = sr_workers_pick(workers, frame, len)) == 0)
+    { return 0; }
+
+    if(w->inflight == SR_WORKER_RING)
+    { return SR_WORKERS_BUSY; }
+
+    desc.frame   = frame;
+    desc.len     = len;
+    desc.ifindex = ifindex;
+    desc.verdict = SR_DESC_PUNT;
+    desc.rxbuf   = sr_rx_hold(sr->rx);
+
+    /* -- can't fail, the ring has room for everything in flight -- */
+    sr_ring_push(&w->in, &desc);
+    ++w->inflight;
+    ++workers->inflight;
+    ++workers->dispatched;
+
+    return 1;
+} /* -- sr_workers_dispatch -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_workers_wait(..)
+ * Scope:  Global
+ *
+ * Reap until the worker the frame would go to has room again.  The
+ * server is on the other end of a TCP stream, so rather than drop the
+ * frame the reader waits for the worker; the stream backs up instead.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_workers_wait(struct sr_instance* sr, uint8_t* frame, unsigned int len)
+{
+    struct sr_workers* workers = sr->workers;
+    struct sr_worker* w = 0;
+
+    /* -- REQUIRES -- */
+    assert(workers);
+    assert(frame);
+
+    if((w = sr_workers_pick(workers, frame, len)) == 0)
+    { return; }
+
+    ++workers->stalls;
+    for(;;)
+    {
+        sr_workers_reap(sr);
+        if(w->inflight < SR_WORKER_RING)
+        { break; }
+        sched_yield();
+    }
+} /* -- sr_workers_wait -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_workers_reap(..)
+ * Scope:  Global
+ *
+ * Take back the frames the workers are done with.  Punted frames go
+ * through the packet graph, a vector at a time.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_workers_reap(struct sr_instance* sr)
+{
+    struct sr_workers* workers = sr->workers;
+    struct sr_pkt pkts[SR_VECTOR_SIZE];
+    struct sr_rxbuf* bufs[SR_VECTOR_SIZE];
+    struct sr_desc desc;
+    unsigned int i, j, npkts = 0;
+
+    /* -- REQUIRES -- */
+    assert(workers);
+
+    for(i = 0; i < workers->n; ++i)
+    {
+        while(sr_ring_pop(&workers->w[i].out, &desc))
+        {
+            --workers->w[i].inflight;
+            --workers->inflight;
+
+            if(desc.verdict == SR_DESC_DONE)
+            {
+                sr_rx_put(sr->rx, desc.rxbuf);
+                continue;
+            }
+
+            pkts[npkts].buf     = desc.frame;
+            pkts[npkts].len     = desc.len;
+            pkts[npkts].ifindex = desc.ifindex;
+            bufs[npkts]         = desc.rxbuf;
+            if(++npkts == SR_VECTOR_SIZE)
+            {
+                sr_handlepackets(sr, pkts, npkts);
+                for(j = 0; j < npkts; ++j)
+                { sr_rx_put(sr->rx, bufs[j]); }
+                npkts = 0;
+            }
+        }
+    }
+
+    if(npkts > 0)
+    {
+        sr_handlepackets(sr, pkts, npkts);
+        for(j = 0; j < npkts; ++j)
+        { sr_rx_put(sr->rx, bufs[j]); }
+    }
+} /* -- sr_workers_reap -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_workers_stop(..)
+ * Scope:  Global
+ *
+ * Stop and join the workers, once they have handed back everything in
+ * flight.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_workers_stop(struct sr_instance* sr)
+{
+    struct sr_workers* workers = sr->workers;
+    unsigned int i;
+
+    /* -- REQUIRES -- */
+    assert(workers);
+
+    while(workers->inflight > 0)
+    {
+        sr_workers_reap(sr);
+        if(workers->inflight > 0)
+        { usleep(SR_WORKER_NAP); }
+    }
+
+    for(i = 0; i < workers->n; ++i)
+    { workers->w[i].stop = 1; }
+    for(i = 0; i < workers->n; ++i)
+    { pthread_join(workers->w[i].thread, 0); }
+
+    sr_tx_flush(sr->tx);
+} /* -- sr_workers_stop -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_workers_print_stats(..)
+ * Scope:  Global
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_workers_print_stats(const struct sr_workers* workers, FILE* out)
+{
+    const struct sr_worker* w = 0;
+    unsigned int i;
+
+    /* -- REQUIRES -- */
+    assert(workers);
+    assert(out);
+
+    fprintf(out, "workers: %u, %lu packets dispatched, %lu stalls, "
+            "%u in flight\n", workers->n,
+            (unsigned long)workers->dispatched,
+            (unsigned long)workers->stalls, workers->inflight);
+
+    for(i = 0; i < workers->n; ++i)
+    {
+        w = &workers->w[i];
+        fprintf(out, "  worker %-2u cpu %-3d %10lu packets %10lu forwarded "
+                "%8lu punted %8lu vectors %6.1f pkts/vector %8.1f "
+                "cycles/pkt\n", w->id, w->cpu,
+                (unsigned long)w->packets, (unsigned long)w->forwarded,
+                (unsigned long)w->punted, (unsigned long)w->vectors,
+                w->vectors ? (double)w->packets / w->vectors : 0.0,
+                w->packets ? (double)w->cycles / w->packets : 0.0);
+    }
+} /* -- sr_workers_print_stats -- */
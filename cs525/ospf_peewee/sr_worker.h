@@ -0,0 +1,100 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_worker.h
+ *
+ * Description:
+ *
+ * Forwarding workers (sr -w n).  The thread reading from the server stays
+ * the only one to parse commands, but rather than forwarding every packet
+ * itself it deals IPv4 frames out to n worker threads, picking the worker
+ * by a hash of the packet's 5-tuple so that all packets of a flow go to
+ * the same worker and leave in the order they came.  Each worker has an
+ * SPSC ring in and one back out (see sr_ring.h); nothing is locked on the
+ * way.
+ *
+ * A worker only takes the fast path: a well formed IPv4 packet, not for
+ * us, with TTL to spare and a resolved next hop.  It decrements the TTL,
+ * puts the next hop's header on and sends the frame through the shared
+ * transmit batch (see sr_tx.h).  Anything else - ARP, PWOSPF, ICMP for
+ * us, TTL expiry, unresolved next hops - is punted back untouched and the
+ * reader runs it through the packet graph as before, so the forwarding
+ * tables are still only ever changed by the reader (and PWOSPF).
+ *
+ * Frames stay in the receive buffer they arrived in; the reader takes a
+ * reference for each one it dispatches and drops it when the frame comes
+ * back.  Tables are read inside an epoch read section (see sr_epoch.h)
+ * that lasts one vector.  Each worker keeps its own counters.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_WORKER_H
+#define SR_WORKER_H
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif /* _DARWIN_ */
+
+#include <stdio.h>
+#include <pthread.h>
+
+#include "sr_ring.h"
+
+#define SR_WORKER_MAX   16    /* most workers sr -w will start */
+#define SR_WORKER_RING  1024  /* descriptors per ring, power of two */
+#define SR_WORKER_SPIN  1024  /* empty polls before a worker naps */
+#define SR_WORKER_NAP   50    /* us a worker naps for */
+
+/* -- descriptor verdicts -- */
+#define SR_DESC_DONE    0     /* forwarded by the worker */
+#define SR_DESC_PUNT    1     /* for the reader's packet graph */
+
+#define SR_WORKERS_BUSY (-1)  /* sr_workers_dispatch: the worker is full */
+
+struct sr_instance;
+struct sr_epoch_reader;
+
+struct sr_worker
+{
+    struct sr_ring      in;       /* reader -> worker */
+    struct sr_ring      out;      /* worker -> reader */
+    struct sr_instance* sr;
+    pthread_t           thread;
+    unsigned int        id;
+    int                 cpu;      /* pinned to, or -1 */
+    struct sr_epoch_reader* reader; /* read section, see sr_epoch.h */
+    unsigned int        inflight; /* dispatched, not yet reaped (reader) */
+    volatile int        stop;
+
+    /* -- statistics, written by the worker only -- */
+    uint64_t            packets;
+    uint64_t            forwarded;
+    uint64_t            punted;
+    uint64_t            vectors;
+    uint64_t            cycles;
+} __attribute__((aligned(SR_CACHE_LINE)));
+
+struct sr_workers
+{
+    struct sr_worker* w;
+    unsigned int      n;
+    unsigned int      inflight;   /* over all workers */
+
+    /* -- statistics, reader -- */
+    uint64_t          dispatched;
+    uint64_t          stalls;     /* waits for a worker with a full ring */
+};
+
+int  sr_workers_start(struct sr_instance* sr, unsigned int n,
+                      const int* cpus, unsigned int ncpus);
+int  sr_workers_dispatch(struct sr_instance* sr, uint8_t* frame,
+                         unsigned int len, unsigned int ifindex);
+void sr_workers_wait(struct sr_instance* sr, uint8_t* frame,
+                     unsigned int len);
+void sr_workers_reap(struct sr_instance* sr);
+void sr_workers_stop(struct sr_instance* sr);
+void sr_workers_print_stats(const struct sr_workers* workers, FILE* out);
+
+#endif /* -- SR_WORKER_H -- */
@@ -0,0 +1,673 @@
+/*-----------------------------------------------------------------------------
+ * file:  vns_host.c
+ *
+ * Description:
+ *
+ * Emulated hosts for the local VNS stand-in, see vns_host.h.  Frames are
+ * handled the moment they arrive, from vns_topo_send, and anything a host
+ * sends in return goes straight back onto its link.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "sr_protocol.h"
+#include "sr_cksum.h"
+#include "vns_host.h"
+
+#define VNS_ETH_LEN   sizeof(struct sr_ethernet_hdr)
+#define VNS_IP_LEN    sizeof(struct ip)
+#define VNS_PING_LEN  56   /* echo payload, as ping(8) sends */
+#define VNS_TTL       64
+#define VNS_NS        1000000000ULL
+
+struct vns_icmp
+{
+    uint8_t  type;
+    uint8_t  code;
+    uint16_t sum;
+    uint16_t id;
+    uint16_t seq;
+} __attribute__ ((packed));
+
+struct vns_udp
+{
+    uint16_t sport;
+    uint16_t dport;
+    uint16_t len;
+    uint16_t sum;
+} __attribute__ ((packed));
+
+/* -- what a flow datagram or echo request carries, in host order -- */
+struct vns_stamp
+{
+    uint32_t id;
+    uint32_t seq;
+    uint64_t sent;   /* ns */
+} __attribute__ ((packed));
+
+static const uint8_t vns_bcast[6] = { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff };
+
+/*---------------------------------------------------------------------
+ * Method: vns_host_create(..)
+ * Scope:  Global
+ *
+ * Addresses in network byte order.  The MAC is left zero for
+ * vns_topo_load to fill in.
+ *
+ *---------------------------------------------------------------------*/
+
+struct vns_host* vns_host_create(const char* name, uint32_t ip, uint32_t mask,
+                                 uint32_t gw, int proxy)
+{
+    struct vns_host* host = 0;
+
+    /* -- REQUIRES -- */
+    assert(name);
+
+    host = (struct vns_host*)calloc(1, sizeof(struct vns_host));
+    assert(host);
+
+    strncpy(host->name, name, VNS_NAME_MAX - 1);
+    strncpy(host->port.name, "eth0", VNS_IFNAME_MAX - 1);
+    host->port.ip   = ip;
+    host->port.mask = mask;
+    host->port.host = host;
+    host->gw        = gw;
+    host->proxy     = proxy;
+
+    return host;
+} /* -- vns_host_create -- */
+
+/*---------------------------------------------------------------------
+ * Method: vns_host_arp_send(..)
+ * Scope:  Local
+ *
+ *---------------------------------------------------------------------*/
+
+static void vns_host_arp_send(struct vns_topo* topo, struct vns_host* host,
+                              uint16_t op, const uint8_t* tha, uint32_t sip,
+                              uint32_t tip, uint64_t now)
+{
+    uint8_t frame[VNS_ETH_LEN + sizeof(struct sr_arphdr)];
+    struct sr_ethernet_hdr* eth = (struct sr_ethernet_hdr*)frame;
+    struct sr_arphdr* arp = (struct sr_arphdr*)(frame + VNS_ETH_LEN);
+
+    memcpy(eth->ether_dhost, op == ARP_REQUEST ? vns_bcast : tha, 6);
+    memcpy(eth->ether_shost, host->port.mac, 6);
+    eth->ether_type = htons(ETHERTYPE_ARP);
+
+    arp->ar_hrd = htons(ARPHDR_ETHER);
+    arp->ar_pro = htons(ETHERTYPE_IP);
+    arp->ar_hln = 6;
+    arp->ar_pln = 4;
+    arp->ar_op  = htons(op);
+    memcpy(arp->ar_sha, host->port.mac, 6);
+    arp->ar_sip = sip;
+    memcpy(arp->ar_tha, op == ARP_REQUEST ? vns_bcast : tha, 6);
+    arp->ar_tip = tip;
+
+    vns_topo_send(topo, &host->port, frame, sizeof(frame), now);
+} /* -- vns_host_arp_send -- */
+
+/*---------------------------------------------------------------------
+ * Method: vns_host_arp_find(..)
+ * Scope:  Local
+ *
+ *---------------------------------------------------------------------*/
+
+static struct vns_arp* vns_host_arp_find(struct vns_host* host, uint32_t ip)
+{
+    unsigned int i;
+
+    for(i = 0; i < VNS_ARP_MAX; ++i)
+    {
+        if(host->arp[i].ip == ip && (host->arp[i].valid ||
+                                     host->arp[i].requested))
+        { return &host->arp[i]; }
+    }
+
+    return 0;
+} /* -- vns_host_arp_find -- */
+
+/*---------------------------------------------------------------------
+ * Method: vns_host_output(..)
+ * Scope:  Local
+ *
+ * Send an IP packet, Ethernet header to be filled in.  Returns 0 if it
+ * went out, 1 if it waits for ARP.
+ *
+ *---------------------------------------------------------------------*/
+
+static int vns_host_output(struct vns_topo* topo, struct vns_host* host,
+                           uint8_t* frame, unsigned int len, uint64_t now)
+{
+    struct sr_ethernet_hdr* eth = (struct sr_ethernet_hdr*)frame;
+    struct ip* iphdr = (struct ip*)(frame + VNS_ETH_LEN);
+    struct vns_arp* arp = 0;
+    uint32_t nexthop = iphdr->ip_dst.s_addr;
+
+    if((nexthop & host->port.mask) != (host->port.ip & host->port.mask))
+    { nexthop = host->gw; }
+
+    memcpy(eth->ether_shost, host->port.mac, 6);
+    eth->ether_type = htons(ETHERTYPE_IP);
+
+    if((arp = vns_host_arp_find(host, nexthop)) && arp->valid)
+    {
+        memcpy(eth->ether_dhost, arp->mac, 6);
+        vns_topo_send(topo, &host->port, frame, len, now);
+        return 0;
+    }
+
+    if(arp == 0)
+    {
+        arp = &host->arp[host->narp];
+        host->narp = (host->narp + 1) % VNS_ARP_MAX;
+        if(arp->held_len)
+        { ++host->arp_dropped; }
+        memset(arp, 0, sizeof(struct vns_arp));
+        arp->ip = nexthop;
+    }
+    else if(arp->held_len)
+    { ++host->arp_dropped; }
+
+    assert(len <= VNS_FRAME_MAX);
+    memcpy(arp->held, frame, len);
+    arp->held_len = len;
+
+    if(arp->requested == 0 || now - arp->requested >= VNS_ARP_RETRY)
+    {
+        arp->requested = now;
+        vns_host_arp_send(topo, host, ARP_REQUEST, 0, host->port.ip, nexthop,
+                          now);
+    }
+
+    return 1;
+} /* -- vns_host_output -- */
+
+/*---------------------------------------------------------------------
+ * Method: vns_host_ip(..)
+ * Scope:  Local
+ *
+ * Fill in an IP header for a packet of len bytes past the Ethernet
+ * header.
+ *
+ *---------------------------------------------------------------------*/
+
+static void vns_host_ip(struct vns_host* host, uint8_t* frame,
+                        unsigned int len, uint8_t proto, uint32_t src,
+                        uint32_t dst)
+{
+    struct ip* iphdr = (struct ip*)(frame + VNS_ETH_LEN);
+
+    memset(iphdr, 0, VNS_IP_LEN);
+    iphdr->ip_v   = 4;
+    iphdr->ip_hl  = VNS_IP_LEN / 4;
+    iphdr->ip_len = htons(len);
+    iphdr->ip_id  = htons(host->ip_id++);
+    iphdr->ip_ttl = VNS_TTL;
+    iphdr->ip_p   = proto;
+    iphdr->ip_src.s_addr = src;
+    iphdr->ip_dst.s_addr = dst;
+    iphdr->ip_sum = sr_cksum(iphdr, VNS_IP_LEN);
+} /* -- vns_host_ip -- */
+
+/*---------------------------------------------------------------------
+ * Method: vns_host_arp_input(..)
+ * Scope:  Local
+ *
+ *---------------------------------------------------------------------*/
+
+static void vns_host_arp_input(struct vns_topo* topo, struct vns_host* host,
+                               const uint8_t* frame, unsigned int len,
+                               uint64_t now)
+{
+    const struct sr_arphdr* arp =
+        (const struct sr_arphdr*)(frame + VNS_ETH_LEN);
+    struct sr_ethernet_hdr* eth = 0;
+    struct vns_arp* entry = 0;
+
+    if(len < VNS_ETH_LEN + sizeof(struct sr_arphdr))
+    {
+        ++host->dropped;
+        return;
+    }
+
+    if((entry = vns_host_arp_find(host, arp->ar_sip)) != 0)
+    {
+        memcpy(entry->mac, arp->ar_sha, 6);
+        entry->valid = 1;
+        entry->requested = 0;
+        if(entry->held_len)
+        {
+            eth = (struct sr_ethernet_hdr*)entry->held;
+            memcpy(eth->ether_dhost, entry->mac, 6);
+            vns_topo_send(topo, &host->port, entry->held, entry->held_len,
+                          now);
+            entry->held_len = 0;
+        }
+    }
+
+    if(ntohs(arp->ar_op) == ARP_REQUEST &&
+       (arp->ar_tip == host->port.ip || host->proxy))
+    {
+        vns_host_arp_send(topo, host, ARP_REPLY, arp->ar_sha, arp->ar_tip,
+                          arp->ar_sip, now);
+    }
+} /* -- vns_host_arp_input -- */
+
+/*---------------------------------------------------------------------
+ * Method: vns_host_unreach(..)
+ * Scope:  Local
+ *
+ * Port unreachable for the packet at frame, as traceroute expects.
+ *
+ *---------------------------------------------------------------------*/
+
+static void vns_host_unreach(struct vns_topo* topo, struct vns_host* host,
+                             const uint8_t* frame, uint64_t now)
+{
+    uint8_t out[VNS_ETH_LEN + VNS_IP_LEN + sizeof(struct vns_icmp) +
+                VNS_IP_LEN + 8];
+    const struct ip* iphdr = (const struct ip*)(frame + VNS_ETH_LEN);
+    struct vns_icmp* icmp = (struct vns_icmp*)(out + VNS_ETH_LEN + VNS_IP_LEN);
+    unsigned int icmp_len = sizeof(out) - VNS_ETH_LEN - VNS_IP_LEN;
+
+    memset(icmp, 0, icmp_len);
+    icmp->type = 3;
+    icmp->code = 3;
+    memcpy(icmp + 1, iphdr, VNS_IP_LEN + 8);
+    icmp->sum = sr_cksum(icmp, icmp_len);
+
+    vns_host_ip(host, out, VNS_IP_LEN + icmp_len, IPPROTO_ICMP,
+                iphdr->ip_dst.s_addr, iphdr->ip_src.s_addr);
+    vns_host_output(topo, host, out, sizeof(out), now);
+    ++host->unreach;
+} /* -- vns_host_unreach -- */
+
+/*---------------------------------------------------------------------
+ * Method: vns_host_ping_of(..)
+ * Scope:  Local
+ *
+ * The ping of this host an echo id belongs to, or 0.
+ *
+ *---------------------------------------------------------------------*/
+
+static struct vns_ping* vns_host_ping_of(struct vns_topo* topo,
+                                         struct vns_host* host, uint16_t id)
+{
+    unsigned int i = (uint16_t)(ntohs(id) - VNS_PING_ID);
+
+    if(i >= topo->npings || topo->pings[i].src != host)
+    { return 0; }
+
+    return &topo->pings[i];
+} /* -- vns_host_ping_of -- */
+
+/*---------------------------------------------------------------------
+ * Method: vns_host_icmp_input(..)
+ * Scope:  Local
+ *
+ *---------------------------------------------------------------------*/
+
+static void vns_host_icmp_input(struct vns_topo* topo, struct vns_host* host,
+                                uint8_t* frame, unsigned int len, uint64_t now)
+{
+    struct ip* iphdr = (struct ip*)(frame + VNS_ETH_LEN);
+    struct vns_icmp* icmp = (struct vns_icmp*)(frame + VNS_ETH_LEN + VNS_IP_LEN);
+    unsigned int icmp_len = len - VNS_ETH_LEN - VNS_IP_LEN;
+    const struct ip* inner = (const struct ip*)(icmp + 1);
+    const struct vns_icmp* inner_icmp = (const struct vns_icmp*)(inner + 1);
+    struct vns_stamp stamp;
+    struct vns_ping* ping = 0;
+    uint32_t src;
+    uint64_t t, rtt;
+
+    if(icmp_len < sizeof(struct vns_icmp) || sr_cksum(icmp, icmp_len) != 0)
+    {
+        ++host->dropped;
+        return;
+    }
+
+    switch(icmp->type)
+    {
+        case 8: /* -- echo request: answer in place -- */
+            src = iphdr->ip_dst.s_addr;
+            icmp->sum = sr_cksum_set8(icmp->sum, icmp, &icmp->type, 0);
+            vns_host_ip(host, frame, len - VNS_ETH_LEN, IPPROTO_ICMP, src,
+                        iphdr->ip_src.s_addr);
+            vns_host_output(topo, host, frame, len, now);
+            ++host->echoes;
+            break;
+
+        case 0:
+            if((ping = vns_host_ping_of(topo, host, icmp->id)) == 0 ||
+               icmp_len < sizeof(struct vns_icmp) + sizeof(stamp))
+            {
+                ++host->dropped;
+                break;
+            }
+            memcpy(&stamp, icmp + 1, sizeof(stamp));
+            rtt = now - stamp.sent;
+            t = now - topo->up;
+
+            ++ping->replies;
+            ping->rtt_sum += rtt;
+            if(rtt > ping->rtt_max)
+            { ping->rtt_max = rtt; }
+            if(ping->first == 0)
+            { ping->first = t; }
+            else if(t - ping->last > ping->outage)
+            { ping->outage = t - ping->last; }
+            ping->last = t;
+            break;
+
+        case 3:
+        case 11:
+            ++host->icmp_errors;
+            if(icmp_len >= sizeof(struct vns_icmp) + VNS_IP_LEN + 8 &&
+               inner->ip_p == IPPROTO_ICMP &&
+               (ping = vns_host_ping_of(topo, host, inner_icmp->id)) != 0)
+            { ++ping->errors; }
+            break;
+
+        default:
+            ++host->dropped;
+    }
+} /* -- vns_host_icmp_input -- */
+
+/*---------------------------------------------------------------------
+ * Method: vns_host_udp_input(..)
+ * Scope:  Local
+ *
+ *---------------------------------------------------------------------*/
+
+static void vns_host_udp_input(struct vns_topo* topo, struct vns_host* host,
+                               uint8_t* frame, unsigned int len, uint64_t now)
+{
+    const struct vns_udp* udp =
+        (const struct vns_udp*)(frame + VNS_ETH_LEN + VNS_IP_LEN);
+    struct vns_stamp stamp;
+    struct vns_flow* flow = 0;
+    uint64_t lat;
+
+    if(len < VNS_ETH_LEN + VNS_IP_LEN + sizeof(struct vns_udp))
+    {
+        ++host->dropped;
+        return;
+    }
+
+    if(ntohs(udp->dport) != VNS_FLOW_PORT)
+    {
+        vns_host_unreach(topo, host, frame, now);
+        return;
+    }
+
+    memcpy(&stamp, udp + 1, sizeof(stamp));
+    if(len < VNS_ETH_LEN + VNS_IP_LEN + sizeof(struct vns_udp) + sizeof(stamp)
+       || stamp.id >= topo->nflows || topo->flows[stamp.id].dst != host)
+    {
+        ++host->dropped;
+        return;
+    }
+
+    flow = &topo->flows[stamp.id];
+    lat  = now - stamp.sent;
+
+    ++flow->received;
+    if(stamp.seq < flow->next)
+    { ++flow->reordered; }
+    else
+    { flow->next = stamp.seq + 1; }
+    flow->lat_sum += lat;
+    if(lat > flow->lat_max)
+    { flow->lat_max = lat; }
+} /* -- vns_host_udp_input -- */
+
+/*---------------------------------------------------------------------
+ * Method: vns_host_input(..)
+ * Scope:  Global
+ *
+ * A frame arriving on the host's link.  It may be modified and sent
+ * back out.
+ *
+ *---------------------------------------------------------------------*/
+
+void vns_host_input(struct vns_topo* topo, struct vns_host* host,
+                    const uint8_t* frame, unsigned int len, uint64_t now)
+{
+    uint8_t copy[VNS_FRAME_MAX];
+    const struct sr_ethernet_hdr* eth = (const struct sr_ethernet_hdr*)frame;
+    struct ip* iphdr = (struct ip*)(copy + VNS_ETH_LEN);
+    uint32_t dst;
+
+    /* -- REQUIRES -- */
+    assert(topo);
+    assert(host);
+    assert(frame);
+
+    if(len < VNS_ETH_LEN || len > VNS_FRAME_MAX ||
+       (memcmp(eth->ether_dhost, host->port.mac, 6) != 0 &&
+        memcmp(eth->ether_dhost, vns_bcast, 6) != 0))
+    { return; }
+
+    if(ntohs(eth->ether_type) == ETHERTYPE_ARP)
+    {
+        vns_host_arp_input(topo, host, frame, len, now);
+        return;
+    }
+
+    if(ntohs(eth->ether_type) != ETHERTYPE_IP ||
+       len < VNS_ETH_LEN + VNS_IP_LEN)
+    {
+        ++host->dropped;
+        return;
+    }
+
+    /* -- replies are built in place, so work on a copy -- */
+    memcpy(copy, frame, len);
+    dst = iphdr->ip_dst.s_addr;
+
+    /* -- PWOSPF hellos and the like are not for hosts -- */
+    if((ntohl(dst) & 0xf0000000) == 0xe0000000)
+    { return; }
+
+    if(iphdr->ip_hl != VNS_IP_LEN / 4 || sr_cksum(iphdr, VNS_IP_LEN) != 0 ||
+       ntohs(iphdr->ip_len) + VNS_ETH_LEN > len ||
+       (dst != host->port.ip && !host->proxy))
+    {
+        ++host->dropped;
+        return;
+    }
+
+    ++host->received;
+    len = ntohs(iphdr->ip_len) + VNS_ETH_LEN;
+
+    switch(iphdr->ip_p)
+    {
+        case IPPROTO_ICMP:
+            vns_host_icmp_input(topo, host, copy, len, now);
+            break;
+        case IPPROTO_UDP:
+            vns_host_udp_input(topo, host, copy, len, now);
+            break;
+        default:
+            ++host->dropped;
+    }
+} /* -- vns_host_input -- */
+
+/*---------------------------------------------------------------------
+ * Method: vns_host_flow_send(..)
+ * Scope:  Local
+ *
+ *---------------------------------------------------------------------*/
+
+static void vns_host_flow_send(struct vns_topo* topo, struct vns_flow* flow,
+                               uint64_t now)
+{
+    uint8_t frame[VNS_FRAME_MAX];
+    struct vns_udp* udp = (struct vns_udp*)(frame + VNS_ETH_LEN + VNS_IP_LEN);
+    struct vns_stamp stamp;
+    unsigned int len = VNS_IP_LEN + sizeof(struct vns_udp) + flow->bytes;
+
+    stamp.id   = (uint32_t)(flow - topo->flows);
+    stamp.seq  = (uint32_t)(flow->sent + flow->unresolved);
+    stamp.sent = now;
+
+    udp->sport = htons(VNS_FLOW_PORT + 1 + stamp.id);
+    udp->dport = htons(VNS_FLOW_PORT);
+    udp->len   = htons(sizeof(struct vns_udp) + flow->bytes);
+    udp->sum   = 0;
+    memset(udp + 1, 0, flow->bytes);
+    memcpy(udp + 1, &stamp, sizeof(stamp));
+
+    vns_host_ip(flow->src, frame, len, IPPROTO_UDP, flow->src->port.ip,
+                flow->dst->port.ip);
+
+    if(vns_host_output(topo, flow->src, frame, VNS_ETH_LEN + len, now))
+    { ++flow->unresolved; }
+    else
+    { ++flow->sent; }
+} /* -- vns_host_flow_send -- */
+
+/*---------------------------------------------------------------------
+ * Method: vns_host_ping_send(..)
+ * Scope:  Local
+ *
+ *---------------------------------------------------------------------*/
+
+static void vns_host_ping_send(struct vns_topo* topo, struct vns_ping* ping,
+                               uint64_t now)
+{
+    uint8_t frame[VNS_ETH_LEN + VNS_IP_LEN + sizeof(struct vns_icmp) +
+                  VNS_PING_LEN];
+    struct vns_icmp* icmp = (struct vns_icmp*)(frame + VNS_ETH_LEN + VNS_IP_LEN);
+    unsigned int icmp_len = sizeof(struct vns_icmp) + VNS_PING_LEN;
+    struct vns_stamp stamp;
+
+    stamp.id   = (uint32_t)(ping - topo->pings);
+    stamp.seq  = ping->seq;
+    stamp.sent = now;
+
+    memset(icmp, 0, icmp_len);
+    icmp->type = 8;
+    icmp->id   = htons(VNS_PING_ID + stamp.id);
+    icmp->seq  = htons(ping->seq++);
+    memcpy(icmp + 1, &stamp, sizeof(stamp));
+    icmp->sum  = sr_cksum(icmp, icmp_len);
+
+    vns_host_ip(ping->src, frame, VNS_IP_LEN + icmp_len, IPPROTO_ICMP,
+                ping->src->port.ip, ping->dst);
+    vns_host_output(topo, ping->src, frame, sizeof(frame), now);
+    ++ping->sent;
+} /* -- vns_host_ping_send -- */
+
+/*---------------------------------------------------------------------
+ * Method: vns_host_tick(..)
+ * Scope:  Global
+ *
+ * Send whatever flow packets and pings are due.  A flow that fell
+ * behind catches up at most VNS_BURST_MAX packets at a time.
+ *
+ *---------------------------------------------------------------------*/
+
+void vns_host_tick(struct vns_topo* topo, uint64_t now)
+{
+    struct vns_flow* flow = 0;
+    struct vns_ping* ping = 0;
+    uint64_t due;
+    unsigned int i, n;
+
+    /* -- REQUIRES -- */
+    assert(topo);
+
+    if(topo->up == 0)
+    { return; }
+
+    for(i = 0; i < topo->nflows; ++i)
+    {
+        flow = &topo->flows[i];
+        due  = (now - topo->up) / 1000 * flow->pps / 1000000;
+        for(n = 0; flow->sent + flow->unresolved < due && n < VNS_BURST_MAX;
+            ++n)
+        { vns_host_flow_send(topo, flow, now); }
+    }
+
+    for(i = 0; i < topo->npings; ++i)
+    {
+        ping = &topo->pings[i];
+        if(now < ping->next_at)
+        { continue; }
+        vns_host_ping_send(topo, ping, now);
+        ping->next_at = now + ping->interval * 1000000ULL;
+    }
+} /* -- vns_host_tick -- */
+
+/*---------------------------------------------------------------------
+ * Method: vns_host_print_stats(..)
+ * Scope:  Global
+ *
+ *---------------------------------------------------------------------*/
+
+void vns_host_print_stats(const struct vns_topo* topo, FILE* out)
+{
+    const struct vns_host* host = 0;
+    const struct vns_flow* flow = 0;
+    const struct vns_ping* ping = 0;
+    struct in_addr dst;
+    uint64_t sent;
+    unsigned int i;
+
+    /* -- REQUIRES -- */
+    assert(topo);
+    assert(out);
+
+    for(i = 0; i < topo->nhosts; ++i)
+    {
+        host = topo->hosts[i];
+        fprintf(out, "%-8s %lu received, %lu echoes answered, "
+                "%lu port unreachables sent, %lu ICMP errors, %lu dropped, "
+                "%lu lost waiting for ARP\n", host->name,
+                (unsigned long)host->received, (unsigned long)host->echoes,
+                (unsigned long)host->unreach, (unsigned long)host->icmp_errors,
+                (unsigned long)host->dropped, (unsigned long)host->arp_dropped);
+    }
+
+    for(i = 0; i < topo->nflows; ++i)
+    {
+        flow = &topo->flows[i];
+        sent = flow->sent + flow->unresolved;
+        fprintf(out, "flow %s -> %s: %lu sent, %lu received (%.2f%% lost), "
+                "%lu out of order, latency %.1f us avg %.1f us max\n",
+                flow->src->name, flow->dst->name, (unsigned long)sent,
+                (unsigned long)flow->received,
+                sent ? 100.0 * (sent - flow->received) / sent : 0.0,
+                (unsigned long)flow->reordered,
+                flow->received ? flow->lat_sum / 1e3 / flow->received : 0.0,
+                flow->lat_max / 1e3);
+    }
+
+    for(i = 0; i < topo->npings; ++i)
+    {
+        ping = &topo->pings[i];
+        dst.s_addr = ping->dst;
+        fprintf(out, "ping %s -> %s: %lu sent, %lu replies, %lu errors",
+                ping->src->name, inet_ntoa(dst), (unsigned long)ping->sent,
+                (unsigned long)ping->replies, (unsigned long)ping->errors);
+        if(ping->replies)
+        {
+            fprintf(out, ", first reply at %.3f s, longest gap %.0f ms, "
+                    "rtt %.1f us avg %.1f us max", ping->first / (double)VNS_NS,
+                    ping->outage / 1e6, ping->rtt_sum / 1e3 / ping->replies,
+                    ping->rtt_max / 1e3);
+        }
+        fputc('\n', out);
+    }
+} /* -- vns_host_print_stats -- */
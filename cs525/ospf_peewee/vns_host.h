@@ -0,0 +1,78 @@
+/*-----------------------------------------------------------------------------
+ * file:  vns_host.h
+ *
+ * Description:
+ *
+ * Emulated hosts for the local VNS stand-in, the app1 and app2 of the
+ * assignment topologies.  A host has one interface, a default gateway
+ * and just enough of a stack to be useful against a router:
+ *
+ *   - it answers ARP for its address and ARPs for its next hops, holding
+ *     the last packet for each until the reply comes,
+ *   - it answers pings, and traceroute probes with port unreachable,
+ *   - it sends and receives the ping and flow traffic of the topology
+ *     (see vns_topo.h), keeping count of what got through.
+ *
+ * TCP is not spoken; TCP segments are counted and dropped.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef VNS_HOST_H
+#define VNS_HOST_H
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif /* _DARWIN_ */
+
+#include <stdio.h>
+
+#include "vns_topo.h"
+
+#define VNS_ARP_MAX      16
+#define VNS_ARP_RETRY    1000000000ULL  /* ns between ARP requests */
+#define VNS_FLOW_PORT    5001           /* UDP port flows go to */
+#define VNS_PING_ID      0x5600         /* echo id of ping i is this + i */
+#define VNS_FRAME_MAX    1514
+#define VNS_BURST_MAX    64             /* flow packets sent per tick */
+
+struct vns_arp
+{
+    uint32_t ip;
+    uint8_t  mac[6];
+    uint64_t requested;  /* ns, while unresolved */
+    int      valid;
+    uint8_t  held[VNS_FRAME_MAX];  /* last frame waiting for the reply */
+    unsigned int held_len;
+};
+
+struct vns_host
+{
+    char            name[VNS_NAME_MAX];
+    struct vns_port port;
+    uint32_t        gw;      /* network byte order */
+    int             proxy;   /* answers for every address */
+    struct vns_arp  arp[VNS_ARP_MAX];
+    unsigned int    narp;    /* next slot to replace */
+    uint16_t        ip_id;
+
+    /* -- statistics -- */
+    uint64_t        received;
+    uint64_t        echoes;      /* echo requests answered */
+    uint64_t        unreach;     /* port unreachables sent */
+    uint64_t        icmp_errors; /* received */
+    uint64_t        dropped;     /* TCP, not for us or malformed */
+    uint64_t        arp_dropped; /* replaced while waiting for ARP */
+};
+
+struct vns_host* vns_host_create(const char* name, uint32_t ip, uint32_t mask,
+                                 uint32_t gw, int proxy);
+void vns_host_input(struct vns_topo* topo, struct vns_host* host,
+                    const uint8_t* frame, unsigned int len, uint64_t now);
+void vns_host_tick(struct vns_topo* topo, uint64_t now);
+void vns_host_print_stats(const struct vns_topo* topo, FILE* out);
+
+#endif /* -- VNS_HOST_H -- */
@@ -0,0 +1,647 @@
+/*-----------------------------------------------------------------------------
+ * file:  vns_server.c
+ *
+ * Description:
+ *
+ * A local stand-in for the VNS server, so a whole topology of routers can
+ * be run and measured on one machine:
+ *
+ *   ./vns -T topo9906.vns &
+ *   ./sr -s localhost -t 9906 -v vhost1 -r rtable.vhost1   (and so on)
+ *
+ * It speaks the server side of vnscommand.h.  A router opens a session
+ * with VNSOPEN naming its virtual host, gets its interfaces in VNSHWINFO
+ * and from then on exchanges Ethernet frames in VNSPACKETs.  Frames are
+ * switched across the links of the topology (vns_topo.c) to other routers
+ * or to emulated hosts (vns_host.c).  Once every router has connected the
+ * hosts start their pings and flows, and the statistics say what got
+ * through and how long routing took to converge.
+ *
+ * Everything runs in one thread around poll.  Frames for a router are
+ * queued on its connection and written as the socket takes them; a
+ * router that stops reading loses frames rather than stalling the rest.
+ *
+ *---------------------------------------------------------------------------*/
+
+#define _DEFAULT_SOURCE  /* clock_gettime and MSG_NOSIGNAL under -ansi */
+#define _BSD_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <poll.h>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#ifdef _LINUX_
+#include <getopt.h>
+#endif /* _LINUX_ */
+
+#include "sr_rx.h"
+#include "sr_cksum.h"
+#include "vns_topo.h"
+#include "vns_host.h"
+#include "vnscommand.h"
+
+extern char* optarg;
+
+#define DEFAULT_PORT   12345
+#define VNS_CONN_MAX   (VNS_ROUTERS_MAX * 2)
+#define VNS_OUT_MAX    (4 * 1024 * 1024)  /* bytes queued per router */
+#define VNS_SPEED      100                /* Mb/s, reported only */
+#define VNS_NS         1000000000ULL
+
+struct vns_conn
+{
+    int                fd;
+    struct sr_rx       rx;
+    struct vns_router* router;  /* 0 until VNSOPEN */
+    uint8_t*           out;
+    unsigned int       out_len;
+    int                closing; /* drop once out is written */
+
+    /* -- statistics -- */
+    uint64_t           dropped; /* frames that didn't fit in out */
+};
+
+struct vns_server
+{
+    struct vns_topo*  topo;
+    int               fd;
+    struct vns_conn*  conns[VNS_CONN_MAX];
+    uint64_t          now;
+};
+
+static volatile sig_atomic_t vns_done = 0;
+
+static void usage(char* );
+
+/*---------------------------------------------------------------------
+ * Method: vns_now(..)
+ * Scope:  Local
+ *
+ *---------------------------------------------------------------------*/
+
+static uint64_t vns_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * VNS_NS + ts.tv_nsec;
+} /* -- vns_now -- */
+
+/*---------------------------------------------------------------------
+ * Method: vns_sigint(..)
+ * Scope:  Local
+ *
+ *---------------------------------------------------------------------*/
+
+static void vns_sigint(int sig)
+{
+    vns_done = 1;
+} /* -- vns_sigint -- */
+
+/*---------------------------------------------------------------------
+ * Method: vns_conn_queue(..)
+ * Scope:  Local
+ *
+ * Queue a command, in two pieces, for the router.  Returns -1 if there
+ * wasn't room.
+ *
+ *---------------------------------------------------------------------*/
+
+static int vns_conn_queue(struct vns_conn* conn, const void* a, unsigned int alen,
+                          const void* b, unsigned int blen)
+{
+    if(conn->out_len + alen + blen > VNS_OUT_MAX)
+    {
+        ++conn->dropped;
+        return -1;
+    }
+
+    memcpy(conn->out + conn->out_len, a, alen);
+    memcpy(conn->out + conn->out_len + alen, b, blen);
+    conn->out_len += alen + blen;
+
+    return 0;
+} /* -- vns_conn_queue -- */
+
+/*---------------------------------------------------------------------
+ * Method: vns_conn_flush(..)
+ * Scope:  Local
+ *
+ * Write what the socket takes.  Returns -1 if the router is gone.
+ *
+ *---------------------------------------------------------------------*/
+
+static int vns_conn_flush(struct vns_conn* conn)
+{
+    int ret;
+
+    while(conn->out_len > 0)
+    {
+        ret = send(conn->fd, conn->out, conn->out_len, MSG_NOSIGNAL);
+        if(ret < 0)
+        {
+            if(errno == EINTR)
+            { continue; }
+            return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+        }
+
+        memmove(conn->out, conn->out + ret, conn->out_len - ret);
+        conn->out_len -= ret;
+    }
+
+    return 0;
+} /* -- vns_conn_flush -- */
+
+/*---------------------------------------------------------------------
+ * Method: vns_to_router(..)
+ * Scope:  Local
+ *
+ * vns_topo's way out to a connected router.
+ *
+ *---------------------------------------------------------------------*/
+
+static void vns_to_router(struct vns_topo* topo, struct vns_port* port,
+                          const uint8_t* frame, unsigned int len)
+{
+    c_packet_header hdr;
+
+    hdr.mLen  = htonl(sizeof(hdr) + len);
+    hdr.mType = htonl(VNSPACKET);
+    memset(hdr.mInterfaceName, 0, sizeof(hdr.mInterfaceName));
+    strncpy(hdr.mInterfaceName, port->name, sizeof(hdr.mInterfaceName));
+
+    vns_conn_queue(port->router->conn, &hdr, sizeof(hdr), frame, len);
+} /* -- vns_to_router -- */
+
+/*---------------------------------------------------------------------
+ * Method: vns_close(..)
+ * Scope:  Local
+ *
+ * Tell the router why its session is over and hang up once it's heard.
+ *
+ *---------------------------------------------------------------------*/
+
+static void vns_close(struct vns_conn* conn, const char* why)
+{
+    c_close cmd;
+
+    memset(&cmd, 0, sizeof(cmd));
+    cmd.mLen  = htonl(sizeof(cmd));
+    cmd.mType = htonl(VNSCLOSE);
+    strncpy(cmd.mErrorMessage, why, sizeof(cmd.mErrorMessage) - 1);
+
+    vns_conn_queue(conn, &cmd, sizeof(cmd), 0, 0);
+    conn->closing = 1;
+    fprintf(stderr, "vns: closing session: %s\n", why);
+} /* -- vns_close -- */
+
+/*---------------------------------------------------------------------
+ * Method: vns_hwinfo(..)
+ * Scope:  Local
+ *
+ * The router's interfaces, in the order sr_handle_hwinfo wants them:
+ * each interface entry first, then what applies to it.
+ *
+ *---------------------------------------------------------------------*/
+
+static void vns_hwinfo(struct vns_conn* conn)
+{
+    c_hwinfo cmd;
+    c_hw_entry* e = cmd.mHWInfo;
+    const struct vns_port* port = 0;
+    uint32_t v;
+    unsigned int i;
+
+    memset(&cmd, 0, sizeof(cmd));
+
+    for(i = 0; i < conn->router->nports; ++i)
+    {
+        port = &conn->router->ports[i];
+
+        e->mKey = htonl(HWINTERFACE);
+        strncpy(e->value, port->name, sizeof(e->value) - 1);
+        ++e;
+        e->mKey = htonl(HWSPEED);
+        v = htonl(VNS_SPEED);
+        memcpy(e->value, &v, 4);
+        ++e;
+        e->mKey = htonl(HWSUBNET);
+        v = port->ip & port->mask;
+        memcpy(e->value, &v, 4);
+        ++e;
+        e->mKey = htonl(HWETHER);
+        memcpy(e->value, port->mac, 6);
+        ++e;
+        e->mKey = htonl(HWETHIP);
+        memcpy(e->value, &port->ip, 4);
+        ++e;
+        e->mKey = htonl(HWMASK);
+        memcpy(e->value, &port->mask, 4);
+        ++e;
+    }
+
+    cmd.mLen  = htonl(2 * sizeof(uint32_t) +
+                      (e - cmd.mHWInfo) * sizeof(c_hw_entry));
+    cmd.mType = htonl(VNSHWINFO);
+
+    vns_conn_queue(conn, &cmd, ntohl(cmd.mLen), 0, 0);
+} /* -- vns_hwinfo -- */
+
+/*---------------------------------------------------------------------
+ * Method: vns_open(..)
+ * Scope:  Local
+ *
+ *---------------------------------------------------------------------*/
+
+static void vns_open(struct vns_server* srv, struct vns_conn* conn,
+                     const c_open* cmd)
+{
+    struct vns_topo* topo = srv->topo;
+    struct vns_router* router = 0;
+    char name[IDSIZE + 1];
+    char why[128];
+
+    memcpy(name, cmd->mVirtualHostID, IDSIZE);
+    name[IDSIZE] = 0;
+
+    if(conn->router)
+    {
+        vns_close(conn, "session already open");
+        return;
+    }
+    if(ntohs(cmd->topoID) != topo->id)
+    {
+        sprintf(why, "no topology %u here, only %u", ntohs(cmd->topoID),
+                topo->id);
+        vns_close(conn, why);
+        return;
+    }
+    if((router = vns_topo_router(topo, name)) == 0)
+    {
+        sprintf(why, "no virtual host %.32s in topology %u", name, topo->id);
+        vns_close(conn, why);
+        return;
+    }
+    if(router->conn)
+    {
+        sprintf(why, "virtual host %.32s already in use", name);
+        vns_close(conn, why);
+        return;
+    }
+
+    conn->router = router;
+    router->conn = conn;
+    vns_hwinfo(conn);
+
+    fprintf(stderr, "vns: %s connected (%u of %u)\n", router->name,
+            ++topo->nconnected, topo->nrouters);
+
+    if(topo->nconnected == topo->nrouters && topo->up == 0)
+    {
+        topo->up = srv->now;
+        fprintf(stderr, "vns: all routers connected, starting traffic\n");
+    }
+} /* -- vns_open -- */
+
+/*---------------------------------------------------------------------
+ * Method: vns_packet(..)
+ * Scope:  Local
+ *
+ *---------------------------------------------------------------------*/
+
+static void vns_packet(struct vns_server* srv, struct vns_conn* conn,
+                       const uint8_t* cmd, unsigned int len)
+{
+    char name[VNS_IFNAME_MAX + 1];
+    struct vns_port* port = 0;
+    unsigned int i;
+
+    if(conn->router == 0 || len < sizeof(c_packet_ethernet_header))
+    { return; }
+
+    memcpy(name, ((const c_packet_header*)cmd)->mInterfaceName, VNS_IFNAME_MAX);
+    name[VNS_IFNAME_MAX] = 0;
+
+    for(i = 0; i < conn->router->nports; ++i)
+    {
+        if(strcmp(conn->router->ports[i].name, name) == 0)
+        {
+            port = &conn->router->ports[i];
+            break;
+        }
+    }
+
+    if(port == 0)
+    {
+        fprintf(stderr, "vns: %s sent on unknown interface %s\n",
+                conn->router->name, name);
+        return;
+    }
+
+    vns_topo_send(srv->topo, port, cmd + sizeof(c_packet_header),
+                  len - sizeof(c_packet_header), srv->now);
+} /* -- vns_packet -- */
+
+/*---------------------------------------------------------------------
+ * Method: vns_drop(..)
+ * Scope:  Local
+ *
+ *---------------------------------------------------------------------*/
+
+static void vns_drop(struct vns_server* srv, unsigned int i)
+{
+    struct vns_conn* conn = srv->conns[i];
+
+    if(conn->router)
+    {
+        fprintf(stderr, "vns: %s disconnected", conn->router->name);
+        if(conn->dropped)
+        { fprintf(stderr, ", %lu frames dropped", (unsigned long)conn->dropped); }
+        fputc('\n', stderr);
+        conn->router->conn = 0;
+        --srv->topo->nconnected;
+    }
+
+    close(conn->fd);
+    sr_rx_destroy(&conn->rx);
+    free(conn->out);
+    free(conn);
+    srv->conns[i] = 0;
+} /* -- vns_drop -- */
+
+/*---------------------------------------------------------------------
+ * Method: vns_read(..)
+ * Scope:  Local
+ *
+ * Returns -1 if the connection should go.
+ *
+ *---------------------------------------------------------------------*/
+
+static int vns_read(struct vns_server* srv, struct vns_conn* conn)
+{
+    uint8_t* cmd = 0;
+    unsigned int len;
+    int ret;
+
+    if((ret = sr_rx_fill(&conn->rx, conn->fd)) <= 0)
+    { return (ret < 0 && errno == EAGAIN) ? 0 : -1; }
+
+    while((ret = sr_rx_next(&conn->rx, &cmd, &len)) == 1 && !conn->closing)
+    {
+        switch(ntohl(((c_base*)cmd)->mType))
+        {
+            case VNSOPEN:
+                if(len >= sizeof(c_open))
+                { vns_open(srv, conn, (const c_open*)cmd); }
+                break;
+            case VNSPACKET:
+                vns_packet(srv, conn, cmd, len);
+                break;
+            case VNSCLOSE:
+                return -1;
+            default:
+                break;
+        }
+    }
+
+    return ret < 0 ? -1 : 0;
+} /* -- vns_read -- */
+
+/*---------------------------------------------------------------------
+ * Method: vns_accept(..)
+ * Scope:  Local
+ *
+ *---------------------------------------------------------------------*/
+
+static void vns_accept(struct vns_server* srv)
+{
+    struct vns_conn* conn = 0;
+    int fd, one = 1;
+    unsigned int i;
+
+    if((fd = accept(srv->fd, 0, 0)) < 0)
+    { return; }
+
+    for(i = 0; i < VNS_CONN_MAX && srv->conns[i]; ++i);
+    if(i == VNS_CONN_MAX)
+    {
+        close(fd);
+        return;
+    }
+
+    fcntl(fd, F_SETFL, O_NONBLOCK);
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    conn = (struct vns_conn*)calloc(1, sizeof(struct vns_conn));
+    assert(conn);
+    conn->fd  = fd;
+    conn->out = (uint8_t*)malloc(VNS_OUT_MAX);
+    assert(conn->out);
+    sr_rx_init(&conn->rx);
+
+    srv->conns[i] = conn;
+} /* -- vns_accept -- */
+
+/*---------------------------------------------------------------------
+ * Method: vns_listen(..)
+ * Scope:  Local
+ *
+ *---------------------------------------------------------------------*/
+
+static int vns_listen(unsigned int port)
+{
+    struct sockaddr_in addr;
+    int fd, one = 1;
+
+    if((fd = socket(AF_INET, SOCK_STREAM, 0)) < 0)
+    {
+        perror("socket");
+        return -1;
+    }
+
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family      = AF_INET;
+    addr.sin_port        = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+
+    if(bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 ||
+       listen(fd, VNS_CONN_MAX) < 0)
+    {
+        perror("bind");
+        close(fd);
+        return -1;
+    }
+
+    fcntl(fd, F_SETFL, O_NONBLOCK);
+
+    return fd;
+} /* -- vns_listen -- */
+
+/*---------------------------------------------------------------------
+ * Method: vns_print_stats(..)
+ * Scope:  Local
+ *
+ *---------------------------------------------------------------------*/
+
+static void vns_print_stats(const struct vns_server* srv, FILE* out)
+{
+    const struct vns_topo* topo = srv->topo;
+
+    fprintf(out, "---- topology %u", topo->id);
+    if(topo->up)
+    { fprintf(out, ", up %.1f s", (srv->now - topo->up) / (double)VNS_NS); }
+    fprintf(out, " ----\n");
+
+    vns_topo_print_stats(topo, out);
+} /* -- vns_print_stats -- */
+
+/*-----------------------------------------------------------------------------
+ *---------------------------------------------------------------------------*/
+
+int main(int argc, char **argv)
+{
+    int c;
+    unsigned int port = DEFAULT_PORT;
+    char *topofile = 0;
+    unsigned int stats = 0;
+    unsigned int duration = 0;
+    struct vns_server srv;
+    struct pollfd fds[VNS_CONN_MAX + 1];
+    struct vns_conn* conns[VNS_CONN_MAX + 1];
+    uint64_t next_stats = 0;
+    unsigned int i, n;
+
+    while ((c = getopt(argc, argv, "hp:T:s:d:")) != EOF)
+    {
+        switch (c)
+        {
+            case 'h':
+                usage(argv[0]);
+                exit(0);
+                break;
+            case 'p':
+                port = atoi((char *) optarg);
+                break;
+            case 'T':
+                topofile = optarg;
+                break;
+            case 's':
+                stats = atoi((char *) optarg);
+                break;
+            case 'd':
+                duration = atoi((char *) optarg);
+                break;
+            default:
+                usage(argv[0]);
+                exit(1);
+        } /* switch */
+    } /* -- while -- */
+
+    if(topofile == 0)
+    {
+        usage(argv[0]);
+        exit(1);
+    }
+
+    sr_cksum_init();
+
+    memset(&srv, 0, sizeof(srv));
+    if((srv.topo = vns_topo_load(topofile)) == 0)
+    { exit(1); }
+    srv.topo->to_router = vns_to_router;
+    srv.topo->ctx       = &srv;
+
+    if((srv.fd = vns_listen(port)) < 0)
+    { exit(1); }
+
+    signal(SIGINT, vns_sigint);
+    signal(SIGTERM, vns_sigint);
+
+    fprintf(stderr, "vns: topology %u, %u routers, %u hosts, listening on "
+            "port %u\n", srv.topo->id, srv.topo->nrouters, srv.topo->nhosts,
+            port);
+
+    while(!vns_done)
+    {
+        fds[0].fd     = srv.fd;
+        fds[0].events = POLLIN;
+        for(i = 0, n = 1; i < VNS_CONN_MAX; ++i)
+        {
+            if(srv.conns[i] == 0)
+            { continue; }
+            fds[n].fd     = srv.conns[i]->fd;
+            fds[n].events = POLLIN | (srv.conns[i]->out_len ? POLLOUT : 0);
+            conns[n++]    = srv.conns[i];
+        }
+
+        /* -- a millisecond at a time while there is traffic to make -- */
+        poll(fds, n, srv.topo->up ? 1 : 100);
+        srv.now = vns_now();
+
+        if(fds[0].revents & POLLIN)
+        { vns_accept(&srv); }
+
+        for(i = 1; i < n; ++i)
+        {
+            if((fds[i].revents & (POLLIN | POLLHUP | POLLERR)) &&
+               vns_read(&srv, conns[i]) < 0)
+            { conns[i]->closing = 2; }
+        }
+
+        vns_topo_events(srv.topo, srv.now);
+        vns_host_tick(srv.topo, srv.now);
+
+        for(i = 0; i < VNS_CONN_MAX; ++i)
+        {
+            if(srv.conns[i] == 0)
+            { continue; }
+            if(srv.conns[i]->closing == 2 || vns_conn_flush(srv.conns[i]) < 0 ||
+               (srv.conns[i]->closing && srv.conns[i]->out_len == 0))
+            { vns_drop(&srv, i); }
+        }
+
+        if(stats && srv.topo->up && srv.now >= next_stats)
+        {
+            if(next_stats)
+            { vns_print_stats(&srv, stderr); }
+            next_stats = srv.now + stats * VNS_NS;
+        }
+
+        if(duration && srv.topo->up &&
+           srv.now - srv.topo->up >= duration * VNS_NS)
+        { break; }
+    }
+
+    vns_print_stats(&srv, stdout);
+
+    return 0;
+}/* -- main -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: usage(..)
+ * Scope: local
+ *---------------------------------------------------------------------------*/
+
+static void usage(char* argv0)
+{
+    printf("Local VNS Server\n");
+    printf("Format: %s [-h] [-p port] -T topology file \n", argv0);
+    printf("           [-s stats every secs] [-d run secs once all are up] \n");
+    printf("   defaults port=%d  \n", DEFAULT_PORT);
+} /* -- usage -- */
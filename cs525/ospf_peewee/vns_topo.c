@@ -0,0 +1,513 @@
+/*-----------------------------------------------------------------------------
+ * file:  vns_topo.c
+ *
+ * Description:
+ *
+ * Topology of the local VNS stand-in: reading it from a file, moving
+ * frames across links and taking links down and up, see vns_topo.h.
+ *
+ *---------------------------------------------------------------------------*/
+
+#define _DEFAULT_SOURCE  /* inet_aton under -ansi */
+#define _BSD_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "vns_topo.h"
+#include "vns_host.h"
+
+#define VNS_ARGS_MAX 8
+#define VNS_NS       1000000000ULL
+
+/*---------------------------------------------------------------------
+ * Method: vns_parse_ip(..)
+ * Scope:  Local
+ *
+ *---------------------------------------------------------------------*/
+
+static int vns_parse_ip(const char* s, uint32_t* ip)
+{
+    struct in_addr in;
+
+    if(inet_aton(s, &in) == 0)
+    { return -1; }
+
+    *ip = in.s_addr;
+    return 0;
+} /* -- vns_parse_ip -- */
+
+/*---------------------------------------------------------------------
+ * Method: vns_parse_mac(..)
+ * Scope:  Local
+ *
+ *---------------------------------------------------------------------*/
+
+static int vns_parse_mac(const char* s, uint8_t* mac)
+{
+    unsigned int m[6], i;
+
+    if(sscanf(s, "%x:%x:%x:%x:%x:%x", &m[0], &m[1], &m[2], &m[3], &m[4],
+              &m[5]) != 6)
+    { return -1; }
+
+    for(i = 0; i < 6; ++i)
+    { mac[i] = (uint8_t)m[i]; }
+
+    return 0;
+} /* -- vns_parse_mac -- */
+
+/*---------------------------------------------------------------------
+ * Method: vns_topo_host(..)
+ * Scope:  Local
+ *
+ *---------------------------------------------------------------------*/
+
+static struct vns_host* vns_topo_host(struct vns_topo* topo, const char* name)
+{
+    unsigned int i;
+
+    for(i = 0; i < topo->nhosts; ++i)
+    {
+        if(strcmp(topo->hosts[i]->name, name) == 0)
+        { return topo->hosts[i]; }
+    }
+
+    return 0;
+} /* -- vns_topo_host -- */
+
+/*---------------------------------------------------------------------
+ * Method: vns_topo_router(..)
+ * Scope:  Global
+ *
+ *---------------------------------------------------------------------*/
+
+struct vns_router* vns_topo_router(struct vns_topo* topo, const char* name)
+{
+    unsigned int i;
+
+    /* -- REQUIRES -- */
+    assert(topo);
+    assert(name);
+
+    for(i = 0; i < topo->nrouters; ++i)
+    {
+        if(strncmp(topo->routers[i].name, name, VNS_NAME_MAX) == 0)
+        { return &topo->routers[i]; }
+    }
+
+    return 0;
+} /* -- vns_topo_router -- */
+
+/*---------------------------------------------------------------------
+ * Method: vns_topo_port(..)
+ * Scope:  Global
+ *
+ * The port named by a link end: "vhost:iface" or a host name.
+ *
+ *---------------------------------------------------------------------*/
+
+struct vns_port* vns_topo_port(struct vns_topo* topo, const char* end)
+{
+    char name[VNS_NAME_MAX];
+    struct vns_router* router = 0;
+    struct vns_host* host = 0;
+    const char* colon = strchr(end, ':');
+    unsigned int i;
+
+    /* -- REQUIRES -- */
+    assert(topo);
+    assert(end);
+
+    if(colon == 0)
+    { return (host = vns_topo_host(topo, end)) ? &host->port : 0; }
+
+    if(colon - end >= VNS_NAME_MAX)
+    { return 0; }
+    memcpy(name, end, colon - end);
+    name[colon - end] = 0;
+
+    if((router = vns_topo_router(topo, name)) == 0)
+    { return 0; }
+
+    for(i = 0; i < router->nports; ++i)
+    {
+        if(strcmp(router->ports[i].name, colon + 1) == 0)
+        { return &router->ports[i]; }
+    }
+
+    return 0;
+} /* -- vns_topo_port -- */
+
+/*---------------------------------------------------------------------
+ * Method: vns_topo_line(..)
+ * Scope:  Local
+ *
+ * One line of the topology file, split into argv.  Returns an error
+ * message, or 0.
+ *
+ *---------------------------------------------------------------------*/
+
+static const char* vns_topo_line(struct vns_topo* topo, char** argv,
+                                 unsigned int argc)
+{
+    struct vns_router* router = 0;
+    struct vns_host* host = 0;
+    struct vns_port* port = 0;
+    struct vns_link* link = 0;
+    struct vns_flow* flow = 0;
+    struct vns_ping* ping = 0;
+    struct vns_event* ev = 0;
+    uint32_t ip, mask, gw;
+    unsigned int i;
+
+    if(strcmp(argv[0], "topology") == 0 && argc == 2)
+    {
+        topo->id = atoi(argv[1]);
+        return 0;
+    }
+
+    if(strcmp(argv[0], "router") == 0 && (argc == 5 || argc == 6))
+    {
+        if((router = vns_topo_router(topo, argv[1])) == 0)
+        {
+            if(topo->nrouters == VNS_ROUTERS_MAX)
+            { return "too many routers"; }
+            router = &topo->routers[topo->nrouters++];
+            strncpy(router->name, argv[1], VNS_NAME_MAX - 1);
+        }
+        if(router->nports == VNS_IFACES_MAX)
+        { return "too many interfaces"; }
+        if(strlen(argv[2]) >= VNS_IFNAME_MAX)
+        { return "interface name too long"; }
+
+        port = &router->ports[router->nports];
+        strcpy(port->name, argv[2]);
+        port->router = router;
+        if(vns_parse_ip(argv[3], &port->ip) || vns_parse_ip(argv[4], &port->mask)
+           || (argc == 6 && vns_parse_mac(argv[5], port->mac)))
+        { return "bad address"; }
+
+        ++router->nports;
+        return 0;
+    }
+
+    if(strcmp(argv[0], "host") == 0 && argc >= 5 && argc <= 7)
+    {
+        if(topo->nhosts == VNS_HOSTS_MAX)
+        { return "too many hosts"; }
+        if(vns_topo_host(topo, argv[1]) || strchr(argv[1], ':'))
+        { return "bad or duplicate host name"; }
+        if(vns_parse_ip(argv[2], &ip) || vns_parse_ip(argv[3], &mask) ||
+           vns_parse_ip(argv[4], &gw))
+        { return "bad address"; }
+
+        host = vns_host_create(argv[1], ip, mask, gw, 0);
+        for(i = 5; i < argc; ++i)
+        {
+            if(strcmp(argv[i], "proxy") == 0)
+            { host->proxy = 1; }
+            else if(vns_parse_mac(argv[i], host->port.mac))
+            { return "bad address"; }
+        }
+
+        topo->hosts[topo->nhosts++] = host;
+        return 0;
+    }
+
+    if(strcmp(argv[0], "link") == 0 && argc >= 3)
+    {
+        if(topo->nlinks == VNS_LINKS_MAX || argc - 1 > VNS_LINK_PORTS)
+        { return "too many links or ports on a link"; }
+
+        link = &topo->links[topo->nlinks++];
+        link->up = 1;
+        for(i = 1; i < argc; ++i)
+        {
+            if((port = vns_topo_port(topo, argv[i])) == 0)
+            { return "no such interface or host"; }
+            if(port->link)
+            { return "interface already linked"; }
+            port->link = link;
+            link->ports[link->nports++] = port;
+        }
+        return 0;
+    }
+
+    if(strcmp(argv[0], "ping") == 0 && argc == 4)
+    {
+        if(topo->npings == VNS_PINGS_MAX)
+        { return "too many pings"; }
+        ping = &topo->pings[topo->npings];
+        if((ping->src = vns_topo_host(topo, argv[1])) == 0)
+        { return "no such host"; }
+        if(vns_parse_ip(argv[2], &ping->dst))
+        { return "bad address"; }
+        if((ping->interval = atoi(argv[3])) == 0)
+        { return "bad interval"; }
+        ++topo->npings;
+        return 0;
+    }
+
+    if(strcmp(argv[0], "flow") == 0 && argc == 5)
+    {
+        if(topo->nflows == VNS_FLOWS_MAX)
+        { return "too many flows"; }
+        flow = &topo->flows[topo->nflows];
+        if((flow->src = vns_topo_host(topo, argv[1])) == 0 ||
+           (flow->dst = vns_topo_host(topo, argv[2])) == 0)
+        { return "no such host"; }
+        flow->pps   = atoi(argv[3]);
+        flow->bytes = atoi(argv[4]);
+        if(flow->pps == 0 || flow->bytes < 16 ||
+           flow->bytes > VNS_FRAME_MAX - 14 - 20 - 8)
+        { return "bad rate or size (16 to 1472 bytes)"; }
+        ++topo->nflows;
+        return 0;
+    }
+
+    if(strcmp(argv[0], "at") == 0 && argc == 4)
+    {
+        if(topo->nevents == VNS_EVENTS_MAX)
+        { return "too many events"; }
+        ev = &topo->events[topo->nevents];
+        ev->at = (uint64_t)(atof(argv[1]) * VNS_NS);
+        if(strcmp(argv[2], "down") != 0 && strcmp(argv[2], "up") != 0)
+        { return "expected down or up"; }
+        ev->up = strcmp(argv[2], "up") == 0;
+        if((port = vns_topo_port(topo, argv[3])) == 0 || port->link == 0)
+        { return "no such linked interface or host"; }
+        ev->link = port->link;
+        ++topo->nevents;
+        return 0;
+    }
+
+    return "unknown or malformed line";
+} /* -- vns_topo_line -- */
+
+/*---------------------------------------------------------------------
+ * Method: vns_topo_macs(..)
+ * Scope:  Local
+ *
+ * Make up a locally administered MAC for every interface without one.
+ *
+ *---------------------------------------------------------------------*/
+
+static void vns_topo_macs(struct vns_topo* topo)
+{
+    static const uint8_t zero[6] = { 0, 0, 0, 0, 0, 0 };
+    struct vns_port* port = 0;
+    unsigned int i, j;
+
+    for(i = 0; i < topo->nrouters; ++i)
+    {
+        for(j = 0; j < topo->routers[i].nports; ++j)
+        {
+            port = &topo->routers[i].ports[j];
+            if(memcmp(port->mac, zero, 6) == 0)
+            {
+                port->mac[0] = 0x02;
+                port->mac[4] = (uint8_t)(i + 1);
+                port->mac[5] = (uint8_t)j;
+            }
+        }
+    }
+
+    for(i = 0; i < topo->nhosts; ++i)
+    {
+        port = &topo->hosts[i]->port;
+        if(memcmp(port->mac, zero, 6) == 0)
+        {
+            port->mac[0] = 0x02;
+            port->mac[3] = 0x01;
+            port->mac[4] = (uint8_t)(i + 1);
+        }
+    }
+} /* -- vns_topo_macs -- */
+
+/*---------------------------------------------------------------------
+ * Method: vns_topo_load(..)
+ * Scope:  Global
+ *
+ * Read a topology file.  Returns 0, having said why, if it is bad.
+ *
+ *---------------------------------------------------------------------*/
+
+struct vns_topo* vns_topo_load(const char* fname)
+{
+    struct vns_topo* topo = 0;
+    char line[512];
+    char* argv[VNS_ARGS_MAX + 1];
+    const char* err = 0;
+    unsigned int argc, lineno = 0;
+    char* hash = 0;
+    FILE* fp = 0;
+
+    /* -- REQUIRES -- */
+    assert(fname);
+
+    if((fp = fopen(fname, "r")) == 0)
+    {
+        perror(fname);
+        return 0;
+    }
+
+    topo = (struct vns_topo*)calloc(1, sizeof(struct vns_topo));
+    assert(topo);
+
+    while(fgets(line, sizeof(line), fp))
+    {
+        ++lineno;
+        if((hash = strchr(line, '#')) != 0)
+        { *hash = 0; }
+
+        for(argc = 0, argv[0] = strtok(line, " \t\r\n");
+            argv[argc] && argc < VNS_ARGS_MAX;
+            argv[++argc] = strtok(0, " \t\r\n"));
+
+        if(argc == 0)
+        { continue; }
+
+        if((err = vns_topo_line(topo, argv, argc)) != 0)
+        {
+            fprintf(stderr, "%s:%u: %s\n", fname, lineno, err);
+            fclose(fp);
+            return 0;
+        }
+    }
+    fclose(fp);
+
+    if(topo->nrouters == 0)
+    {
+        fprintf(stderr, "%s: no routers\n", fname);
+        return 0;
+    }
+
+    vns_topo_macs(topo);
+
+    return topo;
+} /* -- vns_topo_load -- */
+
+/*---------------------------------------------------------------------
+ * Method: vns_topo_send(..)
+ * Scope:  Global
+ *
+ * Put a frame on the link of port 'from'; every other port on it gets
+ * it, unless the link is down.
+ *
+ *---------------------------------------------------------------------*/
+
+void vns_topo_send(struct vns_topo* topo, struct vns_port* from,
+                   const uint8_t* frame, unsigned int len, uint64_t now)
+{
+    struct vns_link* link = from->link;
+    struct vns_port* port = 0;
+    unsigned int i;
+
+    /* -- REQUIRES -- */
+    assert(topo);
+    assert(from);
+
+    ++from->out;
+    if(link == 0)
+    { return; }
+
+    if(!link->up)
+    {
+        ++link->dropped;
+        return;
+    }
+
+    for(i = 0; i < link->nports; ++i)
+    {
+        if((port = link->ports[i]) == from)
+        { continue; }
+
+        if(port->host)
+        {
+            ++port->in;
+            vns_host_input(topo, port->host, frame, len, now);
+        }
+        else if(port->router->conn)
+        {
+            ++port->in;
+            topo->to_router(topo, port, frame, len);
+        }
+        else
+        { ++port->router->dropped; }
+    }
+} /* -- vns_topo_send -- */
+
+/*---------------------------------------------------------------------
+ * Method: vns_topo_events(..)
+ * Scope:  Global
+ *
+ * Take links down or up as scheduled.
+ *
+ *---------------------------------------------------------------------*/
+
+void vns_topo_events(struct vns_topo* topo, uint64_t now)
+{
+    struct vns_event* ev = 0;
+    unsigned int i;
+
+    /* -- REQUIRES -- */
+    assert(topo);
+
+    if(topo->up == 0)
+    { return; }
+
+    for(i = 0; i < topo->nevents; ++i)
+    {
+        ev = &topo->events[i];
+        if(ev->done || now - topo->up < ev->at)
+        { continue; }
+
+        ev->done = 1;
+        ev->link->up = ev->up;
+        fprintf(stderr, "vns: %.3f s: link %s:%s %s\n",
+                (now - topo->up) / (double)VNS_NS,
+                ev->link->ports[0]->router ? ev->link->ports[0]->router->name
+                                           : ev->link->ports[0]->host->name,
+                ev->link->ports[0]->name, ev->up ? "up" : "down");
+    }
+} /* -- vns_topo_events -- */
+
+/*---------------------------------------------------------------------
+ * Method: vns_topo_print_stats(..)
+ * Scope:  Global
+ *
+ *---------------------------------------------------------------------*/
+
+void vns_topo_print_stats(const struct vns_topo* topo, FILE* out)
+{
+    const struct vns_router* router = 0;
+    const struct vns_port* port = 0;
+    unsigned int i, j;
+
+    /* -- REQUIRES -- */
+    assert(topo);
+    assert(out);
+
+    for(i = 0; i < topo->nrouters; ++i)
+    {
+        router = &topo->routers[i];
+        fprintf(out, "%-8s %-12s", router->name,
+                router->conn ? "connected" : "disconnected");
+        for(j = 0; j < router->nports; ++j)
+        {
+            port = &router->ports[j];
+            fprintf(out, " %s %lu/%lu%s", port->name, (unsigned long)port->in,
+                    (unsigned long)port->out,
+                    port->link && !port->link->up ? " (down)" : "");
+        }
+        fprintf(out, ", %lu dropped\n", (unsigned long)router->dropped);
+    }
+
+    vns_host_print_stats(topo, out);
+} /* -- vns_topo_print_stats -- */
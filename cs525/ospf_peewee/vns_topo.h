@@ -0,0 +1,186 @@
+/*-----------------------------------------------------------------------------
+ * file:  vns_topo.h
+ *
+ * Description:
+ *
+ * Topology for the local VNS stand-in (see vns_server.c): virtual routers,
+ * each an sr instance connecting over TCP, emulated hosts and the links
+ * between their interfaces.  A link is a shared segment; a frame sent out
+ * of one of its ports comes in on every other.
+ *
+ * The topology file is read line by line, '#' starting a comment:
+ *
+ *   topology <id>
+ *   router <vhost> <iface> <ip> <mask> [<mac>]       one line per interface
+ *   host   <name> <ip> <mask> <gateway> [<mac>] [proxy]
+ *   link   <end> <end> ...                           end: vhost:iface or host
+ *   ping   <host> <ip> <interval ms>
+ *   flow   <host> <host> <packets/s> <bytes>
+ *   at     <secs> down|up <vhost:iface or host>
+ *
+ * Interfaces without a MAC get one made up from their position.  A proxy
+ * host stands in for everything beyond its link: it answers ARP and
+ * pings for any address.  Times in 'at' lines count from when the last
+ * router connected; that is also when traffic starts.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef VNS_TOPO_H
+#define VNS_TOPO_H
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif /* _DARWIN_ */
+
+#include <stdio.h>
+
+#define VNS_NAME_MAX     32
+#define VNS_IFNAME_MAX   16   /* as in c_packet_header */
+#define VNS_ROUTERS_MAX  32
+#define VNS_IFACES_MAX   8    /* per router */
+#define VNS_HOSTS_MAX    32
+#define VNS_LINKS_MAX    128
+#define VNS_LINK_PORTS   8
+#define VNS_FLOWS_MAX    32
+#define VNS_PINGS_MAX    32
+#define VNS_EVENTS_MAX   64
+
+struct vns_router;
+struct vns_host;
+struct vns_link;
+struct vns_conn;
+
+struct vns_port
+{
+    char               name[VNS_IFNAME_MAX];  /* what sr calls it */
+    uint32_t           ip;                    /* network byte order */
+    uint32_t           mask;
+    uint8_t            mac[6];
+    struct vns_router* router;                /* owner, router or host */
+    struct vns_host*   host;
+    struct vns_link*   link;
+
+    /* -- statistics -- */
+    uint64_t           in;                    /* frames delivered to it */
+    uint64_t           out;                   /* frames sent from it */
+};
+
+struct vns_link
+{
+    struct vns_port* ports[VNS_LINK_PORTS];
+    unsigned int     nports;
+    int              up;
+    uint64_t         dropped;  /* while down */
+};
+
+struct vns_router
+{
+    char             name[VNS_NAME_MAX];
+    struct vns_port  ports[VNS_IFACES_MAX];
+    unsigned int     nports;
+    struct vns_conn* conn;     /* 0 while the sr isn't connected */
+    uint64_t         dropped;  /* frames for it while not connected */
+};
+
+/* ----------------------------------------------------------------------------
+ * struct vns_flow
+ *
+ * A stream of UDP datagrams from one host to another at a fixed rate.
+ * Each carries the flow, a sequence number and when it was sent, so the
+ * receiving end can count what arrived, what came out of order and how
+ * long it took.
+ *
+ * -------------------------------------------------------------------------- */
+
+struct vns_flow
+{
+    struct vns_host* src;
+    struct vns_host* dst;
+    uint32_t         pps;
+    uint32_t         bytes;     /* UDP payload */
+
+    /* -- sender -- */
+    uint64_t         sent;
+    uint64_t         unresolved; /* no ARP reply for the next hop yet */
+
+    /* -- receiver -- */
+    uint64_t         received;
+    uint64_t         reordered;
+    uint32_t         next;      /* sequence number expected */
+    uint64_t         lat_sum;   /* ns */
+    uint64_t         lat_max;
+};
+
+/* ----------------------------------------------------------------------------
+ * struct vns_ping
+ *
+ * Echo requests from a host every interval.  'first' is how long after
+ * topology up the first reply came back, 'outage' the longest time
+ * without replies after that: convergence, and how long a failure took
+ * to route around.
+ *
+ * -------------------------------------------------------------------------- */
+
+struct vns_ping
+{
+    struct vns_host* src;
+    uint32_t         dst;       /* network byte order */
+    uint32_t         interval;  /* ms */
+    uint64_t         next_at;   /* ns */
+    uint16_t         seq;
+
+    uint64_t         sent;
+    uint64_t         replies;
+    uint64_t         errors;    /* ICMP errors about our requests */
+    uint64_t         first;     /* ns from topology up, 0 before any */
+    uint64_t         last;      /* ns, last reply */
+    uint64_t         outage;    /* ns */
+    uint64_t         rtt_sum;
+    uint64_t         rtt_max;
+};
+
+struct vns_event
+{
+    uint64_t         at;       /* ns from topology up */
+    struct vns_link* link;
+    int              up;
+    int              done;
+};
+
+struct vns_topo
+{
+    unsigned int       id;
+    struct vns_router  routers[VNS_ROUTERS_MAX];
+    unsigned int       nrouters;
+    struct vns_host*   hosts[VNS_HOSTS_MAX];
+    unsigned int       nhosts;
+    struct vns_link    links[VNS_LINKS_MAX];
+    unsigned int       nlinks;
+    struct vns_flow    flows[VNS_FLOWS_MAX];
+    unsigned int       nflows;
+    struct vns_ping    pings[VNS_PINGS_MAX];
+    unsigned int       npings;
+    struct vns_event   events[VNS_EVENTS_MAX];
+    unsigned int       nevents;
+    unsigned int       nconnected;
+    uint64_t           up;     /* ns when the last router connected, or 0 */
+
+    /* -- frames for a connected router go out through the server -- */
+    void             (*to_router)(struct vns_topo* topo, struct vns_port* port,
+                                  const uint8_t* frame, unsigned int len);
+    void*              ctx;
+};
+
+struct vns_topo* vns_topo_load(const char* fname);
+void vns_topo_print_stats(const struct vns_topo* topo, FILE* out);
+struct vns_router* vns_topo_router(struct vns_topo* topo, const char* name);
+struct vns_port* vns_topo_port(struct vns_topo* topo, const char* end);
+void vns_topo_send(struct vns_topo* topo, struct vns_port* from,
+                   const uint8_t* frame, unsigned int len, uint64_t now);
+void vns_topo_events(struct vns_topo* topo, uint64_t now);
+
+#endif /* -- VNS_TOPO_H -- */